@@ -13,12 +13,17 @@ interface ListenOptions {
   idleTimeout?: number | string,
   transparent?: boolean,
   masquerade?: boolean,
+  lazyRead?: boolean,
+  gso?: boolean,
+  gro?: boolean,
 }
 
 interface MuxOptions {
   maxIdle?: number | string,
   maxQueue?: number,
   maxMessages?: number,
+  sharedPool?: string,
+  maxConnections?: number,
 }
 
 interface MuxQueueOptions extends MuxOptions {
@@ -93,6 +98,11 @@ interface Configuration {
    *       where the original destination address and port can be found through `__inbound.destinationAddress` and `__inbound.destinationPort` properties.
    *       This is only available on Linux by using NAT or TPROXY.
    *   - _masquerade_ - Set to _true_ to change the source address of responding UDP packets to the original destination.
+   *   - _lazyRead_ - Set to _true_ to wait for a connection to become readable before allocating its receive buffer.
+   *       Saves memory on large numbers of idle connections. Defaults to the `--lazy-read` command line option.
+   *   - _gso_ - Set to _true_ to have runs of equal-sized UDP packets to the same peer segmented by the kernel (UDP GSO, Linux only).
+   *   - _gro_ - Set to _true_ to have the kernel coalesce received UDP packets (UDP GRO, Linux only).
+   *       Coalesced packets are split up again before going into the pipeline.
    * @returns The same _Configuration_ object.
    */
   listen(port: number | null, options?: ListenOptions): Configuration;
@@ -231,6 +241,15 @@ interface Configuration {
    *   - _alpn_ - (optional) An array of allowed protocol names, or a function that receives an array of client-preferred protocol names
    *       and returns the index of the server-chosen protocol in that array.
    *   - _handshake_ - (optional) A callback function that receives the negotiated protocol name after handshake.
+   *   - _offload_ - (optional) If true, hands record encryption over to the kernel (Linux kTLS) after a TLS 1.2 handshake
+   *       when the cipher is supported and the filter sits directly on an inbound TCP connection. Defaults to false.
+   *   - _sessionCache_ - (optional) Enables session resumption shared by all worker threads. It can have the following fields:
+   *     - _name_ - (optional) Name of the cache. Filters using the same name share sessions and ticket keys,
+   *         so they must serve the same certificates. The options of the latest created filter apply to all of them,
+   *         keeping what is cached across reloads. Defaults to `"default"`.
+   *     - _size_ - (optional) Maximum number of cached sessions. Defaults to 20000.
+   *     - _timeout_ - (optional) Lifetime of a cached session. Defaults to 5 minutes.
+   *     - _ticketKeyRotation_ - (optional) Interval between session ticket key rotations, or 0 to never rotate. Defaults to 1 hour.
    * @returns The same _Configuration_ object.
    */
   acceptTLS(
@@ -240,6 +259,13 @@ interface Configuration {
       verify?: (ok: boolean, cert: Certificate) => boolean,
       alpn?: string[] | ((protocolNames: string[]) => number),
       handshake?: (protocolName: string | undefined) => void,
+      offload?: boolean,
+      sessionCache?: {
+        name?: string,
+        size?: number,
+        timeout?: number | string,
+        ticketKeyRotation?: number | string,
+      },
     }
   ): Configuration;
 
@@ -342,6 +368,10 @@ interface Configuration {
    * - **INPUT** - _Data_ stream to send to the host.
    * - **OUTPUT** - _Data_ stream received from the host.
    *
+   * When a TCP _connect_ is the only filter in a pipeline started by a TCP listener,
+   * the bytes are moved between the two connections with _splice(2)_ on Linux
+   * without being copied into user space.
+   *
    * @param target The target to connect to, in form of `"<host>:<port>"`, or a function that returns the target.
    * @param options Options including:
    *   - _protocol_ - Protocol to use. Can be `"TCP"` or `"UDP"`. Default is `"TCP"`.
@@ -361,6 +391,10 @@ interface Configuration {
    *   - _idleTimeout_ - Duration before connection is closed due to no active reading or writing.
    *       Can be a number in seconds or a string with one of the time unit suffixes such as `s`, `m` or `h`.
    *       Defaults to 1 minute.
+   *   - _lazyRead_ - Set to _true_ to wait for the connection to become readable before allocating its receive buffer.
+   *       Defaults to the `--lazy-read` command line option.
+   *   - _gso_ - Set to _true_ to have runs of equal-sized UDP packets segmented by the kernel (UDP GSO, Linux only).
+   *   - _gro_ - Set to _true_ to have the kernel coalesce received UDP packets (UDP GRO, Linux only).
    * @returns The same _Configuration_ object.
    */
   connect(
@@ -373,6 +407,9 @@ interface Configuration {
       readTimeout?: number | string,
       writeTimeout?: number | string,
       idleTimeout?: number | string,
+      lazyRead?: boolean,
+      gso?: boolean,
+      gro?: boolean,
     }
   ): Configuration;
 
@@ -450,6 +487,8 @@ interface Configuration {
    *   - _sni_ - (optional) SNI server name or a function that returns it
    *   - _alpn_ - (optional) Requested protocol name or an array of preferred protocol names
    *   - _handshake_ - (optional) A callback function that receives the negotiated protocol name after handshake.
+   *   - _offload_ - (optional) If true, hands record encryption over to the kernel (Linux kTLS) after a TLS 1.2 handshake
+   *       when the cipher is supported and the sub-pipeline is a single _connect_ filter over TCP. Defaults to false.
    * @returns The same _Configuration_ object.
    */
   connectTLS(
@@ -460,6 +499,7 @@ interface Configuration {
       alpn?: string | string[],
       sni?: string | (() => string),
       handshake?: (protocolName: string | undefined) => void,
+      offload?: boolean,
     }
   ): Configuration;
 
@@ -988,6 +1028,10 @@ interface Configuration {
    *       Defaults is _60 seconds_.
    *   - _maxQueue_ - Maximum number of messages allowed to run concurrently in one sub-pipeline.
    *   - _maxMessages_ - Maximum number of messages allowed to run accumulatively in one sub-pipeline.
+   *   - _sharedPool_ - Name of a pool shared by all worker threads to keep the sub-pipelines in.
+   *       Only sub-pipelines whose key is not an object go in the pool, and only filters of the same kind share them.
+   *   - _maxConnections_ - Maximum number of sub-pipelines in the shared pool with the same key, counting all threads.
+   *       Once reached, messages go to the least loaded one instead, even if it's on another thread.
    * @returns The same _Configuration_ object.
    */
   mux(
@@ -1005,6 +1049,10 @@ interface Configuration {
    *       Defaults is _60 seconds_.
    *   - _maxQueue_ - Maximum number of messages allowed to run concurrently in one sub-pipeline.
    *   - _maxMessages_ - Maximum number of messages allowed to run accumulatively in one sub-pipeline.
+   *   - _sharedPool_ - Name of a pool shared by all worker threads to keep the sub-pipelines in.
+   *       Only sub-pipelines whose key is not an object go in the pool, and only filters of the same kind share them.
+   *   - _maxConnections_ - Maximum number of sub-pipelines in the shared pool with the same key, counting all threads.
+   *       Once reached, messages go to the least loaded one instead, even if it's on another thread.
    * @returns The same _Configuration_ object.
    */
   mux(
@@ -1029,6 +1077,10 @@ interface Configuration {
    *       Defaults is _60 seconds_.
    *   - _maxQueue_ - Maximum number of messages allowed to run concurrently in one sub-pipeline.
    *   - _maxMessages_ - Maximum number of messages allowed to run accumulatively in one sub-pipeline.
+   *   - _sharedPool_ - Name of a pool shared by all worker threads to keep the sub-pipelines in.
+   *       Only sub-pipelines whose key is not an object go in the pool, and only filters of the same kind share them.
+   *   - _maxConnections_ - Maximum number of sub-pipelines in the shared pool with the same key, counting all threads.
+   *       Once reached, messages go to the least loaded one instead, even if it's on another thread.
    *   - _isOneWay_ - A function that receives a _MessageStart_ object and returns a boolean indicating if the message is one-way.
    * @returns The same _Configuration_ object.
    */
@@ -1047,6 +1099,10 @@ interface Configuration {
    *       Defaults is _60 seconds_.
    *   - _maxQueue_ - Maximum number of messages allowed to run concurrently in one sub-pipeline.
    *   - _maxMessages_ - Maximum number of messages allowed to run accumulatively in one sub-pipeline.
+   *   - _sharedPool_ - Name of a pool shared by all worker threads to keep the sub-pipelines in.
+   *       Only sub-pipelines whose key is not an object go in the pool, and only filters of the same kind share them.
+   *   - _maxConnections_ - Maximum number of sub-pipelines in the shared pool with the same key, counting all threads.
+   *       Once reached, messages go to the least loaded one instead, even if it's on another thread.
    *   - _isOneWay_ - A function that receives a _MessageStart_ object and returns a boolean indicating if the message is one-way.
    * @returns The same _Configuration_ object.
    */
@@ -1071,6 +1127,10 @@ interface Configuration {
    *       Defaults is `60` seconds.
    *   - _maxQueue_ - Maximum number of messages allowed to run concurrently in one sub-pipeline.
    *   - _maxMessages_ - Maximum number of messages allowed to run accumulatively in one sub-pipeline.
+   *   - _sharedPool_ - Name of a pool shared by all worker threads to keep the sub-pipelines in.
+   *       Only sub-pipelines whose key is not an object go in the pool, and only filters of the same kind share them.
+   *   - _maxConnections_ - Maximum number of sub-pipelines in the shared pool with the same key, counting all threads.
+   *       Once reached, messages go to the least loaded one instead, even if it's on another thread.
    *   - _bufferSize_ - Maximum body size above which a message should be transferred in chunks.
    *       Can be a number in bytes or a string with a unit suffix such as `'k'`, `'m'`, `'g'` and `'t'`.
    *       Default is _16KB_.
@@ -1092,6 +1152,10 @@ interface Configuration {
    *       Defaults is `60` seconds.
    *   - _maxQueue_ - Maximum number of messages allowed to run concurrently in one sub-pipeline.
    *   - _maxMessages_ - Maximum number of messages allowed to run accumulatively in one sub-pipeline.
+   *   - _sharedPool_ - Name of a pool shared by all worker threads to keep the sub-pipelines in.
+   *       Only sub-pipelines whose key is not an object go in the pool, and only filters of the same kind share them.
+   *   - _maxConnections_ - Maximum number of sub-pipelines in the shared pool with the same key, counting all threads.
+   *       Once reached, messages go to the least loaded one instead, even if it's on another thread.
    *   - _bufferSize_ - Maximum body size above which a message should be transferred in chunks.
    *       Can be a number in bytes or a string with a unit suffix such as `'k'`, `'m'`, `'g'` and `'t'`.
    *       Default is _16KB_.
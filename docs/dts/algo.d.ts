@@ -58,6 +58,67 @@ interface CacheConstructor {
   ): Cache;
 }
 
+/**
+ * A key-value storage like _Cache_ but shared by all worker threads.
+ *
+ * Keys and values are copied in and out of the storage, so only
+ * strings, numbers, booleans, _Data_ and JSON-compatible objects can be stored.
+ */
+interface SharedCache {
+
+  /**
+   * Looks up an entry.
+   *
+   * @param key The key of the entry to look up.
+   * @returns A copy of the value of the entry, or `undefined` if not found.
+   */
+  get(key: any): any;
+
+  /**
+   * Creates or changes an entry.
+   *
+   * @param key The key of the entry to create or change.
+   * @param value The value of the entry.
+   */
+  set(key: any, value: any): void;
+
+  /**
+   * Deletes an entry.
+   *
+   * @param key The key of the entry to delete.
+   * @returns A boolean value indicating whether the entry being deleted was found.
+   */
+  remove(key: any): boolean;
+
+  /**
+   * Deletes all entries.
+   */
+  clear(): void;
+}
+
+interface SharedCacheConstructor {
+
+  /**
+   * Creates an instance of _SharedCache_.
+   *
+   * @param name Name of the storage. All instances of the same name in any thread share the same entries.
+   * @param options Options including:
+   *   - _size_ - Maximum number of entries allowed in the cache.
+   *   - _ttl_ - Time-to-live for the entries in the cache.
+   *       Can be a number in seconds or a string with one of the time unit suffixes such as `'s'`, `'m'` and `'h'`.
+   *   Creating an instance of a name that already exists applies the new options to the existing entries,
+   *   evicting the least recently used ones if the size is now smaller. A new TTL applies to entries set afterwards.
+   * @returns A _SharedCache_ object.
+   */
+  new(
+    name: string,
+    options?: {
+      size?: number,
+      ttl?: number | string,
+    }
+  ): SharedCache;
+}
+
 /**
  * Keeps track of quota.
  */
@@ -115,8 +176,57 @@ interface QuotaConstructor {
   ): Quota;
 }
 
+/**
+ * A set of quotas shared by all worker threads, one for each key.
+ *
+ * Every quota in the set starts with the same initial value and recovers at the same rate.
+ * Quotas taken out of it can be used wherever an _algo.Quota_ is accepted, such as
+ * in _throttleMessageRate()_, _throttleDataRate()_ and _throttleConcurrency()_,
+ * and whatever is consumed from them in one thread is gone for all threads.
+ */
+interface SharedQuota {
+
+  /**
+   * Looks up the quota for a key.
+   *
+   * @param key The key of the quota, such as a tenant name or a client IP.
+   * @returns A _Quota_ object that shares its current value with those of the same key in other threads.
+   */
+  get(key: any): Quota;
+}
+
+interface SharedQuotaConstructor {
+
+  /**
+   * Creates an instance of _SharedQuota_.
+   *
+   * @param name Name of the quota set. All instances of the same name in any thread share the same quotas.
+   * @param initialValue Initial value of each quota. Must be a number.
+   * @param options Options including:
+   *   - _produce_ - Number by which a quota increases each time it recovers.
+   *   - _per_ - Time interval by which a quota recovers automatically.
+   *       Can be a number in seconds or a string with one of the time unit suffixes such as `'s'`, `'m'` and `'h'`.
+   *   Creating an instance of a name that already exists applies the new initial value and options
+   *   to the existing quotas as well.
+   * @returns A _SharedQuota_ object.
+   */
+  new(
+    name: string,
+    initialValue: number,
+    options?: {
+      produce?: number,
+      per?: number | string,
+    }
+  ): SharedQuota;
+}
+
 /**
  * Path-based routing algorithm.
+ *
+ * A route is written as `host/path`, where the host can be left out. In the host,
+ * `*` stands for any one label. In the path, `:name` matches one segment and
+ * captures it as parameter _name_, `*` matches any one segment, and a trailing
+ * `/*` matches the rest of the path, captured as parameter `*`.
  */
 interface URLRouter {
 
@@ -135,6 +245,25 @@ interface URLRouter {
    * @returns The value that the queried path maps to, or `undefined` if the path is not found.
    */
   find(...pathSegments: string[]): any;
+
+  /**
+   * Finds a route and returns the captured parameters along with it.
+   *
+   * @param path A string containing the path to look up.
+   * @returns An object containing the _value_ that the path maps to
+   *   and the _params_ captured from the path, or `undefined` if the path is not found.
+   */
+  match(path: string): { value: any, params: { [name: string]: string } } | undefined;
+
+  /**
+   * Replaces all routes.
+   *
+   * The new routing table is built in the background and swapped in when done.
+   * Lookups keep using the current routes until then.
+   *
+   * @param routes An object of key-value pairs where keys are the paths and values are what the paths map to.
+   */
+  reload(routes: { [path: string]: any }): void;
 }
 
 interface URLRouterConstructor {
@@ -148,6 +277,65 @@ interface URLRouterConstructor {
   new(routes: { [path: string]: any }): URLRouter;
 }
 
+/**
+ * Longest-prefix-match table mapping IPv4 and IPv6 CIDR blocks to values.
+ *
+ * Entries can be given as an object of key-value pairs where keys are CIDR blocks,
+ * as an array of CIDR strings or `[cidr, value]` pairs, or as a _Data_ holding
+ * lines of text in the form `cidr [value]`, where `#` starts a comment line.
+ * A CIDR without a value maps to `true`. When the same block is given more than once,
+ * the last one wins.
+ */
+interface IPTrie {
+
+  /**
+   * Number of CIDR blocks in the table.
+   */
+  readonly size: number;
+
+  /**
+   * Adds a CIDR block.
+   *
+   * @param cidr A string containing an IPv4 or IPv6 CIDR block, such as `10.0.0.0/8`.
+   * @param value The value that the block maps to. Defaults to `true`.
+   */
+  add(cidr: string, value?: any): void;
+
+  /**
+   * Finds the most specific CIDR block containing an address.
+   *
+   * IPv4-mapped IPv6 addresses are looked up as IPv4.
+   *
+   * @param address A string containing an IP address, a _Data_ holding the 4 or 16 raw bytes
+   *   of an address, or an inbound object whose remote address is looked up.
+   *   It defaults to the current value of `__inbound` if not present.
+   * @returns The value of the longest matching block, or `undefined` if no block matches.
+   */
+  lookup(address?: string | Data | object): any;
+
+  /**
+   * Replaces all CIDR blocks.
+   *
+   * The new table is built in the background and swapped in when done.
+   * Lookups keep using the current table until then, and blocks added
+   * in the meantime are kept in the new table as well.
+   *
+   * @param entries An object, an array or a _Data_ containing the new entries.
+   */
+  reload(entries: { [cidr: string]: any } | (string | [string, any])[] | Data): void;
+}
+
+interface IPTrieConstructor {
+
+  /**
+   * Creates an instance of _IPTrie_.
+   *
+   * @param entries An object, an array or a _Data_ containing the initial entries.
+   * @returns An _IPTrie_ object with the provided entries.
+   */
+  new(entries?: { [cidr: string]: any } | (string | [string, any])[] | Data): IPTrie;
+}
+
 /**
  * Load-balancer base class.
  */
@@ -191,6 +379,42 @@ interface HashingLoadBalancerConstructor {
   new(targets: string[], unhealthy?: Cache): HashingLoadBalancer;
 }
 
+/**
+ * Load-balancer using a Maglev lookup table, so that adding, removing or
+ * re-weighting a target only remaps the keys that have to move.
+ */
+interface ConsistentHashingLoadBalancer extends LoadBalancer {
+
+  /**
+   * Sets weight of a target.
+   *
+   * @param target A string representing the target to add or set weight for.
+   * @param weight A number as the weight of the target. A weight of 0 takes the target out of the table.
+   */
+  set(target: string, weight: number): void;
+}
+
+interface ConsistentHashingLoadBalancerConstructor {
+
+  /**
+   * Creates an instance of _ConsistentHashingLoadBalancer_.
+   *
+   * @param targets An array of strings representing the targets, or an object of key-value pairs
+   *   where keys are the targets and values are the weights.
+   * @param unhealthy A _Cache_ object storing _unhealthy_ targets.
+   * @param options Options including:
+   *   - _tableSize_ - Number of slots in the lookup table, rounded up to a prime. Defaults to 65537.
+   * @returns A _ConsistentHashingLoadBalancer_ object with the specified targets.
+   */
+  new(
+    targets: string[] | { [id: string]: number },
+    unhealthy?: Cache,
+    options?: {
+      tableSize?: number,
+    }
+  ): ConsistentHashingLoadBalancer;
+}
+
 /**
  * Load-balancer that rotates targets by round-robin algorithm.
  */
@@ -245,13 +469,59 @@ interface LeastWorkLoadBalancerConstructor {
   new(targets: string[] | { [id: string]: number }, unhealthy?: Cache): LeastWorkLoadBalancer;
 }
 
+/**
+ * Load-balancer that picks the better of two randomly chosen targets, comparing
+ * their average response latency multiplied by their number of requests in flight.
+ *
+ * Latency of a target is measured from `select()` to the matching `deselect()`
+ * and averaged with exponential decay over time.
+ */
+interface EWMALoadBalancer extends LoadBalancer {
+
+  /**
+   * Sets weight of a target.
+   *
+   * @param target A string representing the target to add or set weight for.
+   * @param weight A number as the weight of the target.
+   */
+  set(target: string, weight: number): void;
+}
+
+interface EWMALoadBalancerConstructor {
+
+  /**
+   * Creates an instance of _EWMALoadBalancer_.
+   *
+   * @param targets An array of strings representing the targets, or an object of key-value pairs
+   *   where keys are the targets and values are the weights.
+   * @param unhealthy A _Cache_ object storing _unhealthy_ targets.
+   * @param options Options including:
+   *   - _decay_ - Time for an old latency sample to fade to about 1/3 of its weight. Defaults to 10 seconds.
+   *   - _name_ - Value of the _balancer_ label in the metrics of this load-balancer. Defaults to an empty string.
+   * @returns An _EWMALoadBalancer_ object with the specified targets.
+   */
+  new(
+    targets: string[] | { [id: string]: number },
+    unhealthy?: Cache,
+    options?: {
+      decay?: number | string,
+      name?: string,
+    }
+  ): EWMALoadBalancer;
+}
+
 interface Algo {
   Cache: CacheConstructor;
+  SharedCache: SharedCacheConstructor;
   Quota: QuotaConstructor;
+  SharedQuota: SharedQuotaConstructor;
   URLRouter: URLRouterConstructor;
+  IPTrie: IPTrieConstructor;
   HashingLoadBalancer: HashingLoadBalancerConstructor;
+  ConsistentHashingLoadBalancer: ConsistentHashingLoadBalancerConstructor;
   RoundRobinLoadBalancer: RoundRobinLoadBalancerConstructor;
   LeastWorkLoadBalancer: LeastWorkLoadBalancerConstructor;
+  EWMALoadBalancer: EWMALoadBalancerConstructor;
 
   /**
    * Gets the hash of a value of any type.
@@ -20,6 +20,9 @@ interface Logger {
   /**
    * Adds output to a file.
    *
+   * Messages are appended to the file. Send _SIGUSR1_ to have the file
+   * reopened after it is rotated.
+   *
    * @param filename Pathname of the file to write to.
    * @returns The same logger object.
    */
@@ -101,6 +104,24 @@ interface Logger {
 
 }
 
+/**
+ * Options for creating a logger.
+ *
+ * Messages logged while the event loop is running are queued in a bounded
+ * per-thread buffer and written out by a dedicated logging thread.
+ * The _overflow_ option decides what happens when that buffer is full:
+ *   - `"block"` - Wait for the logging thread to catch up (Default).
+ *   - `"drop"` - Discard the message.
+ *   - `"sample"` - Once the buffer is half full, keep only a portion of messages
+ *       given by _sampleRate_, and discard the rest as well as anything that does not fit.
+ *
+ * Discarded messages are counted in the `pipy_log_dropped_count` metric.
+ */
+interface LoggerOptions {
+  overflow?: "block" | "drop" | "sample",
+  sampleRate?: number,
+}
+
 /**
  * Log values as binary data.
  */
@@ -113,9 +134,12 @@ interface BinaryLoggerConstructor {
    * Creates an instance of _BinaryLogger_.
    *
    * @param name Name of the logger.
+   * @param options Options including:
+   *   - _overflow_ - What to do when the log buffer is full. Can be `"block"` (Default), `"drop"` or `"sample"`.
+   *   - _sampleRate_ - Portion of messages to keep under pressure when _overflow_ is `"sample"`. Default is `0.1`.
    * @returns A _BinaryLogger_ object with the specified name.
    */
-  new(name: string): BinaryLogger;
+  new(name: string, options?: LoggerOptions): BinaryLogger;
 }
 
 /**
@@ -130,9 +154,12 @@ interface TextLoggerConstructor {
    * Creates an instance of _TextLogger_.
    *
    * @param name Name of the logger.
+   * @param options Options including:
+   *   - _overflow_ - What to do when the log buffer is full. Can be `"block"` (Default), `"drop"` or `"sample"`.
+   *   - _sampleRate_ - Portion of messages to keep under pressure when _overflow_ is `"sample"`. Default is `0.1`.
    * @returns A _TextLogger_ object with the specified name.
    */
-  new(name: string): TextLogger;
+  new(name: string, options?: LoggerOptions): TextLogger;
 }
 
 /**
@@ -147,9 +174,12 @@ interface JSONLoggerConstructor {
    * Creates an instance of _JSONLogger_.
    *
    * @param name Name of the logger.
+   * @param options Options including:
+   *   - _overflow_ - What to do when the log buffer is full. Can be `"block"` (Default), `"drop"` or `"sample"`.
+   *   - _sampleRate_ - Portion of messages to keep under pressure when _overflow_ is `"sample"`. Default is `0.1`.
    * @returns A _JSONLogger_ object with the specified name.
    */
-  new(name: string): JSONLogger;
+  new(name: string, options?: LoggerOptions): JSONLogger;
 }
 
 interface Logging {
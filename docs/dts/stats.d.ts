@@ -123,10 +123,71 @@ interface HistogramConstructor {
   new(name: string, buckets: number[], labelNames?: string[]): Histogram;
 }
 
+/**
+ * Log-linear histogram metric.
+ *
+ * Samples are recorded in constant time into buckets whose width grows with
+ * the value, so quantiles are accurate to a relative error of `2^-(precision+1)`.
+ * Buckets are summed across threads, and exported to Prometheus
+ * as classic `_bucket` series along with `quantile` series.
+ */
+interface LogHistogram extends Metric {
+
+  /**
+   * Clears all buckets.
+   */
+  zero(): void;
+
+  /**
+   * Records a sample.
+   *
+   * @param n A sample to add to the histogram.
+   */
+  observe(n: number): void;
+
+  /**
+   * Estimates a quantile from the samples recorded on the current thread.
+   *
+   * @param q Quantile between 0 and 1, e.g. `0.99` for p99.
+   * @returns The estimated value at the quantile.
+   */
+  quantile(q: number): number;
+}
+
+interface LogHistogramConstructor {
+
+  /**
+   * Creates an instance of _LogHistogram_.
+   *
+   * @param name Name of the histogram metric.
+   * @param options Options including:
+   *   - _precision_ - Each power of two is split into `2^precision` buckets. Can be 1 to 10. Default is `3`.
+   *   - _lowest_ - Lowest discernible value. Default is `1`.
+   *   - _highest_ - Highest trackable value. Larger samples are counted in an overflow bucket. Default is `3600000`.
+   *   - _buckets_ - Upper bounds of the classic buckets exported to Prometheus.
+   *       Default is every power of two of _lowest_ up to _highest_.
+   *   - _quantiles_ - Quantiles exported to Prometheus. Default is `[0.5, 0.9, 0.99, 0.999]`.
+   * @param labelNames An array of label names.
+   * @returns A _LogHistogram_ object with the specified name and labels.
+   */
+  new(
+    name: string,
+    options?: {
+      precision?: number,
+      lowest?: number,
+      highest?: number,
+      buckets?: number[],
+      quantiles?: number[],
+    },
+    labelNames?: string[]
+  ): LogHistogram;
+}
+
 interface Stats {
   Counter: CounterConstructor,
   Gauge: GaugeConstructor,
   Histogram: HistogramConstructor,
+  LogHistogram: LogHistogramConstructor,
 }
 
 declare var stats: Stats;
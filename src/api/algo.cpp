@@ -26,9 +26,23 @@
 #include "algo.hpp"
 #include "context.hpp"
 #include "input.hpp"
+#include "net.hpp"
+#include "data.hpp"
+#include "api/json.hpp"
+#include "api/stats.hpp"
 #include "utils.hpp"
 #include "log.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+
 namespace pipy {
 namespace algo {
 
@@ -214,6 +228,488 @@ void Cache::set(
   }
 }
 
+//
+// SharedCache
+//
+
+thread_local static Data::Producer s_dp("algo.SharedCache");
+
+std::mutex SharedCache::s_storages_mutex;
+std::map<std::string, SharedCache::Storage*> SharedCache::s_storages;
+
+thread_local static pjs::Ref<stats::Counter> s_metric_shared_cache_hit;
+thread_local static pjs::Ref<stats::Counter> s_metric_shared_cache_miss;
+thread_local static pjs::Ref<stats::Counter> s_metric_shared_cache_eviction;
+
+static void init_shared_cache_metrics() {
+  if (!s_metric_shared_cache_hit) {
+    pjs::Ref<pjs::Array> label_names = pjs::Array::make(1);
+    label_names->set(0, "cache");
+    s_metric_shared_cache_hit = stats::Counter::make(
+      pjs::Str::make("pipy_shared_cache_hit_count"),
+      label_names
+    );
+    s_metric_shared_cache_miss = stats::Counter::make(
+      pjs::Str::make("pipy_shared_cache_miss_count"),
+      label_names
+    );
+    s_metric_shared_cache_eviction = stats::Counter::make(
+      pjs::Str::make("pipy_shared_cache_eviction_count"),
+      label_names
+    );
+  }
+}
+
+//
+// Storages are looked up by name so that every worker thread
+// constructing a SharedCache of the same name gets the same one.
+// The options of the latest constructed one apply, so that a reloaded
+// codebase can change them while keeping what is cached.
+//
+
+SharedCache::SharedCache(pjs::Str *name, const Options &options)
+  : m_name(name)
+{
+  int n = 0;
+  {
+    std::lock_guard<std::mutex> lock(s_storages_mutex);
+    auto &storage = s_storages[name->str()];
+    if (storage) {
+      n = storage->set_options(options);
+    } else {
+      storage = new Storage(name->str(), options);
+    }
+    m_storage = storage;
+  }
+  if (n > 0) on_evict(n);
+}
+
+SharedCache::~SharedCache() {
+}
+
+bool SharedCache::get(const pjs::Value &key, pjs::Value &value) {
+  std::string k, v;
+  encode(key, k);
+  if (m_storage->get(k, v)) {
+    decode(v, value);
+    on_hit();
+    return true;
+  } else {
+    on_miss();
+    return false;
+  }
+}
+
+void SharedCache::set(const pjs::Value &key, const pjs::Value &value) {
+  std::string k, v;
+  encode(key, k);
+  encode(value, v);
+  if (auto n = m_storage->set(k, v)) on_evict(n);
+}
+
+bool SharedCache::remove(const pjs::Value &key) {
+  std::string k;
+  encode(key, k);
+  return m_storage->remove(k);
+}
+
+void SharedCache::clear() {
+  m_storage->clear();
+}
+
+//
+// Values are stored as bytes, so they can be read from any thread,
+// prefixed with a byte telling the type:
+//
+//   u - undefined
+//   n - null
+//   f - false
+//   t - true
+//   d - number as a native double
+//   s - string
+//   D - Data
+//   j - object in JSON
+//
+
+void SharedCache::encode(const pjs::Value &value, std::string &out) {
+  switch (value.type()) {
+    case pjs::Value::Type::Empty:
+    case pjs::Value::Type::Undefined:
+      out = "u";
+      break;
+    case pjs::Value::Type::Boolean:
+      out = value.b() ? "t" : "f";
+      break;
+    case pjs::Value::Type::Number: {
+      auto n = value.n();
+      out = "d";
+      out.append((const char *)&n, sizeof(n));
+      break;
+    }
+    case pjs::Value::Type::String:
+      out = "s";
+      out += value.s()->str();
+      break;
+    case pjs::Value::Type::Object:
+      if (value.is_null()) {
+        out = "n";
+      } else if (value.is<Data>()) {
+        out = "D";
+        out += value.as<Data>()->to_string();
+      } else {
+        out = "j";
+        out += JSON::stringify(value, nullptr, 0);
+      }
+      break;
+  }
+}
+
+void SharedCache::decode(const std::string &in, pjs::Value &value) {
+  switch (in[0]) {
+    case 'n': value = pjs::Value::null; break;
+    case 'f': value.set(false); break;
+    case 't': value.set(true); break;
+    case 'd': {
+      double n;
+      std::memcpy(&n, in.c_str() + 1, sizeof(n));
+      value.set(n);
+      break;
+    }
+    case 's':
+      value.set(pjs::Str::make(in.c_str() + 1, in.length() - 1));
+      break;
+    case 'D':
+      value.set(s_dp.make(in.c_str() + 1, in.length() - 1));
+      break;
+    case 'j':
+      if (!JSON::parse(in.substr(1), nullptr, value)) value = pjs::Value::undefined;
+      break;
+    default:
+      value = pjs::Value::undefined;
+      break;
+  }
+}
+
+void SharedCache::on_hit() {
+  init_shared_cache_metrics();
+  pjs::Str *label = m_name;
+  s_metric_shared_cache_hit->increase();
+  s_metric_shared_cache_hit->with_labels(&label, 1)->increase();
+}
+
+void SharedCache::on_miss() {
+  init_shared_cache_metrics();
+  pjs::Str *label = m_name;
+  s_metric_shared_cache_miss->increase();
+  s_metric_shared_cache_miss->with_labels(&label, 1)->increase();
+}
+
+void SharedCache::on_evict(int n) {
+  init_shared_cache_metrics();
+  pjs::Str *label = m_name;
+  s_metric_shared_cache_eviction->increase(n);
+  s_metric_shared_cache_eviction->with_labels(&label, 1)->increase(n);
+}
+
+//
+// SharedCache::Storage
+//
+
+SharedCache::Storage::Storage(const std::string &name, const Options &options)
+  : m_name(name)
+  , m_size(options.size > 0 ? options.size : 0)
+  , m_count(0)
+  , m_clock(0)
+  , m_ttl(options.ttl * 1000)
+{
+}
+
+auto SharedCache::Storage::set_options(const Options &options) -> int {
+  m_size.store(options.size > 0 ? options.size : 0);
+  m_ttl.store(options.ttl * 1000);
+  return evict(std::string());
+}
+
+auto SharedCache::Storage::shard(const std::string &key) -> Shard& {
+  std::hash<std::string> hash;
+  return m_shards[hash(key) % SHARDS];
+}
+
+bool SharedCache::Storage::get(const std::string &key, std::string &value) {
+  auto &s = shard(key);
+  std::lock_guard<std::mutex> lock(s.mutex);
+  auto i = s.entries.find(key);
+  if (i == s.entries.end()) return false;
+  auto &e = i->second;
+  if (e.ttl > 0 && utils::now() >= e.ttl) {
+    s.lru.erase(e.lru);
+    s.entries.erase(i);
+    m_count--;
+    return false;
+  }
+  s.lru.splice(s.lru.end(), s.lru, e.lru);
+  e.stamp = ++m_clock;
+  value = e.value;
+  return true;
+}
+
+auto SharedCache::Storage::set(const std::string &key, const std::string &value) -> int {
+  auto ttl_ms = m_ttl.load();
+  auto ttl = (ttl_ms > 0 ? utils::now() + ttl_ms : 0);
+  auto &s = shard(key);
+  {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto i = s.entries.find(key);
+    if (i != s.entries.end()) {
+      auto &e = i->second;
+      e.value = value;
+      e.ttl = ttl;
+      e.stamp = ++m_clock;
+      s.lru.splice(s.lru.end(), s.lru, e.lru);
+      return 0;
+    }
+    s.lru.push_back(key);
+    auto &e = s.entries[key];
+    e.value = value;
+    e.ttl = ttl;
+    e.stamp = ++m_clock;
+    e.lru = std::prev(s.lru.end());
+    m_count++;
+  }
+  return evict(key);
+}
+
+//
+// The size limit is on the whole storage rather than on each shard. Every
+// access stamps the entry with a storage-wide clock, so the oldest of the
+// least recently used entries of all shards is the one to evict. Only one
+// shard is locked at a time, so it is looked for again if that entry was
+// touched in between.
+//
+
+auto SharedCache::Storage::evict(const std::string &key) -> int {
+  auto size = m_size.load();
+  if (!size) return 0;
+  int n = 0;
+  while (m_count.load() > size) {
+    Shard *oldest = nullptr;
+    uint64_t oldest_stamp = 0;
+    for (auto &s : m_shards) {
+      std::lock_guard<std::mutex> lock(s.mutex);
+      if (s.lru.empty() || s.lru.front() == key) continue;
+      auto stamp = s.entries[s.lru.front()].stamp;
+      if (!oldest || stamp < oldest_stamp) {
+        oldest = &s;
+        oldest_stamp = stamp;
+      }
+    }
+    if (!oldest) break;
+    std::lock_guard<std::mutex> lock(oldest->mutex);
+    if (oldest->lru.empty()) continue;
+    auto i = oldest->entries.find(oldest->lru.front());
+    if (i->second.stamp != oldest_stamp) continue;
+    oldest->entries.erase(i);
+    oldest->lru.pop_front();
+    m_count--;
+    n++;
+  }
+  return n;
+}
+
+bool SharedCache::Storage::remove(const std::string &key) {
+  auto &s = shard(key);
+  std::lock_guard<std::mutex> lock(s.mutex);
+  auto i = s.entries.find(key);
+  if (i == s.entries.end()) return false;
+  s.lru.erase(i->second.lru);
+  s.entries.erase(i);
+  m_count--;
+  return true;
+}
+
+void SharedCache::Storage::clear() {
+  for (auto &s : m_shards) {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    m_count -= s.entries.size();
+    s.entries.clear();
+    s.lru.clear();
+  }
+}
+
+//
+// Quota::SharedBucket
+//
+// A token bucket shared by all threads. Tokens are taken and put back
+// with CAS loops, and recovered lazily by whichever thread first sees
+// that a period has passed since the last recovery. The initial value
+// and the options are read from the storage every time, so that they
+// can be changed for the buckets already there.
+//
+
+class Quota::SharedBucket {
+public:
+  SharedBucket(SharedQuota::Storage *storage, const std::string &key)
+    : storage(storage)
+    , key(key)
+    , tokens(storage->initial_value())
+    , recovered_time(now()) {}
+
+  SharedQuota::Storage* const storage;
+  const std::string key;
+  int refs = 0; // guarded by the storage shard's mutex
+
+  auto current() -> double {
+    recover();
+    return tokens.load(std::memory_order_relaxed);
+  }
+
+  bool is_full() {
+    return current() >= storage->initial_value();
+  }
+
+  auto consume(double value) -> double {
+    recover();
+    auto t = tokens.load(std::memory_order_relaxed);
+    double n;
+    do {
+      if (t <= 0) return 0;
+      n = std::min(value, t);
+    } while (!tokens.compare_exchange_weak(t, t - n, std::memory_order_relaxed));
+    return n;
+  }
+
+  void produce(double value) {
+    auto t = tokens.load(std::memory_order_relaxed);
+    while (!tokens.compare_exchange_weak(t, t + value, std::memory_order_relaxed)) {}
+  }
+
+  //
+  // Seconds until the next recovery is due
+  //
+
+  auto next_recovery() -> double {
+    auto period = uint64_t(storage->per() * 1e9);
+    auto due = recovered_time.load(std::memory_order_relaxed) + period;
+    auto t = now();
+    return due > t ? (due - t) / 1e9 : 0;
+  }
+
+  void add_waiter(SharedWaiter *waiter);
+  void remove_waiter(SharedWaiter *waiter);
+  void wake(Net *except);
+
+private:
+  std::atomic<double> tokens;
+  std::atomic<uint64_t> recovered_time;
+  std::mutex m_waiters_mutex;
+  std::vector<SharedWaiter*> m_waiters;
+
+  static auto now() -> uint64_t {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+  }
+
+  void recover() {
+    auto per = storage->per();
+    if (per <= 0) return;
+    auto period = uint64_t(per * 1e9);
+    if (!period) return;
+    auto last = recovered_time.load(std::memory_order_relaxed);
+    auto t = now();
+    if (t < last + period) return;
+    auto n = (t - last) / period;
+    if (!recovered_time.compare_exchange_strong(last, last + n * period, std::memory_order_relaxed)) return;
+    auto initial_value = storage->initial_value();
+    auto produce = storage->produce();
+    auto amount = produce > 0 ? produce * n : initial_value;
+    auto v = tokens.load(std::memory_order_relaxed);
+    double x;
+    do {
+      if (v >= initial_value) return;
+      x = std::min(initial_value, v + amount);
+    } while (!tokens.compare_exchange_weak(v, x, std::memory_order_relaxed));
+  }
+};
+
+//
+// Quota::SharedWaiter
+//
+// Registered with a shared bucket by a thread that has consumers waiting
+// on it, so that quota produced by other threads can wake them up.
+//
+
+class Quota::SharedWaiter {
+public:
+  SharedWaiter(Quota *quota)
+    : net(&Net::current())
+    , quota(quota)
+    , refs(1)
+    , notified(false) {}
+
+  Net* const net;
+  Quota* quota;
+  std::atomic<int> refs;
+  std::atomic<bool> notified;
+
+  void retain() {
+    refs.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void release() {
+    if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete this;
+    }
+  }
+};
+
+void Quota::SharedBucket::add_waiter(SharedWaiter *waiter) {
+  std::lock_guard<std::mutex> lock(m_waiters_mutex);
+  m_waiters.push_back(waiter);
+}
+
+void Quota::SharedBucket::remove_waiter(SharedWaiter *waiter) {
+  std::lock_guard<std::mutex> lock(m_waiters_mutex);
+  auto i = std::find(m_waiters.begin(), m_waiters.end(), waiter);
+  if (i != m_waiters.end()) m_waiters.erase(i);
+}
+
+//
+// Wake-ups to the same thread are coalesced until delivered,
+// so a busy producer doesn't flood other threads with posts.
+//
+
+void Quota::SharedBucket::wake(Net *except) {
+  std::lock_guard<std::mutex> lock(m_waiters_mutex);
+  for (auto *w : m_waiters) {
+    if (w->net == except) continue;
+    if (w->notified.exchange(true)) continue;
+    w->retain();
+    w->net->post(
+      [=]() {
+        InputContext ic;
+        w->notified.store(false);
+        if (auto *quota = w->quota) quota->notify();
+        w->release();
+      }
+    );
+  }
+}
+
+thread_local static pjs::Ref<stats::Counter> s_metric_quota_throttled;
+
+static void init_quota_metrics() {
+  if (!s_metric_quota_throttled) {
+    pjs::Ref<pjs::Array> label_names = pjs::Array::make(2);
+    label_names->set(0, "quota");
+    label_names->set(1, "key");
+    s_metric_quota_throttled = stats::Counter::make(
+      pjs::Str::make("pipy_shared_quota_throttled_count"),
+      label_names
+    );
+  }
+}
+
 //
 // Quota
 //
@@ -234,35 +730,122 @@ Quota::Quota(double initial_value, const Options &options)
 {
 }
 
+Quota::Quota(SharedBucket *bucket, pjs::Str *name, pjs::Str *key)
+  : m_initial_value(0)
+  , m_current_value(0)
+  , m_shared(bucket)
+  , m_name(name)
+  , m_key(key)
+{
+}
+
+Quota::~Quota() {
+  if (m_waiter) {
+    m_shared->remove_waiter(m_waiter);
+    m_waiter->quota = nullptr;
+    m_waiter->release();
+  }
+  if (m_shared) {
+    m_shared->storage->release(m_shared);
+  }
+}
+
+auto Quota::initial() const -> double {
+  return m_shared ? m_shared->storage->initial_value() : m_initial_value;
+}
+
+auto Quota::current() const -> double {
+  return m_shared ? m_shared->current() : m_current_value;
+}
+
 void Quota::reset() {
-  if (m_current_value >= m_initial_value) {
-    m_current_value = m_initial_value;
+  auto initial_value = initial();
+  auto current_value = current();
+  if (current_value >= initial_value) {
+    if (!m_shared) m_current_value = initial_value;
   } else {
-    produce(m_initial_value - m_current_value);
+    produce(initial_value - current_value);
   }
 }
 
 void Quota::produce(double value) {
   if (value <= 0) return;
-  m_current_value += value;
-  auto *p = m_consumers.head();
-  while (p) {
-    auto *consumer = p; p = p->next();
-    consumer->on_consume(this);
-    if (m_current_value <= 0) break;
+  if (m_shared) {
+    m_shared->produce(value);
+    m_shared->wake(&Net::current());
+  } else {
+    m_current_value += value;
   }
+  notify();
 }
 
 auto Quota::consume(double value) -> double {
   if (value <= 0) return 0;
+  if (m_shared) return m_shared->consume(value);
   if (value > m_current_value) value = m_current_value;
   m_current_value -= value;
   schedule_producing();
   return value;
 }
 
+void Quota::add_consumer(Consumer *consumer) {
+  m_consumers.push(consumer);
+  if (m_shared) {
+    if (!m_waiter) {
+      m_waiter = new SharedWaiter(this);
+      m_shared->add_waiter(m_waiter);
+    }
+    init_quota_metrics();
+    pjs::Str *labels[2] = { m_name, m_key };
+    s_metric_quota_throttled->increase();
+    s_metric_quota_throttled->with_labels(labels, 2)->increase();
+    schedule_producing();
+  }
+}
+
+void Quota::remove_consumer(Consumer *consumer) {
+  m_consumers.remove(consumer);
+  if (m_waiter && m_consumers.empty()) {
+    m_shared->remove_waiter(m_waiter);
+    m_waiter->quota = nullptr;
+    m_waiter->release();
+    m_waiter = nullptr;
+    m_timer.cancel();
+    m_is_producing_scheduled = false;
+  }
+}
+
+void Quota::notify() {
+  auto *p = m_consumers.head();
+  while (p) {
+    auto *consumer = p; p = p->next();
+    consumer->on_consume(this);
+    if (current() <= 0) break;
+  }
+}
+
+//
+// A shared quota recovers by itself, so its timer only
+// exists to wake up local consumers when it's due.
+//
+
 void Quota::schedule_producing() {
   if (m_is_producing_scheduled) return;
+  if (m_shared) {
+    if (m_consumers.empty()) return;
+    if (m_shared->storage->per() <= 0) return;
+    m_timer.schedule(
+      m_shared->next_recovery(),
+      [this]() {
+        InputContext ic;
+        m_is_producing_scheduled = false;
+        notify();
+        schedule_producing();
+      }
+    );
+    m_is_producing_scheduled = true;
+    return;
+  }
   if (m_options.per <= 0) return;
   m_timer.schedule(
     m_options.per,
@@ -287,160 +870,1022 @@ void Quota::schedule_producing() {
 void Quota::Consumer::set_quota(Quota *quota) {
   if (quota != m_quota) {
     if (m_quota) {
-      m_quota->m_consumers.remove(this);
+      m_quota->remove_consumer(this);
     }
     m_quota = quota;
-    if (quota) quota->m_consumers.push(this);
+    if (quota) quota->add_consumer(this);
   }
 }
 
 //
-// URLRouter
+// SharedQuota
 //
 
-URLRouter::URLRouter()
-  : m_root(new Node())
-{
-}
+std::mutex SharedQuota::s_storages_mutex;
+std::map<std::string, SharedQuota::Storage*> SharedQuota::s_storages;
 
-URLRouter::URLRouter(pjs::Object *rules)
-  : URLRouter()
+//
+// Storages are looked up by name, same as SharedCache's, and the
+// initial value and options of the latest constructed one apply.
+//
+
+SharedQuota::SharedQuota(pjs::Str *name, double initial_value, const Quota::Options &options)
+  : m_name(name)
 {
-  if (rules) {
-    rules->iterate_all(
-      [this](pjs::Str *k, pjs::Value &v) {
-        add(k->str(), v);
-      }
-    );
+  std::lock_guard<std::mutex> lock(s_storages_mutex);
+  auto &storage = s_storages[name->str()];
+  if (storage) {
+    storage->set_options(initial_value, options);
+  } else {
+    storage = new Storage(initial_value, options);
   }
+  m_storage = storage;
 }
 
-URLRouter::~URLRouter() {
-  delete m_root;
+SharedQuota::~SharedQuota() {
 }
 
-void URLRouter::add(const std::string &url, const pjs::Value &value) {
-  auto segs = utils::split(url, '/');
-  auto domain = segs.front();
-  segs.pop_front();
-
-  if (segs.empty() || domain.find_first_of(':') != std::string::npos) {
-    throw std::runtime_error("invalid URL pattern");
-  }
-
-  auto node = m_root;
+//
+// Quotas are cached per thread so that the shared storage is only
+// locked the first time a key is seen by a thread. The cache is swept
+// of quotas nobody else holds whenever it doubles in size.
+//
 
-  if (!domain.empty()) {
-    auto segs = utils::split(domain, '.');
-    for (const auto &seg : segs) {
-      node = node->new_child(seg);
-    }
+auto SharedQuota::get(const pjs::Value &key) -> Quota* {
+  auto *s = key.to_string();
+  std::string k(s->str());
+  auto i = m_quotas.find(k);
+  if (i != m_quotas.end()) {
+    s->release();
+    return i->second;
   }
 
-  node = node->new_child("/");
-
-  if (segs.back() == "*") {
-    for (const auto &seg : segs) {
-      if (!seg.empty()) {
-        node = node->new_child(seg);
+  if (m_quotas.size() >= m_sweep_size) {
+    for (auto i = m_quotas.begin(); i != m_quotas.end(); ) {
+      if (i->second->ref_count() == 1) {
+        i = m_quotas.erase(i);
+      } else {
+        i++;
       }
     }
-    node->value = value;
-  } else {
-    auto i = url.find_first_of('/');
-    node->new_child(url.substr(i))->value = value;
+    m_sweep_size = std::max(size_t(1000), m_quotas.size() * 2);
   }
+
+  auto *quota = Quota::make(m_storage->acquire(k), m_name, s);
+  s->release();
+  m_quotas[k] = quota;
+  return quota;
 }
 
-bool URLRouter::find(const std::string &url, pjs::Value &value) {
-  static const std::string s_slash("/");
-  static const std::string s_asterisk("*");
+//
+// SharedQuota::Storage
+//
+// Buckets are reference counted by the quotas of all threads, and a
+// bucket is only removed when nobody holds it and it's full again,
+// since by then it's no different from a newly created one. Counting
+// is done under the shard's lock, so that a bucket can't be taken
+// again while it's being removed. Buckets let go while not full are
+// swept whenever their shard doubles in size.
+//
 
-  auto path_start = url.find_first_of('/');
-  if (path_start == std::string::npos) return false;
+void SharedQuota::Storage::set_options(double initial_value, const Quota::Options &options) {
+  m_initial_value.store(initial_value, std::memory_order_relaxed);
+  m_per.store(options.per, std::memory_order_relaxed);
+  m_produce.store(options.produce, std::memory_order_relaxed);
+}
 
-  auto path_end = url.find_first_of('?', path_start);
-  if (path_end == std::string::npos) path_end = url.length();
+auto SharedQuota::Storage::shard(const std::string &key) -> Shard& {
+  return m_shards[std::hash<std::string>()(key) % SHARDS];
+}
 
-  auto domain_end = url.find_last_of(':', path_start);
-  if (domain_end == std::string::npos) domain_end = path_start;
+auto SharedQuota::Storage::acquire(const std::string &key) -> Quota::SharedBucket* {
+  auto &s = shard(key);
+  std::lock_guard<std::mutex> lock(s.mutex);
+  auto &slot = s.buckets[key];
+  if (!slot) slot = new Quota::SharedBucket(this, key);
+  auto *bucket = slot;
+  bucket->refs++;
+  if (s.buckets.size() >= s.sweep_size) sweep(s);
+  return bucket;
+}
 
-  std::function<Node*(Node*, int)> find_host, find_path;
-
-  find_host = [&](Node *node, int p) -> Node* {
-    auto i = p;
-    while (i < domain_end && url[i] != '.') i++;
-    auto s = url.substr(p, i - p);
-    node = node->child(s);
-    if (!node) return nullptr;
-    p = i + 1;
-    if (p <= domain_end) return find_host(node, p);
-    node = node->child(s_slash);
-    if (!node) return nullptr;
-    if (auto exact = node->child(url.substr(path_start, path_end - path_start))) {
-      return exact;
-    }
-    return find_path(node, path_start + 1);
-  };
+void SharedQuota::Storage::release(Quota::SharedBucket *bucket) {
+  auto &s = shard(bucket->key);
+  std::lock_guard<std::mutex> lock(s.mutex);
+  if (--bucket->refs > 0) return;
+  if (!bucket->is_full()) return;
+  s.buckets.erase(bucket->key);
+  delete bucket;
+}
 
-  find_path = [&](Node *node, int p) -> Node* {
-    auto i = p;
-    while (i < path_end && url[i] != '/') i++;
-    auto s = url.substr(p, i - p);
-    if (auto c = node->child(s)) {
-      p = i + 1;
-      c = p >= path_end ? c->child(s_asterisk) : find_path(c, p);
-      if (c) return c;
+void SharedQuota::Storage::sweep(Shard &s) {
+  for (auto i = s.buckets.begin(); i != s.buckets.end(); ) {
+    auto *bucket = i->second;
+    if (bucket->refs == 0 && bucket->is_full()) {
+      i = s.buckets.erase(i);
+      delete bucket;
+    } else {
+      i++;
     }
-    if (auto c = node->child(s_asterisk)) return c;
-    return nullptr;
-  };
+  }
+  s.sweep_size = std::max(size_t(1000), s.buckets.size() * 2);
+}
 
-  auto node = find_host(m_root, 0);
-  if (!node) {
-    auto i = 0;
-    while (i < domain_end && url[i] != '.') i++;
-    if (i < domain_end) {
-      if (auto c = m_root->child(s_asterisk)) {
-        node = find_host(c, i + 1);
-      }
-    }
+//
+// TableBuilder
+//
+
+std::mutex TableBuilder::s_mutex;
+std::condition_variable TableBuilder::s_cv;
+std::thread TableBuilder::s_thread;
+std::deque<std::weak_ptr<TableBuilder::Job>> TableBuilder::s_queue;
+std::map<std::string, std::weak_ptr<TableBuilder::Job>> TableBuilder::s_jobs;
+std::deque<std::pair<std::chrono::steady_clock::time_point, std::shared_ptr<TableBuilder::Job>>> TableBuilder::s_kept;
+bool TableBuilder::s_stopped = false;
+
+auto TableBuilder::submit(const std::string &key, const std::function<std::shared_ptr<Job>()> &make) -> std::shared_ptr<Job> {
+  std::unique_lock<std::mutex> lock(s_mutex);
+
+  auto i = s_jobs.find(key);
+  if (i != s_jobs.end()) {
+    if (auto job = i->second.lock()) return job;
   }
-  if (!node) {
-    if (auto c = m_root->child(s_slash)) {
-      if (auto exact = c->child(url.substr(path_start, path_end - path_start))) {
-        node = exact;
-      } else {
-        node = find_path(c, path_start + 1);
-      }
+
+  auto now = std::chrono::steady_clock::now();
+  while (!s_kept.empty() && s_kept.front().first <= now) {
+    s_kept.pop_front();
+  }
+
+  for (auto i = s_jobs.begin(); i != s_jobs.end(); ) {
+    if (i->second.expired()) {
+      i = s_jobs.erase(i);
+    } else {
+      i++;
     }
   }
 
-  if (node) {
-    value = node->value;
-    return true;
+  auto job = make();
+
+  // Built right here after shutdown, as nothing else would build it
+  if (s_stopped) {
+    lock.unlock();
+    job->build();
+    job->m_done.store(true, std::memory_order_release);
+    return job;
   }
 
-  return false;
+  s_jobs[key] = job;
+  s_queue.push_back(job);
+  if (!s_thread.joinable()) {
+    s_thread = std::thread(main);
+  }
+  s_cv.notify_one();
+  return job;
 }
 
-void URLRouter::dump(Node *node, int level) {
-  for (auto &i : node->children) {
-    std::cout << std::string(level * 2, ' ');
-    std::cout << i.first << std::endl;
-    dump(i.second, level + 1);
+void TableBuilder::shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_stopped = true;
+    s_queue.clear();
+    s_jobs.clear();
+    s_kept.clear();
+  }
+  s_cv.notify_one();
+  if (s_thread.joinable()) s_thread.join();
+}
+
+void TableBuilder::main() {
+  std::unique_lock<std::mutex> lock(s_mutex);
+  for (;;) {
+    s_cv.wait(lock, []() { return s_stopped || !s_queue.empty(); });
+    if (s_stopped) break;
+    auto job = s_queue.front().lock();
+    s_queue.pop_front();
+    if (!job) continue;
+    lock.unlock();
+    job->build();
+    job->m_done.store(true, std::memory_order_release);
+    lock.lock();
+    s_kept.emplace_back(std::chrono::steady_clock::now() + std::chrono::seconds(5), std::move(job));
   }
 }
 
 //
-// LoadBalancer
+// URLRouter
 //
 
-LoadBalancer::~LoadBalancer() {
-  for (const auto &i : m_sessions) {
-    delete i.second;
-  }
-  for (const auto &i : m_targets) {
+URLRouter::URLRouter()
+{
+}
+
+URLRouter::URLRouter(pjs::Object *rules)
+  : URLRouter()
+{
+  if (rules) {
+    rules->iterate_all(
+      [this](pjs::Str *k, pjs::Value &v) {
+        add(k->str(), v);
+      }
+    );
+  }
+}
+
+URLRouter::~URLRouter() {
+}
+
+void URLRouter::add(const std::string &url, const pjs::Value &value) {
+  Table::validate(url);
+  m_rules.push_back({ url, value });
+  m_table = nullptr;
+  if (m_reload) m_pending_rules.push_back({ url, value });
+}
+
+void URLRouter::reload(pjs::Object *rules) {
+  std::vector<Rule> new_rules;
+  std::vector<std::string> patterns;
+
+  if (rules) {
+    rules->iterate_all(
+      [&](pjs::Str *k, pjs::Value &v) {
+        Table::validate(k->str());
+        new_rules.push_back({ k->str(), v });
+        patterns.push_back(k->str());
+      }
+    );
+  }
+
+  if (!Net::main().is_running() || &Net::current() == &Net::main()) {
+    m_table = std::make_shared<Table>(patterns);
+    m_rules = std::move(new_rules);
+    m_pending_rules.clear();
+    m_reload = nullptr;
+    return;
+  }
+
+  //
+  // Build the new table on the TableBuilder thread so that neither this
+  // thread nor the main thread is blocked by a large table, while
+  // lookups keep using the current table until it is picked up.
+  //
+
+  std::string key("url");
+  for (const auto &p : patterns) {
+    key += '\0';
+    key += p;
+  }
+
+  m_pending_rules = std::move(new_rules);
+  m_reload = std::static_pointer_cast<Reload>(
+    TableBuilder::submit(key, [&]() { return std::make_shared<Reload>(patterns); })
+  );
+}
+
+void URLRouter::Reload::build() {
+  table = std::make_shared<Table>(patterns);
+  patterns.clear();
+  patterns.shrink_to_fit();
+}
+
+bool URLRouter::find(const std::string &url, pjs::Value &value, pjs::Object *params) {
+  auto path_start = url.find_first_of('/');
+  if (path_start == std::string::npos) return false;
+
+  auto path_end = url.find_first_of('?', path_start);
+  if (path_end == std::string::npos) path_end = url.length();
+
+  auto domain_end = url.find_last_of(':', path_start);
+  if (domain_end == std::string::npos) domain_end = path_start;
+
+  auto *table = this->table();
+
+  Table::Match match;
+  const char *key = nullptr;
+  int i = -1;
+
+  if (domain_end > 0) {
+    if (domain_end == path_start) {
+      key = url.c_str();
+      i = table->find(key, path_end, match);
+    } else {
+      thread_local static std::string s_key;
+      s_key.assign(url, 0, domain_end);
+      s_key.append(url, path_start, path_end - path_start);
+      key = s_key.c_str();
+      i = table->find(key, s_key.length(), match);
+    }
+  }
+
+  if (i < 0) {
+    match.count = 0;
+    key = url.c_str() + path_start;
+    i = table->find(key, path_end - path_start, match);
+  }
+
+  if (i < 0) return false;
+
+  value = m_rules[i].value;
+
+  if (params) {
+    const auto &names = table->names(i);
+    for (int j = 0; j < match.count; j++) {
+      const auto &c = match.captures[j];
+      params->set(
+        table->name(names[j]),
+        pjs::Str::make(key + c.start, c.end - c.start)
+      );
+    }
+  }
+
+  return true;
+}
+
+auto URLRouter::table() -> Table* {
+  if (m_reload && m_reload->done()) {
+    m_rules = std::move(m_pending_rules);
+    m_pending_rules.clear();
+    if (m_rules.size() == m_reload->size) {
+      m_table = m_reload->table;
+    } else {
+      m_table = nullptr; // Rules added while reloading
+    }
+    m_reload = nullptr;
+  }
+  if (!m_table) {
+    std::vector<std::string> patterns;
+    patterns.reserve(m_rules.size());
+    for (const auto &r : m_rules) patterns.push_back(r.pattern);
+    m_table = std::make_shared<Table>(patterns);
+  }
+  return m_table.get();
+}
+
+//
+// URLRouter::Table::Builder
+//
+
+struct URLRouter::Table::Builder {
+  Kind kind;
+  std::string label;
+  int value = -1;
+  std::vector<std::unique_ptr<Builder>> statics;
+  std::unique_ptr<Builder> param;
+  std::unique_ptr<Builder> label_wildcard;
+  std::unique_ptr<Builder> segment_wildcard;
+  std::unique_ptr<Builder> rest;
+
+  Builder(Kind k, const std::string &l = std::string()) : kind(k), label(l) {}
+
+  auto insert(const Token &token) -> Builder* {
+    switch (token.kind) {
+      case Kind::STATIC: return insert(token.text.c_str(), token.text.length());
+      case Kind::PARAM: return insert(param, token);
+      case Kind::LABEL: return insert(label_wildcard, token);
+      case Kind::SEGMENT: return insert(segment_wildcard, token);
+      case Kind::REST: return insert(rest, token);
+    }
+    return nullptr;
+  }
+
+  auto insert(const char *str, size_t len) -> Builder* {
+    auto node = this;
+    while (len > 0) {
+      std::unique_ptr<Builder> *slot = nullptr;
+      for (auto &c : node->statics) {
+        if (c->label[0] == *str) {
+          slot = &c;
+          break;
+        }
+      }
+      if (!slot) {
+        node->statics.emplace_back(new Builder(Kind::STATIC, std::string(str, len)));
+        return node->statics.back().get();
+      }
+      auto &label = (*slot)->label;
+      size_t n = 0;
+      while (n < len && n < label.length() && label[n] == str[n]) n++;
+      if (n < label.length()) {
+        auto *mid = new Builder(Kind::STATIC, label.substr(0, n));
+        label.erase(0, n);
+        mid->statics.push_back(std::move(*slot));
+        slot->reset(mid);
+      }
+      node = slot->get();
+      str += n;
+      len -= n;
+    }
+    return node;
+  }
+
+  auto insert(std::unique_ptr<Builder> &slot, const Token &token) -> Builder* {
+    if (!slot) slot.reset(new Builder(token.kind));
+    return slot.get();
+  }
+};
+
+//
+// URLRouter::Table
+//
+
+URLRouter::Table::Table(const std::vector<std::string> &patterns) {
+  Builder root(Kind::STATIC);
+  std::vector<Token> tokens;
+
+  //
+  // Routes sharing a ":param" node may name it differently, so names
+  // are kept per route rather than on the node.
+  //
+
+  m_route_names.resize(patterns.size());
+  for (int i = 0; i < int(patterns.size()); i++) {
+    tokens.clear();
+    tokenize(patterns[i], tokens);
+    auto *node = &root;
+    for (const auto &t : tokens) {
+      node = node->insert(t);
+      if (t.kind == Kind::PARAM || t.kind == Kind::REST) {
+        auto n = std::find(m_names.begin(), m_names.end(), t.text);
+        m_route_names[i].push_back(n - m_names.begin());
+        if (n == m_names.end()) m_names.push_back(t.text);
+      }
+    }
+    node->value = i;
+  }
+  flatten(&root);
+}
+
+void URLRouter::Table::validate(const std::string &pattern) {
+  std::vector<Token> tokens;
+  tokenize(pattern, tokens);
+}
+
+void URLRouter::Table::tokenize(const std::string &pattern, std::vector<Token> &tokens) {
+  auto path_start = pattern.find_first_of('/');
+  if (path_start == std::string::npos || pattern.find_first_of(':') < path_start) {
+    throw std::runtime_error("invalid URL pattern");
+  }
+
+  auto literal = [&](const std::string &str, size_t pos, size_t len) {
+    if (!tokens.empty() && tokens.back().kind == Kind::STATIC) {
+      tokens.back().text.append(str, pos, len);
+    } else {
+      tokens.push_back({ Kind::STATIC, str.substr(pos, len) });
+    }
+  };
+
+  for (size_t i = 0; i < path_start;) {
+    auto j = pattern.find_first_of('.', i);
+    if (j > path_start) j = path_start;
+    if (i > 0) literal(pattern, i - 1, 1);
+    if (j - i == 1 && pattern[i] == '*') {
+      tokens.push_back({ Kind::LABEL, std::string() });
+    } else {
+      literal(pattern, i, j - i);
+    }
+    i = j + 1;
+  }
+
+  for (size_t i = path_start; i < pattern.length();) {
+    auto j = pattern.find_first_of('/', i + 1);
+    if (j == std::string::npos) j = pattern.length();
+    auto seg = i + 1;
+    auto len = j - seg;
+    if (len == 1 && pattern[seg] == '*') {
+      if (j == pattern.length()) {
+        tokens.push_back({ Kind::REST, "*" });
+      } else {
+        literal(pattern, i, 1);
+        tokens.push_back({ Kind::SEGMENT, std::string() });
+      }
+    } else if (len > 1 && pattern[seg] == ':') {
+      literal(pattern, i, 1);
+      tokens.push_back({ Kind::PARAM, pattern.substr(seg + 1, len - 1) });
+    } else {
+      literal(pattern, i, j - i);
+    }
+    i = j;
+  }
+}
+
+auto URLRouter::Table::flatten(Builder *builder) -> int {
+  Node node;
+  node.kind = builder->kind;
+  node.value = builder->value;
+  node.label = m_labels.length();
+  node.label_len = builder->label.length();
+  m_labels += builder->label;
+
+  auto index = int(m_nodes.size());
+  m_nodes.push_back(node);
+
+  auto &statics = builder->statics;
+  std::sort(
+    statics.begin(), statics.end(),
+    [](const std::unique_ptr<Builder> &a, const std::unique_ptr<Builder> &b) {
+      return uint8_t(a->label[0]) < uint8_t(b->label[0]);
+    }
+  );
+
+  node.first_edge = m_edges.size();
+  node.edge_count = statics.size();
+  m_edges.resize(node.first_edge + node.edge_count);
+  m_edge_bytes.resize(node.first_edge + node.edge_count);
+
+  for (int i = 0; i < node.edge_count; i++) {
+    auto *child = statics[i].get();
+    auto child_index = flatten(child);
+    m_edge_bytes[node.first_edge + i] = child->label[0];
+    m_edges[node.first_edge + i] = child_index;
+  }
+
+  if (builder->param) node.param = flatten(builder->param.get());
+  if (builder->label_wildcard) node.label_wildcard = flatten(builder->label_wildcard.get());
+  if (builder->segment_wildcard) node.segment_wildcard = flatten(builder->segment_wildcard.get());
+  if (builder->rest) node.rest = flatten(builder->rest.get());
+
+  m_nodes[index] = node;
+  return index;
+}
+
+auto URLRouter::Table::find(const char *str, int len, Match &m) const -> int {
+  return match(0, str, len, 0, m);
+}
+
+auto URLRouter::Table::match(int index, const char *str, int len, int pos, Match &m) const -> int {
+  const auto &node = m_nodes[index];
+
+  auto end = pos;
+  switch (node.kind) {
+    case Kind::STATIC:
+      if (len - pos < node.label_len) return -1;
+      if (std::memcmp(str + pos, m_labels.c_str() + node.label, node.label_len)) return -1;
+      end = pos + node.label_len;
+      break;
+    case Kind::PARAM:
+    case Kind::SEGMENT:
+      while (end < len && str[end] != '/') end++;
+      if (end == pos) return -1;
+      break;
+    case Kind::LABEL:
+      while (end < len && str[end] != '.' && str[end] != '/') end++;
+      if (end == pos) return -1;
+      break;
+    case Kind::REST:
+      if (pos < len && str[pos] != '/') return -1;
+      if (pos < len) pos++;
+      end = len;
+      break;
+  }
+
+  auto count = m.count;
+  if ((node.kind == Kind::PARAM || node.kind == Kind::REST) && count < MAX_CAPTURES) {
+    m.captures[m.count++] = { pos, end };
+  }
+
+  if (end == len && node.value >= 0) return node.value;
+
+  if (end < len && node.edge_count > 0) {
+    auto *bytes = m_edge_bytes.data() + node.first_edge;
+    auto *p = std::lower_bound(bytes, bytes + node.edge_count, uint8_t(str[end]));
+    if (p < bytes + node.edge_count && *p == uint8_t(str[end])) {
+      auto i = match(m_edges[node.first_edge + (p - bytes)], str, len, end, m);
+      if (i >= 0) return i;
+    }
+  }
+
+  for (auto next : { node.param, node.label_wildcard, node.segment_wildcard, node.rest }) {
+    if (next >= 0) {
+      auto i = match(next, str, len, end, m);
+      if (i >= 0) return i;
+    }
+  }
+
+  m.count = count;
+  return -1;
+}
+
+//
+// IPTrie
+//
+
+IPTrie::IPTrie(const pjs::Value &entries) {
+  parse(entries, m_prefixes, m_values);
+}
+
+IPTrie::~IPTrie() {
+}
+
+void IPTrie::add(const std::string &cidr, const pjs::Value &value) {
+  Prefix p;
+  parse_cidr(cidr, p);
+  p.value = m_values.size();
+  m_prefixes.push_back(p);
+  m_values.push_back(value);
+  if (m_table) own_table()->add(p);
+
+  // Also goes into the table being reloaded
+  if (m_reload) {
+    p.value = m_pending_values.size();
+    m_pending_prefixes.push_back(p);
+    m_pending_values.push_back(value);
+  }
+}
+
+void IPTrie::reload(const pjs::Value &entries) {
+  std::vector<Prefix> prefixes;
+  std::vector<pjs::Value> values;
+  parse(entries, prefixes, values);
+
+  if (!Net::main().is_running() || &Net::current() == &Net::main()) {
+    m_table = std::make_shared<Table>(prefixes);
+    m_table_shared = false;
+    m_prefixes = std::move(prefixes);
+    m_values = std::move(values);
+    m_pending_prefixes.clear();
+    m_pending_values.clear();
+    m_reload = nullptr;
+    return;
+  }
+
+  //
+  // Same as URLRouter::reload(), build the new table on the TableBuilder
+  // thread while lookups keep using the current table until the new
+  // one is picked up.
+  //
+
+  std::string key("ip");
+  for (const auto &p : prefixes) {
+    char buf[sizeof(p.ip) + 6];
+    std::memcpy(buf, p.ip, sizeof(p.ip));
+    buf[16] = p.bits;
+    buf[17] = p.v6;
+    buf[18] = p.value >> 24;
+    buf[19] = p.value >> 16;
+    buf[20] = p.value >> 8;
+    buf[21] = p.value >> 0;
+    key.append(buf, sizeof(buf));
+  }
+
+  m_pending_prefixes = prefixes;
+  m_pending_values = std::move(values);
+  m_reload = std::static_pointer_cast<Reload>(
+    TableBuilder::submit(key, [&]() { return std::make_shared<Reload>(prefixes); })
+  );
+}
+
+void IPTrie::Reload::build() {
+  table = std::make_shared<Table>(prefixes);
+  prefixes.clear();
+  prefixes.shrink_to_fit();
+}
+
+bool IPTrie::find(const std::string &ip, pjs::Value &value) {
+  uint8_t buf[16];
+  if (inet_pton(AF_INET, ip.c_str(), buf) == 1) {
+    return find(buf, 4, value);
+  } else if (inet_pton(AF_INET6, ip.c_str(), buf) == 1) {
+    return find(buf, 16, value);
+  }
+  return false;
+}
+
+bool IPTrie::find(const uint8_t *ip, size_t len, pjs::Value &value) {
+  static const uint8_t v4_mapped[12] = { 0,0,0,0,0,0,0,0,0,0,0xff,0xff };
+  if (len == 16 && !std::memcmp(ip, v4_mapped, sizeof(v4_mapped))) {
+    ip += 12;
+    len = 4;
+  }
+
+  int i = -1;
+  if (len == 4) {
+    i = table()->find_v4(
+      (uint32_t)ip[0] << 24 |
+      (uint32_t)ip[1] << 16 |
+      (uint32_t)ip[2] <<  8 |
+      (uint32_t)ip[3] <<  0
+    );
+  } else if (len == 16) {
+    i = table()->find_v6(ip);
+  }
+
+  if (i < 0) return false;
+  value = m_values[i];
+  return true;
+}
+
+auto IPTrie::table() -> Table* {
+  if (m_reload && m_reload->done()) {
+    m_table = m_reload->table;
+    m_table_shared = true;
+    m_prefixes = std::move(m_pending_prefixes);
+    m_values = std::move(m_pending_values);
+    m_pending_prefixes.clear();
+    m_pending_values.clear();
+    for (auto i = m_reload->size; i < m_prefixes.size(); i++) {
+      own_table()->add(m_prefixes[i]); // Added while reloading
+    }
+    m_reload = nullptr;
+  }
+  if (!m_table) {
+    m_table = std::make_shared<Table>(m_prefixes);
+    m_table_shared = false;
+  }
+  return m_table.get();
+}
+
+auto IPTrie::own_table() -> Table* {
+  if (m_table_shared) {
+    m_table = std::make_shared<Table>(*m_table);
+    m_table_shared = false;
+  }
+  return m_table.get();
+}
+
+void IPTrie::parse(const pjs::Value &entries, std::vector<Prefix> &prefixes, std::vector<pjs::Value> &values) {
+  auto add = [&](const std::string &cidr, const pjs::Value &value) {
+    Prefix p;
+    parse_cidr(cidr, p);
+    p.value = values.size();
+    prefixes.push_back(p);
+    values.push_back(value);
+  };
+
+  if (entries.is_nullish()) return;
+
+  if (entries.is<pipy::Data>()) {
+    auto text = entries.as<pipy::Data>()->to_string();
+    size_t i = 0;
+    while (i < text.length()) {
+      auto j = text.find('\n', i);
+      if (j == std::string::npos) j = text.length();
+      auto line = utils::trim(text.substr(i, j - i));
+      i = j + 1;
+      if (line.empty() || line[0] == '#') continue;
+      auto k = line.find_first_of(" \t");
+      if (k == std::string::npos) {
+        add(line, true);
+      } else {
+        add(line.substr(0, k), pjs::Str::make(utils::trim(line.substr(k))));
+      }
+    }
+
+  } else if (entries.is_array()) {
+    entries.as<pjs::Array>()->iterate_all(
+      [&](pjs::Value &v, int) {
+        if (v.is_string()) {
+          add(v.s()->str(), true);
+        } else if (v.is_array()) {
+          pjs::Value cidr, value;
+          v.as<pjs::Array>()->get(0, cidr);
+          v.as<pjs::Array>()->get(1, value);
+          if (!cidr.is_string()) throw std::runtime_error("CIDR must be a string");
+          add(cidr.s()->str(), value);
+        } else {
+          throw std::runtime_error("IPTrie entry must be a string or [cidr, value]");
+        }
+      }
+    );
+
+  } else if (entries.is_object()) {
+    entries.o()->iterate_all(
+      [&](pjs::Str *k, pjs::Value &v) {
+        add(k->str(), v);
+      }
+    );
+
+  } else {
+    throw std::runtime_error("IPTrie entries must be an object, an array or a Data");
+  }
+}
+
+void IPTrie::parse_cidr(const std::string &cidr, Prefix &prefix) {
+  auto p = cidr.find('/');
+  auto ip = cidr.substr(0, p);
+
+  std::memset(prefix.ip, 0, sizeof(prefix.ip));
+  if (inet_pton(AF_INET, ip.c_str(), prefix.ip) == 1) {
+    prefix.v6 = false;
+    prefix.bits = 32;
+  } else if (inet_pton(AF_INET6, ip.c_str(), prefix.ip) == 1) {
+    prefix.v6 = true;
+    prefix.bits = 128;
+  } else {
+    throw std::runtime_error("invalid CIDR: " + cidr);
+  }
+
+  if (p != std::string::npos) {
+    char *end = nullptr;
+    auto bits = std::strtol(cidr.c_str() + p + 1, &end, 10);
+    if (end == cidr.c_str() + p + 1 || *end || bits < 0 || bits > prefix.bits) {
+      throw std::runtime_error("invalid CIDR: " + cidr);
+    }
+    prefix.bits = bits;
+  }
+
+  for (int i = 0; i < 16; i++) {
+    auto n = prefix.bits - i * 8;
+    if (n <= 0) prefix.ip[i] = 0;
+    else if (n < 8) prefix.ip[i] &= 0xff << (8 - n);
+  }
+}
+
+//
+// IPTrie::Table
+//
+
+static inline auto ip6_hi(const uint8_t ip[16]) -> uint64_t {
+  uint64_t n = 0;
+  for (int i = 0; i < 8; i++) n = (n << 8) | ip[i];
+  return n;
+}
+
+static inline auto ip6_lo(const uint8_t ip[16]) -> uint64_t {
+  uint64_t n = 0;
+  for (int i = 8; i < 16; i++) n = (n << 8) | ip[i];
+  return n;
+}
+
+static inline auto ip6_mask_hi(int bits) -> uint64_t {
+  return bits >= 64 ? ~0ull : bits <= 0 ? 0 : ~0ull << (64 - bits);
+}
+
+static inline auto ip6_mask_lo(int bits) -> uint64_t {
+  return bits >= 128 ? ~0ull : bits <= 64 ? 0 : ~0ull << (128 - bits);
+}
+
+static inline auto ip6_bit(uint64_t hi, uint64_t lo, int i) -> int {
+  return i < 64 ? (hi >> (63 - i)) & 1 : (lo >> (127 - i)) & 1;
+}
+
+static inline auto ip6_common(uint64_t hi1, uint64_t lo1, uint64_t hi2, uint64_t lo2) -> int {
+  if (auto x = hi1 ^ hi2) return __builtin_clzll(x);
+  if (auto x = lo1 ^ lo2) return 64 + __builtin_clzll(x);
+  return 128;
+}
+
+IPTrie::Table::Table(const std::vector<Prefix> &prefixes) {
+  for (const auto &p : prefixes) add(p);
+}
+
+void IPTrie::Table::add(const Prefix &p) {
+  if (p.v6) {
+    insert_v6(p);
+  } else {
+    insert_v4(p);
+  }
+}
+
+auto IPTrie::Table::find_v4(uint32_t ip) const -> int {
+  if (m_v4_root.empty()) return -1;
+  auto e = m_v4_root[ip >> 16];
+  if (e & CHUNK) {
+    e = m_v4_chunks[((e & ~CHUNK) << 8) + ((ip >> 8) & 0xff)];
+    if (e & CHUNK) {
+      e = m_v4_chunks[((e & ~CHUNK) << 8) + (ip & 0xff)];
+    }
+  }
+  return int(e) - 1;
+}
+
+auto IPTrie::Table::find_v6(const uint8_t ip[16]) const -> int {
+  if (m_v6_nodes.empty()) return -1;
+  auto hi = ip6_hi(ip);
+  auto lo = ip6_lo(ip);
+  int best = -1;
+  int i = 0;
+  while (i >= 0) {
+    const auto &n = m_v6_nodes[i];
+    if ((hi ^ n.hi) & ip6_mask_hi(n.bits)) break;
+    if ((lo ^ n.lo) & ip6_mask_lo(n.bits)) break;
+    if (n.value >= 0) best = n.value;
+    if (n.bits >= 128) break;
+    i = n.child[ip6_bit(hi, lo, n.bits)];
+  }
+  return best;
+}
+
+void IPTrie::Table::insert_v4(const Prefix &p) {
+  if (m_v4_root.empty()) {
+    m_v4_root.resize(0x10000, 0);
+    m_v4_root_bits.resize(0x10000, 0);
+  }
+
+  uint32_t ip = (uint32_t)p.ip[0] << 24 | (uint32_t)p.ip[1] << 16 | (uint32_t)p.ip[2] << 8 | p.ip[3];
+  uint32_t entry = p.value + 1;
+
+  if (p.bits <= 16) {
+    fill_v4(m_v4_root, m_v4_root_bits, ip >> 16, 1u << (16 - p.bits), entry, p.bits);
+    return;
+  }
+
+  auto r = ip >> 16;
+  if (!(m_v4_root[r] & CHUNK)) {
+    auto c = new_chunk(m_v4_root[r], m_v4_root_bits[r]);
+    m_v4_root[r] = CHUNK | c;
+  }
+  auto i = ((m_v4_root[r] & ~CHUNK) << 8) + ((ip >> 8) & 0xff);
+
+  if (p.bits <= 24) {
+    fill_v4(m_v4_chunks, m_v4_chunk_bits, i, 1u << (24 - p.bits), entry, p.bits);
+    return;
+  }
+
+  if (!(m_v4_chunks[i] & CHUNK)) {
+    auto c = new_chunk(m_v4_chunks[i], m_v4_chunk_bits[i]);
+    m_v4_chunks[i] = CHUNK | c;
+  }
+  auto j = ((m_v4_chunks[i] & ~CHUNK) << 8) + (ip & 0xff);
+  fill_v4(m_v4_chunks, m_v4_chunk_bits, j, 1u << (32 - p.bits), entry, p.bits);
+}
+
+//
+// Entries from longer prefixes are left alone, including the ones down
+// in chunks, while a prefix of the same length replaces an earlier one.
+//
+
+void IPTrie::Table::fill_v4(std::vector<uint32_t> &entries, std::vector<uint8_t> &bits, uint32_t i, uint32_t n, uint32_t entry, int len) {
+  for (auto end = i + n; i < end; i++) {
+    auto e = entries[i];
+    if (e & CHUNK) {
+      fill_v4(m_v4_chunks, m_v4_chunk_bits, (e & ~CHUNK) << 8, 0x100, entry, len);
+    } else if (bits[i] <= len) {
+      entries[i] = entry;
+      bits[i] = len;
+    }
+  }
+}
+
+void IPTrie::Table::insert_v6(const Prefix &p) {
+  if (m_v6_nodes.empty()) m_v6_nodes.emplace_back();
+
+  auto hi = ip6_hi(p.ip);
+  auto lo = ip6_lo(p.ip);
+
+  auto new_node = [&](uint64_t hi, uint64_t lo, int bits, int value) -> int {
+    Node n;
+    n.hi = hi & ip6_mask_hi(bits);
+    n.lo = lo & ip6_mask_lo(bits);
+    n.bits = bits;
+    n.value = value;
+    m_v6_nodes.push_back(n);
+    return m_v6_nodes.size() - 1;
+  };
+
+  int i = 0;
+  for (;;) {
+    if (p.bits == m_v6_nodes[i].bits) {
+      m_v6_nodes[i].value = p.value;
+      return;
+    }
+
+    auto b = ip6_bit(hi, lo, m_v6_nodes[i].bits);
+    auto c = m_v6_nodes[i].child[b];
+    if (c < 0) {
+      auto leaf = new_node(hi, lo, p.bits, p.value);
+      m_v6_nodes[i].child[b] = leaf;
+      return;
+    }
+
+    const auto &child = m_v6_nodes[c];
+    auto common = std::min(ip6_common(hi, lo, child.hi, child.lo), std::min(p.bits, child.bits));
+    if (common == child.bits) {
+      i = c;
+      continue;
+    }
+
+    auto child_hi = child.hi;
+    auto child_lo = child.lo;
+    if (common == p.bits) {
+      auto n = new_node(hi, lo, p.bits, p.value);
+      m_v6_nodes[n].child[ip6_bit(child_hi, child_lo, common)] = c;
+      m_v6_nodes[i].child[b] = n;
+    } else {
+      auto fork = new_node(hi, lo, common, -1);
+      auto leaf = new_node(hi, lo, p.bits, p.value);
+      m_v6_nodes[fork].child[ip6_bit(hi, lo, common)] = leaf;
+      m_v6_nodes[fork].child[ip6_bit(child_hi, child_lo, common)] = c;
+      m_v6_nodes[i].child[b] = fork;
+    }
+    return;
+  }
+}
+
+auto IPTrie::Table::new_chunk(uint32_t entry, int len) -> uint32_t {
+  auto n = m_v4_chunks.size();
+  m_v4_chunks.resize(n + 0x100, entry);
+  m_v4_chunk_bits.resize(n + 0x100, len);
+  return n >> 8;
+}
+
+//
+// LoadBalancer
+//
+
+LoadBalancer::~LoadBalancer() {
+  for (const auto &i : m_sessions) {
+    delete i.second;
+  }
+  for (const auto &i : m_targets) {
     auto &resources = i.second->resources;
     while (auto r = resources.head()) {
       resources.remove(r);
@@ -561,6 +2006,161 @@ auto HashingLoadBalancer::select(const pjs::Value &key, Cache *unhealthy) -> pjs
   return s;
 }
 
+//
+// ConsistentHashingLoadBalancer::Options
+//
+
+ConsistentHashingLoadBalancer::Options::Options(pjs::Object *options) {
+  Value(options, "tableSize")
+    .get(table_size)
+    .check_nullable();
+  if (table_size < 2) {
+    throw std::runtime_error("options.tableSize expected to be at least 2");
+  }
+}
+
+//
+// ConsistentHashingLoadBalancer
+//
+// Targets are laid out in a Maglev lookup table: every target walks its
+// own permutation of the table slots, taking turns to claim free slots in
+// proportion to its weight, until the table is full. Selection is then a
+// single table lookup, and changing one target only moves the slots that
+// target gains or loses, plus a small fraction of the others.
+//
+
+static auto consistent_hash(const std::string &str, uint64_t seed) -> uint64_t {
+  uint64_t h = 14695981039346656037ull ^ seed;
+  for (auto c : str) {
+    h ^= (uint8_t)c;
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+static auto consistent_mix(uint64_t h) -> uint64_t {
+  h += 0x9e3779b97f4a7c15ull;
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+  return h ^ (h >> 31);
+}
+
+ConsistentHashingLoadBalancer::ConsistentHashingLoadBalancer(pjs::Object *targets, Cache *unhealthy, const Options &options)
+  : pjs::ObjectTemplate<ConsistentHashingLoadBalancer, LoadBalancer>(unhealthy)
+  , m_options(options)
+{
+  auto is_prime = [](int n) {
+    for (int i = 2; i * i <= n; i++) if (n % i == 0) return false;
+    return true;
+  };
+
+  while (!is_prime(m_options.table_size)) m_options.table_size++;
+
+  if (targets) {
+    if (targets->is_array()) {
+      targets->as<pjs::Array>()->iterate_all(
+        [this](pjs::Value &v, int) {
+          auto *s = v.to_string();
+          set(s, 1);
+          s->release();
+        }
+      );
+    } else {
+      targets->iterate_all(
+        [this](pjs::Str *k, pjs::Value &v) {
+          set(k, v.to_number());
+        }
+      );
+    }
+  }
+}
+
+ConsistentHashingLoadBalancer::~ConsistentHashingLoadBalancer()
+{
+}
+
+void ConsistentHashingLoadBalancer::set(pjs::Str *target, int weight) {
+  if (weight < 0) weight = 0;
+  for (auto &t : m_targets) {
+    if (t.id == target) {
+      if (t.weight != weight) {
+        t.weight = weight;
+        m_table_dirty = true;
+      }
+      return;
+    }
+  }
+  m_targets.push_back({ target, weight });
+  m_table_dirty = true;
+}
+
+auto ConsistentHashingLoadBalancer::select(const pjs::Value &key, Cache *unhealthy) -> pjs::Str* {
+  if (m_table_dirty) build_table();
+  if (m_table.empty()) return nullptr;
+
+  std::hash<pjs::Value> hash;
+  uint64_t h = consistent_mix(hash(key));
+  auto size = m_table.size();
+
+  for (size_t i = 0, n = m_targets.size() * 2; i < n; i++) {
+    auto *s = m_targets[m_table[h % size]].id.get();
+    if (is_healthy(s, unhealthy)) return s;
+    h = consistent_mix(h);
+  }
+
+  return nullptr;
+}
+
+void ConsistentHashingLoadBalancer::build_table() {
+  m_table_dirty = false;
+  m_table.clear();
+
+  struct Permutation {
+    int target;
+    int weight;
+    int credit;
+    uint64_t offset;
+    uint64_t skip;
+    uint64_t next;
+  };
+
+  uint64_t size = m_options.table_size;
+  std::vector<Permutation> permutations;
+  int max_weight = 0;
+
+  for (int i = 0; i < int(m_targets.size()); i++) {
+    const auto &t = m_targets[i];
+    if (t.weight <= 0) continue;
+    const auto &name = t.id->str();
+    permutations.push_back({
+      i, t.weight, 0,
+      consistent_hash(name, 0) % size,
+      consistent_hash(name, 1) % (size - 1) + 1,
+      0,
+    });
+    max_weight = std::max(max_weight, t.weight);
+  }
+
+  if (permutations.empty()) return;
+
+  m_table.resize(size, -1);
+
+  for (uint64_t filled = 0;;) {
+    for (auto &p : permutations) {
+      p.credit += p.weight;
+      while (p.credit >= max_weight) {
+        p.credit -= max_weight;
+        uint64_t slot;
+        do {
+          slot = (p.offset + p.next++ * p.skip) % size;
+        } while (m_table[slot] >= 0);
+        m_table[slot] = p.target;
+        if (++filled == size) return;
+      }
+    }
+  }
+}
+
 //
 // RoundRobinLoadBalancer
 //
@@ -672,20 +2272,170 @@ auto RoundRobinLoadBalancer::select(const pjs::Value &key, Cache *unhealthy) ->
     }
   }
 
-  if (!key.is_undefined()) {
-    m_target_cache->set(key, p->id.get());
+  if (!key.is_undefined()) {
+    m_target_cache->set(key, p->id.get());
+  }
+
+  return p->id;
+}
+
+//
+// LeastWorkLoadBalancer
+//
+
+LeastWorkLoadBalancer::LeastWorkLoadBalancer(pjs::Object *targets, Cache *unhealthy)
+  : pjs::ObjectTemplate<LeastWorkLoadBalancer, LoadBalancer>(unhealthy)
+{
+  if (targets) {
+    if (targets->is_array()) {
+      targets->as<pjs::Array>()->iterate_all(
+        [this](pjs::Value &v, int) {
+          auto *s = v.to_string();
+          set(s, 1);
+          s->release();
+        }
+      );
+    } else {
+      targets->iterate_all(
+        [this](pjs::Str *k, pjs::Value &v) {
+          set(k, v.to_number());
+        }
+      );
+    }
+  }
+}
+
+LeastWorkLoadBalancer::~LeastWorkLoadBalancer()
+{
+}
+
+void LeastWorkLoadBalancer::set(pjs::Str *target, double weight) {
+  if (weight < 0) weight = 0;
+
+  auto i = m_targets.find(target);
+  if (i == m_targets.end()) {
+    auto &t = m_targets[target];
+    t.weight = weight;
+    t.hits = 0;
+    t.usage = 0;
+  } else {
+    auto &t = i->second;
+    t.weight = weight;
+    t.usage = double(t.hits) / weight;
+  }
+}
+
+auto LeastWorkLoadBalancer::select(const pjs::Value &key, Cache *unhealthy) -> pjs::Str* {
+  if (!key.is_undefined()) {
+    if (!m_target_cache) {
+      Cache::Options options;
+      m_target_cache = Cache::make(options);
+    }
+    pjs::Value target;
+    if (m_target_cache->get(key, target)) {
+      return target.s();
+    }
+  }
+
+  double min = 0;
+  std::map<pjs::Ref<pjs::Str>, Target>::value_type *p = nullptr;
+  for (auto &i : m_targets) {
+    auto &t = i.second;
+    if (t.weight <= 0) continue;
+    if (!is_healthy(i.first.get(), unhealthy)) continue;
+    if (!p || t.usage < min) {
+      min = t.usage;
+      p = &i;
+    }
+  }
+
+  if (!p) return nullptr;
+
+  auto &t = p->second;
+  t.hits++;
+  t.usage = double(t.hits) / t.weight;
+
+  if (!key.is_undefined()) {
+    m_target_cache->set(key, p->first.get());
+  }
+
+  return p->first;
+}
+
+void LeastWorkLoadBalancer::deselect(pjs::Str *target) {
+  if (target) {
+    auto i = m_targets.find(target);
+    if (i != m_targets.end()) {
+      auto &t = i->second;
+      if (t.hits > 0) {
+        t.hits--;
+        t.usage = double(t.hits) / t.weight;
+      }
+    }
+  }
+}
+
+//
+// ResourcePool
+//
+
+void ResourcePool::allocate(pjs::Context &ctx, const pjs::Value &tag, pjs::Value &resource) {
+  auto &p = m_pools[tag];
+  if (p.empty()) {
+    pjs::Value arg(tag);
+    (*m_allocator)(ctx, 1, &arg, resource);
+    if (!ctx.ok()) return;
+  } else {
+    resource = p.front();
+    p.pop_front();
+  }
+
+  m_allocated[resource].tag = tag;
+}
+
+void ResourcePool::free(const pjs::Value &resource) {
+  auto i = m_allocated.find(resource);
+  if (i == m_allocated.end()) return;
+  auto &a = i->second;
+  m_pools[a.tag].push_back(resource);
+  m_allocated.erase(i);
+}
+
+//
+// EWMALoadBalancer::Options
+//
+
+EWMALoadBalancer::Options::Options(pjs::Object *options) {
+  Value(options, "decay")
+    .get_seconds(decay)
+    .check_nullable();
+  Value(options, "name")
+    .get(name)
+    .check_nullable();
+  if (decay <= 0) {
+    throw std::runtime_error("options.decay expected to be greater than 0");
   }
-
-  return p->id;
 }
 
 //
-// LeastWorkLoadBalancer
+// EWMALoadBalancer
+//
+// Picks the cheaper of two randomly sampled targets, where the cost is the
+// decaying average of observed latency multiplied by the number of
+// in-flight requests. Latency is measured from select() to the matching
+// deselect(), pairing them in FIFO order per target.
 //
 
-LeastWorkLoadBalancer::LeastWorkLoadBalancer(pjs::Object *targets, Cache *unhealthy)
-  : pjs::ObjectTemplate<LeastWorkLoadBalancer, LoadBalancer>(unhealthy)
+thread_local static std::set<EWMALoadBalancer*> s_ewma_load_balancers;
+thread_local static pjs::Ref<stats::Gauge> s_metric_ewma_latency;
+thread_local static pjs::Ref<stats::Gauge> s_metric_ewma_inflight;
+
+EWMALoadBalancer::EWMALoadBalancer(pjs::Object *targets, Cache *unhealthy, const Options &options)
+  : pjs::ObjectTemplate<EWMALoadBalancer, LoadBalancer>(unhealthy)
+  , m_options(options)
+  , m_rand(std::random_device()())
 {
+  if (!m_options.name) m_options.name = pjs::Str::empty;
   if (targets) {
     if (targets->is_array()) {
       targets->as<pjs::Array>()->iterate_all(
@@ -703,29 +2453,31 @@ LeastWorkLoadBalancer::LeastWorkLoadBalancer(pjs::Object *targets, Cache *unheal
       );
     }
   }
+
+  init_metrics();
+  s_ewma_load_balancers.insert(this);
 }
 
-LeastWorkLoadBalancer::~LeastWorkLoadBalancer()
-{
+EWMALoadBalancer::~EWMALoadBalancer() {
+  s_ewma_load_balancers.erase(this);
 }
 
-void LeastWorkLoadBalancer::set(pjs::Str *target, double weight) {
+void EWMALoadBalancer::set(pjs::Str *target, double weight) {
   if (weight < 0) weight = 0;
 
-  auto i = m_targets.find(target);
-  if (i == m_targets.end()) {
-    auto &t = m_targets[target];
+  auto i = m_target_map.find(target);
+  if (i == m_target_map.end()) {
+    m_target_map[target] = m_targets.size();
+    m_targets.emplace_back();
+    auto &t = m_targets.back();
+    t.id = target;
     t.weight = weight;
-    t.hits = 0;
-    t.usage = 0;
   } else {
-    auto &t = i->second;
-    t.weight = weight;
-    t.usage = double(t.hits) / weight;
+    m_targets[i->second].weight = weight;
   }
 }
 
-auto LeastWorkLoadBalancer::select(const pjs::Value &key, Cache *unhealthy) -> pjs::Str* {
+auto EWMALoadBalancer::select(const pjs::Value &key, Cache *unhealthy) -> pjs::Str* {
   if (!key.is_undefined()) {
     if (!m_target_cache) {
       Cache::Options options;
@@ -733,72 +2485,160 @@ auto LeastWorkLoadBalancer::select(const pjs::Value &key, Cache *unhealthy) -> p
     }
     pjs::Value target;
     if (m_target_cache->get(key, target)) {
-      return target.s();
+      auto i = m_target_map.find(target.s());
+      if (i != m_target_map.end()) {
+        start(m_targets[i->second], utils::now());
+        return target.s();
+      }
     }
   }
 
-  double min = 0;
-  std::map<pjs::Ref<pjs::Str>, Target>::value_type *p = nullptr;
-  for (auto &i : m_targets) {
-    auto &t = i.second;
-    if (t.weight <= 0) continue;
-    if (!is_healthy(i.first.get(), unhealthy)) continue;
-    if (!p || t.usage < min) {
-      min = t.usage;
-      p = &i;
+  auto n = m_targets.size();
+  if (!n) return nullptr;
+
+  Target *p = nullptr;
+  auto now = utils::now();
+
+  for (int tries = 0; tries < 3 && !p; tries++) {
+    auto i = m_rand() % n;
+    auto j = n > 1 ? (i + 1 + m_rand() % (n - 1)) % n : i;
+    auto *a = &m_targets[i];
+    auto *b = &m_targets[j];
+    if (!is_available(*a, unhealthy)) a = nullptr;
+    if (!is_available(*b, unhealthy)) b = nullptr;
+    if (a && b) {
+      p = cost(*b, now) < cost(*a, now) ? b : a;
+    } else {
+      p = a ? a : b;
+    }
+  }
+
+  //
+  // Mostly unavailable targets: fall back to a full scan.
+  //
+
+  if (!p) {
+    for (auto &t : m_targets) {
+      if (!is_available(t, unhealthy)) continue;
+      if (!p || cost(t, now) < cost(*p, now)) p = &t;
     }
   }
 
   if (!p) return nullptr;
 
-  auto &t = p->second;
-  t.hits++;
-  t.usage = double(t.hits) / t.weight;
+  start(*p, now);
 
   if (!key.is_undefined()) {
-    m_target_cache->set(key, p->first.get());
+    m_target_cache->set(key, p->id.get());
   }
 
-  return p->first;
+  return p->id;
 }
 
-void LeastWorkLoadBalancer::deselect(pjs::Str *target) {
+void EWMALoadBalancer::deselect(pjs::Str *target) {
   if (target) {
-    auto i = m_targets.find(target);
-    if (i != m_targets.end()) {
-      auto &t = i->second;
-      if (t.hits > 0) {
-        t.hits--;
-        t.usage = double(t.hits) / t.weight;
+    auto i = m_target_map.find(target);
+    if (i != m_target_map.end()) {
+      auto &t = m_targets[i->second];
+      if (t.inflight > 0) t.inflight--;
+      if (!t.starts.empty()) {
+        auto now = utils::now();
+        observe(t, now - t.starts.front(), now);
+        t.starts.pop_front();
       }
     }
   }
 }
 
+bool EWMALoadBalancer::is_available(Target &t, Cache *unhealthy) {
+  return t.weight > 0 && is_healthy(t.id, unhealthy);
+}
+
 //
-// ResourcePool
+// Every select(), sticky or not, is paired with a deselect(), so
+// each of them has to record a start for the latency measurement.
 //
 
-void ResourcePool::allocate(pjs::Context &ctx, const pjs::Value &tag, pjs::Value &resource) {
-  auto &p = m_pools[tag];
-  if (p.empty()) {
-    pjs::Value arg(tag);
-    (*m_allocator)(ctx, 1, &arg, resource);
-    if (!ctx.ok()) return;
+void EWMALoadBalancer::start(Target &t, double now) {
+  t.inflight++;
+  t.starts.push_back(now);
+}
+
+//
+// The average keeps fading while a target is not picked, so that a target
+// that was slow once gets probed again after a while.
+//
+
+auto EWMALoadBalancer::cost(const Target &t, double now) const -> double {
+  auto ewma = t.ewma * std::exp((t.updated - now) / (m_options.decay * 1000));
+  return (ewma + 1) * (t.inflight + 1) / t.weight;
+}
+
+void EWMALoadBalancer::observe(Target &t, double latency, double now) {
+  if (t.updated > 0) {
+    auto w = std::exp((t.updated - now) / (m_options.decay * 1000));
+    t.ewma = t.ewma * w + latency * (1 - w);
   } else {
-    resource = p.front();
-    p.pop_front();
+    t.ewma = latency;
   }
-
-  m_allocated[resource].tag = tag;
+  t.updated = now;
 }
 
-void ResourcePool::free(const pjs::Value &resource) {
-  auto i = m_allocated.find(resource);
-  if (i == m_allocated.end()) return;
-  auto &a = i->second;
-  m_pools[a.tag].push_back(resource);
-  m_allocated.erase(i);
+void EWMALoadBalancer::init_metrics() {
+  if (s_metric_ewma_latency) return;
+
+  pjs::Ref<pjs::Array> label_names = pjs::Array::make(2);
+  label_names->set(0, "balancer");
+  label_names->set(1, "target");
+
+  //
+  // Balancers sharing a name add up to one "balancer" level, where
+  // latency is that of the slowest target and in-flight requests are
+  // the sum over all targets.
+  //
+
+  s_metric_ewma_latency = stats::Gauge::make(
+    pjs::Str::make("pipy_lb_ewma_latency"),
+    label_names,
+    [](stats::Gauge *gauge) {
+      for (auto *lb : s_ewma_load_balancers) {
+        pjs::Str *name = lb->m_options.name;
+        gauge->with_labels(&name, 1)->set(0);
+      }
+      for (auto *lb : s_ewma_load_balancers) {
+        pjs::Str *name = lb->m_options.name;
+        auto *balancer = gauge->with_labels(&name, 1);
+        for (auto &t : lb->m_targets) {
+          pjs::Str *labels[2] = { name, t.id };
+          gauge->with_labels(labels, 2)->set(t.ewma);
+          if (t.ewma > balancer->value()) balancer->set(t.ewma);
+        }
+      }
+    }
+  );
+
+  s_metric_ewma_inflight = stats::Gauge::make(
+    pjs::Str::make("pipy_lb_ewma_inflight_count"),
+    label_names,
+    [](stats::Gauge *gauge) {
+      double total = 0;
+      for (auto *lb : s_ewma_load_balancers) {
+        pjs::Str *name = lb->m_options.name;
+        gauge->with_labels(&name, 1)->set(0);
+      }
+      for (auto *lb : s_ewma_load_balancers) {
+        pjs::Str *name = lb->m_options.name;
+        auto *balancer = gauge->with_labels(&name, 1);
+        for (auto &t : lb->m_targets) {
+          pjs::Str *labels[2] = { name, t.id };
+          gauge->with_labels(labels, 2)->set(t.inflight);
+          balancer->increase(t.inflight);
+          total += t.inflight;
+        }
+      }
+      gauge->set(total);
+    }
+  );
 }
 
 //
@@ -850,12 +2690,10 @@ void Percentile::set(int bucket, size_t count) {
 }
 
 void Percentile::observe(double sample) {
-  for (size_t i = 0, n = m_counts.size(); i < n; i++) {
-    if (sample <= m_buckets[i]) {
-      m_counts[i]++;
-      m_sample_count++;
-      break;
-    }
+  auto i = std::lower_bound(m_buckets.begin(), m_buckets.end(), sample);
+  if (i != m_buckets.end()) {
+    m_counts[i - m_buckets.begin()]++;
+    m_sample_count++;
   }
 }
 
@@ -864,7 +2702,7 @@ auto Percentile::calculate(int percentage) -> double {
   size_t total = m_sample_count * percentage / 100;
   size_t count = 0;
   for (size_t i = 0, n = m_buckets.size(); i < n; i++) {
-    count += m_buckets[i];
+    count += m_counts[i];
     if (count >= total) {
       return m_buckets[i];
     }
@@ -928,6 +2766,46 @@ template<> void ClassDef<Constructor<Cache>>::init() {
   ctor();
 }
 
+//
+// SharedCache
+//
+
+template<> void ClassDef<SharedCache>::init() {
+  ctor([](Context &ctx) -> Object* {
+    Str *name;
+    Object *options = nullptr;
+    if (!ctx.arguments(1, &name, &options)) return nullptr;
+    return SharedCache::make(name, options);
+  });
+
+  method("get", [](Context &ctx, Object *obj, Value &ret) {
+    Value key;
+    if (!ctx.arguments(1, &key)) return;
+    obj->as<SharedCache>()->get(key, ret);
+  });
+
+  method("set", [](Context &ctx, Object *obj, Value &ret) {
+    Value key, val;
+    if (!ctx.arguments(2, &key, &val)) return;
+    obj->as<SharedCache>()->set(key, val);
+  });
+
+  method("remove", [](Context &ctx, Object *obj, Value &ret) {
+    Value key;
+    if (!ctx.arguments(1, &key)) return;
+    ret.set(obj->as<SharedCache>()->remove(key));
+  });
+
+  method("clear", [](Context &ctx, Object *obj, Value &ret) {
+    obj->as<SharedCache>()->clear();
+  });
+}
+
+template<> void ClassDef<Constructor<SharedCache>>::init() {
+  super<Function>();
+  ctor();
+}
+
 //
 // Quota
 //
@@ -965,6 +2843,31 @@ template<> void ClassDef<Constructor<Quota>>::init() {
   ctor();
 }
 
+//
+// SharedQuota
+//
+
+template<> void ClassDef<SharedQuota>::init() {
+  ctor([](Context &ctx) -> Object* {
+    Str *name;
+    double initial_value = 0;
+    Object *options = nullptr;
+    if (!ctx.arguments(2, &name, &initial_value, &options)) return nullptr;
+    return SharedQuota::make(name, initial_value, options);
+  });
+
+  method("get", [](Context &ctx, Object *obj, Value &ret) {
+    Value key;
+    if (!ctx.arguments(1, &key)) return;
+    ret.set(obj->as<SharedQuota>()->get(key));
+  });
+}
+
+template<> void ClassDef<Constructor<SharedQuota>>::init() {
+  super<Function>();
+  ctor();
+}
+
 //
 // URLRouter
 //
@@ -1008,6 +2911,29 @@ template<> void ClassDef<URLRouter>::init() {
     }
     obj->as<URLRouter>()->find(url, ret);
   });
+
+  method("match", [](Context &ctx, Object *obj, Value &ret) {
+    Str *url;
+    if (!ctx.arguments(1, &url)) return;
+    Value value;
+    Ref<Object> params = Object::make();
+    if (obj->as<URLRouter>()->find(url->str(), value, params)) {
+      auto result = Object::make();
+      result->set("value", value);
+      result->set("params", params.get());
+      ret.set(result);
+    }
+  });
+
+  method("reload", [](Context &ctx, Object *obj, Value &ret) {
+    Object *rules = nullptr;
+    if (!ctx.arguments(0, &rules)) return;
+    try {
+      obj->as<URLRouter>()->reload(rules);
+    } catch (std::runtime_error &err) {
+      ctx.error(err);
+    }
+  });
 }
 
 template<> void ClassDef<Constructor<URLRouter>>::init() {
@@ -1015,6 +2941,78 @@ template<> void ClassDef<Constructor<URLRouter>>::init() {
   ctor();
 }
 
+//
+// IPTrie
+//
+
+template<> void ClassDef<IPTrie>::init() {
+  ctor([](Context &ctx) -> Object* {
+    Value entries;
+    if (!ctx.arguments(0, &entries)) return nullptr;
+    try {
+      return IPTrie::make(entries);
+    } catch (std::runtime_error &err) {
+      ctx.error(err);
+      return nullptr;
+    }
+  });
+
+  accessor("size", [](Object *obj, Value &ret) {
+    ret.set(int(obj->as<IPTrie>()->size()));
+  });
+
+  method("add", [](Context &ctx, Object *obj, Value &ret) {
+    std::string cidr;
+    Value value(true);
+    if (!ctx.arguments(1, &cidr, &value)) return;
+    try {
+      obj->as<IPTrie>()->add(cidr, value);
+    } catch (std::runtime_error &err) {
+      ctx.error(err);
+    }
+  });
+
+  method("lookup", [](Context &ctx, Object *obj, Value &ret) {
+    Value addr;
+    if (!ctx.arguments(0, &addr)) return;
+    auto *trie = obj->as<IPTrie>();
+    if (addr.is_string()) {
+      trie->find(addr.s()->str(), ret);
+    } else if (addr.is<pipy::Data>()) {
+      auto *data = addr.as<pipy::Data>();
+      uint8_t buf[16];
+      if (data->size() == 4 || data->size() == 16) {
+        data->to_bytes(buf);
+        trie->find(buf, data->size(), ret);
+      }
+    } else if (addr.is_nullish() || addr.is<Inbound>()) {
+      auto *inbound = addr.is_nullish()
+        ? static_cast<pipy::Context*>(ctx.root())->inbound()
+        : addr.as<Inbound>();
+      if (inbound) {
+        trie->find(inbound->remote_address()->str(), ret);
+      }
+    } else {
+      ctx.error_argument_type(0, "a string, a Data or an Inbound");
+    }
+  });
+
+  method("reload", [](Context &ctx, Object *obj, Value &ret) {
+    Value entries;
+    if (!ctx.arguments(0, &entries)) return;
+    try {
+      obj->as<IPTrie>()->reload(entries);
+    } catch (std::runtime_error &err) {
+      ctx.error(err);
+    }
+  });
+}
+
+template<> void ClassDef<Constructor<IPTrie>>::init() {
+  super<Function>();
+  ctor();
+}
+
 //
 // LoadBalancer
 //
@@ -1079,6 +3077,39 @@ template<> void ClassDef<Constructor<HashingLoadBalancer>>::init() {
   ctor();
 }
 
+//
+// ConsistentHashingLoadBalancer
+//
+
+template<> void ClassDef<ConsistentHashingLoadBalancer>::init() {
+  super<LoadBalancer>();
+
+  ctor([](Context &ctx) -> Object* {
+    Object *targets = nullptr;
+    Cache *unhealthy = nullptr;
+    Object *options = nullptr;
+    if (!ctx.arguments(0, &targets, &unhealthy, &options)) return nullptr;
+    try {
+      return ConsistentHashingLoadBalancer::make(targets, unhealthy, options);
+    } catch (std::runtime_error &err) {
+      ctx.error(err);
+      return nullptr;
+    }
+  });
+
+  method("set", [](Context &ctx, Object *obj, Value &ret) {
+    Str *target;
+    int weight;
+    if (!ctx.arguments(2, &target, &weight)) return;
+    obj->as<ConsistentHashingLoadBalancer>()->set(target, weight);
+  });
+}
+
+template<> void ClassDef<Constructor<ConsistentHashingLoadBalancer>>::init() {
+  super<Function>();
+  ctor();
+}
+
 //
 // RoundRobinLoadBalancer
 //
@@ -1133,6 +3164,39 @@ template<> void ClassDef<Constructor<LeastWorkLoadBalancer>>::init() {
   ctor();
 }
 
+//
+// EWMALoadBalancer
+//
+
+template<> void ClassDef<EWMALoadBalancer>::init() {
+  super<LoadBalancer>();
+
+  ctor([](Context &ctx) -> Object* {
+    Object *targets = nullptr;
+    Cache *unhealthy = nullptr;
+    Object *options = nullptr;
+    if (!ctx.arguments(0, &targets, &unhealthy, &options)) return nullptr;
+    try {
+      return EWMALoadBalancer::make(targets, unhealthy, options);
+    } catch (std::runtime_error &err) {
+      ctx.error(err);
+      return nullptr;
+    }
+  });
+
+  method("set", [](Context &ctx, Object *obj, Value &ret) {
+    Str *target;
+    double weight;
+    if (!ctx.arguments(2, &target, &weight)) return;
+    obj->as<EWMALoadBalancer>()->set(target, weight);
+  });
+}
+
+template<> void ClassDef<Constructor<EWMALoadBalancer>>::init() {
+  super<Function>();
+  ctor();
+}
+
 //
 // ResourcePool
 //
@@ -1207,11 +3271,16 @@ template<> void ClassDef<Constructor<Percentile>>::init() {
 template<> void ClassDef<Algo>::init() {
   ctor();
   variable("Cache", class_of<Constructor<Cache>>());
+  variable("SharedCache", class_of<Constructor<SharedCache>>());
   variable("Quota", class_of<Constructor<Quota>>());
+  variable("SharedQuota", class_of<Constructor<SharedQuota>>());
   variable("URLRouter", class_of<Constructor<URLRouter>>());
+  variable("IPTrie", class_of<Constructor<IPTrie>>());
   variable("HashingLoadBalancer", class_of<Constructor<HashingLoadBalancer>>());
+  variable("ConsistentHashingLoadBalancer", class_of<Constructor<ConsistentHashingLoadBalancer>>());
   variable("RoundRobinLoadBalancer", class_of<Constructor<RoundRobinLoadBalancer>>());
   variable("LeastWorkLoadBalancer", class_of<Constructor<LeastWorkLoadBalancer>>());
+  variable("EWMALoadBalancer", class_of<Constructor<EWMALoadBalancer>>());
   variable("ResourcePool", class_of<Constructor<ResourcePool>>());
   variable("Percentile", class_of<Constructor<Percentile>>());
 
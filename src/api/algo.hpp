@@ -31,8 +31,18 @@
 #include "timer.hpp"
 #include "options.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <random>
 #include <set>
+#include <thread>
 #include <unordered_map>
 
 namespace pipy {
@@ -87,10 +97,86 @@ private:
   friend class pjs::ObjectTemplate<Cache>;
 };
 
+//
+// SharedCache
+//
+
+class SharedCache : public pjs::ObjectTemplate<SharedCache> {
+public:
+  typedef Cache::Options Options;
+
+  bool get(const pjs::Value &key, pjs::Value &value);
+  void set(const pjs::Value &key, const pjs::Value &value);
+  bool remove(const pjs::Value &key);
+  void clear();
+
+private:
+  SharedCache(pjs::Str *name, const Options &options);
+  ~SharedCache();
+
+  //
+  // SharedCache::Storage
+  //
+
+  class Storage {
+  public:
+    Storage(const std::string &name, const Options &options);
+
+    auto set_options(const Options &options) -> int;
+    bool get(const std::string &key, std::string &value);
+    auto set(const std::string &key, const std::string &value) -> int;
+    bool remove(const std::string &key);
+    void clear();
+
+  private:
+    enum { SHARDS = 16 };
+
+    struct Entry {
+      std::string value;
+      double ttl;
+      uint64_t stamp;
+      std::list<std::string>::iterator lru;
+    };
+
+    struct Shard {
+      std::mutex mutex;
+      std::unordered_map<std::string, Entry> entries;
+      std::list<std::string> lru;
+    };
+
+    std::string m_name;
+    std::atomic<size_t> m_size;
+    std::atomic<size_t> m_count;
+    std::atomic<uint64_t> m_clock;
+    std::atomic<double> m_ttl;
+    Shard m_shards[SHARDS];
+
+    auto shard(const std::string &key) -> Shard&;
+    auto evict(const std::string &key) -> int;
+  };
+
+  Storage* m_storage;
+  pjs::Ref<pjs::Str> m_name;
+
+  static std::mutex s_storages_mutex;
+  static std::map<std::string, Storage*> s_storages;
+
+  static void encode(const pjs::Value &value, std::string &out);
+  static void decode(const std::string &in, pjs::Value &value);
+
+  void on_hit();
+  void on_miss();
+  void on_evict(int n);
+
+  friend class pjs::ObjectTemplate<SharedCache>;
+};
+
 //
 // Quota
 //
 
+class SharedQuota;
+
 class Quota : public pjs::ObjectTemplate<Quota> {
 public:
   struct Options : public pipy::Options {
@@ -120,26 +206,100 @@ public:
   };
 
   void reset();
-  auto initial() const -> double { return m_initial_value; }
-  auto current() const -> double { return m_current_value; }
+  auto initial() const -> double;
+  auto current() const -> double;
   void produce(double value);
   auto consume(double value) -> double;
   void enqueue(Consumer *consumer) { consumer->set_quota(this); }
   void dequeue(Consumer *consumer) { consumer->set_quota(nullptr); }
 
 private:
+  class SharedBucket;
+  class SharedWaiter;
+
   Quota(double initial_value, const Options &options);
+  Quota(SharedBucket *bucket, pjs::Str *name, pjs::Str *key);
+  ~Quota();
 
   Options m_options;
   double m_initial_value;
   double m_current_value;
   bool m_is_producing_scheduled = false;
   List<Consumer> m_consumers;
-  Timer m_timer;
-
+  WheelTimer m_timer;
+  SharedBucket* m_shared = nullptr;
+  SharedWaiter* m_waiter = nullptr;
+  pjs::Ref<pjs::Str> m_name;
+  pjs::Ref<pjs::Str> m_key;
+
+  void add_consumer(Consumer *consumer);
+  void remove_consumer(Consumer *consumer);
+  void notify();
   void schedule_producing();
 
   friend class pjs::ObjectTemplate<Quota>;
+  friend class SharedQuota;
+};
+
+//
+// SharedQuota
+//
+
+class SharedQuota : public pjs::ObjectTemplate<SharedQuota> {
+public:
+  auto get(const pjs::Value &key) -> Quota*;
+
+private:
+  SharedQuota(pjs::Str *name, double initial_value, const Quota::Options &options);
+  ~SharedQuota();
+
+  //
+  // SharedQuota::Storage
+  //
+
+  class Storage {
+  public:
+    Storage(double initial_value, const Quota::Options &options)
+      : m_initial_value(initial_value)
+      , m_per(options.per)
+      , m_produce(options.produce) {}
+
+    auto initial_value() const -> double { return m_initial_value.load(std::memory_order_relaxed); }
+    auto per() const -> double { return m_per.load(std::memory_order_relaxed); }
+    auto produce() const -> double { return m_produce.load(std::memory_order_relaxed); }
+
+    void set_options(double initial_value, const Quota::Options &options);
+    auto acquire(const std::string &key) -> Quota::SharedBucket*;
+    void release(Quota::SharedBucket *bucket);
+
+  private:
+    enum { SHARDS = 16 };
+
+    struct Shard {
+      std::mutex mutex;
+      std::unordered_map<std::string, Quota::SharedBucket*> buckets;
+      size_t sweep_size = 1000;
+    };
+
+    std::atomic<double> m_initial_value;
+    std::atomic<double> m_per;
+    std::atomic<double> m_produce;
+    Shard m_shards[SHARDS];
+
+    auto shard(const std::string &key) -> Shard&;
+    void sweep(Shard &s);
+  };
+
+  Storage* m_storage;
+  pjs::Ref<pjs::Str> m_name;
+  std::unordered_map<std::string, pjs::Ref<Quota>> m_quotas;
+  size_t m_sweep_size = 1000;
+
+  static std::mutex s_storages_mutex;
+  static std::map<std::string, Storage*> s_storages;
+
+  friend class pjs::ObjectTemplate<SharedQuota>;
+  friend class Quota;
 };
 
 //
@@ -168,6 +328,46 @@ private:
   friend class pjs::ObjectTemplate<ResourcePool>;
 };
 
+//
+// TableBuilder
+//
+// One background thread shared by all workers for building the lookup
+// tables of URLRouter and IPTrie on reloads. Jobs are keyed by their
+// input, so workers reloading with the same input share one job and the
+// table it builds, which is never changed after that. A job nobody holds
+// anymore by the time its turn comes is skipped. Finished jobs are kept
+// for a few seconds so that workers reloading a bit later still find them.
+//
+
+class TableBuilder {
+public:
+  class Job {
+  public:
+    Job() : m_done(false) {}
+    virtual ~Job() {}
+    bool done() const { return m_done.load(std::memory_order_acquire); }
+  protected:
+    virtual void build() = 0;
+  private:
+    std::atomic<bool> m_done;
+    friend class TableBuilder;
+  };
+
+  static auto submit(const std::string &key, const std::function<std::shared_ptr<Job>()> &make) -> std::shared_ptr<Job>;
+  static void shutdown();
+
+private:
+  static std::mutex s_mutex;
+  static std::condition_variable s_cv;
+  static std::thread s_thread;
+  static std::deque<std::weak_ptr<Job>> s_queue;
+  static std::map<std::string, std::weak_ptr<Job>> s_jobs;
+  static std::deque<std::pair<std::chrono::steady_clock::time_point, std::shared_ptr<Job>>> s_kept;
+  static bool s_stopped;
+
+  static void main();
+};
+
 //
 // URLRouter
 //
@@ -175,42 +375,209 @@ private:
 class URLRouter : public pjs::ObjectTemplate<URLRouter> {
 public:
   void add(const std::string &url, const pjs::Value &value);
-  bool find(const std::string &url, pjs::Value &value);
+  void reload(pjs::Object *rules);
+  bool find(const std::string &url, pjs::Value &value, pjs::Object *params = nullptr);
 
 private:
   URLRouter();
   URLRouter(pjs::Object *rules);
   ~URLRouter();
 
-  struct Node {
-    std::map<std::string, Node*> children;
+  //
+  // URLRouter::Table
+  //
+  // A radix trie over the raw bytes of "host/path", with all nodes, edges
+  // and labels kept in flat arrays. Static edges are tried first, then
+  // ":param" segments, then "*" host labels and segments, then trailing
+  // "/*" wildcards, backtracking on failure. Matching does not allocate.
+  //
+
+  class Table {
+  public:
+    enum { MAX_CAPTURES = 16 };
+
+    struct Capture {
+      int start;
+      int end;
+    };
+
+    struct Match {
+      Capture captures[MAX_CAPTURES];
+      int count = 0;
+    };
+
+    Table(const std::vector<std::string> &patterns);
+
+    static void validate(const std::string &pattern);
+
+    auto find(const char *str, int len, Match &m) const -> int;
+    auto name(int i) const -> const std::string& { return m_names[i]; }
+
+    // Names of the captures of a route, in the order they are captured
+    auto names(int route) const -> const std::vector<int>& { return m_route_names[route]; }
+
+  private:
+    enum class Kind : uint8_t { STATIC, PARAM, LABEL, SEGMENT, REST };
+
+    struct Token {
+      Kind kind;
+      std::string text;
+    };
+
+    struct Node {
+      Kind kind;
+      int value = -1;
+      int label = 0;
+      int label_len = 0;
+      int first_edge = 0;
+      int edge_count = 0;
+      int param = -1;
+      int label_wildcard = -1;
+      int segment_wildcard = -1;
+      int rest = -1;
+    };
+
+    struct Builder;
+
+    std::vector<Node> m_nodes;
+    std::vector<int> m_edges;
+    std::vector<uint8_t> m_edge_bytes;
+    std::string m_labels;
+    std::vector<std::string> m_names;
+    std::vector<std::vector<int>> m_route_names;
+
+    static void tokenize(const std::string &pattern, std::vector<Token> &tokens);
+
+    auto flatten(Builder *builder) -> int;
+
+    auto match(int node, const char *str, int len, int pos, Match &m) const -> int;
+  };
+
+  struct Rule {
+    std::string pattern;
     pjs::Value value;
+  };
 
-    auto child(const std::string &name) -> Node* {
-      auto i = children.find(name);
-      return i == children.end() ? nullptr : i->second;
-    }
-
-    auto new_child(const std::string &name) -> Node* {
-      auto i = children.find(name);
-      if (i != children.end()) return i->second;
-      return children[name] = new Node;
-    }
-
-    ~Node() {
-      for (auto &i : children) {
-        delete i.second;
-      }
-    }
+  //
+  // URLRouter::Reload
+  //
+  // A table being built by the TableBuilder, which is ready
+  // to be picked up when the job is done.
+  //
+
+  struct Reload : public TableBuilder::Job {
+    std::vector<std::string> patterns;
+    std::shared_ptr<Table> table;
+    size_t size;
+    Reload(const std::vector<std::string> &p) : patterns(p), size(p.size()) {}
+    virtual void build() override;
   };
 
-  Node* m_root;
+  std::vector<Rule> m_rules;
+  std::vector<Rule> m_pending_rules;
+  std::shared_ptr<Table> m_table;
+  std::shared_ptr<Reload> m_reload;
 
-  void dump(Node *node, int level);
+  auto table() -> Table*;
 
   friend class pjs::ObjectTemplate<URLRouter>;
 };
 
+//
+// IPTrie
+//
+
+class IPTrie : public pjs::ObjectTemplate<IPTrie> {
+public:
+  auto size() const -> size_t { return m_prefixes.size(); }
+  void add(const std::string &cidr, const pjs::Value &value);
+  void reload(const pjs::Value &entries);
+  bool find(const std::string &ip, pjs::Value &value);
+  bool find(const uint8_t *ip, size_t len, pjs::Value &value);
+
+private:
+  IPTrie(const pjs::Value &entries);
+  ~IPTrie();
+
+  struct Prefix {
+    uint8_t ip[16];
+    int bits;
+    bool v6;
+    int value;
+  };
+
+  //
+  // IPTrie::Table
+  //
+  // IPv4 prefixes are expanded into a 16-8-8 multibit table: a direct
+  // 64K-entry first level indexed by the top 16 bits, with 256-entry
+  // chunks for longer prefixes, so a lookup is at most 3 array reads.
+  // Each entry remembers the length of the prefix it was expanded from
+  // so that prefixes can be added in any order.
+  // IPv6 prefixes go into a path-compressed binary trie.
+  //
+
+  class Table {
+  public:
+    Table(const std::vector<Prefix> &prefixes);
+
+    void add(const Prefix &p);
+    auto find_v4(uint32_t ip) const -> int;
+    auto find_v6(const uint8_t ip[16]) const -> int;
+
+  private:
+    enum { CHUNK = 0x80000000u };
+
+    struct Node {
+      uint64_t hi = 0;
+      uint64_t lo = 0;
+      int bits = 0;
+      int value = -1;
+      int child[2] = { -1, -1 };
+    };
+
+    std::vector<uint32_t> m_v4_root;
+    std::vector<uint8_t> m_v4_root_bits;
+    std::vector<uint32_t> m_v4_chunks;
+    std::vector<uint8_t> m_v4_chunk_bits;
+    std::vector<Node> m_v6_nodes;
+
+    void insert_v4(const Prefix &p);
+    void insert_v6(const Prefix &p);
+    void fill_v4(std::vector<uint32_t> &entries, std::vector<uint8_t> &bits, uint32_t i, uint32_t n, uint32_t entry, int len);
+    auto new_chunk(uint32_t entry, int len) -> uint32_t;
+  };
+
+  //
+  // Same as URLRouter::Reload. The table it builds is shared by
+  // all workers, so it is copied before adding to it.
+  //
+
+  struct Reload : public TableBuilder::Job {
+    std::vector<Prefix> prefixes;
+    std::shared_ptr<Table> table;
+    size_t size;
+    Reload(const std::vector<Prefix> &p) : prefixes(p), size(p.size()) {}
+    virtual void build() override;
+  };
+
+  std::vector<Prefix> m_prefixes;
+  std::vector<Prefix> m_pending_prefixes;
+  std::vector<pjs::Value> m_values;
+  std::vector<pjs::Value> m_pending_values;
+  std::shared_ptr<Table> m_table;
+  std::shared_ptr<Reload> m_reload;
+  bool m_table_shared = false;
+
+  auto table() -> Table*;
+  auto own_table() -> Table*;
+
+  static void parse(const pjs::Value &entries, std::vector<Prefix> &prefixes, std::vector<pjs::Value> &values);
+  static void parse_cidr(const std::string &cidr, Prefix &prefix);
+
+  friend class pjs::ObjectTemplate<IPTrie>;
+};
+
 //
 // LoadBalancer
 //
@@ -310,6 +677,48 @@ private:
   friend class pjs::ObjectTemplate<HashingLoadBalancer, LoadBalancer>;
 };
 
+//
+// ConsistentHashingLoadBalancer
+//
+
+class ConsistentHashingLoadBalancer : public pjs::ObjectTemplate<ConsistentHashingLoadBalancer, LoadBalancer> {
+public:
+
+  //
+  // ConsistentHashingLoadBalancer::Options
+  //
+
+  struct Options : public pipy::Options {
+    int table_size = 65537;
+
+    Options() {}
+    Options(pjs::Object *options);
+  };
+
+  void set(pjs::Str *target, int weight);
+
+  virtual auto select(const pjs::Value &key, Cache *unhealthy) -> pjs::Str* override;
+  virtual void deselect(pjs::Str *target) override {}
+
+private:
+  ConsistentHashingLoadBalancer(pjs::Object *targets, Cache *unhealthy = nullptr, const Options &options = Options());
+  ~ConsistentHashingLoadBalancer();
+
+  struct Target {
+    pjs::Ref<pjs::Str> id;
+    int weight;
+  };
+
+  Options m_options;
+  std::vector<Target> m_targets;
+  std::vector<int> m_table;
+  bool m_table_dirty = false;
+
+  void build_table();
+
+  friend class pjs::ObjectTemplate<ConsistentHashingLoadBalancer, LoadBalancer>;
+};
+
 //
 // RoundRobinLoadBalancer
 //
@@ -367,6 +776,59 @@ private:
   friend class pjs::ObjectTemplate<LeastWorkLoadBalancer, LoadBalancer>;
 };
 
+//
+// EWMALoadBalancer
+//
+
+class EWMALoadBalancer : public pjs::ObjectTemplate<EWMALoadBalancer, LoadBalancer> {
+public:
+
+  //
+  // EWMALoadBalancer::Options
+  //
+
+  struct Options : public pipy::Options {
+    double decay = 10;
+    pjs::Ref<pjs::Str> name;
+
+    Options() {}
+    Options(pjs::Object *options);
+  };
+
+  void set(pjs::Str *target, double weight);
+
+  virtual auto select(const pjs::Value &key, Cache *unhealthy) -> pjs::Str* override;
+  virtual void deselect(pjs::Str *target) override;
+
+private:
+  EWMALoadBalancer(pjs::Object *targets, Cache *unhealthy = nullptr, const Options &options = Options());
+  ~EWMALoadBalancer();
+
+  struct Target {
+    pjs::Ref<pjs::Str> id;
+    double weight = 0;
+    double ewma = 0;
+    double updated = 0;
+    int inflight = 0;
+    std::deque<double> starts;
+  };
+
+  Options m_options;
+  std::vector<Target> m_targets;
+  std::unordered_map<pjs::Str*, int> m_target_map;
+  pjs::Ref<Cache> m_target_cache;
+  std::minstd_rand m_rand;
+
+  bool is_available(Target &t, Cache *unhealthy);
+  void start(Target &t, double now);
+  auto cost(const Target &t, double now) const -> double;
+  void observe(Target &t, double latency, double now);
+
+  static void init_metrics();
+
+  friend class pjs::ObjectTemplate<EWMALoadBalancer, LoadBalancer>;
+};
+
 //
 // Percentile
 //
@@ -30,6 +30,9 @@
 #include "utils.hpp"
 #include "compress.hpp"
 
+#include <algorithm>
+#include <cstring>
+
 namespace pipy {
 namespace http {
 
@@ -58,6 +61,179 @@ static std::map<std::string, std::string> s_content_types = {
 
 thread_local static Data::Producer s_dp_http_file("http.File");
 
+//
+// Headers
+//
+
+thread_local static const pjs::ConstStr s_host("host");
+thread_local static const pjs::ConstStr s_content_length("content-length");
+thread_local static const pjs::ConstStr s_content_type("content-type");
+thread_local static const pjs::ConstStr s_transfer_encoding("transfer-encoding");
+thread_local static const pjs::ConstStr s_connection("connection");
+thread_local static const pjs::ConstStr s_upgrade("upgrade");
+
+static bool name_equals(pjs::Str *a, pjs::Str *b) {
+  if (a == b) return true;
+  if (a->size() != b->size()) return false;
+  return !strncasecmp(a->c_str(), b->c_str(), a->size());
+}
+
+static auto slot_of(pjs::Str *name) -> int {
+  if (name_equals(name, s_host)) return int(Headers::Slot::host);
+  if (name_equals(name, s_content_length)) return int(Headers::Slot::content_length);
+  if (name_equals(name, s_content_type)) return int(Headers::Slot::content_type);
+  if (name_equals(name, s_transfer_encoding)) return int(Headers::Slot::transfer_encoding);
+  if (name_equals(name, s_connection)) return int(Headers::Slot::connection);
+  if (name_equals(name, s_upgrade)) return int(Headers::Slot::upgrade);
+  return -1;
+}
+
+const pjs::Class::HashStorage Headers::s_hash_storage = {
+  [](const pjs::Object *obj) -> size_t { return static_cast<const Headers*>(obj)->size(); },
+  [](pjs::Object *obj, pjs::Str *key) { return static_cast<Headers*>(obj)->find(key) >= 0; },
+  [](pjs::Object *obj, pjs::Str *key, pjs::Value &val) { return static_cast<Headers*>(obj)->get_header(key, val); },
+  [](pjs::Object *obj, pjs::Str *key, const pjs::Value &val) { static_cast<Headers*>(obj)->set_header(key, val); },
+  [](pjs::Object *obj, pjs::Str *key) { return static_cast<Headers*>(obj)->delete_header(key); },
+  [](pjs::Object *obj, const std::function<bool(pjs::Str*, pjs::Value&)> &cb) { return static_cast<Headers*>(obj)->iterate_headers(cb); },
+};
+
+Headers::Headers()
+  : m_entries(Entries::make(16))
+{
+  for (auto &i : m_slots) i = -1;
+}
+
+Headers::~Headers() {
+  m_entries->free();
+  if (m_raw) m_raw->free();
+}
+
+auto Headers::value(int i) -> const pjs::Value& {
+  auto &ent = m_entries->at(i);
+  if (ent.raw_length >= 0) {
+    ent.value.set(pjs::Str::make(m_raw->elements() + ent.raw_offset, ent.raw_length));
+    ent.raw_length = -1;
+  }
+  return ent.value;
+}
+
+void Headers::value(int i, const pjs::Value &v) {
+  auto &ent = m_entries->at(i);
+  ent.value = v;
+  ent.raw_length = -1;
+}
+
+bool Headers::raw_value(int i, const char *&ptr, int &len) const {
+  const auto &ent = m_entries->at(i);
+  if (ent.raw_length < 0) return false;
+  ptr = m_raw->elements() + ent.raw_offset;
+  len = ent.raw_length;
+  return true;
+}
+
+//
+// Names that differ only in case are the same header. The exact match
+// goes first since names decoded off the wire are already lowercase.
+//
+
+auto Headers::find(pjs::Str *name) const -> int {
+  auto entries = m_entries->elements();
+  for (int i = 0; i < m_size; i++) {
+    if (entries[i].name == name) return i;
+  }
+  for (int i = 0; i < m_size; i++) {
+    if (name_equals(entries[i].name, name)) return i;
+  }
+  return -1;
+}
+
+void Headers::append(pjs::Str *name, const pjs::Value &value) {
+  new_entry(name).value = value;
+}
+
+void Headers::append(pjs::Str *name, const char *value, int len) {
+  auto capacity = m_raw ? int(m_raw->size()) : 0;
+  if (m_raw_size + len > capacity) {
+    auto size = std::max(256, capacity);
+    while (size < m_raw_size + len) size *= 2;
+    auto raw = Bytes::make(size);
+    if (m_raw) {
+      std::memcpy(raw->elements(), m_raw->elements(), m_raw_size);
+      m_raw->free();
+    }
+    m_raw = raw;
+  }
+  std::memcpy(m_raw->elements() + m_raw_size, value, len);
+  auto &ent = new_entry(name);
+  ent.raw_offset = m_raw_size;
+  ent.raw_length = len;
+  m_raw_size += len;
+}
+
+bool Headers::get_header(pjs::Str *key, pjs::Value &val) {
+  auto i = find(key);
+  if (i < 0) {
+    val = pjs::Value::undefined;
+    return false;
+  }
+  val = value(i);
+  return true;
+}
+
+void Headers::set_header(pjs::Str *key, const pjs::Value &val) {
+  auto i = find(key);
+  if (i < 0) {
+    append(key, val);
+  } else {
+    value(i, val);
+  }
+}
+
+bool Headers::delete_header(pjs::Str *key) {
+  auto i = find(key);
+  if (i < 0) return false;
+  auto entries = m_entries->elements();
+  for (int j = i + 1; j < m_size; j++) entries[j-1] = std::move(entries[j]);
+  entries[--m_size] = Entry();
+  update_slots();
+  return true;
+}
+
+bool Headers::iterate_headers(const std::function<bool(pjs::Str*, pjs::Value&)> &callback) {
+  for (int i = 0; i < m_size; i++) {
+    value(i);
+    auto &ent = m_entries->at(i);
+    if (!callback(ent.name, ent.value)) return false;
+  }
+  return true;
+}
+
+auto Headers::new_entry(pjs::Str *name) -> Entry& {
+  if (m_size >= m_entries->size()) {
+    auto entries = Entries::make(m_entries->size() * 2);
+    for (int i = 0; i < m_size; i++) entries->at(i) = std::move(m_entries->at(i));
+    m_entries->free();
+    m_entries = entries;
+  }
+  auto slot = slot_of(name);
+  if (slot >= 0 && m_slots[slot] < 0) m_slots[slot] = m_size;
+  auto &ent = m_entries->at(m_size++);
+  ent.name = name;
+  return ent;
+}
+
+void Headers::update_slots() {
+  for (auto &i : m_slots) i = -1;
+  for (int i = 0; i < m_size; i++) {
+    auto slot = slot_of(m_entries->at(i).name);
+    if (slot >= 0 && m_slots[slot] < 0) m_slots[slot] = i;
+  }
+}
+
+//
+// File
+//
+
 auto File::from(const std::string &path) -> File* {
   try {
     return File::make(path);
@@ -233,6 +409,10 @@ template<> void EnumDef<StringConstants>::init() {
   define(CONTENT_ENCODING_BR, "br");
 }
 
+template<> void ClassDef<Headers>::init() {
+  hash_storage(&Headers::s_hash_storage);
+}
+
 template<> void ClassDef<MessageHead>::init() {
   variable("protocol", MessageHead::Field::protocol);
   variable("headers", MessageHead::Field::headers);
@@ -37,6 +37,81 @@ class Tarball;
 
 namespace http {
 
+//
+// Headers
+//
+// Header fields as a flat array of name/value pairs in arrival order.
+// Scripts see an ordinary object, while codecs walk the array directly
+// and reach a few well-known headers through fixed slots. Names from the
+// decoders are lowercase interned strings, so matching is by identity.
+// Values can be kept as raw bytes and only become strings when read.
+//
+
+class Headers : public pjs::ObjectTemplate<Headers> {
+public:
+  enum class Slot {
+    host,
+    content_length,
+    content_type,
+    transfer_encoding,
+    connection,
+    upgrade,
+    MAX,
+  };
+
+  auto size() const -> int { return m_size; }
+  auto name(int i) const -> pjs::Str* { return m_entries->at(i).name; }
+  auto value(int i) -> const pjs::Value&;
+  void value(int i, const pjs::Value &v);
+  bool raw_value(int i, const char *&ptr, int &len) const;
+  auto find(pjs::Str *name) const -> int;
+  void append(pjs::Str *name, const pjs::Value &value);
+  void append(pjs::Str *name, const char *value, int len);
+
+  auto get(Slot slot) -> const pjs::Value& {
+    auto i = m_slots[int(slot)];
+    return i < 0 ? pjs::Value::undefined : value(i);
+  }
+
+  auto get_str(Slot slot) -> pjs::Str* {
+    const auto &v = get(slot);
+    return v.is_string() ? v.s() : nullptr;
+  }
+
+  bool get_header(pjs::Str *name, pjs::Value &val);
+  void set_header(pjs::Str *name, const pjs::Value &val);
+  bool delete_header(pjs::Str *name);
+  bool iterate_headers(const std::function<bool(pjs::Str*, pjs::Value&)> &callback);
+
+private:
+  struct Entry {
+    pjs::Ref<pjs::Str> name;
+    pjs::Value value;
+    int raw_offset = 0;
+    int raw_length = -1;
+  };
+
+  typedef pjs::PooledArray<Entry> Entries;
+  typedef pjs::PooledArray<char> Bytes;
+
+  Headers();
+  ~Headers();
+
+  Entries* m_entries;
+  Bytes* m_raw = nullptr;
+  int m_size = 0;
+  int m_raw_size = 0;
+  int m_slots[int(Slot::MAX)];
+
+  static const pjs::Class::HashStorage s_hash_storage;
+
+  auto new_entry(pjs::Str *name) -> Entry&;
+  void update_slots();
+
+  friend class pjs::ObjectTemplate<Headers>;
+  friend class pjs::ClassDef<Headers>;
+};
+
 class MessageHead : public pjs::ObjectTemplate<MessageHead> {
 public:
   enum class Field {
@@ -32,7 +32,10 @@
 #include "fstream.hpp"
 #include "admin-service.hpp"
 #include "admin-link.hpp"
+#include "fs.hpp"
+#include "utils.hpp"
 #include "api/json.hpp"
+#include "api/stats.hpp"
 #include "api/url.hpp"
 #include "filters/tee.hpp"
 #include "filters/pack.hpp"
@@ -40,6 +43,12 @@
 #include "filters/http.hpp"
 #include "filters/connect.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <thread>
+
 #include <syslog.h>
 
 namespace pipy {
@@ -50,7 +59,6 @@ namespace logging {
 //
 
 thread_local static Data::Producer s_dp("Logger");
-thread_local static Data::Producer s_dp_stdout("Logger::StdoutTarget");
 thread_local static Data::Producer s_dp_binary("BinaryLogger");
 thread_local static Data::Producer s_dp_text("TextLogger");
 thread_local static Data::Producer s_dp_json("JSONLogger");
@@ -60,6 +68,208 @@ AdminLink* Logger::s_admin_link = nullptr;
 
 thread_local std::set<Logger*> Logger::s_all_loggers;
 
+thread_local static pjs::Ref<stats::Gauge> s_metric_queued;
+thread_local static pjs::Ref<stats::Counter> s_metric_dropped;
+
+//
+// Logger::Writer
+//
+// The logging thread. It drains all queues in rounds, writes records
+// to their sinks, flushes each touched sink once per round and hands
+// the round's messages over to the main thread for log history.
+// It is never destroyed, as other threads can log till the very end,
+// and is stopped explicitly by Logger::close_all().
+//
+
+class Logger::Writer {
+public:
+  static auto get() -> Writer& {
+    static Writer *s_writer = new Writer;
+    return *s_writer;
+  }
+
+  static bool started() {
+    return s_started.load(std::memory_order_acquire);
+  }
+
+  bool alive() const {
+    return !m_stopped.load(std::memory_order_acquire);
+  }
+
+  void add(Queue *queue) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queues.push_back(queue);
+  }
+
+  void flush() {
+    auto round = m_rounds.load(std::memory_order_acquire);
+    while (alive() && m_rounds.load(std::memory_order_acquire) < round + 2) {
+      wait_round();
+    }
+  }
+
+  //
+  // Sleeps till the logging thread finishes its current round,
+  // or at most 10ms, instead of spinning on the caller's thread
+  //
+
+  void wait_round() {
+    auto round = m_rounds.load();
+    wake();
+    std::unique_lock<std::mutex> lock(m_round_mutex);
+    m_round_waiters++;
+    m_round_cv.wait_for(
+      lock, std::chrono::milliseconds(10),
+      [&]() { return m_rounds.load() != round || !alive(); }
+    );
+    m_round_waiters--;
+  }
+
+  void stop();
+
+  void wake() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_sleeping.load(std::memory_order_relaxed)) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_signaled = true;
+      m_cv.notify_one();
+    }
+  }
+
+private:
+  struct HistoryBatch {
+    struct Item {
+      Route *route;
+      size_t offset;
+      size_t length;
+    };
+    std::string buffer;
+    std::vector<Item> items;
+  };
+
+  Writer()
+    : m_round_waiters(0)
+    , m_rounds(0)
+    , m_sleeping(false)
+    , m_stopping(false)
+    , m_stopped(false)
+  {
+    m_thread = std::thread([this]() { main(); });
+    s_started.store(true, std::memory_order_release);
+  }
+
+  std::thread m_thread;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::mutex m_round_mutex;
+  std::condition_variable m_round_cv;
+  std::atomic<int> m_round_waiters;
+  std::vector<Queue*> m_queues;
+  std::vector<Queue*> m_round;
+  std::vector<Sink*> m_dirty_sinks;
+  std::atomic<size_t> m_rounds;
+  std::atomic<bool> m_sleeping;
+  std::atomic<bool> m_stopping;
+  std::atomic<bool> m_stopped;
+  bool m_signaled = false;
+
+  void main();
+  auto drain() -> size_t;
+  bool pending();
+
+  static void write_history(HistoryBatch *batch);
+
+  static std::atomic<bool> s_started;
+};
+
+std::atomic<bool> Logger::Writer::s_started(false);
+
+//
+// Logger::Queue
+//
+// Bounded single-producer single-consumer ring of log records. Each
+// thread that logs while its event loop is running owns one, and only
+// the logging thread consumes from it.
+//
+
+class Logger::Queue {
+public:
+  static const size_t CAPACITY = 1024 * 1024;
+
+  static bool fits(size_t size) {
+    return record_size(size) <= CAPACITY / 4;
+  }
+
+  static auto local() -> Queue* {
+    return s_holder.queue;
+  }
+
+  static auto current() -> Queue* {
+    auto &h = s_holder;
+    if (!h.queue) {
+      h.queue = new Queue;
+      Writer::get().add(h.queue);
+    }
+    return h.queue;
+  }
+
+  bool closed() const { return m_closed.load(std::memory_order_acquire); }
+  bool empty() const { return m_tail.load(std::memory_order_acquire) == m_head.load(std::memory_order_acquire); }
+  auto usage() const -> size_t { return m_head.load(std::memory_order_relaxed) - m_tail.load(std::memory_order_relaxed); }
+  auto count() const -> size_t { return m_pushed.load(std::memory_order_relaxed) - m_popped.load(std::memory_order_relaxed); }
+
+  bool push(Route *route, const Data &msg);
+  void wait_empty();
+
+  template<class F>
+  auto read(const F &cb) -> size_t;
+  void commit();
+
+private:
+  struct Record {
+    uint32_t length;
+    uint32_t skip;
+    Route *route;
+  };
+
+  struct Holder {
+    Queue *queue = nullptr;
+    ~Holder() { if (queue) queue->m_closed.store(true, std::memory_order_release); }
+  };
+
+  static const size_t ALIGNMENT = 16;
+  static const size_t HEADER_SIZE = (sizeof(Record) + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+
+  static auto record_size(size_t length) -> size_t {
+    return HEADER_SIZE + ((length + ALIGNMENT - 1) & ~(ALIGNMENT - 1));
+  }
+
+  Queue()
+    : m_buffer(new char[CAPACITY])
+    , m_head(0)
+    , m_pushed(0)
+    , m_tail(0)
+    , m_popped(0)
+    , m_closed(false) {}
+
+  ~Queue() { delete [] m_buffer; }
+
+  char* m_buffer;
+  char m_padding0[64];
+  std::atomic<size_t> m_head;
+  std::atomic<size_t> m_pushed;
+  char m_padding1[64];
+  std::atomic<size_t> m_tail;
+  std::atomic<size_t> m_popped;
+  std::atomic<bool> m_closed;
+  size_t m_read_tail = 0;
+  size_t m_read_count = 0;
+
+  thread_local static Holder s_holder;
+
+  friend class Writer;
+};
+
 void Logger::set_admin_service(AdminService *admin_service) {
   s_admin_service = admin_service;
 }
@@ -119,17 +329,118 @@ void Logger::shutdown_all() {
   }
 }
 
-Logger::Logger(pjs::Str *name)
+void Logger::reopen_all() {
+  Sink::for_each([](Sink *sink) { sink->close(); });
+}
+
+void Logger::close_all() {
+  if (Writer::started()) Writer::get().stop();
+  Sink::for_each([](Sink *sink) { sink->close(); });
+}
+
+Logger::Logger(pjs::Str *name, const Options &options)
   : m_name(name)
+  , m_options(options)
+  , m_route(new Route)
 {
+  m_route->name = name->str();
   s_all_loggers.insert(this);
+  init_metrics();
 }
 
 Logger::~Logger() {
   s_all_loggers.erase(this);
+  while (auto *m = m_local_messages.head()) {
+    m_local_messages.remove(m);
+    delete m;
+  }
+  m_route->release();
+}
+
+void Logger::add_target(Target *target) {
+  m_targets.push_back(std::unique_ptr<Target>(target));
+  if (auto *sink = target->sink()) {
+    auto *route = new Route;
+    route->name = m_route->name;
+    route->sinks = m_route->sinks;
+    route->sinks.push_back(sink);
+    m_route->release();
+    m_route = route;
+  } else {
+    m_has_local_targets = true;
+  }
 }
 
 void Logger::write(const Data &msg) {
+  if (!Net::current().is_running()) {
+    write_shared(msg);
+    write_async(msg);
+    return;
+  }
+
+  if (Queue::fits(msg.size())) {
+    if (!enqueue(msg)) return;
+  } else {
+    write_shared(msg);
+  }
+
+  if (m_has_local_targets) {
+    write_local(msg);
+  }
+}
+
+bool Logger::enqueue(const Data &msg) {
+  auto &writer = Writer::get();
+  if (!writer.alive()) {
+    write_shared(msg);
+    return true;
+  }
+
+  auto *queue = Queue::current();
+
+  switch (m_options.overflow) {
+    case Overflow::BLOCK:
+      while (!queue->push(m_route, msg)) {
+        if (!writer.alive()) {
+          write_shared(msg);
+          return true;
+        }
+        writer.wait_round();
+      }
+      break;
+    case Overflow::SAMPLE:
+      if (queue->usage() > Queue::CAPACITY / 2) {
+        m_sample_credit += m_options.sample_rate;
+        if (m_sample_credit < 1) {
+          drop();
+          return false;
+        }
+        m_sample_credit -= 1;
+      }
+      // fall through
+    case Overflow::DROP:
+      if (!queue->push(m_route, msg)) {
+        drop();
+        return false;
+      }
+      break;
+  }
+
+  writer.wake();
+  return true;
+}
+
+void Logger::drop() {
+  pjs::Str *name = m_name;
+  s_metric_dropped->increase();
+  s_metric_dropped->with_labels(&name, 1)->increase();
+}
+
+void Logger::write_shared(const Data &msg) {
+  if (auto *queue = Queue::local()) {
+    queue->wait_empty();
+  }
+
   if (Net::main().is_running()) {
     auto name = m_name->data()->retain();
     auto *sd = SharedData::make(msg)->retain();
@@ -144,38 +455,284 @@ void Logger::write(const Data &msg) {
     );
   }
 
-  if (Net::current().is_running()) {
+  write_targets(msg, true);
+}
+
+void Logger::write_local(const Data &msg) {
+  auto scheduled = !m_local_messages.empty();
+  m_local_messages.push(new LogMessage(msg));
+  if (!scheduled) {
+    pjs::Ref<Logger> self(this);
     Net::current().post(
       [=]() {
-        write_async(msg);
+        self->flush_local();
       }
     );
-  } else {
-    write_async(msg);
   }
 }
 
 void Logger::write_async(const Data &msg) {
   if (InputContext::origin()) {
-    write_targets(msg);
+    write_targets(msg, false);
   } else {
     InputContext ic;
-    write_targets(msg);
+    write_targets(msg, false);
   }
 }
 
-void Logger::write_targets(const Data &msg) {
+void Logger::write_targets(const Data &msg, bool shared) {
   for (const auto &p : m_targets) {
-    p->write(msg);
+    if (bool(p->sink()) == shared) {
+      p->write(msg);
+    }
+  }
+}
+
+void Logger::flush_local() {
+  InputContext ic;
+  while (auto *m = m_local_messages.head()) {
+    m_local_messages.remove(m);
+    write_targets(m->data, false);
+    delete m;
   }
 }
 
 void Logger::shutdown() {
+  flush_local();
+  if (&Net::current() == &Net::main()) {
+    if (Writer::started()) Writer::get().flush();
+  } else if (auto *queue = Queue::local()) {
+    queue->wait_empty();
+  }
   for (const auto &p : m_targets) {
     p->shutdown();
   }
 }
 
+//
+// Logger::Options
+//
+
+Logger::Options::Options(pjs::Object *options) {
+  Value(options, "overflow")
+    .get_enum(overflow)
+    .check_nullable();
+  Value(options, "sampleRate")
+    .get(sample_rate)
+    .check_nullable();
+  if (sample_rate <= 0 || sample_rate > 1) {
+    throw std::runtime_error("options.sampleRate expects a number in range (0, 1]");
+  }
+}
+
+//
+// Logger::Queue
+//
+
+thread_local Logger::Queue::Holder Logger::Queue::s_holder;
+
+bool Logger::Queue::push(Route *route, const Data &msg) {
+  auto length = msg.size();
+  auto size = record_size(length);
+  auto head = m_head.load(std::memory_order_relaxed);
+  auto tail = m_tail.load(std::memory_order_acquire);
+  auto offset = head % CAPACITY;
+  auto room = CAPACITY - offset;
+  auto skip = (room < size ? room : 0);
+  if (CAPACITY - (head - tail) < skip + size) return false;
+
+  if (skip) {
+    auto *r = reinterpret_cast<Record*>(m_buffer + offset);
+    r->skip = 1;
+    head += skip;
+    offset = 0;
+  }
+
+  auto *r = reinterpret_cast<Record*>(m_buffer + offset);
+  r->length = length;
+  r->skip = 0;
+  r->route = route;
+  route->retain();
+  msg.to_bytes(reinterpret_cast<uint8_t*>(m_buffer + offset + HEADER_SIZE));
+
+  m_head.store(head + size, std::memory_order_release);
+  m_pushed.store(m_pushed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  return true;
+}
+
+void Logger::Queue::wait_empty() {
+  auto &writer = Writer::get();
+  while (!empty() && writer.alive()) {
+    writer.wait_round();
+  }
+}
+
+template<class F>
+auto Logger::Queue::read(const F &cb) -> size_t {
+  auto head = m_head.load(std::memory_order_acquire);
+  auto tail = m_read_tail;
+  size_t n = 0;
+  while (tail != head) {
+    auto offset = tail % CAPACITY;
+    auto *r = reinterpret_cast<Record*>(m_buffer + offset);
+    if (r->skip) {
+      tail += CAPACITY - offset;
+      continue;
+    }
+    cb(r->route, m_buffer + offset + HEADER_SIZE, r->length);
+    r->route->release();
+    tail += record_size(r->length);
+    n++;
+  }
+  m_read_tail = tail;
+  m_read_count += n;
+  return n;
+}
+
+void Logger::Queue::commit() {
+  m_tail.store(m_read_tail, std::memory_order_release);
+  m_popped.store(m_read_count, std::memory_order_relaxed);
+}
+
+void Logger::init_metrics() {
+  if (!s_metric_queued) {
+    pjs::Ref<pjs::Array> label_names = pjs::Array::make();
+
+    s_metric_queued = stats::Gauge::make(
+      pjs::Str::make("pipy_log_queued_count"),
+      label_names,
+      [](stats::Gauge *gauge) {
+        auto *queue = Queue::local();
+        gauge->set(queue ? queue->count() : 0);
+      }
+    );
+
+    label_names->length(1);
+    label_names->set(0, "logger");
+
+    s_metric_dropped = stats::Counter::make(
+      pjs::Str::make("pipy_log_dropped_count"),
+      label_names
+    );
+  }
+}
+
+//
+// Logger::Writer
+//
+
+void Logger::Writer::stop() {
+  if (!alive()) return;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping.store(true);
+    m_signaled = true;
+    m_cv.notify_one();
+  }
+  m_thread.join();
+  m_stopped.store(true, std::memory_order_release);
+  {
+    std::lock_guard<std::mutex> lock(m_round_mutex);
+    m_round_cv.notify_all();
+  }
+}
+
+void Logger::Writer::main() {
+  for (;;) {
+    auto stopping = m_stopping.load();
+    if (drain() > 0) continue;
+    if (stopping) break;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_sleeping.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!m_signaled && !pending()) {
+      m_cv.wait_for(lock, std::chrono::milliseconds(10));
+    }
+    m_sleeping.store(false);
+    m_signaled = false;
+  }
+}
+
+auto Logger::Writer::drain() -> size_t {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_round = m_queues;
+  }
+
+  HistoryBatch *history = nullptr;
+  auto history_enabled = !m_stopping.load() && Net::main().is_running();
+
+  size_t count = 0;
+  for (auto *q : m_round) {
+    count += q->read(
+      [&](Route *route, const char *msg, size_t len) {
+        for (auto *sink : route->sinks) {
+          sink->write(msg, len);
+          if (!sink->m_dirty) {
+            sink->m_dirty = true;
+            m_dirty_sinks.push_back(sink);
+          }
+        }
+        if (history_enabled) {
+          if (!history) history = new HistoryBatch;
+          route->retain();
+          history->items.push_back({ route, history->buffer.size(), len });
+          history->buffer.append(msg, len);
+        }
+      }
+    );
+  }
+
+  for (auto *sink : m_dirty_sinks) {
+    sink->flush();
+    sink->m_dirty = false;
+  }
+
+  m_dirty_sinks.clear();
+
+  for (auto *q : m_round) {
+    q->commit();
+    if (q->closed() && q->empty()) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_queues.erase(std::find(m_queues.begin(), m_queues.end(), q));
+      delete q;
+    }
+  }
+
+  m_rounds.fetch_add(1);
+
+  if (m_round_waiters.load() > 0) {
+    std::lock_guard<std::mutex> lock(m_round_mutex);
+    m_round_cv.notify_all();
+  }
+
+  if (history) {
+    Net::main().post(
+      [=]() {
+        write_history(history);
+      }
+    );
+  }
+
+  return count;
+}
+
+bool Logger::Writer::pending() {
+  for (auto *q : m_queues) {
+    if (!q->empty()) return true;
+  }
+  return false;
+}
+
+void Logger::Writer::write_history(HistoryBatch *batch) {
+  for (const auto &i : batch->items) {
+    Data msg(batch->buffer.c_str() + i.offset, i.length, &s_dp);
+    History::write(i.route->name, msg);
+    i.route->release();
+  }
+  delete batch;
+}
+
 //
 // Logger::History
 //
@@ -249,76 +806,226 @@ void Logger::History::dump_messages(Data &buffer) {
 }
 
 //
-// Logger::StdoutTarget
+// Logger::Sink
 //
 
-void Logger::StdoutTarget::write(const Data &msg) {
-  if (Net::current().is_running()) {
-    if (!m_file_stream) m_file_stream = FileStream::make(false, m_f, &s_dp_stdout);
-    Data *buf = Data::make();
-    s_dp.push(buf, &msg);
-    s_dp.push(buf, '\n');
-    m_file_stream->input()->input(buf);
-  } else {
-    for (const auto c : msg.chunks()) {
-      auto ptr = std::get<0>(c);
-      auto len = std::get<1>(c);
-      std::fwrite(ptr, 1, len, m_f);
-    }
-    std::fputc('\n', m_f);
+static std::mutex s_sinks_mutex;
+static std::vector<Logger::Sink*> *s_sinks = nullptr;
+
+void Logger::Sink::for_each(const std::function<void(Sink*)> &cb) {
+  std::vector<Sink*> sinks;
+  {
+    std::lock_guard<std::mutex> lock(s_sinks_mutex);
+    if (s_sinks) sinks = *s_sinks;
   }
+  for (auto *sink : sinks) cb(sink);
+}
+
+Logger::Sink::Sink() {
+  std::lock_guard<std::mutex> lock(s_sinks_mutex);
+  if (!s_sinks) s_sinks = new std::vector<Sink*>;
+  s_sinks->push_back(this);
+}
+
+void Logger::Sink::write(const Data &msg) {
+  std::string buf(msg.size(), 0);
+  msg.to_bytes(reinterpret_cast<uint8_t*>(&buf[0]));
+  write(buf.c_str(), buf.size());
+}
+
+void Logger::Sink::write(const char *msg, size_t len) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  output(msg, len);
+}
+
+void Logger::Sink::flush() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  sync();
+}
+
+void Logger::Sink::close() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  sync();
+  release();
 }
 
 //
-// Logger::FileTarget
+// StreamSink
 //
 
-Logger::FileTarget::FileTarget(pjs::Str *filename)
-  : m_module(new Module)
-{
-  PipelineLayout *ppl = PipelineLayout::make();
-  ppl->append(new Tee(filename));
+class StreamSink : public Logger::Sink {
+public:
+  static auto get(FILE *f) -> StreamSink* {
+    static StreamSink *s_stdout = new StreamSink(stdout);
+    static StreamSink *s_stderr = new StreamSink(stderr);
+    return f == stdout ? s_stdout : s_stderr;
+  }
+
+protected:
+  StreamSink(FILE *f) : m_f(f) {}
+
+  FILE* m_f;
+
+  virtual void output(const char *msg, size_t len) override {
+    std::fwrite(msg, 1, len, m_f);
+    std::fputc('\n', m_f);
+  }
+
+  virtual void sync() override {
+    std::fflush(m_f);
+  }
+};
 
-  m_pipeline_layout = ppl;
-  m_pipeline = Pipeline::make(ppl, new Context());
+//
+// FileSink
+//
+
+class FileSink : public StreamSink {
+public:
+  static auto get(const std::string &path) -> FileSink* {
+    static std::mutex s_mutex;
+    static std::map<std::string, FileSink*> s_all_sinks;
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto &sink = s_all_sinks[path];
+    if (!sink) sink = new FileSink(path);
+    return sink;
+  }
+
+private:
+  FileSink(const std::string &path)
+    : StreamSink(nullptr)
+    , m_path(path) {}
+
+  std::string m_path;
+  bool m_failed = false;
+
+  virtual void output(const char *msg, size_t len) override {
+    if (!m_f && !m_failed) open();
+    if (m_f) StreamSink::output(msg, len);
+  }
+
+  virtual void sync() override {
+    if (m_f) StreamSink::sync();
+  }
+
+  //
+  // Closed by Logger::reopen_all() on SIGUSR1 once the file is rotated.
+  // The next record opens it again, in append mode so that a restart
+  // does not wipe out what was logged before.
+  //
+
+  virtual void release() override {
+    if (m_f && m_f != stdout) std::fclose(m_f);
+    m_f = nullptr;
+    m_failed = false;
+  }
+
+  void open() {
+    if (m_path == "-") {
+      m_f = stdout;
+      return;
+    }
+    auto dirname = utils::path_dirname(m_path);
+    if (!dirname.empty() && !mkdir_p(dirname)) {
+      std::cerr << "[logger] cannot create directory: " << dirname << std::endl;
+      m_failed = true;
+    } else if (!(m_f = std::fopen(m_path.c_str(), "ab"))) {
+      std::cerr << "[logger] cannot open file: " << m_path << std::endl;
+      m_failed = true;
+    }
+  }
+
+  static bool mkdir_p(const std::string &path) {
+    if (fs::is_dir(path)) return true;
+    auto dirname = utils::path_dirname(path);
+    if (!mkdir_p(dirname)) return false;
+    return fs::make_dir(path);
+  }
+};
+
+//
+// SyslogSink
+//
+
+class SyslogSink : public Logger::Sink {
+public:
+  static auto get(int priority) -> SyslogSink* {
+    static SyslogSink *s_sinks[] = {
+      new SyslogSink(LOG_EMERG),
+      new SyslogSink(LOG_ALERT),
+      new SyslogSink(LOG_CRIT),
+      new SyslogSink(LOG_ERR),
+      new SyslogSink(LOG_WARNING),
+      new SyslogSink(LOG_NOTICE),
+      new SyslogSink(LOG_INFO),
+      new SyslogSink(LOG_DEBUG),
+    };
+    for (auto *s : s_sinks) {
+      if (s->m_priority == priority) {
+        return s;
+      }
+    }
+    return s_sinks[LOG_INFO];
+  }
+
+private:
+  SyslogSink(int priority) : m_priority(priority) {}
+
+  int m_priority;
+
+  virtual void output(const char *msg, size_t len) override {
+    syslog(m_priority, "%.*s", int(len), msg);
+  }
+};
+
+//
+// Logger::SinkTarget
+//
+
+void Logger::SinkTarget::write(const Data &msg) {
+  m_sink->write(msg);
+  m_sink->flush();
 }
 
-void Logger::FileTarget::write(const Data &msg) {
-  Data *buf = Data::make();
-  s_dp.push(buf, &msg);
-  s_dp.push(buf, '\n');
-  m_pipeline->input()->input(buf);
+//
+// Logger::StdoutTarget
+//
+
+Logger::StdoutTarget::StdoutTarget(FILE *f)
+  : SinkTarget(StreamSink::get(f))
+{
 }
 
-void Logger::FileTarget::shutdown() {
-  m_module->shutdown();
-  m_pipeline = nullptr;
+//
+// Logger::FileTarget
+//
+
+Logger::FileTarget::FileTarget(pjs::Str *filename)
+  : SinkTarget(FileSink::get(filename->str()))
+{
 }
 
 //
 // Logger::SyslogTarget
 //
 
-Logger::SyslogTarget::SyslogTarget(Priority priority) {
+static int syslog_priority(Logger::SyslogTarget::Priority priority) {
   switch (priority) {
-    case Priority::EMERG   : m_priority = LOG_EMERG; break;
-    case Priority::ALERT   : m_priority = LOG_ALERT; break;
-    case Priority::CRIT    : m_priority = LOG_CRIT; break;
-    case Priority::ERR     : m_priority = LOG_ERR; break;
-    case Priority::WARNING : m_priority = LOG_WARNING; break;
-    case Priority::NOTICE  : m_priority = LOG_NOTICE; break;
-    case Priority::INFO    : m_priority = LOG_INFO; break;
-    case Priority::DEBUG   : m_priority = LOG_DEBUG; break;
-    default                : m_priority = LOG_INFO; break;
+    case Logger::SyslogTarget::Priority::EMERG   : return LOG_EMERG;
+    case Logger::SyslogTarget::Priority::ALERT   : return LOG_ALERT;
+    case Logger::SyslogTarget::Priority::CRIT    : return LOG_CRIT;
+    case Logger::SyslogTarget::Priority::ERR     : return LOG_ERR;
+    case Logger::SyslogTarget::Priority::WARNING : return LOG_WARNING;
+    case Logger::SyslogTarget::Priority::NOTICE  : return LOG_NOTICE;
+    case Logger::SyslogTarget::Priority::INFO    : return LOG_INFO;
+    case Logger::SyslogTarget::Priority::DEBUG   : return LOG_DEBUG;
+    default                                      : return LOG_INFO;
   }
 }
 
-void Logger::SyslogTarget::write(const Data &msg) {
-  auto len = msg.size();
-  uint8_t buf[len+1];
-  msg.to_bytes(buf);
-  buf[len] = 0;
-  syslog(m_priority, "%s", buf);
+Logger::SyslogTarget::SyslogTarget(Priority priority)
+  : SinkTarget(SyslogSink::get(syslog_priority(priority)))
+{
 }
 
 //
@@ -489,6 +1196,12 @@ using namespace pipy::logging;
 // Logger
 //
 
+template<> void EnumDef<Logger::Overflow>::init() {
+  define(Logger::Overflow::BLOCK, "block");
+  define(Logger::Overflow::DROP, "drop");
+  define(Logger::Overflow::SAMPLE, "sample");
+}
+
 template<> void EnumDef<Logger::SyslogTarget::Priority>::init() {
   define(Logger::SyslogTarget::Priority::EMERG, "EMERG");
   define(Logger::SyslogTarget::Priority::ALERT, "ALERT");
@@ -547,8 +1260,14 @@ template<> void ClassDef<BinaryLogger>::init() {
 
   ctor([](Context &ctx) -> Object* {
     pjs::Str *name;
-    if (!ctx.arguments(1, &name)) return nullptr;
-    return BinaryLogger::make(name);
+    pjs::Object *options = nullptr;
+    if (!ctx.arguments(1, &name, &options)) return nullptr;
+    try {
+      return BinaryLogger::make(name, options);
+    } catch (std::runtime_error &err) {
+      ctx.error(err);
+      return nullptr;
+    }
   });
 }
 
@@ -566,8 +1285,14 @@ template<> void ClassDef<TextLogger>::init() {
 
   ctor([](Context &ctx) -> Object* {
     pjs::Str *name;
-    if (!ctx.arguments(1, &name)) return nullptr;
-    return TextLogger::make(name);
+    pjs::Object *options = nullptr;
+    if (!ctx.arguments(1, &name, &options)) return nullptr;
+    try {
+      return TextLogger::make(name, options);
+    } catch (std::runtime_error &err) {
+      ctx.error(err);
+      return nullptr;
+    }
   });
 }
 
@@ -585,8 +1310,14 @@ template<> void ClassDef<JSONLogger>::init() {
 
   ctor([](Context &ctx) -> Object* {
     pjs::Str *name;
-    if (!ctx.arguments(1, &name)) return nullptr;
-    return JSONLogger::make(name);
+    pjs::Object *options = nullptr;
+    if (!ctx.arguments(1, &name, &options)) return nullptr;
+    try {
+      return JSONLogger::make(name, options);
+    } catch (std::runtime_error &err) {
+      ctx.error(err);
+      return nullptr;
+    }
   });
 }
 
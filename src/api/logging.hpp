@@ -33,9 +33,12 @@
 #include "filters/pack.hpp"
 #include "filters/tls.hpp"
 
+#include <atomic>
 #include <list>
 #include <memory>
+#include <mutex>
 #include <set>
+#include <vector>
 #include <functional>
 
 namespace pipy {
@@ -56,11 +59,74 @@ namespace logging {
 
 class Logger : public pjs::ObjectTemplate<Logger> {
 public:
+
+  //
+  // Logger::Overflow
+  //
+
+  enum class Overflow {
+    BLOCK,
+    DROP,
+    SAMPLE,
+  };
+
+  //
+  // Logger::Options
+  //
+
+  struct Options : public pipy::Options {
+    Overflow overflow = Overflow::BLOCK;
+    double sample_rate = 0.1;
+
+    Options() {}
+    Options(pjs::Object *options);
+  };
+
   static void set_admin_service(AdminService *admin_service);
   static void set_admin_link(AdminLink *admin_link);
   static void get_names(const std::function<void(const std::string &)> &cb);
   static void tail(const std::string &name, Data &buffer);
   static void shutdown_all();
+  static void reopen_all();
+  static void close_all();
+
+private:
+  class Queue;
+  class Writer;
+
+public:
+
+  //
+  // Logger::Sink
+  //
+  // Output shared by loggers on all threads. Written by the logging
+  // thread in batches, or directly when no event loop is running.
+  // Sinks live till the process exits since any thread can still log
+  // on its way out. A closed sink opens again on the next write.
+  //
+
+  class Sink {
+  public:
+    static void for_each(const std::function<void(Sink*)> &cb);
+
+    void write(const Data &msg);
+    void write(const char *msg, size_t len);
+    void flush();
+    void close();
+
+  protected:
+    Sink();
+    virtual ~Sink() {}
+    virtual void output(const char *msg, size_t len) = 0;
+    virtual void sync() {}
+    virtual void release() {}
+
+  private:
+    std::mutex m_mutex;
+    bool m_dirty = false;
+
+    friend class Writer;
+  };
 
   //
   // Logger::Target
@@ -69,60 +135,49 @@ public:
   class Target {
   public:
     virtual ~Target() {}
+    virtual auto sink() -> Sink* { return nullptr; }
     virtual void write(const Data &msg) = 0;
     virtual void shutdown() {}
   };
 
   //
-  // Logger::StdoutTarget
+  // Logger::SinkTarget
   //
 
-  class StdoutTarget : public Target {
+  class SinkTarget : public Target {
   public:
-    StdoutTarget(FILE *f) : m_f(f) {}
+    SinkTarget(Sink *sink) : m_sink(sink) {}
 
   private:
+    virtual auto sink() -> Sink* override { return m_sink; }
     virtual void write(const Data &msg) override;
 
-    FILE* m_f;
-    pjs::Ref<FileStream> m_file_stream;
+    Sink* m_sink;
   };
 
   //
-  // Logger::FileTarget
+  // Logger::StdoutTarget
   //
 
-  class FileTarget : public Target {
+  class StdoutTarget : public SinkTarget {
   public:
-    FileTarget(pjs::Str *filename);
-
-  private:
-
-    //
-    // Logger::FileTarget::Module
-    //
-
-    class Module : public ModuleBase {
-    public:
-      Module() : ModuleBase("Logger::FileTarget") {}
-      virtual auto new_context(pipy::Context *base) -> pipy::Context* override {
-        return new Context();
-      }
-    };
+    StdoutTarget(FILE *f);
+  };
 
-    virtual void write(const Data &msg) override;
-    virtual void shutdown() override;
+  //
+  // Logger::FileTarget
+  //
 
-    pjs::Ref<Module> m_module;
-    pjs::Ref<PipelineLayout> m_pipeline_layout;
-    pjs::Ref<Pipeline> m_pipeline;
+  class FileTarget : public SinkTarget {
+  public:
+    FileTarget(pjs::Str *filename);
   };
 
   //
   // Logger::SyslogTarget
   //
 
-  class SyslogTarget : public Target {
+  class SyslogTarget : public SinkTarget {
   public:
     enum class Priority {
       EMERG,
@@ -136,11 +191,6 @@ public:
     };
 
     SyslogTarget(Priority prority = Priority::INFO);
-
-  private:
-    virtual void write(const Data &msg) override;
-
-    int m_priority;
   };
 
   //
@@ -188,21 +238,36 @@ public:
 
   auto name() const -> pjs::Str* { return m_name; }
 
-  void add_target(Target *target) {
-    m_targets.push_back(std::unique_ptr<Target>(target));
-  }
-
+  void add_target(Target *target);
   void write(const Data &msg);
 
   virtual void log(int argc, const pjs::Value *args) = 0;
   virtual void shutdown();
 
 protected:
-  Logger(pjs::Str *name);
+  Logger(pjs::Str *name, const Options &options = Options());
   virtual ~Logger();
 
 private:
 
+  //
+  // Logger::Route
+  //
+  // Name and shared sinks of a logger, referenced by every queued
+  // message until the logging thread has written it out.
+  //
+
+  struct Route {
+    std::string name;
+    std::vector<Sink*> sinks;
+    std::atomic<int> refs;
+
+    Route() : refs(1) {}
+    void retain() { refs.fetch_add(1, std::memory_order_relaxed); }
+    void release() { if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this; }
+  };
+
+
   //
   // Logger::LogMessage
   //
@@ -251,9 +316,21 @@ private:
 
   pjs::Ref<pjs::Str> m_name;
   std::list<std::unique_ptr<Target>> m_targets;
-
+  Options m_options;
+  Route* m_route;
+  List<LogMessage> m_local_messages;
+  double m_sample_credit = 0;
+  bool m_has_local_targets = false;
+
+  static void init_metrics();
+
+  bool enqueue(const Data &msg);
+  void drop();
+  void write_shared(const Data &msg);
+  void write_local(const Data &msg);
   void write_async(const Data &msg);
-  void write_targets(const Data &msg);
+  void write_targets(const Data &msg, bool shared);
+  void flush_local();
 
   static AdminService* s_admin_service;
   static AdminLink* s_admin_link;
@@ -269,8 +346,8 @@ private:
 
 class BinaryLogger : public pjs::ObjectTemplate<BinaryLogger, Logger> {
 private:
-  BinaryLogger(pjs::Str *name)
-    : pjs::ObjectTemplate<BinaryLogger, Logger>(name) {}
+  BinaryLogger(pjs::Str *name, const Options &options = Options())
+    : pjs::ObjectTemplate<BinaryLogger, Logger>(name, options) {}
 
   virtual void log(int argc, const pjs::Value *args) override;
 
@@ -283,8 +360,8 @@ private:
 
 class TextLogger : public pjs::ObjectTemplate<TextLogger, Logger> {
 private:
-  TextLogger(pjs::Str *name)
-    : pjs::ObjectTemplate<TextLogger, Logger>(name) {}
+  TextLogger(pjs::Str *name, const Options &options = Options())
+    : pjs::ObjectTemplate<TextLogger, Logger>(name, options) {}
 
   virtual void log(int argc, const pjs::Value *args) override;
 
@@ -297,8 +374,8 @@ private:
 
 class JSONLogger : public pjs::ObjectTemplate<JSONLogger, Logger> {
 private:
-  JSONLogger(pjs::Str *name)
-    : pjs::ObjectTemplate<JSONLogger, Logger>(name) {}
+  JSONLogger(pjs::Str *name, const Options &options = Options())
+    : pjs::ObjectTemplate<JSONLogger, Logger>(name, options) {}
 
   virtual void log(int argc, const pjs::Value *args) override;
 
@@ -28,7 +28,10 @@
 #include "utils.hpp"
 #include "log.hpp"
 
+#include <algorithm>
 #include <cmath>
+#include <cstdlib>
+#include <limits>
 
 //
 // Initial state:
@@ -70,6 +73,7 @@ namespace pipy {
 namespace stats {
 
 static std::string s_prefix_histogram("Histogram[");
+static std::string s_prefix_log_histogram("LogHistogram[");
 thread_local static pjs::ConstStr s_str_Counter("Counter");
 thread_local static pjs::ConstStr s_str_Gauge("Gauge");
 thread_local static pjs::ConstStr s_str_count("count");
@@ -244,12 +248,14 @@ public:
     const std::vector<std::string> &label_names,
     pjs::Str::CharData *label_values[],
     const char *le_str,
+    const LogHistogram::Layout *log_layout,
     const std::function<void(const void *, size_t)> &out
   ) : m_name(name)
     , m_extra_labels(extra_labels)
     , m_label_names(label_names)
     , m_label_values(label_values)
     , m_le_str(le_str)
+    , m_log_layout(log_layout)
     , m_out(out) {}
 
   void output(Node *node, int level) {
@@ -263,7 +269,32 @@ public:
       m_label_values[level-1] = node->get_key();
     }
 
-    if (m_le_str) {
+    if (auto *layout = m_log_layout) {
+      auto size = layout->size();
+      auto *counts = node->values;
+      char str[100];
+      for (auto le : layout->buckets()) {
+        auto len = pjs::Number::to_string(str, sizeof(str), le);
+        output(m_name);
+        output(s_bucket);
+        output(level, layout->cumulative(counts, le), str, len);
+      }
+      output(m_name);
+      output(s_bucket);
+      output(level, node->values[size], "+Inf", 4);
+      output(m_name);
+      output(s_count);
+      output(level, node->values[size]);
+      output(m_name);
+      output(s_sum);
+      output(level, node->values[size+1]);
+      for (auto q : layout->quantiles()) {
+        auto len = pjs::Number::to_string(str, sizeof(str), q);
+        output(m_name);
+        output(level, layout->quantile(counts, q), str, len, true);
+      }
+
+    } else if (m_le_str) {
       auto le = 0;
       auto *p = m_le_str;
       while (p) {
@@ -302,6 +333,7 @@ private:
   const std::vector<std::string> &m_label_names;
   pjs::Str::CharData **m_label_values;
   const char *m_le_str;
+  const LogHistogram::Layout *m_log_layout;
   const std::function<void(const void *, size_t)> &m_out;
 
   void output(char c) { m_out(&c, 1); }
@@ -310,9 +342,11 @@ private:
 
   void output(
     int level, double num,
-    const char *le = nullptr, int le_len = 0
+    const char *le = nullptr, int le_len = 0,
+    bool quantile = false
   ) {
     static const std::string s_le("le=");
+    static const std::string s_quantile("quantile=");
     if (level > 0 || !m_extra_labels.empty() || le) {
       bool first = true;
       output('{');
@@ -323,7 +357,7 @@ private:
       for (int i = 0, n = (le ? level+1 : level); i < n; i++) {
         if (first) first = false; else output(',');
         if (i == level) {
-          output(s_le);
+          output(quantile ? s_quantile : s_le);
           output('"');
           output(le, le_len);
           output('"');
@@ -430,8 +464,11 @@ void MetricData::to_prometheus(const std::string &extra_labels, const std::funct
       auto *name = ent->name.get();
       auto *type = ent->type.get();
       auto *shape = ent->shape.get();
+      std::shared_ptr<LogHistogram::Layout> log_layout;
       if (utils::starts_with(type->str(), s_prefix_histogram)) {
         le_str = type->c_str() + s_prefix_histogram.length();
+      } else if (utils::starts_with(type->str(), s_prefix_log_histogram)) {
+        log_layout = LogHistogram::Layout::parse(type->str());
       }
       if (shape->size() > 0 && ent->labels.empty()) {
         auto labels = utils::split(shape->str(), '/');
@@ -440,7 +477,7 @@ void MetricData::to_prometheus(const std::string &extra_labels, const std::funct
         for (auto &s : labels) { ent->labels[i++] = std::move(s); }
       }
       pjs::Str::CharData *label_values[ent->labels.size()];
-      Prometheus<Node> prom(name->str(), extra_labels, ent->labels, label_values, le_str, out);
+      Prometheus<Node> prom(name->str(), extra_labels, ent->labels, label_values, le_str, log_layout.get(), out);
       prom.output(root, 0);
     }
   }
@@ -564,12 +601,17 @@ void MetricData::Deserializer::string(const char *s, size_t len) {
             return;
           case Level::Field::TYPE:
             if (is_entry) {
-              int dim = 1;
+              int dim = 1, max_dim = 100;
               if (utils::starts_with(str->str(), s_prefix_histogram)) {
                 for (auto c : str->str()) if (c == ',') dim++;
                 dim += 2;
+              } else if (utils::starts_with(str->str(), s_prefix_log_histogram)) {
+                if (auto layout = LogHistogram::Layout::parse(str->str())) {
+                  dim = layout->size() + 2;
+                  max_dim = dim;
+                }
               }
-              if (dim <= 100) {
+              if (dim <= max_dim) {
                 auto node = Node::make(dim);
                 m_current_entry->type = str->data();
                 m_current_entry->dimensions = dim;
@@ -869,8 +911,11 @@ void MetricDataSum::to_prometheus(const std::function<void(const void *, size_t)
     auto ent = p.second;
     if (auto root = ent->root.get()) {
       const char *le_str = nullptr;
+      std::shared_ptr<LogHistogram::Layout> log_layout;
       if (utils::starts_with(ent->type->str(), s_prefix_histogram)) {
         le_str = ent->type->c_str() + s_prefix_histogram.length();
+      } else if (utils::starts_with(ent->type->str(), s_prefix_log_histogram)) {
+        log_layout = LogHistogram::Layout::parse(ent->type->str());
       }
       if (ent->shape->size() > 0 && ent->labels.empty()) {
         auto labels = utils::split(ent->shape->str(), '/');
@@ -880,7 +925,7 @@ void MetricDataSum::to_prometheus(const std::function<void(const void *, size_t)
       }
       pjs::Str::CharData *label_values[ent->labels.size()];
       std::string empty;
-      Prometheus<Node> prom(ent->name->str(), empty, ent->labels, label_values, le_str, out);
+      Prometheus<Node> prom(ent->name->str(), empty, ent->labels, label_values, le_str, log_layout.get(), out);
       prom.output(root, 0);
     }
   }
@@ -1276,6 +1321,285 @@ void Histogram::set_value(int dim, double value) {
   create_value();
 }
 
+//
+// LogHistogram::Options
+//
+
+LogHistogram::Options::Options()
+  : quantiles({ 0.5, 0.9, 0.99, 0.999 })
+{
+}
+
+LogHistogram::Options::Options(pjs::Object *options) : Options() {
+  pjs::Ref<pjs::Array> buckets_array, quantiles_array;
+  Value(options, "precision")
+    .get(precision)
+    .check_nullable();
+  Value(options, "lowest")
+    .get(lowest)
+    .check_nullable();
+  Value(options, "highest")
+    .get(highest)
+    .check_nullable();
+  Value(options, "buckets")
+    .get(buckets_array)
+    .check_nullable();
+  Value(options, "quantiles")
+    .get(quantiles_array)
+    .check_nullable();
+
+  if (precision < 1 || precision > 10) {
+    throw std::runtime_error("options.precision expects an integer in range [1, 10]");
+  }
+  if (!(lowest > 0)) {
+    throw std::runtime_error("options.lowest expects a positive number");
+  }
+  if (!(highest >= lowest * 2)) {
+    throw std::runtime_error("options.highest expects a number no less than twice options.lowest");
+  }
+
+  if (buckets_array) {
+    buckets_array->iterate_all(
+      [&](pjs::Value &v, int) {
+        auto n = v.to_number();
+        if (!buckets.empty() && n <= buckets.back()) {
+          throw std::runtime_error("options.buckets expects numbers in ascending order");
+        }
+        buckets.push_back(n);
+      }
+    );
+  }
+
+  if (quantiles_array) {
+    quantiles.clear();
+    quantiles_array->iterate_all(
+      [&](pjs::Value &v, int) {
+        auto n = v.to_number();
+        if (!(0 <= n && n <= 1)) {
+          throw std::runtime_error("options.quantiles expects numbers in range [0, 1]");
+        }
+        quantiles.push_back(n);
+      }
+    );
+  }
+}
+
+//
+// LogHistogram::Layout
+//
+
+auto LogHistogram::Layout::parse(const std::string &type) -> std::shared_ptr<Layout> {
+  if (!utils::starts_with(type, s_prefix_log_histogram)) return nullptr;
+  auto body = type.substr(s_prefix_log_histogram.length());
+  if (body.empty() || body.back() != ']') return nullptr;
+  body.pop_back();
+
+  auto split = utils::split(body, ';');
+  std::vector<std::string> parts(split.begin(), split.end());
+  if (parts.size() != 3) return nullptr;
+
+  auto numbers = [](const std::string &str, std::vector<double> &out) {
+    out.clear();
+    for (const auto &s : utils::split(str, ',')) {
+      if (!s.empty()) out.push_back(std::strtod(s.c_str(), nullptr));
+    }
+  };
+
+  std::vector<double> shape;
+  numbers(parts[0], shape);
+  if (shape.size() != 3) return nullptr;
+
+  Options options;
+  options.precision = int(shape[0]);
+  options.lowest = shape[1];
+  options.highest = shape[2];
+  numbers(parts[1], options.buckets);
+  numbers(parts[2], options.quantiles);
+
+  if (options.precision < 1 || options.precision > 10) return nullptr;
+  if (!(options.lowest > 0) || !(options.highest >= options.lowest * 2)) return nullptr;
+
+  try {
+    return std::make_shared<Layout>(options);
+  } catch (std::runtime_error &) {
+    return nullptr;
+  }
+}
+
+LogHistogram::Layout::Layout(const Options &options)
+  : m_precision(options.precision)
+  , m_size(std::numeric_limits<int>::max())
+  , m_linear(uint64_t(2) << options.precision)
+  , m_lowest(options.lowest)
+  , m_scale(1 / options.lowest)
+  , m_limit(std::numeric_limits<double>::infinity())
+  , m_buckets(options.buckets)
+  , m_quantiles(options.quantiles)
+{
+  auto last = index(options.highest);
+  m_size = last + 2;
+  m_limit = bound(last + 1);
+
+  if (m_size > 4096) {
+    throw std::runtime_error("too many histogram buckets, try lowering the precision or the range");
+  }
+
+  if (m_buckets.empty()) {
+    for (auto b = m_lowest; b <= m_limit * m_lowest; b *= 2) {
+      m_buckets.push_back(b);
+    }
+  }
+
+  auto append = [this](double n) {
+    char str[100];
+    auto len = pjs::Number::to_string(str, sizeof(str), n);
+    m_type.append(str, len);
+  };
+
+  m_type = s_prefix_log_histogram;
+  append(m_precision);
+  m_type += ',';
+  append(m_lowest);
+  m_type += ',';
+  append(options.highest);
+  m_type += ';';
+  for (size_t i = 0; i < m_buckets.size(); i++) {
+    if (i > 0) m_type += ',';
+    append(m_buckets[i]);
+  }
+  m_type += ';';
+  for (size_t i = 0; i < m_quantiles.size(); i++) {
+    if (i > 0) m_type += ',';
+    append(m_quantiles[i]);
+  }
+  m_type += ']';
+}
+
+auto LogHistogram::Layout::bound(int i) const -> double {
+  if (uint64_t(i) < m_linear) return i;
+  auto j = uint64_t(i) - m_linear;
+  auto k = (j >> m_precision) + 1;
+  auto sub = (j & ((uint64_t(1) << m_precision) - 1)) + (uint64_t(1) << m_precision);
+  return double(sub << k);
+}
+
+auto LogHistogram::Layout::lower(int i) const -> double {
+  return bound(i) * m_lowest;
+}
+
+auto LogHistogram::Layout::upper(int i) const -> double {
+  if (i >= m_size - 1) return std::numeric_limits<double>::infinity();
+  return bound(i + 1) * m_lowest;
+}
+
+auto LogHistogram::Layout::quantile(const double *counts, double q) const -> double {
+  double total = 0;
+  for (int i = 0; i < m_size; i++) total += counts[i];
+  if (total <= 0) return 0;
+
+  auto rank = q * total;
+  double sum = 0;
+  for (int i = 0; i < m_size; i++) {
+    auto n = counts[i];
+    if (n <= 0) continue;
+    if (sum + n >= rank) {
+      if (i == m_size - 1) return lower(i);
+      auto l = lower(i);
+      auto u = upper(i);
+      return l + (u - l) * (rank - sum) / n;
+    }
+    sum += n;
+  }
+
+  return lower(m_size - 1);
+}
+
+auto LogHistogram::Layout::cumulative(const double *counts, double le) const -> double {
+  auto limit = le * (1 + 1e-9);
+  double sum = 0;
+  for (int i = 0; i < m_size && upper(i) <= limit; i++) {
+    sum += counts[i];
+  }
+  return sum;
+}
+
+//
+// LogHistogram
+//
+
+LogHistogram::LogHistogram(pjs::Str *name, const Options &options, pjs::Array *label_names, MetricSet *set)
+  : MetricTemplate<LogHistogram>(name, label_names, set)
+  , m_layout(std::make_shared<Layout>(options))
+  , m_counts(m_layout->size())
+{
+}
+
+LogHistogram::LogHistogram(Metric *parent, pjs::Str **labels)
+  : MetricTemplate<LogHistogram>(parent, labels)
+  , m_layout(static_cast<LogHistogram*>(parent)->m_layout)
+  , m_counts(m_layout->size())
+{
+}
+
+void LogHistogram::zero() {
+  std::fill(m_counts.begin(), m_counts.end(), 0);
+  m_sum = 0;
+  m_count = 0;
+  create_value();
+}
+
+void LogHistogram::observe(double n) {
+  m_counts[m_layout->index(n)] += 1;
+  m_sum += n;
+  m_count += 1;
+  create_value();
+}
+
+auto LogHistogram::quantile(double q) const -> double {
+  return m_layout->quantile(m_counts.data(), q);
+}
+
+void LogHistogram::value_of(pjs::Value &out) {
+  const auto &quantiles = m_layout->quantiles();
+  auto *a = pjs::Array::make(quantiles.size());
+  for (size_t i = 0; i < quantiles.size(); i++) {
+    a->set(i, quantile(quantiles[i]));
+  }
+  out.set(a);
+}
+
+auto LogHistogram::get_type() -> pjs::Str* {
+  return pjs::Str::make(m_layout->type());
+}
+
+auto LogHistogram::get_dim() -> int {
+  return m_layout->size() + 2;
+}
+
+auto LogHistogram::get_value(int dim) -> double {
+  int size = m_layout->size();
+  if (0 <= dim && dim < size) {
+    return m_counts[dim];
+  }
+  switch (dim - size) {
+    case 0: return m_count;
+    case 1: return m_sum;
+  }
+  return 0;
+}
+
+void LogHistogram::set_value(int dim, double value) {
+  int size = m_layout->size();
+  if (0 <= dim && dim < size) {
+    m_counts[dim] = value;
+  }
+  switch (dim - size) {
+    case 0: m_count = value; break;
+    case 1: m_sum = value; break;
+  }
+  create_value();
+}
+
 } // namespace stats
 } // namespace pipy
 
@@ -1420,6 +1744,50 @@ template<> void ClassDef<Constructor<Histogram>>::init() {
   ctor();
 }
 
+//
+// LogHistogram
+//
+
+template<> void ClassDef<LogHistogram>::init() {
+  super<Metric>();
+
+  ctor([](Context &ctx) -> Object* {
+    Str *name;
+    Object *options = nullptr;
+    Array *labels = nullptr;
+    if (!ctx.check(0, name)) return nullptr;
+    if (!ctx.check(1, options, options)) return nullptr;
+    if (!ctx.check(2, labels, labels)) return nullptr;
+    try {
+      return LogHistogram::make(name, options, labels);
+    } catch (std::runtime_error &err) {
+      ctx.error(err);
+      return nullptr;
+    }
+  });
+
+  method("zero", [](Context &ctx, Object *obj, Value &ret) {
+    obj->as<LogHistogram>()->zero();
+  });
+
+  method("observe", [](Context &ctx, Object *obj, Value &ret) {
+    double n;
+    if (!ctx.arguments(1, &n)) return;
+    obj->as<LogHistogram>()->observe(n);
+  });
+
+  method("quantile", [](Context &ctx, Object *obj, Value &ret) {
+    double q;
+    if (!ctx.arguments(1, &q)) return;
+    ret.set(obj->as<LogHistogram>()->quantile(q));
+  });
+}
+
+template<> void ClassDef<Constructor<LogHistogram>>::init() {
+  super<Function>();
+  ctor();
+}
+
 //
 // Stats
 //
@@ -1429,6 +1797,7 @@ template<> void ClassDef<Stats>::init() {
   variable("Counter", class_of<Constructor<Counter>>());
   variable("Gauge", class_of<Constructor<Gauge>>());
   variable("Histogram", class_of<Constructor<Histogram>>());
+  variable("LogHistogram", class_of<Constructor<LogHistogram>>());
 }
 
 } // namespace pjs
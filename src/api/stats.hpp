@@ -495,6 +495,103 @@ private:
   friend class pjs::ObjectTemplate<Histogram, Metric>;
 };
 
+//
+// LogHistogram
+//
+
+class LogHistogram : public MetricTemplate<LogHistogram> {
+public:
+
+  //
+  // LogHistogram::Options
+  //
+
+  struct Options : public pipy::Options {
+    int precision = 3;
+    double lowest = 1;
+    double highest = 3600000;
+    std::vector<double> buckets;
+    std::vector<double> quantiles;
+
+    Options();
+    Options(pjs::Object *options);
+  };
+
+  //
+  // LogHistogram::Layout
+  //
+  // Values up to 2^(p+1) units of the lowest discernible value get
+  // one bucket per unit. Every power of two above that is split into
+  // 2^p buckets of equal width, up to the highest trackable value,
+  // after which comes a single overflow bucket. Buckets include their
+  // upper bounds like Prometheus buckets do. Relative error is bounded
+  // by 2^-(p+1), and indexing is a couple of bit operations.
+  //
+
+  class Layout {
+  public:
+    static auto parse(const std::string &type) -> std::shared_ptr<Layout>;
+
+    Layout(const Options &options);
+
+    auto type() const -> const std::string& { return m_type; }
+    auto size() const -> int { return m_size; }
+    auto quantiles() const -> const std::vector<double>& { return m_quantiles; }
+    auto buckets() const -> const std::vector<double>& { return m_buckets; }
+
+    auto index(double value) const -> int {
+      if (!(value > 0)) return 0;
+      auto x = value * m_scale;
+      if (x > m_limit) return m_size - 1;
+      auto u = uint64_t(x);
+      if (u > 0 && double(u) == x) u--;
+      if (u < m_linear) return int(u);
+      int k = 63 - __builtin_clzll(u) - m_precision;
+      return int(m_linear + (uint64_t(k - 1) << m_precision) + (u >> k) - (uint64_t(1) << m_precision));
+    }
+
+    auto lower(int i) const -> double;
+    auto upper(int i) const -> double;
+    auto quantile(const double *counts, double q) const -> double;
+    auto cumulative(const double *counts, double le) const -> double;
+
+  private:
+    int m_precision;
+    int m_size;
+    uint64_t m_linear;
+    double m_lowest;
+    double m_scale;
+    double m_limit;
+    std::vector<double> m_buckets;
+    std::vector<double> m_quantiles;
+    std::string m_type;
+
+    auto bound(int i) const -> double;
+  };
+
+  virtual void zero() override;
+
+  void observe(double n);
+  auto quantile(double q) const -> double;
+
+private:
+  LogHistogram(pjs::Str *name, const Options &options, pjs::Array *label_names, MetricSet *set = nullptr);
+  LogHistogram(Metric *parent, pjs::Str **labels);
+
+  virtual void value_of(pjs::Value &out) override;
+  virtual auto get_type() -> pjs::Str* override;
+  virtual auto get_dim() -> int override;
+  virtual auto get_value(int dim) -> double override;
+  virtual void set_value(int dim, double value) override;
+
+  std::shared_ptr<Layout> m_layout;
+  std::vector<double> m_counts;
+  double m_sum = 0;
+  double m_count = 0;
+
+  friend class pjs::ObjectTemplate<LogHistogram, Metric>;
+};
+
 //
 // Stats
 //
@@ -30,6 +30,7 @@ namespace pipy {
 
 const size_t DATA_CHUNK_SIZE = 0x4000;
 const size_t RECEIVE_BUFFER_SIZE = 0x4000;
+const int DATAGRAM_BATCH_SIZE = 32;
 
 } // namespace pipy
 
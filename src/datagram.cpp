@@ -0,0 +1,422 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "datagram.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+
+#ifdef __linux__
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#endif // __linux__
+
+namespace pipy {
+
+static const size_t MAX_GRO_SIZE = 65535;
+static const size_t MAX_GSO_SIZE = 65000;
+static const int MAX_GSO_SEGMENTS = 64;
+static const size_t CONTROL_SIZE = 128;
+
+static auto to_endpoint(const struct sockaddr *addr) -> asio::ip::udp::endpoint {
+  asio::ip::udp::endpoint ep;
+  if (addr->sa_family == AF_INET) {
+    auto *a = (const struct sockaddr_in *)addr;
+    ep.address(asio::ip::make_address_v4(ntohl(a->sin_addr.s_addr)));
+    ep.port(ntohs(a->sin_port));
+  } else if (addr->sa_family == AF_INET6) {
+    auto *a = (const struct sockaddr_in6 *)addr;
+    asio::ip::address_v6::bytes_type bytes;
+    std::memcpy(bytes.data(), &a->sin6_addr, bytes.size());
+    ep.address(asio::ip::make_address_v6(bytes, a->sin6_scope_id));
+    ep.port(ntohs(a->sin6_port));
+  }
+  return ep;
+}
+
+static auto count_chunks(Data *data) -> size_t {
+  size_t n = 0;
+  for (auto c : data->chunks()) { (void)c; n++; }
+  return n;
+}
+
+//
+// DatagramReceiver
+//
+
+void DatagramReceiver::enable_gro(int sock) {
+#ifdef __linux__
+  int enabled = 1;
+  setsockopt(sock, SOL_UDP, UDP_GRO, &enabled, sizeof(enabled));
+#endif // __linux__
+}
+
+auto DatagramReceiver::receive(
+  int sock, size_t max_size, bool gro,
+  const Callback &cb, std::error_code &ec
+) -> int {
+  if (gro && max_size < MAX_GRO_SIZE) max_size = MAX_GRO_SIZE;
+
+  auto batch_size = m_batch_size;
+  auto iov_size = (max_size + DATA_CHUNK_SIZE - 1) / DATA_CHUNK_SIZE;
+  struct iovec iov[batch_size * iov_size];
+  struct sockaddr_storage addr[DATAGRAM_BATCH_SIZE];
+  struct msghdr msg[DATAGRAM_BATCH_SIZE];
+  char control[DATAGRAM_BATCH_SIZE][CONTROL_SIZE];
+
+  for (int i = 0; i < batch_size; i++) {
+    auto &buf = m_buffers[i];
+    if (buf.size() != max_size) buf = Data(max_size, m_producer);
+    auto *v = &iov[i * iov_size];
+    int n = 0;
+    for (auto c : buf.chunks()) {
+      v[n].iov_base = std::get<0>(c);
+      v[n].iov_len = std::get<1>(c);
+      n++;
+    }
+    auto &m = msg[i];
+    m.msg_name = &addr[i];
+    m.msg_namelen = sizeof(addr[i]);
+    m.msg_iov = v;
+    m.msg_iovlen = n;
+    m.msg_control = control[i];
+    m.msg_controllen = CONTROL_SIZE;
+    m.msg_flags = 0;
+  }
+
+  size_t sizes[DATAGRAM_BATCH_SIZE];
+  int count = 0;
+
+#ifdef __linux__
+  struct mmsghdr mmsg[DATAGRAM_BATCH_SIZE];
+  for (int i = 0; i < batch_size; i++) {
+    mmsg[i].msg_hdr = msg[i];
+    mmsg[i].msg_len = 0;
+  }
+  count = recvmmsg(sock, mmsg, batch_size, MSG_DONTWAIT, nullptr);
+  if (count < 0) {
+    count = 0;
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+      ec = std::error_code(errno, std::system_category());
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    msg[i] = mmsg[i].msg_hdr;
+    sizes[i] = mmsg[i].msg_len;
+  }
+#else
+  while (count < batch_size) {
+    auto n = recvmsg(sock, &msg[count], MSG_DONTWAIT);
+    if (n < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        ec = std::error_code(errno, std::system_category());
+      }
+      break;
+    }
+    sizes[count++] = n;
+  }
+#endif // __linux__
+
+  m_full = (count == batch_size);
+  if (m_full && batch_size < DATAGRAM_BATCH_SIZE) {
+    m_batch_size = std::min(batch_size * 2, DATAGRAM_BATCH_SIZE);
+  }
+
+  Data received[DATAGRAM_BATCH_SIZE];
+  for (int i = 0; i < count; i++) {
+    auto &buf = received[i];
+    buf = std::move(m_buffers[i]);
+    buf.pop(buf.size() - sizes[i]);
+  }
+
+  for (int i = 0; i < count; i++) {
+    auto &m = msg[i];
+    auto src = to_endpoint((struct sockaddr *)m.msg_name);
+    asio::ip::udp::endpoint dst;
+    size_t segment_size = 0;
+
+    for (auto *cmsg = CMSG_FIRSTHDR(&m); cmsg; cmsg = CMSG_NXTHDR(&m, cmsg)) {
+#ifdef __linux__
+      if (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_ORIGDSTADDR) {
+        dst = to_endpoint((struct sockaddr *)CMSG_DATA(cmsg));
+      } else if (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_ORIGDSTADDR) {
+        dst = to_endpoint((struct sockaddr *)CMSG_DATA(cmsg));
+      } else if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+        int size;
+        std::memcpy(&size, CMSG_DATA(cmsg), sizeof(size));
+        segment_size = size;
+      }
+#endif // __linux__
+    }
+
+    auto &buf = received[i];
+    if (segment_size > 0) {
+      while (buf.size() > segment_size) {
+        Data seg;
+        buf.shift(segment_size, seg);
+        cb(seg, src, dst);
+      }
+    }
+    cb(buf, src, dst);
+  }
+
+  return count;
+}
+
+//
+// DatagramSender
+//
+
+DatagramSender::DatagramSender(asio::ip::udp::socket &socket, bool gso)
+  : m_socket(&socket)
+  , m_gso(gso)
+{
+}
+
+DatagramSender::~DatagramSender() {
+  clear();
+}
+
+void DatagramSender::send(Source *source, Data *data) {
+  auto *d = new Datagram;
+  d->source = source;
+  d->data = data;
+  d->connected = true;
+  m_queue.push(d);
+  need_flush();
+}
+
+void DatagramSender::send(Source *source, Data *data, const asio::ip::udp::endpoint &peer) {
+  auto *d = new Datagram;
+  d->source = source;
+  d->data = data;
+  d->peer = peer;
+  d->connected = false;
+  m_queue.push(d);
+  need_flush();
+}
+
+void DatagramSender::cancel(Source *source) {
+  for (auto *d = m_queue.head(); d; d = d->next()) {
+    if (d->source == source) {
+      d->source = nullptr;
+    }
+  }
+}
+
+void DatagramSender::clear() {
+  m_clearing++;
+  while (auto *d = m_queue.head()) {
+    m_queue.remove(d);
+    delete d;
+  }
+}
+
+void DatagramSender::close() {
+  m_socket = nullptr;
+  clear();
+}
+
+void DatagramSender::on_flush() {
+  if (!m_waiting) pump();
+}
+
+//
+// Sends until the queue is empty or the socket would block,
+// in which case it waits for the socket to get writable again.
+//
+
+void DatagramSender::pump() {
+  if (!m_socket || !m_socket->is_open()) {
+    clear();
+    return;
+  }
+
+  pjs::Ref<DatagramSender> self(this);
+  auto sock = m_socket->native_handle();
+
+  while (!m_queue.empty()) {
+    Datagram *first[DATAGRAM_BATCH_SIZE];
+    int count[DATAGRAM_BATCH_SIZE];
+    size_t segment[DATAGRAM_BATCH_SIZE];
+    size_t chunks = 0;
+    int n = 0;
+
+    auto *d = m_queue.head();
+    while (d && n < DATAGRAM_BATCH_SIZE) {
+      auto size = d->data->size();
+      first[n] = d;
+      count[n] = 1;
+      segment[n] = 0;
+      chunks += count_chunks(d->data);
+      d = d->next();
+      if (m_gso && size > 0) {
+        auto total = size;
+        while (
+          d && d->connected == first[n]->connected &&
+          (d->connected || d->peer == first[n]->peer) &&
+          d->data->size() > 0 && d->data->size() <= size &&
+          total + d->data->size() <= MAX_GSO_SIZE &&
+          count[n] < MAX_GSO_SEGMENTS
+        ) {
+          auto last = d->data->size() < size;
+          total += d->data->size();
+          chunks += count_chunks(d->data);
+          count[n]++;
+          d = d->next();
+          if (last) break;
+        }
+        if (count[n] > 1) segment[n] = size;
+      }
+      n++;
+    }
+
+    std::vector<struct iovec> iov(chunks);
+    struct msghdr msg[DATAGRAM_BATCH_SIZE];
+    char control[DATAGRAM_BATCH_SIZE][CONTROL_SIZE];
+    size_t k = 0;
+
+    for (int i = 0; i < n; i++) {
+      auto &m = msg[i];
+      auto *d = first[i];
+      std::memset(&m, 0, sizeof(m));
+      if (!d->connected) {
+        m.msg_name = d->peer.data();
+        m.msg_namelen = d->peer.size();
+      }
+      m.msg_iov = &iov[k];
+      for (int j = 0; j < count[i]; j++, d = d->next()) {
+        for (auto c : d->data->chunks()) {
+          iov[k].iov_base = std::get<0>(c);
+          iov[k].iov_len = std::get<1>(c);
+          k++;
+        }
+      }
+      m.msg_iovlen = &iov[k] - (struct iovec *)m.msg_iov;
+#ifdef __linux__
+      if (segment[i] > 0) {
+        uint16_t size = segment[i];
+        m.msg_control = control[i];
+        m.msg_controllen = CMSG_SPACE(sizeof(size));
+        auto *cmsg = CMSG_FIRSTHDR(&m);
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(size));
+        std::memcpy(CMSG_DATA(cmsg), &size, sizeof(size));
+      }
+#endif // __linux__
+    }
+
+    int done = 0;
+    int err = 0;
+
+#ifdef __linux__
+    struct mmsghdr mmsg[DATAGRAM_BATCH_SIZE];
+    for (int i = 0; i < n; i++) {
+      mmsg[i].msg_hdr = msg[i];
+      mmsg[i].msg_len = 0;
+    }
+    done = sendmmsg(sock, mmsg, n, MSG_DONTWAIT);
+    if (done < 0) {
+      done = 0;
+      err = errno;
+    }
+#else
+    while (done < n) {
+      if (sendmsg(sock, &msg[done], MSG_DONTWAIT) < 0) {
+        err = errno;
+        break;
+      }
+      done++;
+    }
+#endif // __linux__
+
+    auto clearing = m_clearing;
+    for (int i = 0; i < done; i++) {
+      sent(first[i], count[i], std::error_code());
+      if (m_clearing != clearing) return;
+    }
+
+    if (done < n && err) {
+      if (err == EAGAIN || err == EWOULDBLOCK) {
+        m_socket->async_wait(
+          asio::ip::udp::socket::wait_write,
+          [this](const std::error_code &ec) {
+            m_waiting = false;
+            if (ec != asio::error::operation_aborted) pump();
+            release();
+          }
+        );
+        m_waiting = true;
+        retain();
+        return;
+      } else if (err == EINTR) {
+        continue;
+      } else if (segment[done] > 0 && (err == EIO || err == EINVAL || err == EOPNOTSUPP)) {
+        Log::warn("[udp] GSO not supported, sending datagrams one by one");
+        m_gso = false;
+      } else {
+        sent(first[done], count[done], std::error_code(err, std::system_category()));
+      }
+    }
+  }
+}
+
+//
+// Datagrams are taken off the queue before their sources get notified,
+// as a source could close the sender from inside the notification.
+//
+
+void DatagramSender::sent(Datagram *first, int count, const std::error_code &ec) {
+  Datagram *done[MAX_GSO_SEGMENTS];
+  auto *d = first;
+  for (int i = 0; i < count; i++) {
+    auto *next = d->next();
+    m_queue.remove(d);
+    done[i] = d;
+    d = next;
+  }
+  auto clearing = m_clearing;
+  for (int i = 0; i < count; i++) {
+    auto *d = done[i];
+    if (m_clearing == clearing) {
+      if (auto *s = d->source) {
+        s->on_datagram_sent(d->data->size(), ec);
+      }
+    }
+    delete d;
+  }
+}
+
+} // namespace pipy
@@ -0,0 +1,139 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef DATAGRAM_HPP
+#define DATAGRAM_HPP
+
+#include "net.hpp"
+#include "constants.hpp"
+#include "data.hpp"
+#include "input.hpp"
+#include "list.hpp"
+#include "pjs/pjs.hpp"
+
+#include <functional>
+
+namespace pipy {
+
+//
+// DatagramReceiver
+//
+// Reads datagrams off a non-blocking UDP socket a batch at a time with
+// recvmmsg(2). Each socket has its own receiver, whose buffers are sized
+// to the options of that socket and kept between calls, so only the ones
+// that got filled need replacing. The batch starts with one buffer and
+// doubles every time a read fills it up, so quiet sockets hold on to
+// little memory. With GRO enabled, a coalesced read is split back into
+// the original datagrams before being handed out.
+//
+
+class DatagramReceiver {
+public:
+  typedef std::function<
+    void(
+      Data &data,
+      const asio::ip::udp::endpoint &src,
+      const asio::ip::udp::endpoint &dst
+    )
+  > Callback;
+
+  static void enable_gro(int sock);
+
+  DatagramReceiver(Data::Producer *producer) : m_producer(producer) {}
+
+  // Whether the last receive() filled up the whole batch
+  bool full() const { return m_full; }
+
+  auto receive(int sock, size_t max_size, bool gro, const Callback &cb, std::error_code &ec) -> int;
+
+private:
+  Data::Producer* m_producer;
+  Data m_buffers[DATAGRAM_BATCH_SIZE];
+  int m_batch_size = 1;
+  bool m_full = false;
+};
+
+//
+// DatagramSender
+//
+// Queues datagrams written during one round of input and sends them all
+// at once with sendmmsg(2) when the round is flushed. With GSO enabled,
+// a run of datagrams of the same size to the same peer goes down as one
+// message for the kernel to segment.
+//
+
+class DatagramSender :
+  public pjs::RefCount<DatagramSender>,
+  public pjs::Pooled<DatagramSender>,
+  public FlushTarget
+{
+public:
+
+  //
+  // DatagramSender::Source
+  //
+
+  class Source {
+  public:
+    virtual void on_datagram_sent(size_t size, const std::error_code &ec) = 0;
+  };
+
+  DatagramSender(asio::ip::udp::socket &socket, bool gso);
+  ~DatagramSender();
+
+  void send(Source *source, Data *data);
+  void send(Source *source, Data *data, const asio::ip::udp::endpoint &peer);
+  void cancel(Source *source);
+  void clear();
+  void close();
+
+private:
+  struct Datagram :
+    public pjs::Pooled<Datagram>,
+    public List<Datagram>::Item
+  {
+    Source* source;
+    pjs::Ref<Data> data;
+    asio::ip::udp::endpoint peer;
+    bool connected;
+  };
+
+  asio::ip::udp::socket* m_socket;
+  List<Datagram> m_queue;
+  int m_clearing = 0;
+  bool m_gso;
+  bool m_waiting = false;
+
+  virtual void on_flush() override;
+
+  void pump();
+  void sent(Datagram *first, int count, const std::error_code &ec);
+
+  friend class pjs::RefCount<DatagramSender>;
+};
+
+} // namespace pipy
+
+#endif // DATAGRAM_HPP
@@ -24,7 +24,10 @@
  */
 
 #include "connect.hpp"
+#include "context.hpp"
+#include "inbound.hpp"
 #include "outbound.hpp"
+#include "pipeline.hpp"
 #include "utils.hpp"
 #include "log.hpp"
 
@@ -78,6 +81,15 @@ Connect::Options::Options(pjs::Object *options) {
   Value(options, "keepAlive")
     .get(keep_alive)
     .check_nullable();
+  Value(options, "lazyRead")
+    .get(lazy_read)
+    .check_nullable();
+  Value(options, "gso")
+    .get(gso)
+    .check_nullable();
+  Value(options, "gro")
+    .get(gro)
+    .check_nullable();
 }
 
 //
@@ -144,6 +156,7 @@ void Connect::process(Event *evt) {
         switch (m_options.protocol) {
           case Outbound::Protocol::TCP:
             outbound = new OutboundTCP(ConnectReceiver::input(), m_options);
+            splice(static_cast<OutboundTCP*>(outbound));
             break;
           case Outbound::Protocol::UDP:
             outbound = new OutboundUDP(ConnectReceiver::input(), m_options);
@@ -180,6 +193,22 @@ void Connect::process(Event *evt) {
   }
 }
 
+//
+// When this is the only filter in a pipeline started by a TCP inbound,
+// nothing between the two sockets looks at the bytes, so they can be
+// spliced together and have the bytes moved without copying.
+//
+
+void Connect::splice(OutboundTCP *outbound) {
+  auto *p = pipeline();
+  if (p->filters().size() != 1) return;
+  if (auto *inbound = dynamic_cast<InboundTCP*>(context()->inbound())) {
+    if (inbound->pipeline() == p) {
+      Splicer::pair(inbound, outbound);
+    }
+  }
+}
+
 //
 // ConnectReceiver
 //
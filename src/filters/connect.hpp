@@ -56,6 +56,8 @@ public:
 
   Connect(const pjs::Value &target, const Options &options);
 
+  auto outbound() const -> Outbound* { return m_outbound; }
+
 private:
   Connect(const Connect &r);
   ~Connect();
@@ -65,6 +67,8 @@ private:
   virtual void process(Event *evt) override;
   virtual void dump(Dump &d) override;
 
+  void splice(OutboundTCP *outbound);
+
   pjs::Value m_target;
   pjs::Ref<Outbound> m_outbound;
   Options m_options;
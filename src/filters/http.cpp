@@ -35,6 +35,7 @@
 #include "log.hpp"
 
 #include <cctype>
+#include <cstring>
 #include <queue>
 #include <limits>
 
@@ -258,74 +259,104 @@ static auto lookup_status_text(int status) -> const char* {
   return nullptr;
 }
 
-static auto read_str(Data::Reader &dr, char ending, const StrMap &strmap) -> pjs::Str* {
-  size_t i = 0;
-  StrMap::Parser p(strmap);
-  pjs::Str *found = nullptr;
-  for (;;) {
-    auto c = dr.get();
-    if (c < 0) return nullptr;
-    if (c == ending) return found;
-    if (c == ' ' && !i) continue;
-    found = p.parse(c);
-    if (found == pjs::Str::empty) return nullptr;
-    i++;
-  }
+//
+// Head lines are flattened into contiguous memory before parsing,
+// so that separators can be located with memchr(3), which libc
+// already vectorizes for the CPU it runs on.
+//
+
+static auto find_byte(const char *p, size_t n, char c) -> size_t {
+  auto q = (const char *)std::memchr(p, c, n);
+  return q ? q - p : n;
 }
 
-static auto read_str(Data::Reader &dr, char ending, const StrMap &strmap, char *buf) -> pjs::Str* {
-  size_t i = 0;
-  StrMap::Parser p(strmap);
-  pjs::Str *found = nullptr;
-  for (;;) {
-    auto c = dr.get();
-    if (c < 0) return nullptr;
-    if (c == ending) {
-      if (found && found != pjs::Str::empty) {
-        return found;
-      } else {
-        return i > 0 ? pjs::Str::make(buf, i) : pjs::Str::empty.get();
-      }
-    }
-    if (c == ' ' && !i) continue;
-    found = p.parse(c);
-    buf[i++] = c;
-  }
+static bool read_token(const char *&p, const char *e, char ending, const char *&s, size_t &n) {
+  auto i = find_byte(p, e - p, ending);
+  if (i == size_t(e - p)) return false;
+  s = p; n = i; p += i + 1;
+  while (n > 0 && *s == ' ') { s++; n--; }
+  return true;
 }
 
-static auto read_str_lower(Data::Reader &dr, char ending, const StrMap &strmap, char *buf) -> pjs::Str* {
-  size_t i = 0;
+static auto lookup_str(const StrMap &strmap, const char *s, size_t n) -> pjs::Str* {
   StrMap::Parser p(strmap);
   pjs::Str *found = nullptr;
-  for (;;) {
-    auto c = dr.get();
-    if (c < 0) return nullptr;
-    if (c == ending) {
-      if (found && found != pjs::Str::empty) {
-        return found;
-      } else {
-        return i > 0 ? pjs::Str::make(buf, i) : nullptr;
-      }
-    }
-    if (c == ' ' && !i) continue;
-    c = std::tolower(c);
-    found = p.parse(c);
-    buf[i++] = c;
-  }
+  for (size_t i = 0; i < n && found != pjs::Str::empty; i++) found = p.parse(s[i]);
+  return found;
+}
+
+static auto read_str(const char *&p, const char *e, char ending, const StrMap &strmap) -> pjs::Str* {
+  const char *s; size_t n;
+  if (!read_token(p, e, ending, s, n)) return nullptr;
+  auto found = lookup_str(strmap, s, n);
+  return found == pjs::Str::empty ? nullptr : found;
 }
 
-static auto read_uint(Data::Reader &dr, char ending) -> int {
+static auto read_str_or_make(const char *&p, const char *e, char ending, const StrMap &strmap) -> pjs::Str* {
+  const char *s; size_t n;
+  if (!read_token(p, e, ending, s, n)) return nullptr;
+  auto found = lookup_str(strmap, s, n);
+  if (found && found != pjs::Str::empty) return found;
+  return n > 0 ? pjs::Str::make(s, n) : pjs::Str::empty.get();
+}
+
+static auto read_str_lower(const char *&p, const char *e, char ending, const StrMap &strmap, char *buf) -> pjs::Str* {
+  const char *s; size_t n;
+  if (!read_token(p, e, ending, s, n)) return nullptr;
+  for (size_t i = 0; i < n; i++) buf[i] = std::tolower(s[i]);
+  auto found = lookup_str(strmap, buf, n);
+  if (found && found != pjs::Str::empty) return found;
+  return n > 0 ? pjs::Str::make(buf, n) : nullptr;
+}
+
+static auto read_uint(const char *&p, const char *e, char ending) -> int {
+  auto i = find_byte(p, e - p, ending);
+  if (i == size_t(e - p)) return -1;
   int n = 0;
-  for (;;) {
-    auto c = dr.get();
-    if (c < 0) return -1;
-    if (c == ending) return n;
+  for (auto s = p, t = p + i; s < t; s++) {
+    auto c = *s;
     if ('0' <= c && c <= '9') {
       n = n * 10 + (c - '0');
     } else {
       return -1;
     }
   }
+  p += i + 1;
+  return n;
+}
+
+//
+// Headers the encoders rewrite rather than pass through
+//
+
+static bool is_framing_header(pjs::Str *name) {
+  return (
+    name == s_keep_alive ||
+    name == s_transfer_encoding ||
+    name == s_content_length ||
+    name == s_connection ||
+    name == s_upgrade
+  );
+}
+
+//
+// Shift out bytes up to and including the next LF
+//
+
+static bool shift_line(Data &data, Data &out) {
+  int n = 0;
+  for (const auto c : data.chunks()) {
+    auto p = std::get<0>(c);
+    auto l = std::get<1>(c);
+    auto i = find_byte(p, l, '\n');
+    if (i < l) {
+      data.shift(n + i + 1, out);
+      return true;
+    }
+    n += l;
+  }
+  data.shift(n, out);
+  return false;
 }
 
 //
@@ -377,25 +408,17 @@ void Decoder::on_event(Event *evt) {
       data->shift(n, *output);
       if (0 == (m_body_size -= n)) state = (state == BODY ? HEAD : CHUNK_TAIL);
 
-    // byte scan the head
+    // memchr for the end of a head line
+    } else if (state == HEAD || state == HEADER) {
+      if (shift_line(*data, *output)) {
+        state = (state == HEAD ? HEAD_EOL : HEADER_EOL);
+      }
+
+    // byte scan the chunk framing
     } else {
       data->shift_to(
         [&](int c) -> bool {
           switch (state) {
-          case HEAD:
-            if (c == '\n') {
-              state = HEAD_EOL;
-              return true;
-            }
-            return false;
-
-          case HEADER:
-            if (c == '\n') {
-              state = HEADER_EOL;
-              return true;
-            }
-            return false;
-
           case CHUNK_HEAD:
             if (c == '\n') {
               if (m_body_size > 0) {
@@ -470,13 +493,15 @@ void Decoder::on_event(Event *evt) {
     // new state
     switch (state) {
       case HEAD_EOL: {
-        Data::Reader dr(m_head_buffer);
-        char buf[m_head_buffer.size()];
+        auto len = m_head_buffer.size();
+        char buf[len];
+        m_head_buffer.to_bytes((uint8_t *)buf);
+        const char *p = buf, *e = buf + len;
         if (m_is_response) {
           pjs::Ref<pjs::Str> protocol, status_text; int status;
-          protocol = read_str(dr, ' ', s_strmap_protocols); if (!protocol) { error(); break; }
-          status = read_uint(dr, ' '); if (status < 100 || status > 599) { error(); break; }
-          status_text = read_str(dr, '\r', s_strmap_statuses, buf); if (!status_text) { error(); break; }
+          protocol = read_str(p, e, ' ', s_strmap_protocols); if (!protocol) { error(); break; }
+          status = read_uint(p, e, ' '); if (status < 100 || status > 599) { error(); break; }
+          status_text = read_str_or_make(p, e, '\r', s_strmap_statuses); if (!status_text) { error(); break; }
           auto res = ResponseHead::make();
           res->protocol(protocol);
           res->status(status);
@@ -484,9 +509,9 @@ void Decoder::on_event(Event *evt) {
           m_head = res;
         } else {
           pjs::Ref<pjs::Str> method, path, protocol;
-          method = read_str(dr, ' ', s_strmap_methods); if (!method) { error(); break; }
-          path = read_str(dr, ' ', s_strmap_paths, buf); if (!path) { error(); break; }
-          protocol = read_str(dr, '\r', s_strmap_protocols); if (!protocol) { error(); break; }
+          method = read_str(p, e, ' ', s_strmap_methods); if (!method) { error(); break; }
+          path = read_str_or_make(p, e, ' ', s_strmap_paths); if (!path) { error(); break; }
+          protocol = read_str(p, e, '\r', s_strmap_protocols); if (!protocol) { error(); break; }
           if (
             (s_http2_preface_method == method) &&
             (s_http2_preface_path == path) &&
@@ -506,7 +531,7 @@ void Decoder::on_event(Event *evt) {
             m_head = req;
           }
         }
-        m_head->headers(pjs::Object::make());
+        m_head->headers(Headers::make());
         m_header_transfer_encoding = nullptr;
         m_header_content_length = nullptr;
         m_header_connection = nullptr;
@@ -518,31 +543,35 @@ void Decoder::on_event(Event *evt) {
       case HEADER_EOL: {
         auto len = m_head_buffer.size();
         if (len > 2) {
-          Data::Reader dr(m_head_buffer);
           char buf[len];
-          pjs::Ref<pjs::Str> key(read_str_lower(dr, ':', s_strmap_headers, buf));
-          pjs::Ref<pjs::Str> val(read_str(dr, '\r', s_strmap_header_values, buf));
-          auto headers = m_head->headers();
-          if (key == s_set_cookie) {
-            pjs::Value old;
-            headers->get(key, old);
-            if (old.is_array()) {
-              old.as<pjs::Array>()->push(val.get());
-            } else if (old.is_string()) {
-              auto a = pjs::Array::make(2);
-              a->set(0, old.s());
-              a->set(1, val.get());
-              headers->set(key, a);
+          m_head_buffer.to_bytes((uint8_t *)buf);
+          const char *p = buf, *e = buf + len;
+          pjs::Ref<pjs::Str> key(read_str_lower(p, e, ':', s_strmap_headers, buf));
+          const char *val; size_t val_len;
+          if (!key || !read_token(p, e, '\r', val, val_len)) { error(); break; }
+          auto known = lookup_str(s_strmap_header_values, val, val_len);
+          if (known == pjs::Str::empty) known = nullptr;
+          auto headers = m_head->headers()->as<Headers>();
+          auto i = headers->find(key);
+          if (i < 0) {
+            if (known) {
+              headers->append(key, known);
             } else {
-              headers->set(key, val.get());
+              headers->append(key, val, val_len);
             }
           } else {
-            auto v = val.get();
-            headers->set(key, v);
-            if (key == s_transfer_encoding) m_header_transfer_encoding = v;
-            else if (key == s_content_length) m_header_content_length = v;
-            else if (key == s_connection) m_header_connection = v;
-            else if (key == s_upgrade) m_header_upgrade = v;
+            pjs::Ref<pjs::Str> s(known ? known : pjs::Str::make(val, val_len));
+            auto old = headers->value(i);
+            if (key != s_set_cookie) {
+              headers->value(i, s.get());
+            } else if (old.is_array()) {
+              old.as<pjs::Array>()->push(s.get());
+            } else {
+              auto a = pjs::Array::make(2);
+              a->set(0, old);
+              a->set(1, s.get());
+              headers->value(i, a);
+            }
           }
           state = HEADER;
           m_head_buffer.clear();
@@ -551,6 +580,12 @@ void Decoder::on_event(Event *evt) {
           m_body_size = 0;
           m_head_buffer.clear();
 
+          auto headers = m_head->headers()->as<Headers>();
+          m_header_transfer_encoding = headers->get_str(Headers::Slot::transfer_encoding);
+          m_header_content_length = headers->get_str(Headers::Slot::content_length);
+          m_header_connection = headers->get_str(Headers::Slot::connection);
+          m_header_upgrade = headers->get_str(Headers::Slot::upgrade);
+
           static const std::string s_chunked("chunked");
 
           // Transfer-Encoding and Content-Length
@@ -663,7 +698,7 @@ void Decoder::stream_end(StreamEnd *end) {
       break;
     }
     auto head = ResponseHead::make();
-    head->headers(pjs::Object::make());
+    head->headers(Headers::make());
     head->protocol(s_http_1_1);
     head->status(status_code);
     head->status_text(status_text);
@@ -847,48 +882,64 @@ void Encoder::output_head() {
   bool content_length_written = false;
 
   if (headers.is_object()) {
-    headers.o()->iterate_all(
-      [&](pjs::Str *k, pjs::Value &v) {
-        if (k == s_keep_alive) return;
-        if (k == s_transfer_encoding) return;
-        if (k == s_content_length) {
-          if (is_bodiless_response()) {
-            content_length_written = true;
-          } else {
-            return;
-          }
-        } else if (k == s_connection) {
-          auto *s = v.to_string();
-          auto is_upgrade = utils::iequals(s->str(), s_upgrade.get()->str());
-          m_header_connection = s;
-          s->release();
-          if (!is_upgrade) return;
-        } else if (k == s_upgrade) {
-          auto *s = v.to_string();
-          m_header_upgrade = s;
-          s->release();
-        }
-        if (k == s_set_cookie && v.is_array()) {
-          v.as<pjs::Array>()->iterate_all(
-            [&](pjs::Value &v, int) {
-              auto s = v.to_string();
-              db.push(k->str());
-              db.push(": ");
-              db.push(s->str());
-              db.push("\r\n");
-              s->release();
-            }
-          );
+    auto write_header = [&](pjs::Str *k, const pjs::Value &v) {
+      if (k == s_keep_alive) return;
+      if (k == s_transfer_encoding) return;
+      if (k == s_content_length) {
+        if (is_bodiless_response()) {
+          content_length_written = true;
         } else {
+          return;
+        }
+      } else if (k == s_connection) {
+        auto *s = v.to_string();
+        auto is_upgrade = utils::iequals(s->str(), s_upgrade.get()->str());
+        m_header_connection = s;
+        s->release();
+        if (!is_upgrade) return;
+      } else if (k == s_upgrade) {
+        auto *s = v.to_string();
+        m_header_upgrade = s;
+        s->release();
+      }
+      if (k == s_set_cookie && v.is_array()) {
+        v.as<pjs::Array>()->iterate_all(
+          [&](pjs::Value &v, int) {
+            auto s = v.to_string();
+            db.push(k->str());
+            db.push(": ");
+            db.push(s->str());
+            db.push("\r\n");
+            s->release();
+          }
+        );
+      } else {
+        db.push(k->str());
+        db.push(": ");
+        auto s = v.to_string();
+        db.push(s->str());
+        db.push("\r\n");
+        s->release();
+      }
+    };
+    auto obj = headers.o();
+    if (obj->is<Headers>()) {
+      auto h = obj->as<Headers>();
+      for (int i = 0, n = h->size(); i < n; i++) {
+        auto k = h->name(i);
+        const char *p; int len;
+        if (!is_framing_header(k) && h->raw_value(i, p, len)) {
           db.push(k->str());
           db.push(": ");
-          auto s = v.to_string();
-          db.push(s->str());
+          db.push(p, len);
           db.push("\r\n");
-          s->release();
+        } else {
+          write_header(k, h->value(i));
         }
       }
-    );
+    } else {
+      obj->iterate_all(write_header);
+    }
   }
 
   if (!m_is_response) {
@@ -1369,7 +1420,7 @@ void Demux::on_decode_request(http::RequestHead *head) {
   m_request_queue.push(req);
   if (req->is_http2()) {
     auto head = ResponseHead::make();
-    auto headers = pjs::Object::make();
+    auto headers = Headers::make();
     head->status(101);
     head->headers(headers);
     headers->set(s_connection, s_upgrade.get());
@@ -1509,6 +1560,12 @@ void Mux::Session::close_stream(EventFunction *stream) {
   }
 }
 
+void Mux::Session::set_one_way(EventFunction *stream) {
+  if (!m_http2_muxer) {
+    QueueMuxer::set_one_way(stream);
+  }
+}
+
 void Mux::Session::close() {
   QueueMuxer::reset();
   m_request_queue.reset();
@@ -1699,7 +1756,7 @@ void Server::on_decode_request(http::RequestHead *head) {
   m_request_queue.push(req);
   if (req->is_http2()) {
     auto head = ResponseHead::make();
-    auto headers = pjs::Object::make();
+    auto headers = Headers::make();
     head->status(101);
     head->headers(headers);
     headers->set(s_connection, s_upgrade.get());
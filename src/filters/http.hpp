@@ -459,6 +459,7 @@ private:
     virtual void open() override;
     virtual auto open_stream() -> EventFunction* override;
     virtual void close_stream(EventFunction *stream) override;
+    virtual void set_one_way(EventFunction *stream) override;
     virtual void close() override;
     virtual void on_encode_request(pjs::Object *head) override;
     virtual void on_decode_response(http::ResponseHead *head) override;
@@ -643,7 +643,7 @@ void HeaderDecoder::start(bool is_response, bool is_trailer) {
   } else {
     m_head = http::RequestHead::make();
   }
-  m_head->headers(pjs::Object::make());
+  m_head->headers(http::Headers::make());
   m_buffer.clear();
   m_state = INDEX_PREFIX;
   m_is_response = is_response;
@@ -903,10 +903,8 @@ bool HeaderDecoder::add_field(pjs::Str *name, pjs::Str *value) {
         }
       } else if (name == s_colon_authority) {
         auto req = m_head->as<http::RequestHead>();
-        pjs::Value v;
-        auto headers = m_head->headers();
-        headers->get(s_host, v);
-        if (v.is_undefined()) headers->set(s_host, value);
+        auto headers = m_head->headers()->as<http::Headers>();
+        if (headers->get(http::Headers::Slot::host).is_undefined()) headers->append(s_host, value);
         req->authority(value);
       } else if (name == s_colon_path) {
         auto req = m_head->as<http::RequestHead>();
@@ -938,12 +936,8 @@ bool HeaderDecoder::add_field(pjs::Str *name, pjs::Str *value) {
     if (name == s_content_length) {
       m_content_length = std::atoi(value->c_str());
     }
-    auto headers = m_head->headers();
-    if (!headers) {
-      headers = pjs::Object::make();
-      m_head->headers(headers);
-    }
-    headers->set(name, value);
+    auto headers = m_head->headers()->as<http::Headers>();
+    headers->ht_set(name, value);
     m_is_pseudo_end = true;
   }
   return true;
@@ -1060,23 +1054,29 @@ void HeaderEncoder::encode(bool is_response, bool is_tail, pjs::Object *head, Da
   if (head) head->get(s_headers, headers);
   if (headers.is_object()) {
     if (auto obj = headers.o()) {
-      obj->iterate_all(
-        [&](pjs::Str *k, pjs::Value &v) {
-          if (k == pjs::Str::empty) return;
-          if (k == s_host) {
-            if (has_authority) return;
-            k = s_colon_authority;
-          }
-          if (k == s_connection) return;
-          if (k == s_keep_alive) return;
-          if (k == s_proxy_connection) return;
-          if (k == s_transfer_encoding) return;
-          if (k == s_upgrade) return;
-          auto s = v.to_string();
-          encode_header_field(db, k, s);
-          s->release();
+      auto write_header = [&](pjs::Str *k, const pjs::Value &v) {
+        if (k == pjs::Str::empty) return;
+        if (k == s_host) {
+          if (has_authority) return;
+          k = s_colon_authority;
         }
-      );
+        if (k == s_connection) return;
+        if (k == s_keep_alive) return;
+        if (k == s_proxy_connection) return;
+        if (k == s_transfer_encoding) return;
+        if (k == s_upgrade) return;
+        auto s = v.to_string();
+        encode_header_field(db, k, s);
+        s->release();
+      };
+      if (obj->is<http::Headers>()) {
+        auto h = obj->as<http::Headers>();
+        for (int i = 0, n = h->size(); i < n; i++) {
+          write_header(h->name(i), h->value(i));
+        }
+      } else {
+        obj->iterate_all(write_header);
+      }
     }
   }
 
@@ -28,8 +28,17 @@
 #include "input.hpp"
 #include "utils.hpp"
 #include "log.hpp"
+#include "net.hpp"
+#include "api/http.hpp"
+#include "api/json.hpp"
+#include "api/stats.hpp"
 
+#include <chrono>
 #include <limits>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace pipy {
 
@@ -41,6 +50,8 @@ MuxBase::Options::Options(pjs::Object *options) {
   thread_local static pjs::ConstStr s_max_idle("maxIdle");
   thread_local static pjs::ConstStr s_max_queue("maxQueue");
   thread_local static pjs::ConstStr s_max_messages("maxMessages");
+  thread_local static pjs::ConstStr s_max_connections("maxConnections");
+  thread_local static pjs::ConstStr s_shared_pool("sharedPool");
   Value(options, s_max_idle)
     .get_seconds(max_idle)
     .check_nullable();
@@ -50,6 +61,815 @@ MuxBase::Options::Options(pjs::Object *options) {
   Value(options, s_max_messages)
     .get(max_messages)
     .check_nullable();
+  Value(options, s_max_connections)
+    .get(max_connections)
+    .check_nullable();
+  Value(options, s_shared_pool)
+    .get(shared_pool)
+    .check_nullable();
+}
+
+//
+// MuxBase::SharedSession
+//
+// The part of a session in a shared pool that all threads can see.
+// Only the thread owning the session ever touches the session itself.
+// Other threads only read its load and state when picking one, and
+// post streams to the owner's mailbox.
+//
+
+class MuxBase::SharedSession : public List<SharedSession>::Item {
+public:
+  static auto make(SharedPool *pool, const std::string &key, Session *session) -> SharedSession*;
+
+  static void for_each(const std::function<void(SharedSession*)> &cb) {
+    for (auto *s = s_all.head(); s; s = s->next()) cb(s);
+  }
+
+  SharedPool* const pool;
+  const std::string key;
+  Mailbox* const owner;
+  Session* session;
+  std::atomic<int> load;
+  std::atomic<bool> ready;
+  std::atomic<bool> closed;
+
+  void retain() {
+    m_retain_count.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void release() {
+    if (m_retain_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete this;
+    }
+  }
+
+  void detach();
+  void unregister();
+
+private:
+  SharedSession(SharedPool *pool, const std::string &key, Session *session);
+
+  std::atomic<int> m_retain_count;
+  bool m_detached = false;
+
+  thread_local static List<SharedSession> s_all;
+};
+
+//
+// MuxBase::SharedPool
+//
+// Pools are looked up by name so that the same-named pools in all
+// worker threads are one. The pool keeps the sessions by their session
+// keys, along with how many connections have been opened to each key,
+// counting those still being set up.
+//
+
+class MuxBase::SharedPool {
+public:
+  static auto get(const std::string &name) -> SharedPool*;
+
+  auto name() const -> const std::string& { return m_name; }
+
+  bool reserve(const std::string &key, int max_connections, SharedSession **picked);
+  void add(SharedSession *session);
+  void remove(SharedSession *session);
+
+private:
+  struct Upstream {
+    int connections = 0;
+    std::vector<SharedSession*> sessions;
+  };
+
+  SharedPool(const std::string &name) : m_name(name) {}
+
+  std::string m_name;
+  std::mutex m_mutex;
+  std::unordered_map<std::string, Upstream> m_upstreams;
+
+  static std::mutex s_pools_mutex;
+  static std::map<std::string, SharedPool*> s_pools;
+};
+
+//
+// MuxBase::Mailbox
+//
+// Each thread has one for receiving handoffs from other threads. Posting
+// pushes onto a lock-free stack and only wakes up the receiving thread
+// when the stack was empty, so a burst of handoffs costs one wake-up.
+//
+
+class MuxBase::Mailbox {
+public:
+  static auto local() -> Mailbox*;
+
+  bool post(Handoff *handoff);
+
+private:
+  Mailbox()
+    : m_net(&Net::current())
+    , m_head(nullptr)
+    , m_posting(0)
+    , m_closed(false) {}
+
+  Net* m_net;
+  std::atomic<Handoff*> m_head;
+  std::atomic<int> m_posting;
+  std::atomic<bool> m_closed;
+
+  void deliver();
+  void close();
+
+  //
+  // Closes the mailbox when the thread exits, so that nobody
+  // posts to the thread's Net after it's gone. Handoffs still
+  // in it are dropped.
+  //
+
+  struct Guard {
+    Mailbox *mailbox = nullptr;
+    ~Guard() { if (mailbox) mailbox->close(); }
+  };
+
+  thread_local static Guard s_local;
+};
+
+//
+// MuxBase::Link
+//
+// Joins the two ends of a stream handed over to another thread: a
+// RemoteStream on the thread the stream comes from, and a HostedStream
+// on the thread owning the session. Each end holds one reference, and
+// so does every handoff on its way between them.
+//
+
+class MuxBase::Link {
+public:
+  Link(SharedSession *session)
+    : session(session)
+    , client_mailbox(Mailbox::local())
+    , client_lost(false)
+    , host_lost(false)
+    , m_retain_count(2) {}
+
+  SharedSession* session;
+  Mailbox* client_mailbox;
+  RemoteStream* client = nullptr;
+  HostedStream* host = nullptr;
+  std::atomic<bool> client_lost;
+  std::atomic<bool> host_lost;
+
+  void retain() {
+    m_retain_count.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void release() {
+    if (m_retain_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      session->release();
+      delete this;
+    }
+  }
+
+private:
+  std::atomic<int> m_retain_count;
+};
+
+//
+// MuxBase::Handoff
+//
+// One event crossing threads. Events are objects of the sending thread,
+// so their contents are copied into a thread-neutral form: heads and
+// tails as JSON, data as SharedData. HTTP heads, tails and headers
+// are turned back into their own classes on the receiving end.
+//
+
+class MuxBase::Handoff {
+public:
+  enum Type { OPEN, EVENT, ONE_WAY, CLOSE };
+
+  static void send(Link *link, bool to_host, Type type, Event *evt = nullptr);
+
+  Handoff* next = nullptr;
+
+  ~Handoff() {
+    if (m_data) m_data->release();
+    m_link->release();
+  }
+
+  void deliver();
+  void drop();
+
+private:
+  enum HeadClass {
+    OBJECT,
+    MESSAGE_HEAD,
+    REQUEST_HEAD,
+    RESPONSE_HEAD,
+    MESSAGE_TAIL,
+  };
+
+  Handoff(Link *link, bool to_host, Type type)
+    : m_link(link)
+    , m_to_host(to_host)
+    , m_type(type)
+    , m_time(std::chrono::steady_clock::now()) { link->retain(); }
+
+  Link* m_link;
+  bool m_to_host;
+  Type m_type;
+  Event::Type m_event_type = Event::StreamEnd;
+  HeadClass m_head_class = OBJECT;
+  bool m_http_headers = false;
+  std::string m_head;
+  std::string m_payload;
+  SharedData* m_data = nullptr;
+  int m_error = 0;
+  std::chrono::steady_clock::time_point m_time;
+
+  static void post(Link *link, bool to_host, Type type, int error = 0);
+
+  void marshal(pjs::Object *head);
+  void unmarshal(pjs::Value &head);
+  auto event() -> Event*;
+};
+
+//
+// MuxBase::RemoteStream
+//
+
+class MuxBase::RemoteStream :
+  public pjs::Pooled<RemoteStream>,
+  public EventFunction
+{
+public:
+  static auto open(SharedSession *shared) -> RemoteStream*;
+
+  void close();
+  void set_one_way() { Handoff::send(m_link, true, Handoff::ONE_WAY); }
+  void receive(Event *evt) { output(evt); }
+
+private:
+  RemoteStream(Link *link) : m_link(link) {}
+
+  Link* m_link;
+
+  virtual void on_event(Event *evt) override {
+    Handoff::send(m_link, true, Handoff::EVENT, evt);
+  }
+};
+
+//
+// MuxBase::HostedStream
+//
+
+class MuxBase::HostedStream :
+  public pjs::Pooled<HostedStream>,
+  public EventFunction
+{
+public:
+  static void open(Link *link);
+
+  void close();
+  void set_one_way();
+  void receive(Event *evt);
+
+private:
+  HostedStream(Link *link) : m_link(link) {}
+
+  Link* m_link;
+  pjs::Ref<Session> m_session;
+  EventFunction* m_stream = nullptr;
+
+  virtual void on_event(Event *evt) override {
+    Handoff::send(m_link, false, Handoff::EVENT, evt);
+  }
+};
+
+//
+// Shared pool metrics
+//
+
+thread_local static pjs::Ref<stats::Counter> s_metric_pool_handoff_count;
+thread_local static pjs::Ref<stats::Counter> s_metric_pool_handoff_drop_count;
+thread_local static pjs::Ref<stats::Histogram> s_metric_pool_handoff_time;
+thread_local static std::unordered_map<const void*, pjs::Ref<stats::Histogram>> s_metric_pool_handoff_times;
+
+static void init_shared_pool_metrics() {
+  if (s_metric_pool_handoff_count) return;
+
+  pjs::Ref<pjs::Array> label_names = pjs::Array::make(1);
+  label_names->set(0, "pool");
+
+  stats::Gauge::make(
+    pjs::Str::make("pipy_mux_pool_connection_count"),
+    label_names,
+    [=](stats::Gauge *gauge) {
+      int total = 0;
+      gauge->zero_all();
+      MuxBase::for_each_shared_session(
+        [&](const std::string &pool, int) {
+          pjs::Ref<pjs::Str> name(pjs::Str::make(pool));
+          pjs::Str *k = name;
+          gauge->with_labels(&k, 1)->increase();
+          total++;
+        }
+      );
+      gauge->set(total);
+    }
+  );
+
+  stats::Gauge::make(
+    pjs::Str::make("pipy_mux_pool_stream_count"),
+    label_names,
+    [=](stats::Gauge *gauge) {
+      int total = 0;
+      gauge->zero_all();
+      MuxBase::for_each_shared_session(
+        [&](const std::string &pool, int streams) {
+          pjs::Ref<pjs::Str> name(pjs::Str::make(pool));
+          pjs::Str *k = name;
+          gauge->with_labels(&k, 1)->increase(streams);
+          total += streams;
+        }
+      );
+      gauge->set(total);
+    }
+  );
+
+  s_metric_pool_handoff_count = stats::Counter::make(
+    pjs::Str::make("pipy_mux_pool_handoff_count"),
+    label_names
+  );
+
+  s_metric_pool_handoff_drop_count = stats::Counter::make(
+    pjs::Str::make("pipy_mux_pool_handoff_drop_count"),
+    label_names
+  );
+
+  pjs::Ref<pjs::Array> buckets = pjs::Array::make(21);
+  double limit = 0.01;
+  for (int i = 0; i < 20; i++) {
+    buckets->set(i, limit);
+    limit *= 2;
+  }
+  buckets->set(20, std::numeric_limits<double>::infinity());
+
+  s_metric_pool_handoff_time = stats::Histogram::make(
+    pjs::Str::make("pipy_mux_pool_handoff_time"),
+    buckets, label_names
+  );
+}
+
+void MuxBase::for_each_shared_session(const std::function<void(const std::string&, int)> &cb) {
+  SharedSession::for_each(
+    [&](SharedSession *s) {
+      cb(s->pool->name(), s->load.load(std::memory_order_relaxed));
+    }
+  );
+}
+
+//
+// MuxBase::SharedSession
+//
+
+thread_local List<MuxBase::SharedSession> MuxBase::SharedSession::s_all;
+
+MuxBase::SharedSession::SharedSession(SharedPool *pool, const std::string &key, Session *session)
+  : pool(pool)
+  , key(key)
+  , owner(Mailbox::local())
+  , session(session)
+  , load(1)
+  , ready(false)
+  , closed(false)
+  , m_retain_count(1)
+{
+}
+
+auto MuxBase::SharedSession::make(SharedPool *pool, const std::string &key, Session *session) -> SharedSession* {
+  init_shared_pool_metrics();
+  auto *s = new SharedSession(pool, key, session);
+  s_all.push(s);
+  pool->add(s);
+  return s;
+}
+
+//
+// Takes the session out of the pool as soon as it's closed, so that
+// its connection no longer counts towards the limit.
+//
+
+void MuxBase::SharedSession::detach() {
+  closed.store(true, std::memory_order_relaxed);
+  if (!m_detached) {
+    pool->remove(this);
+    m_detached = true;
+  }
+}
+
+void MuxBase::SharedSession::unregister() {
+  session = nullptr;
+  detach();
+  s_all.remove(this);
+  release();
+}
+
+//
+// MuxBase::SharedPool
+//
+
+std::mutex MuxBase::SharedPool::s_pools_mutex;
+std::map<std::string, MuxBase::SharedPool*> MuxBase::SharedPool::s_pools;
+
+auto MuxBase::SharedPool::get(const std::string &name) -> SharedPool* {
+  std::lock_guard<std::mutex> lock(s_pools_mutex);
+  auto &pool = s_pools[name];
+  if (!pool) pool = new SharedPool(name);
+  return pool;
+}
+
+//
+// Reserves a new connection to the key if it's still under the limit.
+// Otherwise returns false with the least loaded session retained in
+// 'picked', preferring sessions that are ready over those still being
+// set up. Closed sessions are no longer in the pool and don't count.
+//
+
+bool MuxBase::SharedPool::reserve(const std::string &key, int max_connections, SharedSession **picked) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto &upstream = m_upstreams[key];
+  if (max_connections <= 0 || upstream.connections < max_connections) {
+    upstream.connections++;
+    return true;
+  }
+  SharedSession *best = nullptr;
+  bool best_ready = false;
+  int best_load = 0;
+  for (auto *s : upstream.sessions) {
+    if (s->closed.load(std::memory_order_relaxed)) continue;
+    auto ready = s->ready.load(std::memory_order_relaxed);
+    auto load = s->load.load(std::memory_order_relaxed);
+    if (!best || (ready && !best_ready) || (ready == best_ready && load < best_load)) {
+      best = s;
+      best_ready = ready;
+      best_load = load;
+    }
+  }
+  if (!best) {
+    upstream.connections++;
+    return true;
+  }
+  best->retain();
+  *picked = best;
+  return false;
+}
+
+void MuxBase::SharedPool::add(SharedSession *session) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_upstreams[session->key].sessions.push_back(session);
+}
+
+void MuxBase::SharedPool::remove(SharedSession *session) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto i = m_upstreams.find(session->key);
+  if (i == m_upstreams.end()) return;
+  auto &upstream = i->second;
+  auto &sessions = upstream.sessions;
+  for (auto j = sessions.begin(); j != sessions.end(); j++) {
+    if (*j == session) {
+      sessions.erase(j);
+      upstream.connections--;
+      break;
+    }
+  }
+  if (sessions.empty() && upstream.connections <= 0) {
+    m_upstreams.erase(i);
+  }
+}
+
+//
+// MuxBase::Mailbox
+//
+
+thread_local MuxBase::Mailbox::Guard MuxBase::Mailbox::s_local;
+
+auto MuxBase::Mailbox::local() -> Mailbox* {
+  auto &mailbox = s_local.mailbox;
+  if (!mailbox) mailbox = new Mailbox;
+  return mailbox;
+}
+
+bool MuxBase::Mailbox::post(Handoff *handoff) {
+  m_posting.fetch_add(1);
+  if (m_closed.load()) {
+    m_posting.fetch_sub(1);
+    return false;
+  }
+  auto *head = m_head.load(std::memory_order_relaxed);
+  do {
+    handoff->next = head;
+  } while (!m_head.compare_exchange_weak(head, handoff, std::memory_order_release, std::memory_order_relaxed));
+  if (!head) m_net->post([this]() { deliver(); });
+  m_posting.fetch_sub(1);
+  return true;
+}
+
+void MuxBase::Mailbox::deliver() {
+  Handoff *list = m_head.exchange(nullptr, std::memory_order_acquire);
+  Handoff *head = nullptr;
+  while (list) {
+    auto *h = list; list = h->next;
+    h->next = head;
+    head = h;
+  }
+  InputContext ic;
+  while (head) {
+    auto *h = head; head = h->next;
+    h->deliver();
+    delete h;
+  }
+}
+
+void MuxBase::Mailbox::close() {
+  m_closed.store(true);
+  while (m_posting.load()) std::this_thread::yield();
+  auto *list = m_head.exchange(nullptr, std::memory_order_acquire);
+  while (list) {
+    auto *h = list; list = h->next;
+    h->drop();
+    delete h;
+  }
+}
+
+//
+// MuxBase::Handoff
+//
+
+void MuxBase::Handoff::send(Link *link, bool to_host, Type type, Event *evt) {
+  auto *h = new Handoff(link, to_host, type);
+  if (evt) {
+    h->m_event_type = evt->type();
+    if (auto start = evt->as<MessageStart>()) {
+      if (auto head = start->head()) {
+        h->marshal(head);
+      }
+    } else if (auto data = evt->as<Data>()) {
+      h->m_data = SharedData::make(*data)->retain();
+    } else if (auto end = evt->as<MessageEnd>()) {
+      if (auto tail = end->tail()) {
+        h->marshal(tail);
+      }
+      if (!end->payload().is_undefined()) {
+        h->m_payload = JSON::stringify(end->payload(), nullptr, 0);
+      }
+    } else if (auto end = evt->as<StreamEnd>()) {
+      h->m_error = end->error();
+    }
+  }
+  auto *mailbox = to_host ? link->session->owner : link->client_mailbox;
+  if (!mailbox->post(h)) {
+    pjs::Ref<pjs::Str> name(pjs::Str::make(link->session->pool->name()));
+    pjs::Str *k = name;
+    s_metric_pool_handoff_drop_count->increase();
+    s_metric_pool_handoff_drop_count->with_labels(&k, 1)->increase();
+    h->drop();
+    delete h;
+  }
+}
+
+//
+// Posts a handoff made up here rather than from an event, which can
+// be done on a thread that is exiting. Nothing is posted if the other
+// end has gone as well.
+//
+
+void MuxBase::Handoff::post(Link *link, bool to_host, Type type, int error) {
+  auto *h = new Handoff(link, to_host, type);
+  h->m_error = error;
+  auto *mailbox = to_host ? link->session->owner : link->client_mailbox;
+  if (!mailbox->post(h)) delete h;
+}
+
+//
+// Called when the thread at the other end has gone. A stream opened
+// there never got its HostedStream, so the reference kept for that is
+// released here. Whichever end is still alive is told once: the client
+// gets a reset and the host gets closed.
+//
+
+void MuxBase::Handoff::drop() {
+  if (m_to_host) {
+    if (m_type == OPEN) m_link->release();
+    if (m_type != CLOSE && !m_link->host_lost.exchange(true)) {
+      post(m_link, false, EVENT, StreamEnd::CONNECTION_RESET);
+    }
+  } else {
+    if (!m_link->client_lost.exchange(true)) {
+      post(m_link, true, CLOSE);
+    }
+  }
+}
+
+void MuxBase::Handoff::marshal(pjs::Object *head) {
+  if (head->is_instance_of<http::RequestHead>()) {
+    m_head_class = REQUEST_HEAD;
+  } else if (head->is_instance_of<http::ResponseHead>()) {
+    m_head_class = RESPONSE_HEAD;
+  } else if (head->is_instance_of<http::MessageHead>()) {
+    m_head_class = MESSAGE_HEAD;
+  } else if (head->is_instance_of<http::MessageTail>()) {
+    m_head_class = MESSAGE_TAIL;
+  }
+  if (m_head_class == MESSAGE_TAIL) {
+    auto *headers = static_cast<http::MessageTail*>(head)->headers();
+    m_http_headers = headers && headers->is_instance_of<http::Headers>();
+  } else if (m_head_class != OBJECT) {
+    auto *headers = static_cast<http::MessageHead*>(head)->headers();
+    m_http_headers = headers && headers->is_instance_of<http::Headers>();
+  }
+  m_head = JSON::stringify(head, nullptr, 0);
+}
+
+void MuxBase::Handoff::unmarshal(pjs::Value &head) {
+  if (m_head.empty() || !JSON::parse(m_head, nullptr, head) || !head.is_object() || !head.o()) {
+    head = pjs::Value::undefined;
+    return;
+  }
+
+  if (m_head_class == OBJECT) return;
+
+  pjs::Object *obj = head.o();
+  pjs::Object *headers = nullptr;
+  pjs::Value val;
+  obj->get("headers", val);
+  if (val.is_object() && val.o()) {
+    headers = val.o();
+    if (m_http_headers) {
+      auto *h = http::Headers::make();
+      headers->iterate_all([&](pjs::Str *k, pjs::Value &v) { h->append(k, v); });
+      headers = h;
+    }
+  }
+
+  pjs::Object *typed = nullptr;
+  switch (m_head_class) {
+    case MESSAGE_HEAD: typed = http::MessageHead::make(); break;
+    case REQUEST_HEAD: typed = http::RequestHead::make(); break;
+    case RESPONSE_HEAD: typed = http::ResponseHead::make(); break;
+    default: typed = http::MessageTail::make(); break;
+  }
+
+  pjs::Object::assign(typed, obj);
+  if (headers) {
+    if (m_head_class == MESSAGE_TAIL) {
+      static_cast<http::MessageTail*>(typed)->headers(headers);
+    } else {
+      static_cast<http::MessageHead*>(typed)->headers(headers);
+    }
+  }
+
+  head.set(typed);
+}
+
+auto MuxBase::Handoff::event() -> Event* {
+  switch (m_event_type) {
+    case Event::MessageStart: {
+      pjs::Value head;
+      unmarshal(head);
+      return MessageStart::make(head.is_object() ? head.o() : nullptr);
+    }
+    case Event::Data:
+      return m_data ? Data::make(*m_data) : Data::make();
+    case Event::MessageEnd: {
+      pjs::Value tail, payload;
+      unmarshal(tail);
+      if (!m_payload.empty()) JSON::parse(m_payload, nullptr, payload);
+      return MessageEnd::make(tail.is_object() ? tail.o() : nullptr, payload);
+    }
+    default:
+      return StreamEnd::make(StreamEnd::Error(m_error));
+  }
+}
+
+void MuxBase::Handoff::deliver() {
+  init_shared_pool_metrics();
+  auto *pool = m_link->session->pool;
+  auto &metric = s_metric_pool_handoff_times[pool];
+  if (!metric) {
+    pjs::Ref<pjs::Str> name(pjs::Str::make(pool->name()));
+    pjs::Str *k = name;
+    metric = s_metric_pool_handoff_time->with_labels(&k, 1);
+  }
+  auto t = std::chrono::steady_clock::now() - m_time;
+  auto ms = std::chrono::duration_cast<std::chrono::nanoseconds>(t).count() / 1e6;
+  s_metric_pool_handoff_time->observe(ms);
+  metric->observe(ms);
+
+  if (m_to_host) {
+    switch (m_type) {
+      case OPEN:
+        HostedStream::open(m_link);
+        break;
+      case EVENT:
+        if (auto *host = m_link->host) {
+          pjs::Ref<Event> evt(event());
+          host->receive(evt);
+        }
+        break;
+      case ONE_WAY:
+        if (auto *host = m_link->host) {
+          host->set_one_way();
+        }
+        break;
+      case CLOSE:
+        if (auto *host = m_link->host) {
+          host->close();
+        }
+        break;
+    }
+  } else if (auto *client = m_link->client) {
+    pjs::Ref<Event> evt(event());
+    client->receive(evt);
+  }
+}
+
+//
+// MuxBase::RemoteStream
+//
+
+auto MuxBase::RemoteStream::open(SharedSession *shared) -> RemoteStream* {
+  init_shared_pool_metrics();
+  auto *link = new Link(shared);
+  auto *s = new RemoteStream(link);
+  link->client = s;
+  Handoff::send(link, true, Handoff::OPEN);
+  pjs::Ref<pjs::Str> name(pjs::Str::make(shared->pool->name()));
+  pjs::Str *k = name;
+  s_metric_pool_handoff_count->increase();
+  s_metric_pool_handoff_count->with_labels(&k, 1)->increase();
+  return s;
+}
+
+void MuxBase::RemoteStream::close() {
+  Handoff::send(m_link, true, Handoff::CLOSE);
+  m_link->client = nullptr;
+  m_link->release();
+  delete this;
+}
+
+//
+// MuxBase::HostedStream
+//
+
+void MuxBase::HostedStream::open(Link *link) {
+  auto *s = new HostedStream(link);
+  link->host = s;
+  auto *session = link->session->session;
+  if (session && session->m_cluster && session->m_pipeline &&
+      !session->m_is_closed && !session->is_pending()
+  ) {
+    session->m_cluster->share(session);
+    s->m_session = session;
+  } else {
+    pjs::Ref<StreamEnd> end(StreamEnd::make(StreamEnd::CONNECTION_RESET));
+    Handoff::send(link, false, Handoff::EVENT, end);
+  }
+}
+
+void MuxBase::HostedStream::close() {
+  if (auto *stream = m_stream) {
+    stream->chain(nullptr);
+    m_session->close_stream(stream);
+    m_stream = nullptr;
+  }
+  if (auto *session = m_session.get()) {
+    session->free();
+    m_session = nullptr;
+  }
+  m_link->host = nullptr;
+  m_link->release();
+  delete this;
+}
+
+void MuxBase::HostedStream::set_one_way() {
+  if (auto *stream = m_stream) {
+    m_session->set_one_way(stream);
+  }
+}
+
+//
+// The stream is only opened on its first event, same as a local one,
+// since protocols like HTTP/2 number streams in the order they're opened
+// and expect them to start in that order, too.
+//
+
+void MuxBase::HostedStream::receive(Event *evt) {
+  if (!m_session) return;
+  if (!m_stream) {
+    m_stream = m_session->open_stream();
+    m_stream->chain(EventFunction::input());
+  }
+  output(evt, m_stream->input());
 }
 
 //
@@ -101,6 +921,11 @@ void MuxBase::reset() {
     }
     m_session->free();
     m_session = nullptr;
+  } else if (m_remote_stream) {
+    m_remote_stream->chain(nullptr);
+    m_remote_stream->close();
+    m_remote_stream = nullptr;
+    m_stream = nullptr;
   }
   m_waiting_events.clear();
   m_session_key = pjs::Value::undefined;
@@ -118,7 +943,13 @@ void MuxBase::process(Event *evt) {
       if (m_session_key.is_undefined()) {
         m_session_key.set(context()->inbound());
       }
-      session = m_session_manager->get(this, m_session_key);
+      SharedSession *remote = nullptr;
+      session = m_session_manager->get(this, m_session_key, &remote);
+      if (remote) {
+        open_remote_stream(remote);
+        Filter::output(evt, m_stream->input());
+        return;
+      }
       if (!session) return;
       m_session = session;
     }
@@ -129,6 +960,9 @@ void MuxBase::process(Event *evt) {
       args[1].set((int)session->m_cluster->m_sessions.size());
       auto p = sub_pipeline(0, true, session->reply(), nullptr, 2, args);
       session->init(p);
+      if (auto *shared = session->m_shared) {
+        shared->ready.store(!session->is_pending(), std::memory_order_relaxed);
+      }
     }
 
     if (session->is_pending()) {
@@ -149,6 +983,21 @@ void MuxBase::open_stream() {
   m_stream = s;
 }
 
+void MuxBase::open_remote_stream(SharedSession *shared) {
+  auto s = RemoteStream::open(shared);
+  s->chain(output());
+  m_remote_stream = s;
+  m_stream = s;
+}
+
+void MuxBase::set_one_way() {
+  if (m_session) {
+    m_session->set_one_way(m_stream);
+  } else if (m_remote_stream) {
+    m_remote_stream->set_one_way();
+  }
+}
+
 void MuxBase::start_waiting() {
   if (!m_waiting) {
     m_session->m_waiting_muxers.push(this);
@@ -212,6 +1061,9 @@ void MuxBase::Session::set_pending(bool pending) {
       }
     }
     m_is_pending = pending;
+    if (m_shared) {
+      m_shared->ready.store(!pending, std::memory_order_relaxed);
+    }
   }
 }
 
@@ -246,6 +1098,7 @@ void MuxBase::Session::on_reply(Event *evt) {
   output(evt);
   if (evt->is<StreamEnd>()) {
     m_is_closed = true;
+    if (m_shared) m_shared->detach();
   }
 }
 
@@ -259,14 +1112,26 @@ MuxBase::SessionCluster::SessionCluster(MuxBase *mux, pjs::Object *options) {
     m_max_idle = opts.max_idle;
     m_max_queue = opts.max_queue;
     m_max_messages = opts.max_messages;
+    m_max_connections = opts.max_connections;
+    if (!opts.shared_pool.empty()) m_pool = SharedPool::get(opts.shared_pool);
   } else {
     m_max_idle = mux->m_options.max_idle;
     m_max_queue = mux->m_options.max_queue;
     m_max_messages = mux->m_options.max_messages;
+    m_max_connections = mux->m_options.max_connections;
+    if (!mux->m_options.shared_pool.empty()) m_pool = SharedPool::get(mux->m_options.shared_pool);
   }
 }
 
-auto MuxBase::SessionCluster::alloc() -> Session* {
+//
+// When all local sessions are busy, a cluster in a shared pool only opens
+// a new session if the upstream is still under its connection limit
+// process-wide. Otherwise the least loaded session of the same key is
+// picked from the pool, and if that belongs to another cluster, most
+// likely on another thread, the stream is handed over to it.
+//
+
+auto MuxBase::SessionCluster::alloc(SharedSession **remote) -> Session* {
   auto max_share_count = m_max_queue;
   auto max_message_count = m_max_messages;
   auto *s = m_sessions.head();
@@ -283,13 +1148,37 @@ auto MuxBase::SessionCluster::alloc() -> Session* {
     }
     s = s->next();
   }
+  if (m_pool) {
+    SharedSession *picked = nullptr;
+    if (!m_pool->reserve(m_pool_key, m_max_connections, &picked)) {
+      if (picked->owner == Mailbox::local()) {
+        auto *session = picked->session;
+        if (session && session->m_cluster == this) {
+          picked->release();
+          share(session);
+          return session;
+        }
+      }
+      *remote = picked;
+      return nullptr;
+    }
+  }
   s = session();
   s->m_cluster = this;
   s->retain();
   m_sessions.unshift(s);
+  if (m_pool) {
+    s->m_shared = SharedSession::make(m_pool, m_pool_key, s);
+  }
   return s;
 }
 
+void MuxBase::SessionCluster::share(Session *session) {
+  session->m_share_count++;
+  session->m_message_count++;
+  sort(session);
+}
+
 void MuxBase::SessionCluster::free(Session *session) {
   session->m_share_count--;
   if (session->is_free()) {
@@ -299,6 +1188,10 @@ void MuxBase::SessionCluster::free(Session *session) {
 }
 
 void MuxBase::SessionCluster::discard(Session *session) {
+  if (auto *shared = session->m_shared) {
+    session->m_shared = nullptr;
+    shared->unregister();
+  }
   Session::auto_release(session);
   m_sessions.remove(session);
   session->release();
@@ -307,6 +1200,9 @@ void MuxBase::SessionCluster::discard(Session *session) {
 
 void MuxBase::SessionCluster::sort(Session *session) {
   if (session) {
+    if (auto *shared = session->m_shared) {
+      shared->load.store(session->m_share_count, std::memory_order_relaxed);
+    }
     auto p = session->back();
     while (p && p->m_share_count > session->m_share_count) p = p->back();
     if (p == session->back()) {
@@ -388,7 +1284,7 @@ MuxBase::SessionManager::~SessionManager() {
   for (const auto &p : m_weak_clusters) p.second->free();
 }
 
-auto MuxBase::SessionManager::get(MuxBase *mux, const pjs::Value &key) -> Session* {
+auto MuxBase::SessionManager::get(MuxBase *mux, const pjs::Value &key, SharedSession **remote) -> Session* {
   bool is_weak = (key.is_object() && key.o());
   SessionCluster *cluster = nullptr;
 
@@ -405,7 +1301,7 @@ auto MuxBase::SessionManager::get(MuxBase *mux, const pjs::Value &key) -> Sessio
     }
   }
 
-  if (cluster) return cluster->alloc();
+  if (cluster) return cluster->alloc(remote);
 
   try {
     pjs::Value opts;
@@ -430,13 +1326,21 @@ auto MuxBase::SessionManager::get(MuxBase *mux, const pjs::Value &key) -> Sessio
   if (is_weak) {
     cluster->m_weak_key = key.o();
     cluster->watch(key.o()->weak_ptr());
+    cluster->m_pool = nullptr;
     m_weak_clusters[key.o()] = cluster;
   } else {
     cluster->m_key = key;
     m_clusters[key] = cluster;
+    if (cluster->m_pool) {
+      Filter::Dump d;
+      mux->dump(d);
+      auto *s = key.to_string();
+      cluster->m_pool_key = d.name + ':' + s->str();
+      s->release();
+    }
   }
 
-  return cluster->alloc();
+  return cluster->alloc(remote);
 }
 
 void MuxBase::SessionManager::shutdown() {
@@ -666,12 +1570,11 @@ void MuxQueue::process(Event *evt) {
   if (auto *f = m_options.is_one_way.get()) {
     if (!m_started) {
       if (auto *start = evt->as<MessageStart>()) {
-        if (auto *s = MuxBase::stream()) {
+        if (MuxBase::stream()) {
           pjs::Value arg(start), ret;
           if (Filter::callback(f, 1, &arg, ret)) {
             if (ret.to_boolean()) {
-              auto *session = static_cast<Session*>(MuxBase::session());
-              static_cast<QueueMuxer*>(session)->set_one_way(s);
+              MuxBase::set_one_way();
             }
           }
         }
@@ -702,6 +1605,10 @@ void MuxQueue::Session::close_stream(EventFunction *stream) {
   return QueueMuxer::close(stream);
 }
 
+void MuxQueue::Session::set_one_way(EventFunction *stream) {
+  QueueMuxer::set_one_way(stream);
+}
+
 void MuxQueue::Session::close() {
   QueueMuxer::reset();
   MuxBase::Session::close();
@@ -35,6 +35,8 @@
 #include "options.hpp"
 
 #include <unordered_map>
+#include <functional>
+#include <string>
 
 namespace pipy {
 
@@ -53,10 +55,14 @@ public:
     double max_idle = 60;
     int max_queue = 0;
     int max_messages = 0;
+    int max_connections = 0;
+    std::string shared_pool;
     Options() {}
     Options(pjs::Object *options);
   };
 
+  static void for_each_shared_session(const std::function<void(const std::string &pool, int streams)> &cb);
+
 protected:
   class Session;
   class SessionCluster;
@@ -69,6 +75,7 @@ protected:
 
   auto session() -> Session* { return m_session; }
   auto stream() -> EventFunction* { return m_stream; }
+  void set_one_way();
 
   virtual void reset() override;
   virtual void shutdown() override;
@@ -77,6 +84,13 @@ protected:
 
 private:
   class SessionManager;
+  class SharedPool;
+  class SharedSession;
+  class Mailbox;
+  class Handoff;
+  class Link;
+  class RemoteStream;
+  class HostedStream;
 
   Options m_options;
   pjs::Ref<pjs::Function> m_options_f;
@@ -85,10 +99,12 @@ private:
   pjs::Ref<pjs::Function> m_group;
   pjs::Value m_session_key;
   EventFunction* m_stream = nullptr;
+  RemoteStream* m_remote_stream = nullptr;
   EventBuffer m_waiting_events;
   bool m_waiting = false;
 
   void open_stream();
+  void open_remote_stream(SharedSession *shared);
   void start_waiting();
   void flush_waiting();
   void stop_waiting();
@@ -109,6 +125,7 @@ protected:
     virtual void open();
     virtual auto open_stream() -> EventFunction* = 0;
     virtual void close_stream(EventFunction *stream) = 0;
+    virtual void set_one_way(EventFunction *stream) {}
     virtual void close();
 
     Session() {}
@@ -127,6 +144,7 @@ protected:
     void reset();
 
     SessionCluster* m_cluster = nullptr;
+    SharedSession* m_shared = nullptr;
     pjs::Ref<Pipeline> m_pipeline;
     int m_share_count = 1;
     int m_message_count = 0;
@@ -158,7 +176,8 @@ protected:
     virtual void free() = 0;
 
   private:
-    auto alloc() -> Session*;
+    auto alloc(SharedSession **remote) -> Session*;
+    void share(Session *session);
     void free(Session *session);
     void discard(Session *session);
 
@@ -166,9 +185,12 @@ protected:
     pjs::Value m_key;
     pjs::WeakRef<pjs::Object> m_weak_key;
     List<Session> m_sessions;
+    SharedPool* m_pool = nullptr;
+    std::string m_pool_key;
     double m_max_idle;
     int m_max_queue;
     int m_max_messages;
+    int m_max_connections;
     bool m_weak_ptr_gone = false;
     bool m_recycle_scheduled = false;
 
@@ -190,7 +212,7 @@ private:
   class SessionManager : public pjs::RefCount<SessionManager> {
     ~SessionManager();
 
-    auto get(MuxBase *mux, const pjs::Value &key) -> Session*;
+    auto get(MuxBase *mux, const pjs::Value &key, SharedSession **remote) -> Session*;
     void shutdown();
 
     std::unordered_map<pjs::Value, SessionCluster*> m_clusters;
@@ -298,6 +320,7 @@ protected:
     virtual void open() override;
     virtual auto open_stream() -> EventFunction* override;
     virtual void close_stream(EventFunction *stream) override;
+    virtual void set_one_way(EventFunction *stream) override;
     virtual void close() override;
 
     friend class MuxQueue;
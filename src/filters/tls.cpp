@@ -24,13 +24,27 @@
  */
 
 #include "tls.hpp"
+#include "connect.hpp"
 #include "context.hpp"
+#include "inbound.hpp"
+#include "listener.hpp"
 #include "module.hpp"
+#include "outbound.hpp"
 #include "pipeline.hpp"
 #include "api/crypto.hpp"
+#include "api/stats.hpp"
+#include "utils.hpp"
 #include "log.hpp"
 
 #include <openssl/err.h>
+#include <openssl/kdf.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+
+#ifdef __linux__
+#include <netinet/tcp.h>
+#include <linux/tls.h>
+#endif // __linux__
 
 namespace pipy {
 namespace tls {
@@ -46,6 +60,430 @@ static void throw_error() {
   throw std::runtime_error(str);
 }
 
+//
+// Kernel TLS
+//
+
+#ifdef __linux__
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+
+union KernelCryptoInfo {
+  tls_crypto_info info;
+  tls12_crypto_info_aes_gcm_128 aes_gcm_128;
+  tls12_crypto_info_aes_gcm_256 aes_gcm_256;
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+  tls12_crypto_info_chacha20_poly1305 chacha20_poly1305;
+#endif
+};
+
+static auto kernel_cipher_key_size(int nid) -> size_t {
+  switch (nid) {
+    case NID_aes_128_gcm: return TLS_CIPHER_AES_GCM_128_KEY_SIZE;
+    case NID_aes_256_gcm: return TLS_CIPHER_AES_GCM_256_KEY_SIZE;
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+    case NID_chacha20_poly1305: return TLS_CIPHER_CHACHA20_POLY1305_KEY_SIZE;
+#endif
+    default: return 0;
+  }
+}
+
+static bool kernel_crypto_info(
+  int nid,
+  const uint8_t *key, const uint8_t *iv, uint64_t seq,
+  KernelCryptoInfo &ci, size_t &size
+) {
+  uint8_t rec_seq[8];
+  for (int i = 7; i >= 0; i--) {
+    rec_seq[i] = seq;
+    seq >>= 8;
+  }
+
+  std::memset(&ci, 0, sizeof(ci));
+  ci.info.version = TLS_1_2_VERSION;
+
+  // For AES-GCM, the first 4 bytes of the IV are the implicit salt and the
+  // rest is the explicit nonce, where we follow OpenSSL in using the record
+  // sequence number.
+  switch (nid) {
+    case NID_aes_128_gcm: {
+      auto &c = ci.aes_gcm_128;
+      c.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+      std::memcpy(c.key, key, sizeof(c.key));
+      std::memcpy(c.salt, iv, sizeof(c.salt));
+      std::memcpy(c.iv, rec_seq, sizeof(c.iv));
+      std::memcpy(c.rec_seq, rec_seq, sizeof(c.rec_seq));
+      size = sizeof(c);
+      return true;
+    }
+    case NID_aes_256_gcm: {
+      auto &c = ci.aes_gcm_256;
+      c.info.cipher_type = TLS_CIPHER_AES_GCM_256;
+      std::memcpy(c.key, key, sizeof(c.key));
+      std::memcpy(c.salt, iv, sizeof(c.salt));
+      std::memcpy(c.iv, rec_seq, sizeof(c.iv));
+      std::memcpy(c.rec_seq, rec_seq, sizeof(c.rec_seq));
+      size = sizeof(c);
+      return true;
+    }
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+    case NID_chacha20_poly1305: {
+      auto &c = ci.chacha20_poly1305;
+      c.info.cipher_type = TLS_CIPHER_CHACHA20_POLY1305;
+      std::memcpy(c.key, key, sizeof(c.key));
+      std::memcpy(c.iv, iv, sizeof(c.iv));
+      std::memcpy(c.rec_seq, rec_seq, sizeof(c.rec_seq));
+      size = sizeof(c);
+      return true;
+    }
+#endif
+    default: return false;
+  }
+}
+
+static bool tls1_prf(
+  const EVP_MD *md,
+  const uint8_t *secret, size_t secret_len,
+  const char *label,
+  const uint8_t *seed1, size_t seed1_len,
+  const uint8_t *seed2, size_t seed2_len,
+  uint8_t *out, size_t len
+) {
+  auto *pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_TLS1_PRF, nullptr);
+  bool ok = (
+    pctx &&
+    EVP_PKEY_derive_init(pctx) > 0 &&
+    EVP_PKEY_CTX_set_tls1_prf_md(pctx, md) > 0 &&
+    EVP_PKEY_CTX_set1_tls1_prf_secret(pctx, secret, secret_len) > 0 &&
+    EVP_PKEY_CTX_add1_tls1_prf_seed(pctx, label, std::strlen(label)) > 0 &&
+    EVP_PKEY_CTX_add1_tls1_prf_seed(pctx, seed1, seed1_len) > 0 &&
+    EVP_PKEY_CTX_add1_tls1_prf_seed(pctx, seed2, seed2_len) > 0 &&
+    EVP_PKEY_derive(pctx, out, &len) > 0
+  );
+  EVP_PKEY_CTX_free(pctx);
+  return ok;
+}
+
+#endif // __linux__
+
+thread_local static pjs::Ref<stats::Counter> s_metric_offloaded;
+
+static void init_metrics() {
+  if (!s_metric_offloaded) {
+    pjs::Ref<pjs::Array> label_names = pjs::Array::make(1);
+    label_names->set(0, "listen");
+    s_metric_offloaded = stats::Counter::make(
+      pjs::Str::make("pipy_tls_offload_count"),
+      label_names
+    );
+  }
+}
+
+//
+// SessionCache::Options
+//
+
+SessionCache::Options::Options(pjs::Object *options, const char *base_name) {
+  Value(options, "name", base_name)
+    .get(name)
+    .check_nullable();
+  Value(options, "size", base_name)
+    .get(size)
+    .check_nullable();
+  Value(options, "timeout", base_name)
+    .get_seconds(timeout)
+    .check_nullable();
+  Value(options, "ticketKeyRotation", base_name)
+    .get_seconds(ticket_key_rotation)
+    .check_nullable();
+}
+
+//
+// SessionCache
+//
+
+int SessionCache::s_ex_data_index = 0;
+std::mutex SessionCache::s_caches_mutex;
+std::map<std::string, SessionCache*> SessionCache::s_caches;
+
+thread_local static pjs::Ref<stats::Counter> s_metric_session_cache_hit;
+thread_local static pjs::Ref<stats::Counter> s_metric_session_cache_miss;
+thread_local static pjs::Ref<stats::Counter> s_metric_session_cache_eviction;
+
+static void init_session_cache_metrics() {
+  if (!s_metric_session_cache_hit) {
+    pjs::Ref<pjs::Array> label_names = pjs::Array::make(1);
+    label_names->set(0, "cache");
+    s_metric_session_cache_hit = stats::Counter::make(
+      pjs::Str::make("pipy_tls_session_cache_hit_count"),
+      label_names
+    );
+    s_metric_session_cache_miss = stats::Counter::make(
+      pjs::Str::make("pipy_tls_session_cache_miss_count"),
+      label_names
+    );
+    s_metric_session_cache_eviction = stats::Counter::make(
+      pjs::Str::make("pipy_tls_session_cache_eviction_count"),
+      label_names
+    );
+  }
+}
+
+void SessionCache::init() {
+  s_ex_data_index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+}
+
+//
+// Caches are shared by all worker threads and live as long as the process.
+// The options of the latest filter to ask for a name apply, so that a
+// reloaded codebase can change them while keeping the cached sessions.
+//
+
+auto SessionCache::get(const Options &options) -> SessionCache* {
+  SessionCache *cache = nullptr;
+  int n = 0;
+  {
+    std::lock_guard<std::mutex> lock(s_caches_mutex);
+    auto &c = s_caches[options.name];
+    if (c) {
+      n = c->set_options(options);
+    } else {
+      c = new SessionCache(options);
+    }
+    cache = c;
+  }
+  if (n > 0) cache->on_evict(n);
+  return cache;
+}
+
+SessionCache::SessionCache(const Options &options)
+  : m_name(options.name)
+{
+  set_options(options);
+  rotate_ticket_keys();
+  rotate_ticket_keys();
+}
+
+auto SessionCache::set_options(const Options &options) -> int {
+  auto stripe_size = std::max(size_t(1), (options.size + STRIPES - 1) / STRIPES);
+  m_stripe_size.store(stripe_size);
+  m_timeout.store(options.timeout);
+  m_ticket_key_rotation.store(options.ticket_key_rotation);
+
+  int evicted = 0;
+  for (auto &s : m_stripes) {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    while (s.entries.size() > stripe_size) {
+      s.entries.erase(s.lru.back());
+      s.lru.pop_back();
+      evicted++;
+    }
+  }
+  return evicted;
+}
+
+void SessionCache::enable(SSL_CTX *ctx) {
+  unsigned char sid_ctx[SHA256_DIGEST_LENGTH];
+  SHA256((const unsigned char *)m_name.c_str(), m_name.length(), sid_ctx);
+  SSL_CTX_set_ex_data(ctx, s_ex_data_index, this);
+  SSL_CTX_set_session_id_context(ctx, sid_ctx, sizeof(sid_ctx));
+  SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+  SSL_CTX_set_timeout(ctx, long(m_timeout.load()));
+  SSL_CTX_sess_set_new_cb(ctx, on_new_session);
+  SSL_CTX_sess_set_get_cb(ctx, on_get_session);
+  SSL_CTX_sess_set_remove_cb(ctx, on_remove_session);
+  SSL_CTX_set_tlsext_ticket_key_cb(ctx, on_ticket_key);
+}
+
+auto SessionCache::stripe(const unsigned char *id, size_t len) -> Stripe& {
+  size_t h = 0;
+  for (size_t i = 0; i < len; i++) h = h * 31 + id[i];
+  return m_stripes[h % STRIPES];
+}
+
+void SessionCache::rotate_ticket_keys() {
+  m_ticket_keys[1] = m_ticket_keys[0];
+  auto &k = m_ticket_keys[0];
+  RAND_bytes(k.name, sizeof(k.name));
+  RAND_bytes(k.aes_key, sizeof(k.aes_key));
+  RAND_bytes(k.hmac_key, sizeof(k.hmac_key));
+  m_ticket_key_time = utils::now();
+}
+
+void SessionCache::on_hit() {
+  init_session_cache_metrics();
+  pjs::Str *label = pjs::Str::make(m_name);
+  s_metric_session_cache_hit->increase();
+  s_metric_session_cache_hit->with_labels(&label, 1)->increase();
+}
+
+void SessionCache::on_miss() {
+  init_session_cache_metrics();
+  pjs::Str *label = pjs::Str::make(m_name);
+  s_metric_session_cache_miss->increase();
+  s_metric_session_cache_miss->with_labels(&label, 1)->increase();
+}
+
+void SessionCache::on_evict(int n) {
+  init_session_cache_metrics();
+  pjs::Str *label = pjs::Str::make(m_name);
+  s_metric_session_cache_eviction->increase(n);
+  s_metric_session_cache_eviction->with_labels(&label, 1)->increase(n);
+}
+
+auto SessionCache::from(SSL_CTX *ctx) -> SessionCache* {
+  return static_cast<SessionCache*>(SSL_CTX_get_ex_data(ctx, s_ex_data_index));
+}
+
+auto SessionCache::on_new_session(SSL *ssl, SSL_SESSION *sess) -> int {
+  auto cache = from(SSL_get_SSL_CTX(ssl));
+  if (!cache) return 0;
+
+  unsigned int id_len;
+  auto id = SSL_SESSION_get_id(sess, &id_len);
+  if (!id_len) return 0;
+
+  auto size = i2d_SSL_SESSION(sess, nullptr);
+  if (size <= 0) return 0;
+
+  std::string der(size, 0);
+  auto p = (unsigned char *)&der[0];
+  i2d_SSL_SESSION(sess, &p);
+
+  std::string key((const char *)id, id_len);
+  auto &s = cache->stripe(id, id_len);
+  int evicted = 0;
+
+  {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto i = s.entries.find(key);
+    if (i != s.entries.end()) {
+      s.lru.erase(i->second.lru);
+      s.entries.erase(i);
+    }
+    s.lru.push_front(key);
+    auto &e = s.entries[key];
+    e.session = std::move(der);
+    e.time = utils::now();
+    e.lru = s.lru.begin();
+    while (s.entries.size() > cache->m_stripe_size) {
+      s.entries.erase(s.lru.back());
+      s.lru.pop_back();
+      evicted++;
+    }
+  }
+
+  if (evicted > 0) cache->on_evict(evicted);
+  return 0;
+}
+
+auto SessionCache::on_get_session(SSL *ssl, const unsigned char *id, int len, int *copy) -> SSL_SESSION* {
+  *copy = 0;
+  auto cache = from(SSL_get_SSL_CTX(ssl));
+  if (!cache || len <= 0) return nullptr;
+
+  std::string key((const char *)id, len);
+  std::string der;
+  auto &s = cache->stripe(id, len);
+
+  {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto i = s.entries.find(key);
+    if (i != s.entries.end()) {
+      auto &e = i->second;
+      if (utils::now() - e.time > cache->m_timeout.load() * 1000) {
+        s.lru.erase(e.lru);
+        s.entries.erase(i);
+      } else {
+        s.lru.splice(s.lru.begin(), s.lru, e.lru);
+        der = e.session;
+      }
+    }
+  }
+
+  if (der.empty()) {
+      cache->on_miss();
+    return nullptr;
+  }
+
+  auto p = (const unsigned char *)der.c_str();
+  auto sess = d2i_SSL_SESSION(nullptr, &p, der.length());
+  if (sess) cache->on_hit(); else cache->on_miss();
+  return sess;
+}
+
+void SessionCache::on_remove_session(SSL_CTX *ctx, SSL_SESSION *sess) {
+  auto cache = from(ctx);
+  if (!cache) return;
+
+  unsigned int id_len;
+  auto id = SSL_SESSION_get_id(sess, &id_len);
+  std::string key((const char *)id, id_len);
+  auto &s = cache->stripe(id, id_len);
+
+  std::lock_guard<std::mutex> lock(s.mutex);
+  auto i = s.entries.find(key);
+  if (i != s.entries.end()) {
+    s.lru.erase(i->second.lru);
+    s.entries.erase(i);
+  }
+}
+
+auto SessionCache::on_ticket_key(
+  SSL *ssl,
+  unsigned char key_name[16],
+  unsigned char *iv,
+  EVP_CIPHER_CTX *cipher_ctx,
+  HMAC_CTX *hmac_ctx,
+  int enc
+) -> int {
+  auto cache = from(SSL_get_SSL_CTX(ssl));
+  if (!cache) return -1;
+
+  TicketKey key;
+  bool is_current = true;
+
+  {
+    std::lock_guard<std::mutex> lock(cache->m_ticket_key_mutex);
+    if (enc) {
+      auto rotation = cache->m_ticket_key_rotation.load();
+      if (rotation > 0 && utils::now() - cache->m_ticket_key_time >= rotation * 1000) {
+        cache->rotate_ticket_keys();
+      }
+      key = cache->m_ticket_keys[0];
+    } else if (!std::memcmp(key_name, cache->m_ticket_keys[0].name, sizeof(key.name))) {
+      key = cache->m_ticket_keys[0];
+    } else if (!std::memcmp(key_name, cache->m_ticket_keys[1].name, sizeof(key.name))) {
+      key = cache->m_ticket_keys[1];
+      is_current = false;
+    } else {
+      cache->on_miss();
+      return 0;
+    }
+  }
+
+  int ret;
+  if (enc) {
+    if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) <= 0) return -1;
+    std::memcpy(key_name, key.name, sizeof(key.name));
+    EVP_EncryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), nullptr, key.aes_key, iv);
+    HMAC_Init_ex(hmac_ctx, key.hmac_key, sizeof(key.hmac_key), EVP_sha256(), nullptr);
+    ret = 1;
+  } else {
+    EVP_DecryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), nullptr, key.aes_key, iv);
+    HMAC_Init_ex(hmac_ctx, key.hmac_key, sizeof(key.hmac_key), EVP_sha256(), nullptr);
+    cache->on_hit();
+
+    // Tickets sealed with the previous key are accepted but renewed
+    ret = is_current ? 1 : 2;
+  }
+
+  OPENSSL_cleanse(&key, sizeof(key));
+  return ret;
+}
+
 //
 // TLSContext
 //
@@ -70,6 +508,10 @@ TLSContext::~TLSContext() {
   if (m_ctx) SSL_CTX_free(m_ctx);
 }
 
+void TLSContext::enable_session_cache(SessionCache *cache) {
+  cache->enable(m_ctx);
+}
+
 void TLSContext::add_certificate(crypto::Certificate *cert) {
   X509_STORE_add_cert(m_verify_store, cert->x509());
   SSL_CTX_set_verify(m_ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, on_verify);
@@ -164,6 +606,8 @@ void TLSSession::init() {
   SSL_library_init();
 
   s_user_data_index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+
+  SessionCache::init();
 }
 
 auto TLSSession::get(SSL *ssl) -> TLSSession* {
@@ -209,6 +653,14 @@ TLSSession::TLSSession(
 
 TLSSession::~TLSSession() {
   close();
+
+  // No close_notify is ever sent, so OpenSSL would take every session as
+  // broken and drop it from the cache on SSL_free(). Sessions that did go
+  // wrong were dropped already when the fatal alert was sent.
+  if (SSL_is_init_finished(m_ssl)) {
+    SSL_set_shutdown(m_ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+  }
+
   SSL_free(m_ssl);
 }
 
@@ -216,6 +668,14 @@ void TLSSession::set_sni(const char *name) {
   SSL_set_tlsext_host_name(m_ssl, name);
 }
 
+void TLSSession::enable_offload() {
+#ifdef __linux__
+  m_offload = true;
+  SSL_set_msg_callback(m_ssl, on_message);
+  SSL_set_msg_callback_arg(m_ssl, this);
+#endif // __linux__
+}
+
 void TLSSession::start_handshake() {
   handshake_step();
 }
@@ -228,11 +688,19 @@ void TLSSession::on_input(Event *evt) {
 
   } else if (auto *data = evt->as<Data>()) {
     if (m_is_server) {
-      m_buffer_receive.push(*data);
-      if (handshake_step()) pump_read();
+      if (m_offloaded) {
+        forward(evt);
+      } else {
+        m_buffer_receive.push(*data);
+        if (handshake_step()) pump_read();
+      }
     } else {
-      m_buffer_write.push(*data);
-      if (handshake_step()) pump_write();
+      if (m_offloaded) {
+        forward(evt);
+      } else {
+        m_buffer_write.push(*data);
+        if (handshake_step()) pump_write();
+      }
     }
 
   } else if (evt->is<StreamEnd>()) {
@@ -249,11 +717,19 @@ void TLSSession::on_reply(Event *evt) {
 
   } else if (auto *data = evt->as<Data>()) {
     if (m_is_server) {
-      m_buffer_write.push(*data);
-      if (handshake_step()) pump_write();
+      if (m_offloaded) {
+        output(evt);
+      } else {
+        m_buffer_write.push(*data);
+        if (handshake_step()) pump_write();
+      }
     } else {
-      m_buffer_receive.push(*data);
-      if (handshake_step()) pump_read();
+      if (m_offloaded) {
+        output(evt);
+      } else {
+        m_buffer_receive.push(*data);
+        if (handshake_step()) pump_read();
+      }
     }
 
   } else if (evt->is<StreamEnd>()) {
@@ -262,6 +738,21 @@ void TLSSession::on_reply(Event *evt) {
   }
 }
 
+void TLSSession::on_message(int write_p, int version, int content_type, const void *buf, size_t len, SSL *ssl, void *arg) {
+  if (!write_p) return;
+  auto *session = static_cast<TLSSession*>(arg);
+
+  // Count the records sent after our Finished message, which
+  // gives the sequence number to start from once offloaded
+  if (content_type == SSL3_RT_HEADER) {
+    session->m_records_written++;
+  } else if (content_type == SSL3_RT_HANDSHAKE && len > 0) {
+    if (*(const uint8_t *)buf == SSL3_MT_FINISHED) {
+      session->m_records_written = 0;
+    }
+  }
+}
+
 auto TLSSession::on_verify(int preverify_ok, X509_STORE_CTX *cert_store_ctx) -> int {
   if (!m_verify) return preverify_ok;
   auto *x509 = X509_STORE_CTX_get0_cert(cert_store_ctx);
@@ -346,6 +837,7 @@ bool TLSSession::handshake_step() {
     if (ret == 1) {
       handshake_done();
       pump_send();
+      if (m_offload) offload();
       pump_write();
       return true;
     }
@@ -387,7 +879,122 @@ void TLSSession::handshake_done() {
   }
 }
 
+void TLSSession::offload() {
+#ifdef __linux__
+  m_offload = false;
+
+  // Only TLS 1.2 is offloaded. In TLS 1.3 a KeyUpdate from the peer changes
+  // the keys at any time, which would have to be handled by OpenSSL again
+  if (SSL_version(m_ssl) != TLS1_2_VERSION) return;
+
+  // After offloading, OpenSSL is no longer involved in either direction, so
+  // all records it has produced must be out already and no record must be
+  // left for it to read
+  pump_send();
+  if (
+    BIO_ctrl_pending(m_wbio) > 0 ||
+    !m_buffer_receive.empty() ||
+    BIO_ctrl_pending(m_rbio) > 0 ||
+    SSL_pending(m_ssl) > 0
+  ) return;
+
+  auto cipher = SSL_get_current_cipher(m_ssl);
+  auto nid = SSL_CIPHER_get_cipher_nid(cipher);
+  auto md = SSL_CIPHER_get_handshake_digest(cipher);
+  auto key_size = kernel_cipher_key_size(nid);
+  if (!key_size || !md) return;
+
+  uint8_t tx_key[32], tx_iv[12], rx_key[32], rx_iv[12];
+  uint8_t master_key[SSL_MAX_MASTER_KEY_LENGTH];
+  uint8_t client_random[SSL3_RANDOM_SIZE];
+  uint8_t server_random[SSL3_RANDOM_SIZE];
+  uint8_t key_block[2 * (32 + 12)];
+  auto iv_size = (nid == NID_aes_128_gcm || nid == NID_aes_256_gcm ? 4 : 12);
+  auto master_key_size = SSL_SESSION_get_master_key(SSL_get_session(m_ssl), master_key, sizeof(master_key));
+  SSL_get_client_random(m_ssl, client_random, sizeof(client_random));
+  SSL_get_server_random(m_ssl, server_random, sizeof(server_random));
+  bool ok = tls1_prf(
+    md, master_key, master_key_size, "key expansion",
+    server_random, sizeof(server_random),
+    client_random, sizeof(client_random),
+    key_block, 2 * (key_size + iv_size)
+  );
+  OPENSSL_cleanse(master_key, sizeof(master_key));
+  if (!ok) {
+    OPENSSL_cleanse(key_block, sizeof(key_block));
+    return;
+  }
+
+  auto client_key = key_block;
+  auto server_key = client_key + key_size;
+  auto client_iv = server_key + key_size;
+  auto server_iv = client_iv + iv_size;
+  std::memcpy(tx_key, m_is_server ? server_key : client_key, key_size);
+  std::memcpy(rx_key, m_is_server ? client_key : server_key, key_size);
+  std::memcpy(tx_iv, m_is_server ? server_iv : client_iv, iv_size);
+  std::memcpy(rx_iv, m_is_server ? client_iv : server_iv, iv_size);
+  OPENSSL_cleanse(key_block, sizeof(key_block));
+
+  KernelCryptoInfo tx, rx;
+  size_t tx_size, rx_size;
+  ok = (
+    kernel_crypto_info(nid, tx_key, tx_iv, m_records_written + 1, tx, tx_size) &&
+    kernel_crypto_info(nid, rx_key, rx_iv, 1, rx, rx_size)
+  );
+
+  OPENSSL_cleanse(tx_key, sizeof(tx_key));
+  OPENSSL_cleanse(rx_key, sizeof(rx_key));
+  OPENSSL_cleanse(tx_iv, sizeof(tx_iv));
+  OPENSSL_cleanse(rx_iv, sizeof(rx_iv));
+
+  if (!ok) return;
+
+  auto setup = [&](int sock) -> bool {
+    return (
+      !setsockopt(sock, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) &&
+      !setsockopt(sock, SOL_TLS, TLS_TX, &tx, tx_size) &&
+      !setsockopt(sock, SOL_TLS, TLS_RX, &rx, rx_size)
+    );
+  };
+
+  Listener *listener = nullptr;
+  bool offloaded = false;
+
+  if (m_is_server) {
+    if (auto inbound = dynamic_cast<InboundTCP*>(m_pipeline->context()->inbound())) {
+      listener = inbound->listener();
+      offloaded = inbound->offload(setup);
+    }
+  } else {
+    auto &filters = m_pipeline->filters();
+    if (filters.size() == 1) {
+      if (auto connect = dynamic_cast<Connect*>(filters.head())) {
+        if (auto outbound = dynamic_cast<OutboundTCP*>(connect->outbound())) {
+          offloaded = outbound->offload(setup);
+        }
+      }
+    }
+  }
+
+  OPENSSL_cleanse(&tx, sizeof(tx));
+  OPENSSL_cleanse(&rx, sizeof(rx));
+
+  if (offloaded) {
+    m_offloaded = true;
+    init_metrics();
+    s_metric_offloaded->increase();
+    if (listener && listener->pipeline_layout()) {
+      pjs::Str *label = listener->pipeline_layout()->name_or_label();
+      s_metric_offloaded->with_labels(&label, 1)->increase();
+    }
+  } else {
+    Log::debug(m_is_server ? Log::INBOUND : Log::OUTBOUND, "[tls] session %p not offloaded to the kernel", this);
+  }
+#endif // __linux__
+}
+
 auto TLSSession::pump_send() -> int {
+  if (m_offloaded) return 0;
   int size = 0;
   for (;;) {
     size_t n = 0;
@@ -458,6 +1065,17 @@ void TLSSession::pump_read() {
 }
 
 void TLSSession::pump_write() {
+  if (m_offloaded) {
+    if (!m_buffer_write.empty()) {
+      auto *data = Data::make(std::move(m_buffer_write));
+      if (m_is_server) {
+        output(data);
+      } else {
+        forward(data);
+      }
+    }
+    return;
+  }
   while (!m_buffer_write.empty()) {
     int size = 0;
     for (const auto c : m_buffer_write.chunks()) {
@@ -533,6 +1151,10 @@ Options::Options(pjs::Object *options, const char *base_name) {
   Value(options, "handshake", base_name)
     .get(handshake)
     .check_nullable();
+
+  Value(options, "offload", base_name)
+    .get(offload)
+    .check_nullable();
 }
 
 //
@@ -633,6 +1255,7 @@ void Client::process(Event *evt) {
       m_options->handshake
     );
     m_session->chain(output());
+    if (m_options->offload) m_session->enable_offload();
     pjs::Value sni(m_options->sni);
     if (!eval(m_options->sni_f, sni)) return;
     if (!sni.is_undefined()) {
@@ -673,6 +1296,18 @@ Server::Options::Options(pjs::Object *options)
       }
     );
   }
+
+  pjs::Ref<pjs::Object> session_cache_options;
+  Value(options, "sessionCache")
+    .get(session_cache_options)
+    .check_nullable();
+
+  if (session_cache_options) {
+    session_cache = std::make_shared<SessionCache::Options>(
+      session_cache_options,
+      "options.sessionCache"
+    );
+  }
 }
 
 //
@@ -688,6 +1323,12 @@ Server::Server(const Options &options)
   }
 
   m_tls_context->set_server_alpn(options.alpn_set);
+
+  if (options.session_cache) {
+    m_tls_context->enable_session_cache(
+      SessionCache::get(*options.session_cache)
+    );
+  }
 }
 
 Server::Server(const Server &r)
@@ -727,6 +1368,12 @@ void Server::process(Event *evt) {
       m_options->handshake
     );
     m_session->chain(output());
+    if (m_options->offload) {
+      auto inbound = context()->inbound();
+      if (inbound && inbound->pipeline() == pipeline() && pipeline()->filters().head() == this) {
+        m_session->enable_offload();
+      }
+    }
   }
 
   output(evt, m_session->input());
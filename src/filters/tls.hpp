@@ -34,9 +34,14 @@
 #include <openssl/bio.h>
 #include <openssl/ssl.h>
 
-#include <vector>
-#include <string>
+#include <atomic>
+#include <list>
+#include <map>
+#include <mutex>
 #include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace pipy {
 
@@ -44,6 +49,86 @@ namespace tls {
 
 class TLSFilter;
 
+//
+// SessionCache
+//
+
+class SessionCache {
+public:
+  struct Options : public pipy::Options {
+    std::string name = "default";
+    size_t size = 20000;
+    double timeout = 300;
+    double ticket_key_rotation = 3600;
+
+    Options() {}
+    Options(pjs::Object *options, const char *base_name = nullptr);
+  };
+
+  static void init();
+  static auto get(const Options &options) -> SessionCache*;
+
+  void enable(SSL_CTX *ctx);
+
+private:
+  SessionCache(const Options &options);
+
+  auto set_options(const Options &options) -> int;
+
+  enum { STRIPES = 16 };
+
+  struct Entry {
+    std::string session;
+    double time;
+    std::list<std::string>::iterator lru;
+  };
+
+  struct Stripe {
+    std::mutex mutex;
+    std::unordered_map<std::string, Entry> entries;
+    std::list<std::string> lru;
+  };
+
+  struct TicketKey {
+    unsigned char name[16];
+    unsigned char aes_key[32];
+    unsigned char hmac_key[32];
+  };
+
+  std::string m_name;
+  std::atomic<size_t> m_stripe_size;
+  std::atomic<double> m_timeout;
+  std::atomic<double> m_ticket_key_rotation;
+  Stripe m_stripes[STRIPES];
+  std::mutex m_ticket_key_mutex;
+  TicketKey m_ticket_keys[2];
+  double m_ticket_key_time;
+
+  auto stripe(const unsigned char *id, size_t len) -> Stripe&;
+  void rotate_ticket_keys();
+
+  void on_hit();
+  void on_miss();
+  void on_evict(int n);
+
+  static int s_ex_data_index;
+  static std::mutex s_caches_mutex;
+  static std::map<std::string, SessionCache*> s_caches;
+
+  static auto from(SSL_CTX *ctx) -> SessionCache*;
+  static auto on_new_session(SSL *ssl, SSL_SESSION *sess) -> int;
+  static auto on_get_session(SSL *ssl, const unsigned char *id, int len, int *copy) -> SSL_SESSION*;
+  static void on_remove_session(SSL_CTX *ctx, SSL_SESSION *sess);
+  static auto on_ticket_key(
+    SSL *ssl,
+    unsigned char key_name[16],
+    unsigned char *iv,
+    EVP_CIPHER_CTX *cipher_ctx,
+    HMAC_CTX *hmac_ctx,
+    int enc
+  ) -> int;
+};
+
 //
 // TLSContext
 //
@@ -54,6 +139,7 @@ public:
   ~TLSContext();
 
   auto ctx() const -> SSL_CTX* { return m_ctx; }
+  void enable_session_cache(SessionCache *cache);
   void add_certificate(crypto::Certificate *cert);
   void set_client_alpn(const std::vector<std::string> &protocols);
   void set_server_alpn(const std::set<pjs::Ref<pjs::Str>> &protocols);
@@ -100,6 +186,7 @@ public:
   ~TLSSession();
 
   void set_sni(const char *name);
+  void enable_offload();
   void start_handshake();
 
 private:
@@ -108,6 +195,7 @@ private:
   BIO* m_wbio;
   Data m_buffer_write;
   Data m_buffer_receive;
+  int m_records_written = 0;
   pjs::Ref<Pipeline> m_pipeline;
   pjs::Ref<pjs::Object> m_certificate;
   pjs::Ref<pjs::Object> m_ca;
@@ -117,6 +205,8 @@ private:
   bool m_is_server;
   bool m_closed_input = false;
   bool m_closed_output = false;
+  bool m_offload = false;
+  bool m_offloaded = false;
 
   virtual void on_input(Event *evt) override;
   virtual void on_reply(Event *evt) override;
@@ -129,6 +219,7 @@ private:
   void use_certificate(pjs::Str *sni);
   bool handshake_step();
   void handshake_done();
+  void offload();
   auto pump_send() -> int;
   auto pump_receive() -> int;
   void pump_read();
@@ -137,6 +228,8 @@ private:
 
   static int s_user_data_index;
 
+  static void on_message(int write_p, int version, int content_type, const void *buf, size_t len, SSL *ssl, void *arg);
+
   friend class pjs::RefCount<TLSSession>;
   friend class TLSContext;
 };
@@ -150,6 +243,7 @@ struct Options : public pipy::Options {
   std::vector<pjs::Ref<crypto::Certificate>> trusted;
   pjs::Ref<pjs::Function> verify;
   pjs::Ref<pjs::Function> handshake;
+  bool offload = false;
 
   Options() {}
   Options(pjs::Object *options, const char *base_name = nullptr);
@@ -195,6 +289,7 @@ public:
   struct Options : public tls::Options {
     pjs::Ref<pjs::Function> alpn;
     std::set<pjs::Ref<pjs::Str>> alpn_set;
+    std::shared_ptr<SessionCache::Options> session_cache;
 
     Options() {}
     Options(pjs::Object *options);
@@ -25,6 +25,7 @@
 
 #include "wait.hpp"
 #include "pipeline.hpp"
+#include "input.hpp"
 #include "log.hpp"
 
 namespace pipy {
@@ -91,7 +92,10 @@ void Wait::process(Event *evt) {
       if (m_buffer.empty() && m_options.timeout > 0) {
         m_timer.schedule(
           m_options.timeout,
-          [=]() { fulfill(); }
+          [=]() {
+            InputContext ic;
+            fulfill();
+          }
         );
       }
       Waiter::wait(context()->group());
@@ -27,9 +27,12 @@
 #include "listener.hpp"
 #include "pipeline.hpp"
 #include "worker.hpp"
+#include "worker-thread.hpp"
 #include "constants.hpp"
 #include "log.hpp"
 
+#include <unistd.h>
+
 #ifdef __linux__
 #include <linux/netfilter_ipv4.h>
 #include <linux/ip.h>
@@ -45,13 +48,16 @@ using tcp = asio::ip::tcp;
 //
 
 thread_local static Data::Producer s_dp_tcp("InboundTCP");
+thread_local static Data::Producer s_dp_tcp_lazy("InboundTCP Lazy");
 thread_local static Data::Producer s_dp_udp("InboundUDP Raw");
 
 std::atomic<uint64_t> Inbound::s_inbound_id;
+bool Inbound::s_lazy_read = false;
 
 thread_local pjs::Ref<stats::Gauge> Inbound::s_metric_concurrency;
 thread_local pjs::Ref<stats::Counter> Inbound::s_metric_traffic_in;
 thread_local pjs::Ref<stats::Counter> Inbound::s_metric_traffic_out;
+thread_local pjs::Ref<stats::Counter> Inbound::s_metric_accept;
 
 Inbound::Inbound() {
   init_metrics();
@@ -71,6 +77,10 @@ Inbound::~Inbound() {
   }
 }
 
+void Inbound::set_lazy_read(bool lazy) {
+  s_lazy_read = lazy;
+}
+
 auto Inbound::output() -> Output* {
   if (!m_output) {
     m_output = Output::make(EventTarget::input());
@@ -108,6 +118,19 @@ void Inbound::start(PipelineLayout *layout) {
     auto ctx = layout->new_context();
     ctx->m_inbound = this;
     m_pipeline = Pipeline::make(layout, ctx);
+
+    thread_local static pjs::Ref<pjs::Str> s_thread;
+    if (!s_thread) {
+      auto wt = WorkerThread::current();
+      s_thread = pjs::Str::make(wt ? wt->index() : 0);
+    }
+
+    auto k = layout->name_or_label();
+    auto l = s_metric_accept->with_labels(&k, 1);
+    pjs::Str *t = s_thread;
+    s_metric_accept->increase();
+    l->increase();
+    l->with_labels(&t, 1)->increase();
   }
 }
 
@@ -193,6 +216,13 @@ void Inbound::init_metrics() {
       pjs::Str::make("pipy_inbound_out"),
       label_names
     );
+
+    label_names->set(1, "thread");
+
+    s_metric_accept = stats::Counter::make(
+      pjs::Str::make("pipy_inbound_accept_count"),
+      label_names
+    );
   }
 }
 
@@ -209,6 +239,7 @@ InboundTCP::InboundTCP(Listener *listener, const Options &options)
 }
 
 InboundTCP::~InboundTCP() {
+  Splicer::unpair(this);
   if (m_listener) {
     m_listener->close(this);
   }
@@ -237,9 +268,13 @@ void InboundTCP::accept(asio::ip::tcp::acceptor &acceptor) {
           }
 
           if (m_listener && m_listener->pipeline_layout()) {
-            m_socket.set_option(asio::socket_base::keep_alive(m_options.keep_alive));
-            InputContext ic(this);
-            start();
+            if (Listener::s_balancing && Listener::Balancer::local()->hand_off(m_listener, m_socket)) {
+              dangle();
+            } else {
+              m_socket.set_option(asio::socket_base::keep_alive(m_options.keep_alive));
+              InputContext ic(this);
+              start();
+            }
           }
         }
       }
@@ -251,6 +286,57 @@ void InboundTCP::accept(asio::ip::tcp::acceptor &acceptor) {
   retain();
 }
 
+void InboundTCP::adopt(int fd, bool v6) {
+  std::error_code ec;
+  m_socket.assign(v6 ? tcp::v6() : tcp::v4(), fd, ec);
+  if (ec) {
+    ::close(fd);
+  } else {
+    m_peer = m_socket.remote_endpoint(ec);
+  }
+
+  if (ec) {
+    if (Log::is_enabled(Log::ERROR)) {
+      char desc[200];
+      describe(desc);
+      Log::error("%s error adopting connection: %s", desc, ec.message().c_str());
+    }
+    dangle();
+    return;
+  }
+
+  if (Log::is_enabled(Log::INBOUND)) {
+    char desc[200];
+    describe(desc);
+    Log::debug(Log::INBOUND, "%s connection adopted from another thread", desc);
+  }
+
+  m_socket.set_option(asio::socket_base::keep_alive(m_options.keep_alive));
+  InputContext ic(this);
+  start();
+}
+
+bool InboundTCP::offload(const std::function<bool(int)> &setup) {
+  if (!m_socket.is_open() || m_pumping || m_ended) return false;
+
+  std::error_code ec;
+  auto non_blocking = m_socket.non_blocking();
+  m_socket.non_blocking(true, ec);
+  while (!m_buffer.empty() && !ec) {
+    auto n = m_socket.write_some(DataChunks(m_buffer.chunks()), ec);
+    m_buffer.shift(n);
+    m_metric_traffic_out->increase(n);
+    s_metric_traffic_out->increase(n);
+  }
+  m_socket.non_blocking(non_blocking, ec);
+
+  if (!m_buffer.empty()) return false;
+  if (!setup(m_socket.native_handle())) return false;
+
+  m_offloaded = true;
+  return true;
+}
+
 void InboundTCP::on_get_address() {
   if (m_socket.is_open()) {
     const auto &ep = m_socket.local_endpoint();
@@ -325,6 +411,11 @@ void InboundTCP::start() {
   m_metric_traffic_in = Inbound::s_metric_traffic_in->with_labels(labels, n);
   m_metric_traffic_out = Inbound::s_metric_traffic_out->with_labels(labels, n);
 
+  if (m_options.lazy_read) {
+    std::error_code ec;
+    m_socket.non_blocking(true, ec);
+  }
+
   p->start();
   receive();
 }
@@ -332,19 +423,31 @@ void InboundTCP::start() {
 void InboundTCP::receive() {
   if (!m_socket.is_open()) return;
 
-  pjs::Ref<Data> buffer(Data::make(RECEIVE_BUFFER_SIZE, &s_dp_tcp));
-
-  m_socket.async_read_some(
-    DataChunks(buffer->chunks()),
-    [=](const std::error_code &ec, std::size_t n) {
-      InputContext ic(this);
+  if (m_splicer.target()) {
+    receive_spliced();
+    return;
+  }
 
-      if (m_options.read_timeout > 0) {
-        m_read_timer.cancel();
+  if (m_options.lazy_read) {
+    m_socket.async_wait(
+      tcp::socket::wait_read,
+      [=](const std::error_code &ec) {
+        if (ec) {
+          received(nullptr, ec);
+        } else {
+          read_available();
+        }
+        release();
       }
+    );
 
-      if (ec != asio::error::operation_aborted) {
-        if (n > 0) {
+  } else {
+    pjs::Ref<Data> buffer(Data::make(RECEIVE_BUFFER_SIZE, &s_dp_tcp));
+
+    m_socket.async_read_some(
+      DataChunks(buffer->chunks()),
+      [=](const std::error_code &ec, std::size_t n) {
+        if (n > 0 && ec != asio::error::operation_aborted) {
           buffer->pop(buffer->size() - n);
           if (m_socket.is_open()) {
             if (auto more = m_socket.available()) {
@@ -354,63 +457,163 @@ void InboundTCP::receive() {
               buffer->push(buf);
             }
           }
-          m_metric_traffic_in->increase(buffer->size());
-          s_metric_traffic_in->increase(buffer->size());
-          output(buffer);
+          received(buffer, ec);
+        } else {
+          received(nullptr, ec);
         }
+        release();
+      }
+    );
+  }
 
-        if (ec) {
-          if (ec == asio::error::eof) {
-            if (Log::is_enabled(Log::INBOUND)) {
-              char desc[200];
-              describe(desc);
-              Log::debug(Log::INBOUND, "%s EOF from peer", desc);
-            }
-            linger();
-            output(StreamEnd::make());
-          } else if (ec == asio::error::connection_reset) {
-            if (Log::is_enabled(Log::WARN)) {
-              char desc[200];
-              describe(desc);
-              Log::warn("%s connection reset by peer", desc);
-            }
-            close(StreamEnd::CONNECTION_RESET);
-          } else {
-            if (Log::is_enabled(Log::WARN)) {
-              char desc[200];
-              describe(desc);
-              Log::warn("%s error reading from peer: %s", desc, ec.message().c_str());
-            }
-            close(StreamEnd::READ_ERROR);
-          }
+  if (m_options.read_timeout > 0) {
+    m_read_timer.schedule(
+      m_options.read_timeout,
+      [this]() {
+        close(StreamEnd::READ_TIMEOUT);
+      }
+    );
+  }
+
+  retain();
+}
 
-        } else if (m_receiving_state == PAUSING) {
-          m_receiving_state = PAUSED;
-          retain();
-          wait();
+//
+// When spliced to an outbound, bytes go from this socket straight into
+// the outbound's socket in kernel space and never reach the pipeline.
+// Whatever the outbound is not ready to take yet, like before it gets
+// connected, still takes the normal way through the pipeline.
+//
 
-        } else if (m_receiving_state == RECEIVING) {
-          receive();
-          wait();
+void InboundTCP::receive_spliced() {
+  if (m_splicer.pending()) {
+    m_splicer.target()->splice_socket().async_wait(
+      tcp::socket::wait_write,
+      [=](const std::error_code &ec) {
+        if (m_options.write_timeout > 0) {
+          m_write_timer.cancel();
         }
+        if (ec != asio::error::operation_aborted) {
+          if (ec) m_splicer.fail(ec); else m_splicer.flush();
+          received(nullptr, std::error_code());
+        }
+        release();
       }
+    );
 
-      release();
+    if (m_options.write_timeout > 0) {
+      m_write_timer.schedule(
+        m_options.write_timeout,
+        [this]() {
+          close(StreamEnd::WRITE_TIMEOUT);
+        }
+      );
     }
-  );
 
-  if (m_options.read_timeout > 0) {
-    m_read_timer.schedule(
-      m_options.read_timeout,
-      [this]() {
-        close(StreamEnd::READ_TIMEOUT);
+  } else {
+    m_socket.async_wait(
+      tcp::socket::wait_read,
+      [=](const std::error_code &ec) {
+        if (ec) {
+          received(nullptr, ec);
+        } else if (!m_socket.is_open()) {
+          // Closed by a failed splice into it after this wait completed
+        } else if (m_splicer.ready()) {
+          std::error_code err;
+          auto n = m_splicer.transfer(m_socket.native_handle(), err);
+          m_metric_traffic_in->increase(n);
+          s_metric_traffic_in->increase(n);
+          received(nullptr, err);
+        } else {
+          read_available();
+        }
+        release();
       }
     );
+
+    if (m_options.read_timeout > 0) {
+      m_read_timer.schedule(
+        m_options.read_timeout,
+        [this]() {
+          close(StreamEnd::READ_TIMEOUT);
+        }
+      );
+    }
   }
 
   retain();
 }
 
+void InboundTCP::read_available() {
+  std::error_code err;
+  pjs::Ref<Data> buffer;
+  if (auto size = m_socket.available(err)) {
+    buffer = Data::make(size, &s_dp_tcp_lazy);
+  } else if (!err) {
+    buffer = Data::make(1, &s_dp_tcp_lazy);
+  }
+  if (buffer) {
+    auto n = m_socket.read_some(DataChunks(buffer->chunks()), err);
+    buffer->pop(buffer->size() - n);
+  }
+  if (err == asio::error::would_block || err == asio::error::try_again) {
+    received(buffer, std::error_code());
+  } else {
+    received(buffer, err);
+  }
+}
+
+void InboundTCP::received(Data *data, const std::error_code &ec) {
+  InputContext ic(this);
+
+  if (m_options.read_timeout > 0) {
+    m_read_timer.cancel();
+  }
+
+  if (ec != asio::error::operation_aborted) {
+    if (data && data->size() > 0) {
+      m_metric_traffic_in->increase(data->size());
+      s_metric_traffic_in->increase(data->size());
+      output(data);
+    }
+
+    if (ec) {
+      if (ec == asio::error::eof || (m_offloaded && ec.value() == EIO)) {
+        if (Log::is_enabled(Log::INBOUND)) {
+          char desc[200];
+          describe(desc);
+          Log::debug(Log::INBOUND, "%s EOF from peer", desc);
+        }
+        linger();
+        output(StreamEnd::make());
+      } else if (ec == asio::error::connection_reset) {
+        if (Log::is_enabled(Log::WARN)) {
+          char desc[200];
+          describe(desc);
+          Log::warn("%s connection reset by peer", desc);
+        }
+        close(StreamEnd::CONNECTION_RESET);
+      } else {
+        if (Log::is_enabled(Log::WARN)) {
+          char desc[200];
+          describe(desc);
+          Log::warn("%s error reading from peer: %s", desc, ec.message().c_str());
+        }
+        close(StreamEnd::READ_ERROR);
+      }
+
+    } else if (m_receiving_state == PAUSING) {
+      m_receiving_state = PAUSED;
+      retain();
+      wait();
+
+    } else if (m_receiving_state == RECEIVING) {
+      receive();
+      wait();
+    }
+  }
+}
+
 void InboundTCP::linger() {
   if (!m_socket.is_open()) return;
 
@@ -484,6 +687,26 @@ void InboundTCP::pump() {
   m_pumping = true;
 }
 
+bool InboundTCP::splice_ready() const {
+  return m_socket.is_open() && !m_ended && !m_pumping && m_buffer.empty();
+}
+
+void InboundTCP::splice_written(size_t size) {
+  m_metric_traffic_out->increase(size);
+  s_metric_traffic_out->increase(size);
+  wait();
+}
+
+void InboundTCP::splice_failed(const std::error_code &ec) {
+  InputContext ic(this);
+  if (Log::is_enabled(Log::WARN)) {
+    char desc[200];
+    describe(desc);
+    Log::warn("%s error writing to peer: %s", desc, ec.message().c_str());
+  }
+  close(StreamEnd::WRITE_ERROR);
+}
+
 void InboundTCP::wait() {
   if (!m_socket.is_open()) return;
   if (m_options.idle_timeout > 0) {
@@ -502,6 +725,7 @@ void InboundTCP::output(Event *evt) {
 }
 
 void InboundTCP::close(StreamEnd::Error err) {
+  Splicer::unpair(this);
   if (m_socket.is_open()) {
     std::error_code ec;
     if (err == StreamEnd::NO_ERROR) m_socket.shutdown(tcp::socket::shutdown_both, ec);
@@ -563,7 +787,7 @@ void InboundTCP::describe(char *buf) {
 InboundUDP::InboundUDP(
   Listener* listener,
   const Options &options,
-  asio::ip::udp::socket &socket,
+  DatagramSender *sender,
   asio::generic::raw_protocol::socket &socket_raw,
   const asio::ip::udp::endpoint &local,
   const asio::ip::udp::endpoint &peer,
@@ -571,7 +795,7 @@ InboundUDP::InboundUDP(
 ) : m_listener(listener)
   , m_options(options)
   , m_socket_raw(socket_raw)
-  , m_socket(socket)
+  , m_sender(sender)
   , m_local(local)
   , m_peer(peer)
   , m_destination(destination)
@@ -603,6 +827,7 @@ InboundUDP::InboundUDP(
 }
 
 InboundUDP::~InboundUDP() {
+  m_sender->cancel(this);
   if (m_listener) {
     m_listener->close(this);
   }
@@ -692,24 +917,18 @@ void InboundUDP::on_event(Event *evt) {
         } else
 #endif // __linux__
         {
-          auto *buf = Data::make(std::move(m_buffer));
-          auto size = m_buffer.size();
-          m_socket.async_send_to(
-            DataChunks(buf->chunks()),
-            m_peer,
-            [=](const std::error_code &ec, std::size_t n) {
-              m_sending_size -= size;
-              buf->release();
-            }
-          );
-          m_sending_size += size;
-          buf->retain();
+          m_sending_size += m_buffer.size();
+          m_sender->send(this, Data::make(std::move(m_buffer)), m_peer);
         }
       }
     }
   }
 }
 
+void InboundUDP::on_datagram_sent(size_t size, const std::error_code &ec) {
+  m_sending_size -= size;
+}
+
 void InboundUDP::wait_idle() {
   if (m_options.idle_timeout > 0) {
     m_idle_timer.schedule(
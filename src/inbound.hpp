@@ -27,14 +27,17 @@
 #define INBOUND_HPP
 
 #include "net.hpp"
+#include "datagram.hpp"
 #include "event.hpp"
 #include "input.hpp"
 #include "output.hpp"
+#include "splice.hpp"
 #include "timer.hpp"
 #include "list.hpp"
 #include "api/stats.hpp"
 
 #include <atomic>
+#include <functional>
 
 namespace pipy {
 
@@ -61,8 +64,11 @@ public:
     bool transparent = false;
     bool masquerade = false;
     bool peer_stats = false;
+    bool lazy_read = s_lazy_read;
   };
 
+  static void set_lazy_read(bool lazy);
+
   auto id() const -> uint64_t { return m_id; }
   auto output() -> Output*;
   auto pipeline() const -> Pipeline* { return m_pipeline; }
@@ -102,6 +108,7 @@ protected:
   thread_local static pjs::Ref<stats::Gauge> s_metric_concurrency;
   thread_local static pjs::Ref<stats::Counter> s_metric_traffic_in;
   thread_local static pjs::Ref<stats::Counter> s_metric_traffic_out;
+  thread_local static pjs::Ref<stats::Counter> s_metric_accept;
 
 private:
   virtual void on_get_address() = 0;
@@ -120,6 +127,7 @@ private:
   virtual void on_weak_ptr_gone() override;
 
   static std::atomic<uint64_t> s_inbound_id;
+  static bool s_lazy_read;
 
   static void init_metrics();
 
@@ -133,11 +141,15 @@ private:
 class InboundTCP :
   public pjs::ObjectTemplate<InboundTCP, Inbound>,
   public List<InboundTCP>::Item,
-  public FlushTarget
+  public FlushTarget,
+  public Splicer::Target
 {
 public:
+  auto listener() const -> Listener* { return m_listener; }
   void accept(asio::ip::tcp::acceptor &acceptor);
+  void adopt(int fd, bool v6);
   void dangle() { m_listener = nullptr; }
+  bool offload(const std::function<bool(int)> &setup);
 
 private:
   InboundTCP(Listener *listener, const Options &options);
@@ -145,17 +157,19 @@ private:
 
   Listener* m_listener;
   Options m_options;
-  Timer m_read_timer;
-  Timer m_write_timer;
-  Timer m_idle_timer;
+  WheelTimer m_read_timer;
+  WheelTimer m_write_timer;
+  WheelTimer m_idle_timer;
   pjs::Ref<EventTarget::Input> m_input;
   asio::ip::tcp::endpoint m_peer;
   asio::ip::tcp::socket m_socket;
   pjs::Ref<stats::Counter> m_metric_traffic_in;
   pjs::Ref<stats::Counter> m_metric_traffic_out;
   Data m_buffer;
+  Splicer m_splicer;
   bool m_pumping = false;
   bool m_ended = false;
+  bool m_offloaded = false;
 
   virtual auto size_in_buffer() const -> size_t override { return m_buffer.size(); }
   virtual void on_get_address() override;
@@ -163,8 +177,18 @@ private:
   virtual void on_event(Event *evt) override;
   virtual void on_flush() override;
 
+  virtual auto splicer() -> Splicer* override { return &m_splicer; }
+  virtual auto splice_socket() -> asio::ip::tcp::socket& override { return m_socket; }
+  virtual bool splice_ready() const override;
+  virtual bool splice_pumping() const override { return m_pumping || !m_buffer.empty(); }
+  virtual void splice_written(size_t size) override;
+  virtual void splice_failed(const std::error_code &ec) override;
+
   void start();
   void receive();
+  void receive_spliced();
+  void read_available();
+  void received(Data *data, const std::error_code &ec);
   void linger();
   void pump();
   void wait();
@@ -182,7 +206,8 @@ private:
 
 class InboundUDP :
   public pjs::ObjectTemplate<InboundUDP, Inbound>,
-  public List<InboundUDP>::Item
+  public List<InboundUDP>::Item,
+  public DatagramSender::Source
 {
 public:
   auto local() const -> const asio::ip::udp::endpoint& { return m_local; }
@@ -198,7 +223,7 @@ private:
   InboundUDP(
     Listener* listener,
     const Options &options,
-    asio::ip::udp::socket &socket,
+    DatagramSender *sender,
     asio::generic::raw_protocol::socket &socket_raw,
     const asio::ip::udp::endpoint &local,
     const asio::ip::udp::endpoint &peer,
@@ -209,9 +234,9 @@ private:
 
   Listener* m_listener;
   Options m_options;
-  Timer m_idle_timer;
+  WheelTimer m_idle_timer;
   asio::generic::raw_protocol::socket& m_socket_raw;
-  asio::ip::udp::socket& m_socket;
+  pjs::Ref<DatagramSender> m_sender;
   asio::ip::udp::endpoint m_local;
   asio::ip::udp::endpoint m_peer;
   asio::ip::udp::endpoint m_destination;
@@ -225,6 +250,7 @@ private:
   virtual void on_get_address() override;
   virtual void on_inbound_resume() override {}
   virtual void on_event(Event *evt) override;
+  virtual void on_datagram_sent(size_t size, const std::error_code &ec) override;
 
   void wait_idle();
 
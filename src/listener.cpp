@@ -25,8 +25,24 @@
 
 #include "listener.hpp"
 #include "pipeline.hpp"
+#include "worker-thread.hpp"
 #include "log.hpp"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/bpf.h>
+#include <sys/syscall.h>
+#endif // __linux__
+
 namespace pjs {
 
 using namespace pipy;
@@ -77,6 +93,15 @@ Listener::Options::Options(pjs::Object *options) {
   Value(options, "peerStats")
     .get(peer_stats)
     .check_nullable();
+  Value(options, "lazyRead")
+    .get(lazy_read)
+    .check_nullable();
+  Value(options, "gso")
+    .get(gso)
+    .check_nullable();
+  Value(options, "gro")
+    .get(gro)
+    .check_nullable();
 }
 
 //
@@ -85,11 +110,31 @@ Listener::Options::Options(pjs::Object *options) {
 
 thread_local std::set<Listener*> Listener::s_listeners[int(Listener::Protocol::MAX)];
 bool Listener::s_reuse_port = false;
+bool Listener::s_reuse_port_by_cpu = false;
+bool Listener::s_balancing = false;
 
 void Listener::set_reuse_port(bool reuse) {
   s_reuse_port = reuse;
 }
 
+void Listener::set_reuse_port_by_cpu(bool by_cpu) {
+  s_reuse_port_by_cpu = by_cpu;
+}
+
+void Listener::set_balancing(bool enabled) {
+  s_balancing = enabled;
+}
+
+//
+// Called on a worker thread when its event loop has stopped, so that no
+// more connections are handed over to it and the ones on their way are
+// closed instead of waiting for a loop that doesn't run anymore.
+//
+
+void Listener::stop_balancing() {
+  if (s_balancing) Balancer::local()->disable();
+}
+
 Listener::Listener(Protocol protocol, const std::string &ip, int port)
   : m_protocol(protocol)
   , m_ip(ip)
@@ -119,6 +164,7 @@ void Listener::pipeline_layout(PipelineLayout *layout) {
 
 void Listener::close() {
   if (m_acceptor) {
+    if (s_balancing && m_protocol == Protocol::TCP) Balancer::local()->set_full(m_port, false);
     m_acceptor->close();
     m_acceptor = nullptr;
     char desc[200];
@@ -157,6 +203,11 @@ void Listener::start() {
         auto *acceptor = new AcceptorTCP(this);
         m_paused = !acceptor->start(endpoint);
         m_acceptor = acceptor;
+        if (s_balancing) {
+          auto *balancer = Balancer::local();
+          balancer->enable();
+          balancer->set_full(m_port, m_paused);
+        }
         break;
       }
       case Protocol::UDP: {
@@ -190,6 +241,7 @@ void Listener::pause() {
   if (!m_paused) {
     m_acceptor->cancel();
     m_paused = true;
+    if (s_balancing && m_protocol == Protocol::TCP) Balancer::local()->set_full(m_port, true);
   }
 }
 
@@ -197,11 +249,13 @@ void Listener::resume() {
   if (m_paused) {
     m_acceptor->accept();
     m_paused = false;
+    if (s_balancing && m_protocol == Protocol::TCP) Balancer::local()->set_full(m_port, false);
   }
 }
 
 void Listener::open(Inbound *inbound) {
   m_acceptor->open(inbound);
+  if (s_balancing && m_protocol == Protocol::TCP) Balancer::local()->open();
   auto n = m_acceptor->count();
   m_peak_connections = std::max(m_peak_connections, int(n));
   int max = m_options.max_connections;
@@ -214,6 +268,7 @@ void Listener::open(Inbound *inbound) {
 
 void Listener::close(Inbound *inbound) {
   m_acceptor->close(inbound);
+  if (s_balancing && m_protocol == Protocol::TCP) Balancer::local()->close();
   auto n = m_acceptor->count();
   int max = m_options.max_connections;
   if (max < 0 || n < max) {
@@ -253,6 +308,143 @@ void Listener::set_sock_opts(int sock) {
   }
 }
 
+//
+// Connections are steered to the worker thread pinned to the CPU they
+// arrive on. Newer kernels pick the socket with a matching SO_INCOMING_CPU
+// within a reuseport group by themselves. On older ones, an extended BPF
+// program looks the CPU up in a REUSEPORT_SOCKARRAY map, where every worker
+// thread puts its own socket under the CPU it's pinned to, so it doesn't
+// matter in what order the sockets join the group. A CPU with no socket in
+// the map falls back to the usual hashing, and so does everything if the
+// kernel doesn't allow the program. The map and the program are made once
+// for each port and kept until exit. This has to be done once the socket is
+// in the group, or else it would end up in a group of its own.
+//
+
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_EBPF)
+
+struct CPUSteering {
+  int map_fd = -1;
+  int prog_fd = -1;
+};
+
+static std::mutex s_cpu_steerings_mutex;
+static std::map<std::string, CPUSteering> s_cpu_steerings;
+
+static int bpf(int cmd, bpf_attr &attr) {
+  return syscall(__NR_bpf, cmd, &attr, sizeof(attr));
+}
+
+static auto bpf_insn_of(uint8_t code, uint8_t dst, uint8_t src, int16_t off, int32_t imm) -> bpf_insn {
+  bpf_insn insn;
+  insn.code = code;
+  insn.dst_reg = dst;
+  insn.src_reg = src;
+  insn.off = off;
+  insn.imm = imm;
+  return insn;
+}
+
+static bool make_cpu_steering(int max_cpu, CPUSteering &steering) {
+  bpf_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.map_type = BPF_MAP_TYPE_REUSEPORT_SOCKARRAY;
+  attr.key_size = sizeof(uint32_t);
+  attr.value_size = sizeof(uint64_t);
+  attr.max_entries = max_cpu + 1;
+  int map_fd = bpf(BPF_MAP_CREATE, attr);
+  if (map_fd < 0) return false;
+
+  // key = bpf_get_smp_processor_id();
+  // bpf_sk_select_reuseport(ctx, map, &key, 0);
+  // return SK_PASS;
+  bpf_insn code[] = {
+    bpf_insn_of(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_6, BPF_REG_1, 0, 0),
+    bpf_insn_of(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_get_smp_processor_id),
+    bpf_insn_of(BPF_STX | BPF_MEM | BPF_W, BPF_REG_10, BPF_REG_0, -4, 0),
+    bpf_insn_of(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_2, BPF_PSEUDO_MAP_FD, 0, map_fd),
+    bpf_insn_of(0, 0, 0, 0, 0),
+    bpf_insn_of(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_3, BPF_REG_10, 0, 0),
+    bpf_insn_of(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_3, 0, 0, -4),
+    bpf_insn_of(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_4, 0, 0, 0),
+    bpf_insn_of(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_1, BPF_REG_6, 0, 0),
+    bpf_insn_of(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_sk_select_reuseport),
+    bpf_insn_of(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, SK_PASS),
+    bpf_insn_of(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+  };
+
+  static const char license[] = "MIT";
+  std::memset(&attr, 0, sizeof(attr));
+  attr.prog_type = BPF_PROG_TYPE_SK_REUSEPORT;
+  attr.insn_cnt = sizeof(code) / sizeof(code[0]);
+  attr.insns = uint64_t(uintptr_t(code));
+  attr.license = uint64_t(uintptr_t(license));
+  int prog_fd = bpf(BPF_PROG_LOAD, attr);
+  if (prog_fd < 0) {
+    auto err = errno;
+    ::close(map_fd);
+    errno = err;
+    return false;
+  }
+
+  steering.map_fd = map_fd;
+  steering.prog_fd = prog_fd;
+  return true;
+}
+
+#endif // __linux__ && SO_ATTACH_REUSEPORT_EBPF
+
+void Listener::steer_by_cpu(int sock) {
+#ifdef __linux__
+  if (!s_reuse_port || !s_reuse_port_by_cpu) return;
+  auto wt = WorkerThread::current();
+  if (!wt || wt->cpu() < 0) return;
+
+  int cpu = wt->cpu();
+  if (setsockopt(sock, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu))) {
+    Log::warn("[listener] Cannot set SO_INCOMING_CPU: %s", std::strerror(errno));
+  }
+
+#ifdef SO_ATTACH_REUSEPORT_EBPF
+  std::lock_guard<std::mutex> lock(s_cpu_steerings_mutex);
+  std::string key(m_protocol == Protocol::TCP ? "tcp/" : "udp/");
+  key += m_ip;
+  key += ':';
+  key += std::to_string(m_port);
+  auto i = s_cpu_steerings.find(key);
+  if (i == s_cpu_steerings.end()) {
+    CPUSteering steering;
+    auto &cpus = WorkerManager::get().cpu_affinity();
+    auto max_cpu = std::max(cpu, cpus.empty() ? 0 : *std::max_element(cpus.begin(), cpus.end()));
+    if (!make_cpu_steering(max_cpu, steering)) {
+      Log::warn("[listener] Cannot load reuseport CPU program: %s", std::strerror(errno));
+    }
+    i = s_cpu_steerings.emplace(key, steering).first;
+  }
+
+  auto &steering = i->second;
+  if (steering.prog_fd < 0) return;
+
+  uint32_t k = cpu;
+  uint64_t v = sock;
+  bpf_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.map_fd = steering.map_fd;
+  attr.key = uint64_t(uintptr_t(&k));
+  attr.value = uint64_t(uintptr_t(&v));
+  attr.flags = BPF_ANY;
+  if (bpf(BPF_MAP_UPDATE_ELEM, attr)) {
+    Log::warn("[listener] Cannot add socket to reuseport CPU map: %s", std::strerror(errno));
+    return;
+  }
+
+  if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_EBPF, &steering.prog_fd, sizeof(steering.prog_fd))) {
+    Log::warn("[listener] Cannot attach reuseport CPU program: %s", std::strerror(errno));
+  }
+#endif // SO_ATTACH_REUSEPORT_EBPF
+#endif // __linux__
+}
+
 auto Listener::find(Protocol protocol, const std::string &ip, int port) -> Listener* {
   for (auto *l : s_listeners[int(protocol)]) {
     if (l->ip() == ip && l->port() == port) {
@@ -286,6 +478,7 @@ bool Listener::AcceptorTCP::start(const asio::ip::tcp::endpoint &endpoint) {
 
   m_acceptor.bind(endpoint);
   m_acceptor.listen(asio::socket_base::max_connections);
+  m_listener->steer_by_cpu(m_acceptor.native_handle());
 
   if (options.max_connections < 0 || m_inbounds.size() < options.max_connections) {
     accept();
@@ -299,7 +492,14 @@ auto Listener::AcceptorTCP::count() -> size_t const {
   return m_inbounds.size();
 }
 
+//
+// Only one accept is outstanding at a time. Connections adopted from other
+// threads also open on the listener but don't complete the outstanding
+// accept, so they don't start another one.
+//
+
 void Listener::AcceptorTCP::accept() {
+  if (m_accepting) return;
   auto inbound = InboundTCP::make(m_listener, m_listener->m_options);
   inbound->accept(m_acceptor);
   m_accepting = inbound;
@@ -307,9 +507,11 @@ void Listener::AcceptorTCP::accept() {
 
 void Listener::AcceptorTCP::cancel() {
   m_acceptor.cancel();
+  m_accepting = nullptr;
 }
 
 void Listener::AcceptorTCP::open(Inbound *inbound) {
+  if (inbound == m_accepting) m_accepting = nullptr;
   m_inbounds.push(static_cast<InboundTCP*>(inbound));
 }
 
@@ -332,12 +534,187 @@ void Listener::AcceptorTCP::for_each_inbound(const std::function<void(Inbound*)>
   }
 }
 
+void Listener::AcceptorTCP::handed_off() {
+  m_accepting = nullptr;
+  accept();
+}
+
+//
+// Listener::Balancer
+//
+// Each worker thread counts the TCP connections it has open. A freshly
+// accepted connection is handed over to another thread when that one has
+// noticeably fewer connections, before any pipeline starts on it. The
+// socket goes over as a bare file descriptor through a lock-free stack
+// per thread, which only wakes up the receiving thread when it was empty.
+// The receiving thread adopts the socket into its own listener of the
+// same port, or closes it if it doesn't listen there anymore or has
+// reached maxConnections there in the meantime. Threads that are at
+// maxConnections on a port are left out when picking, and so are threads
+// whose event loop has stopped.
+//
+
+std::atomic<Listener::Balancer*> Listener::Balancer::s_balancers[MAX_THREADS];
+thread_local Listener::Balancer::Guard Listener::Balancer::s_local;
+
+auto Listener::Balancer::local() -> Balancer* {
+  auto &balancer = s_local.balancer;
+  if (!balancer) {
+    auto wt = WorkerThread::current();
+    balancer = new Balancer(wt ? wt->index() : -1);
+  }
+  return balancer;
+}
+
+Listener::Balancer::Balancer(int index)
+  : m_index(index)
+  , m_net(&Net::current())
+  , m_load(0)
+  , m_head(nullptr)
+  , m_posting(0)
+  , m_closed(false)
+{
+  for (auto &bits : m_full) bits.store(0, std::memory_order_relaxed);
+}
+
+Listener::Balancer::Guard::~Guard() {
+  if (balancer) balancer->disable();
+}
+
+void Listener::Balancer::enable() {
+  m_closed.store(false);
+  auto i = m_index;
+  if (0 <= i && i < MAX_THREADS) s_balancers[i].store(this, std::memory_order_release);
+}
+
+void Listener::Balancer::disable() {
+  auto i = m_index;
+  if (0 <= i && i < MAX_THREADS && s_balancers[i].load() == this) s_balancers[i].store(nullptr);
+  m_closed.store(true);
+  while (m_posting.load()) std::this_thread::yield();
+  auto *h = m_head.exchange(nullptr);
+  while (h) {
+    auto *next = h->next;
+    m_load.fetch_sub(1, std::memory_order_relaxed);
+    ::close(h->fd);
+    delete h;
+    h = next;
+  }
+}
+
+void Listener::Balancer::set_full(int port, bool full) {
+  auto &bits = m_full[(port & 0xffff) >> 6];
+  auto bit = uint64_t(1) << (port & 63);
+  if (full) {
+    bits.fetch_or(bit, std::memory_order_relaxed);
+  } else {
+    bits.fetch_and(~bit, std::memory_order_relaxed);
+  }
+}
+
+bool Listener::Balancer::is_full(int port) const {
+  auto bits = m_full[(port & 0xffff) >> 6].load(std::memory_order_relaxed);
+  return bits & (uint64_t(1) << (port & 63));
+}
+
+bool Listener::Balancer::hand_off(Listener *listener, asio::ip::tcp::socket &socket) {
+  auto *target = pick(listener->m_port);
+  if (!target) return false;
+
+  std::error_code ec;
+  auto fd = socket.release(ec);
+  if (ec) return false;
+
+  auto *h = new Handoff;
+  h->ip = listener->m_ip;
+  h->port = listener->m_port;
+  h->fd = fd;
+  h->v6 = listener->m_address.is_v6();
+
+  target->m_load.fetch_add(1, std::memory_order_relaxed);
+  if (!target->post(h)) {
+    target->m_load.fetch_sub(1, std::memory_order_relaxed);
+    socket.assign(h->v6 ? tcp::v6() : tcp::v4(), fd, ec);
+    if (ec) ::close(fd);
+    delete h;
+    return !socket.is_open();
+  }
+
+  static_cast<AcceptorTCP*>(listener->m_acceptor.get())->handed_off();
+  return true;
+}
+
+//
+// Picks the thread with the fewest connections, as long as it has fewer
+// than this thread by a margin, so that connections don't go back and
+// forth between threads of about the same load.
+//
+
+auto Listener::Balancer::pick(int port) -> Balancer* {
+  auto n = std::min(WorkerManager::get().concurrency(), int(MAX_THREADS));
+  auto load = m_load.load(std::memory_order_relaxed);
+  auto min = load - 1 - load / 16;
+  Balancer *target = nullptr;
+  for (int i = 1; i < n; i++) {
+    auto *b = s_balancers[(m_index + i) % n].load(std::memory_order_acquire);
+    if (!b || b == this || b->is_full(port)) continue;
+    auto l = b->m_load.load(std::memory_order_relaxed);
+    if (l < min) {
+      min = l;
+      target = b;
+    }
+  }
+  return target;
+}
+
+bool Listener::Balancer::post(Handoff *handoff) {
+  m_posting.fetch_add(1);
+  if (m_closed.load()) {
+    m_posting.fetch_sub(1);
+    return false;
+  }
+  auto *head = m_head.load(std::memory_order_relaxed);
+  do {
+    handoff->next = head;
+  } while (!m_head.compare_exchange_weak(head, handoff, std::memory_order_release, std::memory_order_relaxed));
+  if (!head) m_net->post([this]() { deliver(); });
+  m_posting.fetch_sub(1);
+  return true;
+}
+
+void Listener::Balancer::deliver() {
+  Handoff *list = m_head.exchange(nullptr, std::memory_order_acquire);
+  Handoff *head = nullptr;
+  while (list) {
+    auto *h = list; list = h->next;
+    h->next = head;
+    head = h;
+  }
+  while (head) {
+    auto *h = head; head = h->next;
+    m_load.fetch_sub(1, std::memory_order_relaxed);
+    auto *l = Listener::find(Protocol::TCP, h->ip, h->port);
+    auto max = l ? l->m_options.max_connections : -1;
+    if (
+      l && l->m_acceptor && l->m_pipeline_layout &&
+      (max < 0 || l->m_acceptor->count() < max)
+    ) {
+      pjs::Ref<InboundTCP> inbound = InboundTCP::make(l, l->m_options);
+      inbound->adopt(h->fd, h->v6);
+    } else {
+      ::close(h->fd);
+    }
+    delete h;
+  }
+}
+
 //
 // Listener::AcceptorUDP
 //
 
 Listener::AcceptorUDP::AcceptorUDP(Listener *listener, bool transparent, bool masquerade)
   : m_listener(listener)
+  , m_receiver(&s_dp_udp)
   , m_socket(Net::context())
   , m_socket_raw(Net::context())
   , m_transparent(transparent)
@@ -354,10 +731,16 @@ void Listener::AcceptorUDP::start(const asio::ip::udp::endpoint &endpoint) {
   m_socket.set_option(asio::socket_base::reuse_address(true));
   m_listener->set_sock_opts(m_socket.native_handle());
   m_socket.bind(endpoint);
+  m_listener->steer_by_cpu(m_socket.native_handle());
+  m_socket.non_blocking(true);
   m_local = m_socket.local_endpoint();
+  if (m_listener->m_options.gro) {
+    DatagramReceiver::enable_gro(m_socket.native_handle());
+  }
   if (m_masquerade) {
     m_socket_raw.open(asio::generic::raw_protocol(AF_INET, IPPROTO_RAW));
   }
+  m_sender = new DatagramSender(m_socket, m_listener->m_options.gso);
   receive();
 }
 
@@ -376,7 +759,7 @@ auto Listener::AcceptorUDP::inbound(
     auto *inbound = InboundUDP::make(
       m_listener,
       m_listener->m_options,
-      m_socket,
+      m_sender,
       m_socket_raw,
       m_local, src, dst
     );
@@ -389,82 +772,50 @@ auto Listener::AcceptorUDP::count() -> size_t const {
   return m_inbounds.size();
 }
 
+//
+// Drains the socket a batch at a time on each wake-up, but no more than
+// a few batches so that other sockets get their turns.
+//
+
 void Listener::AcceptorUDP::receive() {
-  m_socket.async_receive_from(
-    asio::null_buffers(),
-    m_peer,
-    [=](const std::error_code &ec, std::size_t n) {
+  static const int MAX_BATCHES = 4;
+
+  m_socket.async_wait(
+    asio::ip::udp::socket::wait_read,
+    [=](const std::error_code &ec) {
       if (ec != asio::error::operation_aborted) {
-        if (!ec) {
+        std::error_code err(ec);
+        if (!err) {
           InputContext ic;
-
-          auto max_size = m_listener->m_options.max_packet_size;
-          auto iov_size = (max_size + DATA_CHUNK_SIZE - 1) / DATA_CHUNK_SIZE;
-          Data buf(max_size, &s_dp_udp);
-
-          auto s = m_socket.native_handle();
-
-          struct sockaddr_in addr;
-          struct msghdr msg;
-          struct iovec iov[iov_size];
-
-          int i = 0;
-          for (auto c : buf.chunks()) {
-            auto buf = std::get<0>(c);
-            auto len = std::get<1>(c);
-            iov[i].iov_base = buf;
-            iov[i].iov_len = len;
-            i++;
-          }
-
-          msg.msg_name = &addr;
-          msg.msg_namelen = sizeof(addr);
-          msg.msg_iov = iov;
-          msg.msg_iovlen = iov_size;
-          msg.msg_flags = 0;
-
-          char control_data[1000];
-          if (m_transparent) {
-            msg.msg_control = control_data;
-            msg.msg_controllen = sizeof(control_data);
-          } else {
-            msg.msg_control = nullptr;
-            msg.msg_controllen = 0;
-          }
-
-          auto n = recvmsg(s, &msg, 0);
-          if (n > 0) {
-            buf.pop(buf.size() - n);
-            m_peer.address(asio::ip::make_address_v4(ntohl(addr.sin_addr.s_addr)));
-            m_peer.port(ntohs(addr.sin_port));
-            asio::ip::udp::endpoint destination;
-
-#ifdef __linux__
-            if (m_transparent) {
-              for (auto *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
-                if (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_ORIGDSTADDR) {
-                  auto *addr = (struct sockaddr_in *)CMSG_DATA(cmsg);
-                  destination.address(asio::ip::make_address_v4(ntohl(addr->sin_addr.s_addr)));
-                  destination.port(ntohs(addr->sin_port));
-                  break;
+          const auto &options = m_listener->m_options;
+          for (int i = 0; i < MAX_BATCHES; i++) {
+            m_receiver.receive(
+              m_socket.native_handle(),
+              options.max_packet_size,
+              options.gro,
+              [this](
+                Data &data,
+                const asio::ip::udp::endpoint &src,
+                const asio::ip::udp::endpoint &dst
+              ) {
+                InboundUDP *inb = inbound(src, dst, !m_paused);
+                if (inb && inb->is_receiving()) {
+                  inb->receive(Data::make(std::move(data)));
                 }
-              }
-            }
-#endif // __linux__
-
-            InboundUDP *inb = inbound(m_peer, destination, !m_paused);
-            if (inb && inb->is_receiving()) {
-              inb->receive(Data::make(std::move(buf)));
-            }
+              },
+              err
+            );
+            if (err || !m_receiver.full()) break;
           }
+        }
 
-        } else {
+        if (err) {
           if (Log::is_enabled(Log::WARN)) {
             char desc[200];
             m_listener->describe(desc, sizeof(desc));
             Log::warn(
               "[listener] error receiving on %s: %s",
-              desc, ec.message().c_str()
+              desc, err.message().c_str()
             );
           }
         }
@@ -505,6 +856,7 @@ void Listener::AcceptorUDP::close(Inbound *inbound) {
 }
 
 void Listener::AcceptorUDP::close() {
+  if (m_sender) m_sender->close();
   m_socket.close();
   for (auto *p = m_inbounds.head(); p; ) {
     auto *i = p; p = p->List<InboundUDP>::Item::next();
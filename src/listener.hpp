@@ -30,6 +30,7 @@
 #include "inbound.hpp"
 #include "options.hpp"
 
+#include <atomic>
 #include <functional>
 #include <string>
 #include <set>
@@ -55,6 +56,8 @@ public:
     Protocol protocol = Protocol::TCP;
     size_t max_packet_size = 16 * 1024;
     int max_connections = -1;
+    bool gso = false;
+    bool gro = false;
     bool reserved = false;
 
     Options() {}
@@ -62,6 +65,9 @@ public:
   };
 
   static void set_reuse_port(bool reuse);
+  static void set_reuse_port_by_cpu(bool by_cpu);
+  static void set_balancing(bool enabled);
+  static void stop_balancing();
 
   static auto get(Protocol protocol, const std::string &ip, int port) -> Listener* {
     if (auto *l = find(protocol, ip, port)) return l;
@@ -136,6 +142,8 @@ private:
     virtual void close() override;
     virtual void for_each_inbound(const std::function<void(Inbound*)> &cb) override;
 
+    void handed_off();
+
   private:
     Listener* m_listener;
     asio::ip::tcp::acceptor m_acceptor;
@@ -143,6 +151,55 @@ private:
     List<InboundTCP> m_inbounds;
   };
 
+  //
+  // Listener::Balancer
+  //
+
+  class Balancer {
+  public:
+    static auto local() -> Balancer*;
+
+    void open() { m_load.fetch_add(1, std::memory_order_relaxed); }
+    void close() { m_load.fetch_sub(1, std::memory_order_relaxed); }
+    void enable();
+    void disable();
+    void set_full(int port, bool full);
+    bool hand_off(Listener *listener, asio::ip::tcp::socket &socket);
+
+  private:
+    struct Handoff {
+      Handoff* next;
+      std::string ip;
+      int port;
+      int fd;
+      bool v6;
+    };
+
+    Balancer(int index);
+
+    int m_index;
+    Net* m_net;
+    std::atomic<int> m_load;
+    std::atomic<Handoff*> m_head;
+    std::atomic<int> m_posting;
+    std::atomic<bool> m_closed;
+    std::atomic<uint64_t> m_full[65536 / 64];
+
+    bool is_full(int port) const;
+    auto pick(int port) -> Balancer*;
+    bool post(Handoff *handoff);
+    void deliver();
+
+    struct Guard {
+      Balancer *balancer = nullptr;
+      ~Guard();
+    };
+
+    static const int MAX_THREADS = 1024;
+    static std::atomic<Balancer*> s_balancers[MAX_THREADS];
+    thread_local static Guard s_local;
+  };
+
   //
   // Listener::AcceptorUDP
   //
@@ -172,11 +229,12 @@ private:
 
     Listener* m_listener;
     List<InboundUDP> m_inbounds;
+    DatagramReceiver m_receiver;
     asio::ip::udp::endpoint m_local;
-    asio::ip::udp::endpoint m_peer;
     asio::ip::udp::socket m_socket;
     asio::generic::raw_protocol::socket m_socket_raw;
     std::map<asio::ip::udp::endpoint, PeerMap> m_inbound_map;
+    pjs::Ref<DatagramSender> m_sender;
     bool m_transparent;
     bool m_masquerade;
     bool m_paused = false;
@@ -192,6 +250,7 @@ private:
   void close();
   void describe(char *buf, size_t len);
   void set_sock_opts(int sock);
+  void steer_by_cpu(int sock);
 
   Options m_options;
   Protocol m_protocol;
@@ -205,6 +264,8 @@ private:
 
   thread_local static std::set<Listener*> s_listeners[];
   static bool s_reuse_port;
+  static bool s_reuse_port_by_cpu;
+  static bool s_balancing;
 
   static auto find(Protocol protocol, const std::string &ip, int port) -> Listener*;
 
@@ -32,6 +32,10 @@
 #include <iostream>
 #include <thread>
 
+#ifdef __linux__
+#include <sched.h>
+#endif
+
 namespace pipy {
 
 thread_local static Data::Producer s_dp("Command Line Options");
@@ -44,12 +48,19 @@ void MainOptions::show_help() {
   std::cout << "  -v, -version, --version              Show version information" << std::endl;
   std::cout << "  -e, -eval, --eval                    Evaluate the given string as script" << std::endl;
   std::cout << "  --threads=<number>                   Number of worker threads (1, 2, ... max)" << std::endl;
+  std::cout << "  --cpu-affinity[=<cpus>]              Pin worker threads to CPUs in order, e.g. 0-7,16-23 (default: all allowed CPUs)" << std::endl;
   std::cout << "  --log-level=<debug|info|warn|error>  Set the level of log output" << std::endl;
   std::cout << "  --verify                             Verify configuration only" << std::endl;
   std::cout << "  --no-graph                           Do not print pipeline graphs to the log" << std::endl;
   std::cout << "  --instance-uuid=<uuid>               Specify a UUID for this worker process" << std::endl;
   std::cout << "  --instance-name=<name>               Specify a name for this worker process" << std::endl;
-  std::cout << "  --reuse-port                         Enable kernel load balancing for all listening ports" << std::endl;
+  std::cout << "  --reuse-port[=cpu]                   Enable kernel load balancing for all listening ports, or steer by receiving CPU" << std::endl;
+  std::cout << "  --balance-connections                Hand new TCP connections over to the worker thread with the fewest connections" << std::endl;
+  std::cout << "  --lazy-read                          Allocate receive buffers only when sockets become readable" << std::endl;
+  std::cout << "  --no-bytecode                        Evaluate scripts by walking the syntax tree only" << std::endl;
+  std::cout << "  --inline-cache-metrics               Report property inline cache hits and misses per script location" << std::endl;
+  std::cout << "  --script-cache=<dirname>             Keep lexed scripts in a local database to speed up later startups" << std::endl;
+  std::cout << "  --dns-server=<ip[:port]>             Send DNS queries to the given server instead of those in /etc/resolv.conf" << std::endl;
   std::cout << "  --admin-port=<[[ip]:]port>           Enable administration service on the specified port" << std::endl;
   std::cout << "  --admin-tls-cert=<filename>          Administration service certificate" << std::endl;
   std::cout << "  --admin-tls-key=<filename>           Administration service private key" << std::endl;
@@ -75,6 +86,38 @@ static const struct {
   { Log::NO_TOPIC , nullptr },
 };
 
+//
+// Parses a list of CPUs like "0-7,16-23", or gets all CPUs the process
+// is allowed to run on when the list is empty
+//
+
+static void parse_cpu_list(const std::string &str, std::vector<int> &cpus) {
+#ifdef __linux__
+  if (str.empty()) {
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set)) {
+      throw std::runtime_error("cannot get CPU affinity");
+    }
+    for (int i = 0; i < CPU_SETSIZE; i++) {
+      if (CPU_ISSET(i, &set)) cpus.push_back(i);
+    }
+    return;
+  }
+  for (const auto &range : utils::split(str, ',')) {
+    char *end;
+    auto first = std::strtol(range.c_str(), &end, 10);
+    auto last = first;
+    if (*end == '-') last = std::strtol(end + 1, &end, 10);
+    if (*end || range.empty() || first < 0 || last < first || last >= CPU_SETSIZE) {
+      throw std::runtime_error("invalid CPU list for --cpu-affinity");
+    }
+    for (auto i = first; i <= last; i++) cpus.push_back(i);
+  }
+#else
+  throw std::runtime_error("--cpu-affinity is not supported on this platform");
+#endif
+}
+
 MainOptions::MainOptions(int argc, char *argv[]) {
   auto max_threads = std::thread::hardware_concurrency();
 
@@ -109,6 +152,9 @@ MainOptions::MainOptions(int argc, char *argv[]) {
             throw std::runtime_error(msg + std::to_string(max_threads));
           }
         }
+      } else if (k == "--cpu-affinity") {
+        cpu_affinity.clear();
+        parse_cpu_list(v, cpu_affinity);
       } else if (k == "--log-level") {
         if (
           utils::starts_with(v, "debug") && (
@@ -159,7 +205,24 @@ MainOptions::MainOptions(int argc, char *argv[]) {
       } else if (k == "--instance-name") {
         instance_name = v;
       } else if (k == "--reuse-port") {
+        if (v == "cpu") {
+          reuse_port_by_cpu = true;
+        } else if (!v.empty()) {
+          throw std::runtime_error("--reuse-port expects nothing or 'cpu'");
+        }
         reuse_port = true;
+      } else if (k == "--balance-connections") {
+        balance_connections = true;
+      } else if (k == "--lazy-read") {
+        lazy_read = true;
+      } else if (k == "--no-bytecode") {
+        no_bytecode = true;
+      } else if (k == "--inline-cache-metrics") {
+        inline_cache_metrics = true;
+      } else if (k == "--script-cache") {
+        script_cache = v;
+      } else if (k == "--dns-server") {
+        dns_server = v;
       } else if (k == "--admin-port") {
         admin_port = v;
       } else if (k == "--admin-tls-cert") {
@@ -187,6 +250,15 @@ MainOptions::MainOptions(int argc, char *argv[]) {
     throw std::runtime_error("missing script to evaluate");
   }
 
+  if (reuse_port_by_cpu) {
+    if (cpu_affinity.empty()) {
+      throw std::runtime_error("--reuse-port=cpu requires --cpu-affinity");
+    }
+    if (threads > cpu_affinity.size()) {
+      throw std::runtime_error("--reuse-port=cpu requires no more threads than CPUs in --cpu-affinity");
+    }
+  }
+
   if (!instance_uuid.empty() && instance_uuid.find('/') != std::string::npos) {
     throw std::runtime_error("--instance-uuid does not allow slashes");
   }
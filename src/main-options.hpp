@@ -52,13 +52,21 @@ public:
   bool        verify = false;
   bool        no_graph = false;
   bool        reuse_port = false;
+  bool        reuse_port_by_cpu = false;
+  bool        balance_connections = false;
+  bool        lazy_read = false;
+  bool        no_bytecode = false;
+  bool        inline_cache_metrics = false;
   int         threads = 1;
+  std::vector<int> cpu_affinity;
   Log::Level  log_level = Log::ERROR;
   int         log_topics = 0;
   std::string admin_port;
   std::string instance_uuid;
   std::string instance_name;
   std::string openssl_engine;
+  std::string script_cache;
+  std::string dns_server;
 
   pjs::Ref<crypto::Certificate>               admin_tls_cert;
   pjs::Ref<crypto::PrivateKey>                admin_tls_key;
@@ -28,6 +28,7 @@
 #include "admin-link.hpp"
 #include "admin-service.hpp"
 #include "admin-proxy.hpp"
+#include "api/algo.hpp"
 #include "api/crypto.hpp"
 #include "api/logging.hpp"
 #include "api/pipy.hpp"
@@ -38,7 +39,11 @@
 #include "input.hpp"
 #include "listener.hpp"
 #include "main-options.hpp"
+#include "module.hpp"
 #include "net.hpp"
+#include "outbound.hpp"
+#include "resolver.hpp"
+#include "pjs/bytecode.hpp"
 #include "status.hpp"
 #include "timer.hpp"
 #include "utils.hpp"
@@ -46,6 +51,7 @@
 #include "worker-thread.hpp"
 
 #include <signal.h>
+#include <string.h>
 
 #include <list>
 #include <string>
@@ -53,6 +59,10 @@
 
 #include <openssl/opensslv.h>
 
+#ifdef PIPY_USE_IO_URING
+#include <liburing.h>
+#endif
+
 using namespace pipy;
 
 static AdminService *s_admin = nullptr;
@@ -85,6 +95,33 @@ static void show_version() {
 #else
   std::cout << "Samples     : " << "No" << std::endl;
 #endif
+
+#ifdef PIPY_USE_IO_URING
+  std::cout << "I/O Backend : " << "io_uring" << std::endl;
+#else
+  std::cout << "I/O Backend : " << "default" << std::endl;
+#endif
+}
+
+//
+// Check io_uring availability
+//
+
+static void check_io_uring() {
+#ifdef PIPY_USE_IO_URING
+  // This build has epoll compiled out, so there is nothing to fall back on
+  // when the kernel refuses io_uring. Find out before asio does, so that we
+  // can stop with an explanation instead of an uncaught exception.
+  io_uring ring;
+  auto ret = io_uring_queue_init(8, &ring, 0);
+  if (ret < 0) {
+    std::string msg("this build of Pipy requires io_uring, which is not available: ");
+    msg += strerror(-ret);
+    msg += " (rebuild without PIPY_IO_URING to use epoll)";
+    throw std::runtime_error(msg);
+  }
+  io_uring_queue_exit(&ring);
+#endif
 }
 
 //
@@ -274,6 +311,7 @@ public:
     m_signals.add(SIGINT);
     m_signals.add(SIGHUP);
     m_signals.add(SIGTSTP);
+    m_signals.add(SIGUSR1);
   }
 
   void start() { wait(); }
@@ -332,6 +370,11 @@ private:
       case SIGTSTP:
         toggle_admin_port();
         break;
+
+      case SIGUSR1:
+        Log::info("[logger] Reopening log files...");
+        logging::Logger::reopen_all();
+        break;
     }
   }
 
@@ -378,6 +421,8 @@ int main(int argc, char *argv[]) {
       return 0;
     }
 
+    check_io_uring();
+
     Status::LocalInstance::since = utils::now();
     Status::LocalInstance::name = opts.instance_name;
 
@@ -392,10 +437,33 @@ int main(int argc, char *argv[]) {
     Log::set_level(opts.log_level);
     Log::set_topics(opts.log_topics);
     Listener::set_reuse_port(opts.reuse_port);
+    Listener::set_reuse_port_by_cpu(opts.reuse_port_by_cpu);
+    Listener::set_balancing(opts.balance_connections);
+    Inbound::set_lazy_read(opts.lazy_read);
+    Outbound::set_lazy_read(opts.lazy_read);
+    if (!opts.dns_server.empty()) Resolver::set_server(opts.dns_server);
+    pjs::bytecode::Program::set_enabled(!opts.no_bytecode);
+    pjs::PropertyCache::set_stats_enabled(opts.inline_cache_metrics);
     pjs::Math::init();
     crypto::Crypto::init(opts.openssl_engine);
     tls::TLSSession::init();
 
+    //
+    // The script cache only speeds up startup, so run without
+    // it if it can't be opened, e.g. when locked by another process
+    //
+
+    Store *script_cache = nullptr;
+    if (!opts.script_cache.empty()) {
+      auto path = fs::abs_path(opts.script_cache);
+      try {
+        script_cache = Store::open_level_db(path);
+        JSModule::set_script_cache(script_cache);
+      } catch (std::runtime_error &err) {
+        Log::warn("[pjs] Running without script cache at %s: %s", path.c_str(), err.what());
+      }
+    }
+
     s_admin_options.cert = opts.admin_tls_cert;
     s_admin_options.key = opts.admin_tls_key;
     s_admin_options.trusted = opts.admin_tls_trusted;
@@ -527,6 +595,7 @@ int main(int argc, char *argv[]) {
             }
 
             WorkerManager::get().enable_graph(!opts.no_graph);
+            WorkerManager::get().set_cpu_affinity(opts.cpu_affinity);
 
             if (!is_repo && !is_remote) {
               WorkerManager::get().on_done(
@@ -591,9 +660,16 @@ int main(int argc, char *argv[]) {
 
     if (store) store->close();
 
+    if (script_cache) {
+      JSModule::set_script_cache(nullptr);
+      script_cache->close();
+    }
+
+    algo::TableBuilder::shutdown();
     crypto::Crypto::free();
     stats::Metric::local().clear();
     Log::shutdown();
+    logging::Logger::close_all();
     Timer::cancel_all();
 
     std::cerr << "Done." << std::endl;
@@ -24,6 +24,7 @@
  */
 
 #include "module.hpp"
+#include "version.h"
 #include "codebase.hpp"
 #include "worker.hpp"
 #include "pipeline.hpp"
@@ -31,13 +32,18 @@
 #include "api/console.hpp"
 #include "api/json.hpp"
 #include "graph.hpp"
+#include "store.hpp"
 #include "utils.hpp"
 #include "log.hpp"
 
+#include <chrono>
 #include <fstream>
+#include <mutex>
 #include <sstream>
 #include <iostream>
 
+#include <openssl/evp.h>
+
 namespace pipy {
 
 //
@@ -95,6 +101,104 @@ auto JSModule::new_context(Context *base) -> Context* {
   return m_worker->new_runtime_context(base);
 }
 
+//
+// Every worker thread loads the same scripts, so each script is lexed
+// only once by whichever thread gets to it first, while the others wait
+// for the result. Each thread still parses the tokens into its own tree
+// of expressions, since those hold thread-local values once resolved.
+// A cached script is reused as long as its content stays the same.
+// Scripts are stamped with the reload they were last loaded in, so
+// that the ones no longer loaded by a reloaded codebase are let go.
+//
+// With a script cache, the tokens are also persisted in a store under
+// the SHA-256 hash of the script content, so that the next process
+// starting up with the same scripts can skip lexing altogether.
+//
+
+struct LexedScript {
+  std::mutex mutex;
+  std::string content;
+  std::shared_ptr<const pjs::Parser::Tokens> tokens;
+  int generation = 0;
+};
+
+static std::mutex s_lexed_scripts_mutex;
+static std::map<std::string, std::shared_ptr<LexedScript>> s_lexed_scripts;
+static int s_lexed_generation = 0;
+static Store* s_script_cache = nullptr;
+thread_local static Data::Producer s_dp("Script Cache");
+
+void JSModule::set_script_cache(Store *store) {
+  s_script_cache = store;
+}
+
+void JSModule::begin_reload() {
+  std::lock_guard<std::mutex> lock(s_lexed_scripts_mutex);
+  s_lexed_generation++;
+}
+
+void JSModule::end_reload(bool ok) {
+  if (!ok) return;
+  std::lock_guard<std::mutex> lock(s_lexed_scripts_mutex);
+  for (auto i = s_lexed_scripts.begin(); i != s_lexed_scripts.end(); ) {
+    if (i->second->generation != s_lexed_generation) {
+      i = s_lexed_scripts.erase(i);
+    } else {
+      i++;
+    }
+  }
+}
+
+static auto lex_with_cache(const pjs::Source &source) -> std::shared_ptr<const pjs::Parser::Tokens> {
+  if (!s_script_cache) return pjs::Parser::lex(&source);
+
+  unsigned char hash[EVP_MAX_MD_SIZE];
+  unsigned int size = 0;
+  char hex[EVP_MAX_MD_SIZE * 2];
+  EVP_Digest(source.content.c_str(), source.content.length(), hash, &size, EVP_sha256(), nullptr);
+  std::string key("pjs/tokens/");
+  key.append(hex, utils::encode_hex(hex, hash, size));
+
+  //
+  // Tokens are tied to the build that lexed them, so an entry left by
+  // another version of pipy is rejected and gets overwritten below
+  //
+
+  static const std::string build(PIPY_VERSION " " PIPY_COMMIT " " PIPY_COMMIT_DATE);
+
+  Data data;
+  if (s_script_cache->get(key, data)) {
+    if (auto tokens = pjs::Parser::decode(data.to_string(), build)) {
+      return tokens;
+    }
+    Log::info("[pjs] Discarded script cache for %s made by another build or invalid", source.filename.c_str());
+  }
+
+  auto tokens = pjs::Parser::lex(&source);
+  std::string encoded;
+  pjs::Parser::encode(tokens.get(), build, encoded);
+  s_script_cache->set(key, Data(encoded, &s_dp));
+  return tokens;
+}
+
+auto JSModule::lex(const pjs::Source &source) -> std::shared_ptr<const pjs::Parser::Tokens> {
+  std::shared_ptr<LexedScript> script;
+  {
+    std::lock_guard<std::mutex> lock(s_lexed_scripts_mutex);
+    auto &s = s_lexed_scripts[source.filename];
+    if (!s) s = std::make_shared<LexedScript>();
+    s->generation = s_lexed_generation;
+    script = s;
+  }
+
+  std::lock_guard<std::mutex> lock(script->mutex);
+  if (!script->tokens || script->content != source.content) {
+    script->content = source.content;
+    script->tokens = lex_with_cache(source);
+  }
+  return script->tokens;
+}
+
 bool JSModule::load(const std::string &path) {
   m_filename = pjs::Str::make(path);
 
@@ -109,9 +213,13 @@ bool JSModule::load(const std::string &path) {
   m_source.filename = path;
   m_source.content = data.to_string();
 
+  auto t = std::chrono::steady_clock::now();
+  auto tokens = lex(m_source);
+  m_worker->m_parse_time += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
+
   std::string error;
   int error_line, error_column;
-  auto expr = pjs::Parser::parse(&m_source, error, error_line, error_column);
+  auto expr = pjs::Parser::parse(&m_source, tokens.get(), error, error_line, error_column);
   m_script = std::unique_ptr<pjs::Expr>(expr);
 
   if (!expr) {
@@ -31,6 +31,7 @@
 #include "task.hpp"
 
 #include <map>
+#include <memory>
 #include <set>
 
 namespace pipy {
@@ -38,6 +39,7 @@ namespace pipy {
 class Context;
 class Configuration;
 class PipelineLayout;
+class Store;
 
 //
 // ModuleBase
@@ -106,7 +108,13 @@ public:
 
   virtual auto new_context(Context *base = nullptr) -> Context* override;
 
+  static void set_script_cache(Store *store);
+  static void begin_reload();
+  static void end_reload(bool ok);
+
 private:
+  static auto lex(const pjs::Source &source) -> std::shared_ptr<const pjs::Parser::Tokens>;
+
   bool load(const std::string &path);
   virtual void unload() override;
 
@@ -35,6 +35,7 @@ using tcp = asio::ip::tcp;
 using udp = asio::ip::udp;
 
 thread_local static Data::Producer s_dp_tcp("OutboundTCP");
+thread_local static Data::Producer s_dp_tcp_lazy("OutboundTCP Lazy");
 thread_local static Data::Producer s_dp_udp("OutboundUDP");
 
 //
@@ -46,6 +47,11 @@ thread_local pjs::Ref<stats::Gauge> Outbound::s_metric_concurrency;
 thread_local pjs::Ref<stats::Counter> Outbound::s_metric_traffic_in;
 thread_local pjs::Ref<stats::Counter> Outbound::s_metric_traffic_out;
 thread_local pjs::Ref<stats::Histogram> Outbound::s_metric_conn_time;
+bool Outbound::s_lazy_read = false;
+
+void Outbound::set_lazy_read(bool lazy) {
+  s_lazy_read = lazy;
+}
 
 Outbound::Outbound(EventTarget::Input *output, const Options &options)
   : m_options(options)
@@ -155,20 +161,49 @@ void Outbound::init_metrics() {
 OutboundTCP::OutboundTCP(EventTarget::Input *output, const Options &options)
   : Outbound(output, options)
   , FlushTarget(true)
-  , m_resolver(Net::context())
   , m_socket(Net::context())
 {
 }
 
+OutboundTCP::~OutboundTCP() {
+  Splicer::unpair(this);
+}
+
 void OutboundTCP::bind(const std::string &ip, int port) {
   tcp::endpoint ep(asio::ip::make_address(ip), port);
   m_socket.open(ep.protocol());
   m_socket.bind(ep);
+  m_bind_endpoint = ep;
+  m_bound = true;
   const auto &local = m_socket.local_endpoint();
   m_local_addr = local.address().to_string();
   m_local_port = local.port();
 }
 
+//
+// A socket closed for trying the next address or for a retry is bound
+// again to the local address and port that were asked for, so that
+// every attempt goes out from there.
+//
+
+bool OutboundTCP::rebind() {
+  if (!m_bound || m_socket.is_open()) return true;
+  std::error_code ec;
+  m_socket.open(m_bind_endpoint.protocol(), ec);
+  if (!ec) m_socket.set_option(asio::socket_base::reuse_address(true), ec);
+  if (!ec) m_socket.bind(m_bind_endpoint, ec);
+  if (ec) {
+    if (Log::is_enabled(Log::ERROR)) {
+      char desc[200];
+      describe(desc);
+      Log::error("%s cannot bind: %s", desc, ec.message().c_str());
+    }
+    m_socket.close(ec);
+    return false;
+  }
+  return true;
+}
+
 void OutboundTCP::connect(const std::string &host, int port) {
   m_host = host;
   m_port = port;
@@ -215,6 +250,8 @@ void OutboundTCP::send(Event *evt) {
 void OutboundTCP::reset() {
   asio::error_code ec;
 
+  Splicer::unpair(this);
+
   if (m_connecting) {
     m_connecting = false;
     m_connect_timer.cancel();
@@ -228,6 +265,7 @@ void OutboundTCP::reset() {
   m_discarded_data_size = 0;
   m_overflowed = false;
   m_ended = false;
+  m_offloaded = false;
   m_retries = 0;
   m_connected = false;
   m_buffer.clear();
@@ -235,6 +273,27 @@ void OutboundTCP::reset() {
   m_socket.close(ec);
 }
 
+bool OutboundTCP::offload(const std::function<bool(int)> &setup) {
+  if (!m_socket.is_open() || !m_connected || m_pumping || m_ended) return false;
+
+  std::error_code ec;
+  auto non_blocking = m_socket.non_blocking();
+  m_socket.non_blocking(true, ec);
+  while (!m_buffer.empty() && !ec) {
+    auto n = m_socket.write_some(DataChunks(m_buffer.chunks()), ec);
+    m_buffer.shift(n);
+    m_metric_traffic_out->increase(n);
+    s_metric_traffic_out->increase(n);
+  }
+  m_socket.non_blocking(non_blocking, ec);
+
+  if (!m_buffer.empty()) return false;
+  if (!setup(m_socket.native_handle())) return false;
+
+  m_offloaded = true;
+  return true;
+}
+
 void OutboundTCP::on_flush() {
   if (!m_ended) {
     pump();
@@ -263,15 +322,26 @@ void OutboundTCP::start(double delay) {
 }
 
 void OutboundTCP::resolve() {
-  auto host = m_host;
-  if (host == "localhost") host = "127.0.0.1";
-
-  m_resolver.async_resolve(
-    tcp::resolver::query(host, std::to_string(m_port)),
+  m_resolver.resolve(
+    m_host,
     [this](
-      const std::error_code &ec,
-      tcp::resolver::results_type results
+      const std::error_code &resolve_error,
+      const Resolver::Addresses &addresses
     ) {
+      auto ec = resolve_error;
+      auto targets = addresses;
+      if (!ec && m_bound) {
+        auto v6 = m_bind_endpoint.address().is_v6();
+        targets.erase(
+          std::remove_if(
+            targets.begin(), targets.end(),
+            [=](const asio::ip::address &a) { return a.is_v6() != v6; }
+          ),
+          targets.end()
+        );
+        if (targets.empty()) ec = asio::error::address_family_not_supported;
+      }
+
       if (ec && m_options.connect_timeout > 0) {
         m_connect_timer.cancel();
       }
@@ -286,10 +356,9 @@ void OutboundTCP::resolve() {
           restart(StreamEnd::CANNOT_RESOLVE);
 
         } else {
-          auto &result = *results;
-          const auto &target = result.endpoint();
-          m_remote_addr = target.address().to_string();
-          connect(target);
+          m_addresses = std::move(targets);
+          m_address_index = 0;
+          connect(tcp::endpoint(m_addresses[0], m_port));
         }
       }
 
@@ -329,10 +398,18 @@ void OutboundTCP::resolve() {
 }
 
 void OutboundTCP::connect(const asio::ip::tcp::endpoint &target) {
+  m_remote_addr = target.address().to_string();
+  if (!rebind()) {
+    if (m_options.connect_timeout > 0) m_connect_timer.cancel();
+    restart(StreamEnd::CONNECTION_REFUSED);
+    return;
+  }
   m_socket.async_connect(
     target,
     [=](const std::error_code &ec) {
-      if (m_options.connect_timeout > 0) {
+      auto next = (ec && m_connecting && m_address_index + 1 < m_addresses.size());
+
+      if (m_options.connect_timeout > 0 && !next) {
         m_connect_timer.cancel();
       }
 
@@ -343,7 +420,13 @@ void OutboundTCP::connect(const asio::ip::tcp::endpoint &target) {
             describe(desc);
             Log::error("%s cannot connect: %s", desc, ec.message().c_str());
           }
-          restart(StreamEnd::CONNECTION_REFUSED);
+          if (next) {
+            std::error_code err;
+            m_socket.close(err);
+            connect(tcp::endpoint(m_addresses[++m_address_index], m_port));
+          } else {
+            restart(StreamEnd::CONNECTION_REFUSED);
+          }
 
         } else {
           if (Log::is_enabled(Log::OUTBOUND)) {
@@ -362,6 +445,10 @@ void OutboundTCP::connect(const asio::ip::tcp::endpoint &target) {
             m_connected = true;
             m_connecting = false;
             m_socket.set_option(asio::socket_base::keep_alive(m_options.keep_alive));
+            if (m_options.lazy_read || m_splicer.target()) {
+              std::error_code ec;
+              m_socket.non_blocking(true, ec);
+            }
             receive();
             pump();
           } else {
@@ -400,19 +487,31 @@ void OutboundTCP::restart(StreamEnd::Error err) {
 void OutboundTCP::receive() {
   if (!m_socket.is_open()) return;
 
-  pjs::Ref<Data> buffer(Data::make(RECEIVE_BUFFER_SIZE, &s_dp_tcp));
-
-  m_socket.async_read_some(
-    DataChunks(buffer->chunks()),
-    [=](const std::error_code &ec, size_t n) {
-      InputContext ic(this);
+  if (m_splicer.target()) {
+    receive_spliced();
+    return;
+  }
 
-      if (m_options.read_timeout > 0){
-        m_read_timer.cancel();
+  if (m_options.lazy_read) {
+    m_socket.async_wait(
+      tcp::socket::wait_read,
+      [=](const std::error_code &ec) {
+        if (ec) {
+          received(nullptr, ec);
+        } else {
+          read_available();
+        }
+        release();
       }
+    );
 
-      if (ec != asio::error::operation_aborted) {
-        if (n > 0) {
+  } else {
+    pjs::Ref<Data> buffer(Data::make(RECEIVE_BUFFER_SIZE, &s_dp_tcp));
+
+    m_socket.async_read_some(
+      DataChunks(buffer->chunks()),
+      [=](const std::error_code &ec, size_t n) {
+        if (n > 0 && ec != asio::error::operation_aborted) {
           if (m_socket.is_open()) {
             buffer->pop(buffer->size() - n);
             if (auto more = m_socket.available()) {
@@ -422,44 +521,14 @@ void OutboundTCP::receive() {
               buffer->push(buf);
             }
           }
-          m_metric_traffic_in->increase(buffer->size());
-          s_metric_traffic_in->increase(buffer->size());
-          output(buffer);
-        }
-
-        if (ec) {
-          if (ec == asio::error::eof) {
-            if (Log::is_enabled(Log::OUTBOUND)) {
-              char desc[200];
-              describe(desc);
-              Log::debug(Log::OUTBOUND, "%s connection closed by peer", desc);
-            }
-            close(StreamEnd::NO_ERROR);
-          } else if (ec == asio::error::connection_reset) {
-            if (Log::is_enabled(Log::WARN)) {
-              char desc[200];
-              describe(desc);
-              Log::warn("%s connection reset by peer", desc);
-            }
-            close(StreamEnd::CONNECTION_RESET);
-          } else {
-            if (Log::is_enabled(Log::WARN)) {
-              char desc[200];
-              describe(desc);
-              Log::warn("%s error reading from peer: %s", desc, ec.message().c_str());
-            }
-            close(StreamEnd::READ_ERROR);
-          }
-
+          received(buffer, ec);
         } else {
-          receive();
-          wait();
+          received(nullptr, ec);
         }
+        release();
       }
-
-      release();
-    }
-  );
+    );
+  }
 
   if (m_options.read_timeout > 0) {
     m_read_timer.schedule(
@@ -473,6 +542,129 @@ void OutboundTCP::receive() {
   retain();
 }
 
+void OutboundTCP::receive_spliced() {
+  if (m_splicer.pending()) {
+    m_splicer.target()->splice_socket().async_wait(
+      tcp::socket::wait_write,
+      [=](const std::error_code &ec) {
+        if (m_options.write_timeout > 0) {
+          m_write_timer.cancel();
+        }
+        if (ec != asio::error::operation_aborted) {
+          if (ec) m_splicer.fail(ec); else m_splicer.flush();
+          received(nullptr, std::error_code());
+        }
+        release();
+      }
+    );
+
+    if (m_options.write_timeout > 0) {
+      m_write_timer.schedule(
+        m_options.write_timeout,
+        [this]() {
+          close(StreamEnd::WRITE_TIMEOUT);
+        }
+      );
+    }
+
+  } else {
+    m_socket.async_wait(
+      tcp::socket::wait_read,
+      [=](const std::error_code &ec) {
+        if (ec) {
+          received(nullptr, ec);
+        } else if (!m_socket.is_open()) {
+          // Closed by a failed splice into it after this wait completed
+        } else if (m_splicer.ready()) {
+          std::error_code err;
+          auto n = m_splicer.transfer(m_socket.native_handle(), err);
+          m_metric_traffic_in->increase(n);
+          s_metric_traffic_in->increase(n);
+          received(nullptr, err);
+        } else {
+          read_available();
+        }
+        release();
+      }
+    );
+
+    if (m_options.read_timeout > 0) {
+      m_read_timer.schedule(
+        m_options.read_timeout,
+        [this]() {
+          close(StreamEnd::READ_TIMEOUT);
+        }
+      );
+    }
+  }
+
+  retain();
+}
+
+void OutboundTCP::read_available() {
+  std::error_code err;
+  pjs::Ref<Data> buffer;
+  if (auto size = m_socket.available(err)) {
+    buffer = Data::make(size, &s_dp_tcp_lazy);
+  } else if (!err) {
+    buffer = Data::make(1, &s_dp_tcp_lazy);
+  }
+  if (buffer) {
+    auto n = m_socket.read_some(DataChunks(buffer->chunks()), err);
+    buffer->pop(buffer->size() - n);
+  }
+  if (err == asio::error::would_block || err == asio::error::try_again) {
+    received(buffer, std::error_code());
+  } else {
+    received(buffer, err);
+  }
+}
+
+void OutboundTCP::received(Data *data, const std::error_code &ec) {
+  InputContext ic(this);
+
+  if (m_options.read_timeout > 0){
+    m_read_timer.cancel();
+  }
+
+  if (ec != asio::error::operation_aborted) {
+    if (data && data->size() > 0) {
+      m_metric_traffic_in->increase(data->size());
+      s_metric_traffic_in->increase(data->size());
+      output(data);
+    }
+
+    if (ec) {
+      if (ec == asio::error::eof || (m_offloaded && ec.value() == EIO)) {
+        if (Log::is_enabled(Log::OUTBOUND)) {
+          char desc[200];
+          describe(desc);
+          Log::debug(Log::OUTBOUND, "%s connection closed by peer", desc);
+        }
+        close(StreamEnd::NO_ERROR);
+      } else if (ec == asio::error::connection_reset) {
+        if (Log::is_enabled(Log::WARN)) {
+          char desc[200];
+          describe(desc);
+          Log::warn("%s connection reset by peer", desc);
+        }
+        close(StreamEnd::CONNECTION_RESET);
+      } else {
+        if (Log::is_enabled(Log::WARN)) {
+          char desc[200];
+          describe(desc);
+          Log::warn("%s error reading from peer: %s", desc, ec.message().c_str());
+        }
+        close(StreamEnd::READ_ERROR);
+      }
+
+    } else {
+      receive();
+      wait();
+    }
+  }
+}
+
 void OutboundTCP::pump() {
   if (!m_socket.is_open()) return;
   if (m_pumping || !m_connected) return;
@@ -539,6 +731,29 @@ void OutboundTCP::pump() {
   m_pumping = true;
 }
 
+bool OutboundTCP::splice_ready() const {
+  return (
+    m_connected && m_socket.is_open() && !m_ended &&
+    !m_pumping && !m_overflowed && m_buffer.empty()
+  );
+}
+
+void OutboundTCP::splice_written(size_t size) {
+  m_metric_traffic_out->increase(size);
+  s_metric_traffic_out->increase(size);
+  wait();
+}
+
+void OutboundTCP::splice_failed(const std::error_code &ec) {
+  InputContext ic(this);
+  if (Log::is_enabled(Log::WARN)) {
+    char desc[200];
+    describe(desc);
+    Log::warn("%s error writing to peer: %s", desc, ec.message().c_str());
+  }
+  close(StreamEnd::WRITE_ERROR);
+}
+
 void OutboundTCP::wait() {
   if (!m_socket.is_open()) return;
   if (m_options.idle_timeout > 0) {
@@ -555,6 +770,8 @@ void OutboundTCP::wait() {
 void OutboundTCP::close(StreamEnd::Error err) {
   if (!m_connected) return;
 
+  Splicer::unpair(this);
+
   m_buffer.clear();
   m_discarded_data_size = 0;
   m_overflowed = false;
@@ -592,11 +809,16 @@ void OutboundTCP::close(StreamEnd::Error err) {
 
 OutboundUDP::OutboundUDP(EventTarget::Input *output, const Options &options)
   : Outbound(output, options)
-  , m_resolver(Net::context())
+  , m_receiver(&s_dp_udp)
   , m_socket(Net::context())
+  , m_sender(new DatagramSender(m_socket, options.gso))
 {
 }
 
+OutboundUDP::~OutboundUDP() {
+  m_sender->close();
+}
+
 void OutboundUDP::bind(const std::string &ip, int port) {
   udp::endpoint ep(asio::ip::make_address(ip), port);
   m_socket.open(ep.protocol());
@@ -668,6 +890,7 @@ void OutboundUDP::reset() {
   m_connected = false;
   m_buffer.clear();
   m_pending_buffer.clear();
+  m_sender->clear();
   m_socket.shutdown(udp::socket::shutdown_both, ec);
   m_socket.close(ec);
 }
@@ -680,6 +903,20 @@ void OutboundUDP::on_tap_close()
 {
 }
 
+void OutboundUDP::on_datagram_sent(size_t size, const std::error_code &ec) {
+  if (ec) {
+    if (Log::is_enabled(Log::WARN)) {
+      char desc[200];
+      describe(desc);
+      Log::warn("%s error writing to peer: %s", desc, ec.message().c_str());
+    }
+    close(StreamEnd::WRITE_ERROR);
+  } else {
+    m_metric_traffic_out->increase(size);
+    s_metric_traffic_out->increase(size);
+  }
+}
+
 void OutboundUDP::start(double delay) {
   if (delay > 0) {
     m_retry_timer.schedule(
@@ -694,15 +931,26 @@ void OutboundUDP::start(double delay) {
 }
 
 void OutboundUDP::resolve() {
-  auto host = m_host;
-  if (host == "localhost") host = "127.0.0.1";
-
-  m_resolver.async_resolve(
-    udp::resolver::query(host, std::to_string(m_port)),
+  m_resolver.resolve(
+    m_host,
     [this](
-      const std::error_code &ec,
-      udp::resolver::results_type results
+      const std::error_code &resolve_error,
+      const Resolver::Addresses &addresses
     ) {
+      auto ec = resolve_error;
+      auto targets = addresses;
+      if (!ec && m_socket.is_open()) {
+        auto v6 = m_socket.local_endpoint().address().is_v6();
+        targets.erase(
+          std::remove_if(
+            targets.begin(), targets.end(),
+            [=](const asio::ip::address &a) { return a.is_v6() != v6; }
+          ),
+          targets.end()
+        );
+        if (targets.empty()) ec = asio::error::address_family_not_supported;
+      }
+
       if (ec && m_options.connect_timeout > 0) {
         m_connect_timer.cancel();
       }
@@ -717,10 +965,7 @@ void OutboundUDP::resolve() {
           restart(StreamEnd::CANNOT_RESOLVE);
 
         } else {
-          auto &result = *results;
-          const auto &target = result.endpoint();
-          m_remote_addr = target.address().to_string();
-          connect(target);
+          connect(udp::endpoint(targets[0], m_port));
         }
       }
 
@@ -760,6 +1005,7 @@ void OutboundUDP::resolve() {
 }
 
 void OutboundUDP::connect(const asio::ip::udp::endpoint &target) {
+  m_remote_addr = target.address().to_string();
   m_socket.async_connect(
     target,
     [=](const std::error_code &ec) {
@@ -792,6 +1038,11 @@ void OutboundUDP::connect(const asio::ip::udp::endpoint &target) {
             s_metric_conn_time->observe(conn_time);
             m_connected = true;
             m_connecting = false;
+            m_socket.non_blocking(true);
+            if (m_options.gro) {
+              DatagramReceiver::enable_gro(m_socket.native_handle());
+            }
+            InputContext ic(this);
             receive();
             pump();
           } else {
@@ -828,55 +1079,39 @@ void OutboundUDP::restart(StreamEnd::Error err) {
 }
 
 void OutboundUDP::receive() {
-  if (!m_socket.is_open()) return;
+  static const int MAX_BATCHES = 4;
 
-  pjs::Ref<Data> buffer(Data::make(m_options.max_packet_size, &s_dp_udp));
-
-  m_socket.async_receive(
-    DataChunks(buffer->chunks()),
-    [=](const std::error_code &ec, size_t n) {
-      InputContext ic(this);
+  if (!m_socket.is_open()) return;
 
+  m_socket.async_wait(
+    udp::socket::wait_read,
+    [=](const std::error_code &ec) {
       if (ec != asio::error::operation_aborted) {
-        if (n > 0) {
-          if (m_socket.is_open()) {
-            buffer->pop(buffer->size() - n);
-          }
-          m_metric_traffic_in->increase(buffer->size());
-          s_metric_traffic_in->increase(buffer->size());
-          output(MessageStart::make());
-          output(buffer);
-          output(MessageEnd::make());
-        }
-
-        if (ec) {
-          if (ec == asio::error::eof) {
-            if (Log::is_enabled(Log::OUTBOUND)) {
-              char desc[200];
-              describe(desc);
-              Log::debug(Log::OUTBOUND, "%s connection closed by peer", desc);
-            }
-            close(StreamEnd::NO_ERROR);
-          } else if (ec == asio::error::connection_reset) {
-            if (Log::is_enabled(Log::WARN)) {
-              char desc[200];
-              describe(desc);
-              Log::warn("%s connection reset by peer", desc);
-            }
-            close(StreamEnd::CONNECTION_RESET);
-          } else {
-            if (Log::is_enabled(Log::WARN)) {
-              char desc[200];
-              describe(desc);
-              Log::warn("%s error reading from peer: %s", desc, ec.message().c_str());
-            }
-            close(StreamEnd::READ_ERROR);
-          }
-
-        } else {
-          receive();
-          wait();
+        InputContext ic(this);
+        std::error_code err(ec);
+        for (int i = 0; i < MAX_BATCHES && !err; i++) {
+          m_receiver.receive(
+            m_socket.native_handle(),
+            m_options.max_packet_size,
+            m_options.gro,
+            [this](
+              Data &data,
+              const asio::ip::udp::endpoint &,
+              const asio::ip::udp::endpoint &
+            ) {
+              if (m_socket.is_open()) {
+                m_metric_traffic_in->increase(data.size());
+                s_metric_traffic_in->increase(data.size());
+                output(MessageStart::make());
+                output(Data::make(std::move(data)));
+                output(MessageEnd::make());
+              }
+            },
+            err
+          );
+          if (!m_receiver.full() || !m_socket.is_open()) break;
         }
+        received(err);
       }
 
       release();
@@ -886,37 +1121,46 @@ void OutboundUDP::receive() {
   retain();
 }
 
+void OutboundUDP::received(const std::error_code &ec) {
+  if (ec) {
+    if (ec == asio::error::eof) {
+      if (Log::is_enabled(Log::OUTBOUND)) {
+        char desc[200];
+        describe(desc);
+        Log::debug(Log::OUTBOUND, "%s connection closed by peer", desc);
+      }
+      close(StreamEnd::NO_ERROR);
+    } else if (ec == asio::error::connection_reset) {
+      if (Log::is_enabled(Log::WARN)) {
+        char desc[200];
+        describe(desc);
+        Log::warn("%s connection reset by peer", desc);
+      }
+      close(StreamEnd::CONNECTION_RESET);
+    } else {
+      if (Log::is_enabled(Log::WARN)) {
+        char desc[200];
+        describe(desc);
+        Log::warn("%s error reading from peer: %s", desc, ec.message().c_str());
+      }
+      close(StreamEnd::READ_ERROR);
+    }
+
+  } else {
+    receive();
+    wait();
+  }
+}
+
 void OutboundUDP::pump() {
   if (!m_socket.is_open()) return;
   if (!m_connected) return;
 
   while (!m_pending_buffer.empty()) {
     auto evt = m_pending_buffer.shift();
-
     if (auto data = evt->as<Data>()) {
-      m_socket.async_send(
-        DataChunks(data->chunks()),
-        [=](const std::error_code &ec, std::size_t n) {
-          if (ec != asio::error::operation_aborted) {
-            m_metric_traffic_out->increase(n);
-            s_metric_traffic_out->increase(n);
-            if (ec) {
-              if (Log::is_enabled(Log::WARN)) {
-                char desc[200];
-                describe(desc);
-                Log::warn("%s error writing to peer: %s", desc, ec.message().c_str());
-              }
-              close(StreamEnd::WRITE_ERROR);
-            }
-          }
-
-          release();
-        }
-      );
-
-      retain();
+      m_sender->send(this, data);
     }
-
     evt->release();
   }
 
@@ -941,6 +1185,7 @@ void OutboundUDP::close(StreamEnd::Error err) {
 
   m_buffer.clear();
   m_pending_buffer.clear();
+  m_sender->clear();
   m_ended = false;
   m_retries = 0;
   m_connected = false;
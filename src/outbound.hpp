@@ -29,7 +29,10 @@
 #include "net.hpp"
 #include "event.hpp"
 #include "input.hpp"
+#include "datagram.hpp"
+#include "splice.hpp"
 #include "timer.hpp"
+#include "resolver.hpp"
 #include "list.hpp"
 #include "api/stats.hpp"
 
@@ -64,8 +67,13 @@ public:
     double    write_timeout = 0;
     double    idle_timeout = 60;
     bool      keep_alive = true;
+    bool      lazy_read = s_lazy_read;
+    bool      gso = false;
+    bool      gro = false;
   };
 
+  static void set_lazy_read(bool lazy);
+
   static void for_each(const std::function<void(Outbound*)> &cb) {
     for (auto p = s_all_outbounds.head(); p; p = p->List<Outbound>::Item::next()) {
       cb(p);
@@ -113,6 +121,7 @@ private:
   virtual void finalize() = 0;
 
   thread_local static List<Outbound> s_all_outbounds;
+  static bool s_lazy_read;
 
   static void init_metrics();
 
@@ -127,10 +136,12 @@ class OutboundTCP :
   public pjs::Pooled<OutboundTCP>,
   public Outbound,
   public InputSource,
-  public FlushTarget
+  public FlushTarget,
+  public Splicer::Target
 {
 public:
   OutboundTCP(EventTarget::Input *output, const Options &options);
+  ~OutboundTCP();
 
   bool overflowed() const { return m_overflowed; }
   auto buffered() const -> int { return m_buffer.size(); }
@@ -140,34 +151,53 @@ public:
   virtual void send(Event *evt) override;
   virtual void reset() override;
 
+  bool offload(const std::function<bool(int)> &setup);
+
 private:
   pjs::Ref<stats::Counter> m_metric_traffic_out;
   pjs::Ref<stats::Counter> m_metric_traffic_in;
   pjs::Ref<stats::Histogram> m_metric_conn_time;
-  asio::ip::tcp::resolver m_resolver;
+  Resolver m_resolver;
+  Resolver::Addresses m_addresses;
+  size_t m_address_index = 0;
+  asio::ip::tcp::endpoint m_bind_endpoint;
+  bool m_bound = false;
   asio::ip::tcp::socket m_socket;
-  Timer m_connect_timer;
+  WheelTimer m_connect_timer;
   Timer m_retry_timer;
-  Timer m_read_timer;
-  Timer m_write_timer;
-  Timer m_idle_timer;
+  WheelTimer m_read_timer;
+  WheelTimer m_write_timer;
+  WheelTimer m_idle_timer;
   Data m_buffer;
+  Splicer m_splicer;
   size_t m_discarded_data_size = 0;
   bool m_connecting = false;
   bool m_connected = false;
   bool m_overflowed = false;
   bool m_pumping = false;
   bool m_ended = false;
+  bool m_offloaded = false;
 
   virtual void on_flush() override;
   virtual void on_tap_open() override;
   virtual void on_tap_close() override;
 
+  virtual auto splicer() -> Splicer* override { return &m_splicer; }
+  virtual auto splice_socket() -> asio::ip::tcp::socket& override { return m_socket; }
+  virtual bool splice_ready() const override;
+  virtual bool splice_pumping() const override { return m_connected && (m_pumping || !m_buffer.empty()); }
+  virtual void splice_written(size_t size) override;
+  virtual void splice_failed(const std::error_code &ec) override;
+
   void start(double delay);
   void resolve();
+  bool rebind();
   void connect(const asio::ip::tcp::endpoint &target);
   void restart(StreamEnd::Error err);
   void receive();
+  void receive_spliced();
+  void read_available();
+  void received(Data *data, const std::error_code &ec);
   void pump();
   void wait();
   void close(StreamEnd::Error err);
@@ -182,10 +212,12 @@ private:
 class OutboundUDP :
   public pjs::Pooled<OutboundUDP>,
   public Outbound,
-  public InputSource
+  public InputSource,
+  public DatagramSender::Source
 {
 public:
   OutboundUDP(EventTarget::Input *output, const Options &options);
+  ~OutboundUDP();
 
   virtual void bind(const std::string &ip, int port) override;
   virtual void connect(const std::string &host, int port) override;
@@ -196,11 +228,13 @@ private:
   pjs::Ref<stats::Counter> m_metric_traffic_out;
   pjs::Ref<stats::Counter> m_metric_traffic_in;
   pjs::Ref<stats::Histogram> m_metric_conn_time;
-  asio::ip::udp::resolver m_resolver;
+  Resolver m_resolver;
+  DatagramReceiver m_receiver;
   asio::ip::udp::socket m_socket;
-  Timer m_connect_timer;
+  pjs::Ref<DatagramSender> m_sender;
+  WheelTimer m_connect_timer;
   Timer m_retry_timer;
-  Timer m_idle_timer;
+  WheelTimer m_idle_timer;
   Data m_buffer;
   EventBuffer m_pending_buffer;
   bool m_message_started = false;
@@ -210,12 +244,14 @@ private:
 
   virtual void on_tap_open() override;
   virtual void on_tap_close() override;
+  virtual void on_datagram_sent(size_t size, const std::error_code &ec) override;
 
   void start(double delay);
   void resolve();
   void connect(const asio::ip::udp::endpoint &target);
   void restart(StreamEnd::Error err);
   void receive();
+  void received(const std::error_code &ec);
   void pump();
   void wait();
   void close(StreamEnd::Error err);
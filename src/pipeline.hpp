@@ -159,6 +159,7 @@ public:
   void output(Output *output) { m_output = output; }
   auto chain() const -> PipelineLayout::Chain* { return m_chain; }
   void chain(PipelineLayout::Chain *chain) { m_chain = chain; }
+  auto filters() const -> const List<Filter>& { return m_filters; }
 
   void start(int argc = 0, pjs::Value *argv = nullptr) {
     m_layout->start(this, argc, argv);
@@ -0,0 +1,400 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "bytecode.hpp"
+#include "expr.hpp"
+
+#include <cmath>
+
+namespace pjs {
+namespace bytecode {
+
+static bool error(Context &ctx, Expr *expr, const char *msg) {
+  ctx.error(msg);
+  ctx.backtrace(expr->source(), expr->line(), expr->column());
+  return false;
+}
+
+static bool compare(const Value &a, const Value &b, Op op) {
+  if (a.is_undefined() || b.is_undefined()) return false;
+  if (a.is_string() && b.is_string()) {
+    const auto &sa = a.s()->str();
+    const auto &sb = b.s()->str();
+    switch (op) {
+      case Op::GT: return sa > sb;
+      case Op::GE: return sa >= sb;
+      case Op::LT: return sa < sb;
+      default: return sa <= sb;
+    }
+  }
+  auto na = a.to_number();
+  auto nb = b.to_number();
+  switch (op) {
+    case Op::GT: return na > nb;
+    case Op::GE: return na >= nb;
+    case Op::LT: return na < nb;
+    default: return na <= nb;
+  }
+}
+
+//
+// Program
+//
+
+bool Program::s_enabled = true;
+
+bool Program::run(Context &ctx, Value &result) {
+  Value stack[m_stack_size];
+  const auto *code = &m_code[0];
+  const auto *constants = &m_constants[0];
+  auto *caches = m_caches.empty() ? nullptr : &m_caches[0];
+  int pc = 0, sp = 0, end = m_code.size();
+
+  while (pc < end) {
+    const auto &i = code[pc++];
+    switch (i.op) {
+      case Op::UNDEFINED:
+        stack[sp++] = Value::undefined;
+        break;
+
+      case Op::NULL_VALUE:
+        stack[sp++] = Value::null;
+        break;
+
+      case Op::CONST:
+        stack[sp++] = constants[i.a];
+        break;
+
+      case Op::ARG: {
+        auto *scope = ctx.scope();
+        for (int n = 0; n < i.b; n++) scope = scope->parent();
+        stack[sp++] = scope->value(i.a);
+        break;
+      }
+
+      case Op::EVAL:
+        if (!i.expr->eval(ctx, stack[sp])) return false;
+        sp++;
+        break;
+
+      case Op::POP:
+        stack[--sp] = Value::undefined;
+        break;
+
+      case Op::GET:
+      case Op::GET_OPT:
+      case Op::GET_NAMED:
+      case Op::GET_NAMED_OPT: {
+        bool named = (i.op == Op::GET_NAMED || i.op == Op::GET_NAMED_OPT);
+        bool optional = (i.op == Op::GET_OPT || i.op == Op::GET_NAMED_OPT);
+        auto &obj = stack[named ? sp - 1 : sp - 2];
+        if (obj.is_undefined() || obj.is_null()) {
+          if (!optional) {
+            return error(ctx, i.expr, obj.is_null()
+              ? "cannot read property of null"
+              : "cannot read property of undefined"
+            );
+          }
+          obj = Value::undefined;
+        } else if (named) {
+          auto o = obj.to_object();
+          caches[i.a]->get(o, constants[i.b].s(), obj);
+          o->release();
+        } else {
+          auto &key = stack[sp - 1];
+          auto o = obj.to_object();
+          auto c = o->type();
+          auto n = c->has_seti() ? key.to_number() : NAN;
+          if (std::isfinite(n)) {
+            c->geti(o, n, obj);
+          } else {
+            auto k = key.to_string();
+            caches[i.a]->get(o, k, obj);
+            k->release();
+          }
+          o->release();
+        }
+        if (!named) stack[--sp] = Value::undefined;
+        break;
+      }
+
+      case Op::CALLEE:
+      case Op::CALLEE_OPT: {
+        auto &f = stack[sp - 1];
+        if (i.op == Op::CALLEE_OPT && (f.is_undefined() || f.is_null())) {
+          f = Value::undefined;
+          pc = i.a;
+        } else if (!f.is_function()) {
+          return error(ctx, i.expr, "not a function");
+        }
+        break;
+      }
+
+      case Op::CALL: {
+        auto argc = i.a;
+        auto argv = &stack[sp - argc];
+        auto &f = argv[-1];
+        Value ret;
+        (*f.as<Function>())(ctx, argc, argv, ret);
+        if (!ctx.ok()) {
+          ctx.backtrace(i.expr->source(), i.expr->line(), i.expr->column());
+          return false;
+        }
+        f = ret;
+        for (int n = 0; n < argc; n++) stack[--sp] = Value::undefined;
+        break;
+      }
+
+      case Op::POS: {
+        auto &x = stack[sp - 1];
+        x.set(x.to_number());
+        break;
+      }
+      case Op::NEG: {
+        auto &x = stack[sp - 1];
+        x.set(-x.to_number());
+        break;
+      }
+      case Op::BIT_NOT: {
+        auto &x = stack[sp - 1];
+        x.set(~int(x.to_number()));
+        break;
+      }
+      case Op::NOT: {
+        auto &x = stack[sp - 1];
+        x.set(!x.to_boolean());
+        break;
+      }
+
+      case Op::ADD: {
+        auto &a = stack[sp - 2];
+        auto &b = stack[sp - 1];
+        if (a.is_number() && b.is_number()) {
+          a.set(a.n() + b.n());
+        } else if (a.is_string() || b.is_string()) {
+          auto sa = a.to_string();
+          auto sb = b.to_string();
+          a.set(sa->str() + sb->str());
+          sa->release();
+          sb->release();
+        } else {
+          a.set(a.to_number() + b.to_number());
+        }
+        stack[--sp] = Value::undefined;
+        break;
+      }
+
+      case Op::SUB:
+      case Op::MUL:
+      case Op::DIV:
+      case Op::REM:
+      case Op::POW: {
+        auto &a = stack[sp - 2];
+        auto &b = stack[sp - 1];
+        auto na = a.to_number();
+        auto nb = b.to_number();
+        switch (i.op) {
+          case Op::SUB: a.set(na - nb); break;
+          case Op::MUL: a.set(na * nb); break;
+          case Op::DIV: a.set(na / nb); break;
+          case Op::REM: a.set(std::fmod(na, nb)); break;
+          default: a.set(std::pow(na, nb)); break;
+        }
+        stack[--sp] = Value::undefined;
+        break;
+      }
+
+      case Op::SHL:
+      case Op::SHR:
+      case Op::USR:
+      case Op::BIT_AND:
+      case Op::BIT_OR:
+      case Op::BIT_XOR: {
+        auto &a = stack[sp - 2];
+        auto &b = stack[sp - 1];
+        int32_t na(a.to_number());
+        int32_t nb(b.to_number());
+        switch (i.op) {
+          case Op::SHL: a.set(na << nb); break;
+          case Op::SHR: a.set(na >> nb); break;
+          case Op::USR: a.set((uint32_t)na >> nb); break;
+          case Op::BIT_AND: a.set(na & nb); break;
+          case Op::BIT_OR: a.set(na | nb); break;
+          default: a.set(na ^ nb); break;
+        }
+        stack[--sp] = Value::undefined;
+        break;
+      }
+
+      case Op::EQL: case Op::NEQ: case Op::SAME: case Op::DIFF:
+      case Op::GT: case Op::GE: case Op::LT: case Op::LE: {
+        auto &a = stack[sp - 2];
+        auto &b = stack[sp - 1];
+        bool r;
+        switch (i.op) {
+          case Op::EQL: r = Value::is_equal(a, b); break;
+          case Op::NEQ: r = !Value::is_equal(a, b); break;
+          case Op::SAME: r = Value::is_identical(a, b); break;
+          case Op::DIFF: r = !Value::is_identical(a, b); break;
+          default: r = compare(a, b, i.op); break;
+        }
+        a.set(r);
+        stack[--sp] = Value::undefined;
+        break;
+      }
+
+      case Op::JUMP:
+        pc = i.a;
+        break;
+
+      case Op::JUMP_IF_NOT: {
+        bool b = stack[sp - 1].to_boolean();
+        stack[--sp] = Value::undefined;
+        if (!b) pc = i.a;
+        break;
+      }
+
+      case Op::AND:
+      case Op::OR:
+      case Op::NULL_OR: {
+        auto &x = stack[sp - 1];
+        bool done;
+        switch (i.op) {
+          case Op::AND: done = !x.to_boolean(); break;
+          case Op::OR: done = x.to_boolean(); break;
+          default: done = !x.is_undefined() && !x.is_null(); break;
+        }
+        if (done) {
+          pc = i.a;
+        } else {
+          stack[--sp] = Value::undefined;
+        }
+        break;
+      }
+    }
+  }
+
+  result = stack[0];
+  return true;
+}
+
+void Program::dump(std::ostream &out, const std::string &indent) {
+  static const char *names[] = {
+    "undefined", "null", "const", "arg", "eval", "pop",
+    "get", "get_named", "get_opt", "get_named_opt", "callee", "callee_opt", "call",
+    "pos", "neg", "bit_not", "not",
+    "add", "sub", "mul", "div", "rem", "pow",
+    "shl", "shr", "usr", "bit_and", "bit_or", "bit_xor",
+    "eql", "neq", "same", "diff", "gt", "ge", "lt", "le",
+    "jump", "jump_if_not", "and", "or", "null_or",
+  };
+  for (size_t pc = 0; pc < m_code.size(); pc++) {
+    const auto &i = m_code[pc];
+    out << indent << pc << ' ' << names[int(i.op)];
+    switch (i.op) {
+      case Op::CONST:
+      case Op::GET_NAMED:
+      case Op::GET_NAMED_OPT: {
+        auto &v = m_constants[i.op == Op::CONST ? i.a : i.b];
+        auto s = v.to_string();
+        out << ' ' << s->str();
+        s->release();
+        break;
+      }
+      case Op::ARG: out << ' ' << i.a << ' ' << i.b; break;
+      case Op::CALL: out << ' ' << i.a; break;
+      case Op::CALLEE_OPT:
+      case Op::JUMP: case Op::JUMP_IF_NOT:
+      case Op::AND: case Op::OR: case Op::NULL_OR: out << " -> " << i.a; break;
+      default: break;
+    }
+    out << std::endl;
+    if (i.op == Op::EVAL) i.expr->dump(out, indent + "    ");
+  }
+}
+
+//
+// Compiler
+//
+
+void Compiler::emit(Op op, int a, int b, Expr *expr) {
+  switch (op) {
+    case Op::UNDEFINED:
+    case Op::NULL_VALUE:
+    case Op::CONST:
+    case Op::ARG:
+    case Op::EVAL:
+      adjust(1);
+      break;
+    case Op::GET_NAMED:
+    case Op::GET_NAMED_OPT:
+    case Op::CALLEE:
+    case Op::CALLEE_OPT:
+    case Op::POS: case Op::NEG: case Op::BIT_NOT: case Op::NOT:
+    case Op::JUMP:
+      break;
+    case Op::CALL:
+      adjust(-a);
+      break;
+    default:
+      adjust(-1);
+      break;
+  }
+  m_program.m_code.push_back({ op, a, b, expr });
+  if (op != Op::EVAL) lowered();
+}
+
+void Compiler::constant(const Value &value) {
+  emit(Op::CONST, constant_index(value));
+}
+
+void Compiler::fallback(Expr *expr) {
+  emit(Op::EVAL, 0, 0, expr);
+}
+
+auto Compiler::constant_index(const Value &value) -> int {
+  auto &constants = m_program.m_constants;
+  for (size_t i = 0; i < constants.size(); i++) {
+    if (Value::is_identical(constants[i], value)) return i;
+  }
+  constants.push_back(value);
+  return constants.size() - 1;
+}
+
+auto Compiler::cache_index(PropertyCache &cache) -> int {
+  auto &caches = m_program.m_caches;
+  caches.push_back(&cache);
+  return caches.size() - 1;
+}
+
+void Compiler::adjust(int depth) {
+  m_depth += depth;
+  if (m_depth > m_program.m_stack_size) {
+    m_program.m_stack_size = m_depth;
+  }
+}
+
+} // namespace bytecode
+} // namespace pjs
@@ -0,0 +1,135 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef PJS_BYTECODE_HPP
+#define PJS_BYTECODE_HPP
+
+#include "types.hpp"
+
+#include <iostream>
+#include <vector>
+
+namespace pjs {
+
+class Expr;
+
+namespace bytecode {
+
+//
+// Op
+//
+
+enum class Op : uint8_t {
+  UNDEFINED,    // push undefined
+  NULL_VALUE,   // push null
+  CONST,        // push constants[a]
+  ARG,          // push argument a from scope level b
+  EVAL,         // push the result of evaluating expr as a tree
+  POP,          // pop 1
+
+  GET,          // pop key and object, push property, using caches[a]
+  GET_NAMED,    // pop object, push property constants[b], using caches[a]
+  GET_OPT,      // same as GET, but yields undefined for undefined/null objects
+  GET_NAMED_OPT,
+  CALLEE,       // check that top is a function
+  CALLEE_OPT,   // same as CALLEE, but jump to a with undefined if top is undefined/null
+  CALL,         // pop a arguments and a function, push return value
+
+  POS, NEG, BIT_NOT, NOT,
+  ADD, SUB, MUL, DIV, REM, POW,
+  SHL, SHR, USR, BIT_AND, BIT_OR, BIT_XOR,
+  EQL, NEQ, SAME, DIFF, GT, GE, LT, LE,
+
+  JUMP,         // jump to a
+  JUMP_IF_NOT,  // pop, jump to a if falsy
+  AND,          // jump to a if top is falsy, otherwise pop
+  OR,           // jump to a if top is truthy, otherwise pop
+  NULL_OR,      // jump to a if top is not undefined/null, otherwise pop
+};
+
+//
+// Instruction
+//
+
+struct Instruction {
+  Op op;
+  int a;
+  int b;
+  Expr* expr;
+};
+
+//
+// Program
+//
+
+class Program {
+public:
+  static void set_enabled(bool enabled) { s_enabled = enabled; }
+  static bool enabled() { return s_enabled; }
+
+  bool run(Context &ctx, Value &result);
+  void dump(std::ostream &out, const std::string &indent);
+
+private:
+  std::vector<Instruction> m_code;
+  std::vector<Value> m_constants;
+  std::vector<PropertyCache*> m_caches;
+  int m_stack_size = 0;
+  int m_lowered = 0;
+
+  static bool s_enabled;
+
+  friend class Compiler;
+};
+
+//
+// Compiler
+//
+
+class Compiler {
+public:
+  Compiler(Program &program) : m_program(program) {}
+
+  void emit(Op op, int a = 0, int b = 0, Expr *expr = nullptr);
+  void constant(const Value &value);
+  void fallback(Expr *expr);
+  auto constant_index(const Value &value) -> int;
+  auto cache_index(PropertyCache &cache) -> int;
+  auto label() const -> int { return m_program.m_code.size(); }
+  void patch(int at) { m_program.m_code[at].a = label(); }
+  void adjust(int depth);
+  void lowered() { m_program.m_lowered++; }
+
+  bool is_trivial() const { return m_program.m_lowered == 0; }
+
+private:
+  Program& m_program;
+  int m_depth = 0;
+};
+
+} // namespace bytecode
+} // namespace pjs
+
+#endif // PJS_BYTECODE_HPP
@@ -57,6 +57,35 @@ bool Expr::Imports::get(Str *name, int *file, Str **original_name) {
   return true;
 }
 
+//
+// CacheSite
+//
+
+thread_local CacheSite* CacheSite::s_all = nullptr;
+thread_local uint64_t CacheSite::s_removed = 0;
+
+CacheSite::CacheSite(Expr *expr, PropertyCache &cache)
+  : m_expr(expr)
+  , m_cache(cache)
+  , m_list(&s_all)
+  , m_next(s_all)
+{
+  if (s_all) s_all->m_prev = this;
+  s_all = this;
+}
+
+CacheSite::~CacheSite() {
+  if (m_prev) m_prev->m_next = m_next; else *m_list = m_next;
+  if (m_next) m_next->m_prev = m_prev;
+  s_removed++;
+}
+
+void CacheSite::for_each(const std::function<void(CacheSite*)> &cb) {
+  for (auto *s = s_all; s; s = s->m_next) {
+    cb(s);
+  }
+}
+
 namespace expr {
 
 //
@@ -73,6 +102,12 @@ void Discard::resolve(Context &ctx, int l, Imports *imports) {
   m_x->resolve(ctx, l, imports);
 }
 
+void Discard::compile(bytecode::Compiler &c) {
+  m_x->compile(c);
+  c.emit(bytecode::Op::POP);
+  c.emit(bytecode::Op::UNDEFINED);
+}
+
 void Discard::dump(std::ostream &out, const std::string &indent) {
   out << indent << "discard" << std::endl;
   m_x->dump(out, indent + "  ");
@@ -116,6 +151,17 @@ void Compound::resolve(Context &ctx, int l, Imports *imports) {
   }
 }
 
+void Compound::compile(bytecode::Compiler &c) {
+  if (m_exprs.empty()) {
+    c.emit(bytecode::Op::UNDEFINED);
+    return;
+  }
+  for (size_t i = 0; i < m_exprs.size(); i++) {
+    if (i > 0) c.emit(bytecode::Op::POP);
+    m_exprs[i]->compile(c);
+  }
+}
+
 void Compound::dump(std::ostream &out, const std::string &indent) {
   out << indent << "compound" << std::endl;
   for (const auto &p : m_exprs) {
@@ -167,6 +213,10 @@ auto Undefined::reduce(Reducer &r) -> Reducer::Value* {
   return r.undefined();
 }
 
+void Undefined::compile(bytecode::Compiler &c) {
+  c.emit(bytecode::Op::UNDEFINED);
+}
+
 void Undefined::dump(std::ostream &out, const std::string &indent) {
   out << indent << "undefined" << std::endl;
 }
@@ -184,6 +234,10 @@ auto Null::reduce(Reducer &r) -> Reducer::Value* {
   return r.null();
 }
 
+void Null::compile(bytecode::Compiler &c) {
+  c.emit(bytecode::Op::NULL_VALUE);
+}
+
 void Null::dump(std::ostream &out, const std::string &indent) {
   out << indent << "null" << std::endl;
 }
@@ -201,6 +255,10 @@ auto BooleanLiteral::reduce(Reducer &r) -> Reducer::Value* {
   return r.boolean(m_b);
 }
 
+void BooleanLiteral::compile(bytecode::Compiler &c) {
+  c.constant(m_b);
+}
+
 void BooleanLiteral::dump(std::ostream &out, const std::string &indent) {
   out << indent << (m_b ? "true" : "false") << std::endl;
 }
@@ -218,6 +276,10 @@ auto NumberLiteral::reduce(Reducer &r) -> Reducer::Value* {
   return r.number(m_n);
 }
 
+void NumberLiteral::compile(bytecode::Compiler &c) {
+  c.constant(m_n);
+}
+
 void NumberLiteral::dump(std::ostream &out, const std::string &indent) {
   out << indent << "number " << m_n << std::endl;
 }
@@ -235,6 +297,10 @@ auto StringLiteral::reduce(Reducer &r) -> Reducer::Value* {
   return r.string(m_s->str());
 }
 
+void StringLiteral::compile(bytecode::Compiler &c) {
+  c.constant(m_s.get());
+}
+
 void StringLiteral::dump(std::ostream &out, const std::string &indent) {
   out << indent << "string \"" << m_s->str() << '"' << std::endl;
 }
@@ -522,6 +588,10 @@ void FunctionLiteral::resolve(Context &ctx, int l, Imports *imports) {
   Context fctx(ctx, 0, nullptr, Scope::make(ctx.scope(), m_variables.size(), &m_variables[0]));
   for (auto &i : m_inputs) i->resolve(fctx, l, imports);
   m_output->resolve(fctx, l, imports);
+
+  if (bytecode::Program::enabled()) {
+    m_output.reset(Compiled::compile(m_output.release()));
+  }
 }
 
 auto FunctionLiteral::reduce(Reducer &r) -> Reducer::Value* {
@@ -619,6 +689,10 @@ bool Argument::clear(Context &ctx, Value &result) {
   return error(ctx, "cannot delete an argument");
 }
 
+void Argument::compile(bytecode::Compiler &c) {
+  c.emit(bytecode::Op::ARG, m_i, m_level);
+}
+
 void Argument::dump(std::ostream &out, const std::string &indent) {
   out << indent << "argument " << m_i << std::endl;
 }
@@ -703,6 +777,14 @@ auto Identifier::reduce(Reducer &r) -> Reducer::Value* {
   return r.get(m_key->str());
 }
 
+void Identifier::compile(bytecode::Compiler &c) {
+  if (dynamic_cast<Argument*>(m_resolved.get())) {
+    m_resolved->compile(c);
+  } else {
+    c.fallback(this);
+  }
+}
+
 void Identifier::dump(std::ostream &out, const std::string &indent) {
   out << indent << "identifier " << m_key->c_str() << std::endl;
 }
@@ -792,6 +874,18 @@ auto Property::reduce(Reducer &r) -> Reducer::Value* {
   return r.get(m_obj->reduce(r), m_key->reduce(r));
 }
 
+void Property::compile(bytecode::Compiler &c) {
+  m_obj->compile(c);
+  if (auto *s = dynamic_cast<StringLiteral*>(m_key.get())) {
+    if (!std::isfinite(Value(s->s()).to_number())) {
+      c.emit(bytecode::Op::GET_NAMED, c.cache_index(m_cache), c.constant_index(s->s()), this);
+      return;
+    }
+  }
+  m_key->compile(c);
+  c.emit(bytecode::Op::GET, c.cache_index(m_cache), 0, this);
+}
+
 void Property::dump(std::ostream &out, const std::string &indent) {
   out << indent << "property" << std::endl;
   m_obj->dump(out, indent + "  ");
@@ -832,6 +926,18 @@ void OptionalProperty::resolve(Context &ctx, int l, Imports *imports) {
   m_key->resolve(ctx, l, imports);
 }
 
+void OptionalProperty::compile(bytecode::Compiler &c) {
+  m_obj->compile(c);
+  if (auto *s = dynamic_cast<StringLiteral*>(m_key.get())) {
+    if (!std::isfinite(Value(s->s()).to_number())) {
+      c.emit(bytecode::Op::GET_NAMED_OPT, c.cache_index(m_cache), c.constant_index(s->s()), this);
+      return;
+    }
+  }
+  m_key->compile(c);
+  c.emit(bytecode::Op::GET_OPT, c.cache_index(m_cache), 0, this);
+}
+
 void OptionalProperty::dump(std::ostream &out, const std::string &indent) {
   out << indent << "optional property" << std::endl;
   m_obj->dump(out, indent + "  ");
@@ -903,6 +1009,13 @@ auto Invocation::reduce(Reducer &r) -> Reducer::Value* {
   return r.call(m_func->reduce(r), argv, argc);
 }
 
+void Invocation::compile(bytecode::Compiler &c) {
+  m_func->compile(c);
+  c.emit(bytecode::Op::CALLEE, 0, 0, this);
+  for (const auto &arg : m_argv) arg->compile(c);
+  c.emit(bytecode::Op::CALL, m_argv.size(), 0, this);
+}
+
 void Invocation::dump(std::ostream &out, const std::string &indent) {
   out << indent << "invocation" << std::endl;
   m_func->dump(out, indent + "  ");
@@ -938,6 +1051,15 @@ void OptionalInvocation::resolve(Context &ctx, int l, Imports *imports) {
   }
 }
 
+void OptionalInvocation::compile(bytecode::Compiler &c) {
+  m_func->compile(c);
+  auto j = c.label();
+  c.emit(bytecode::Op::CALLEE_OPT, 0, 0, this);
+  for (const auto &arg : m_argv) arg->compile(c);
+  c.emit(bytecode::Op::CALL, m_argv.size(), 0, this);
+  c.patch(j);
+}
+
 void OptionalInvocation::dump(std::ostream &out, const std::string &indent) {
   out << indent << "optional invocation" << std::endl;
   m_func->dump(out, indent + "  ");
@@ -959,6 +1081,11 @@ void Plus::resolve(Context &ctx, int l, Imports *imports) {
   m_x->resolve(ctx, l, imports);
 }
 
+void Plus::compile(bytecode::Compiler &c) {
+  m_x->compile(c);
+  c.emit(bytecode::Op::POS);
+}
+
 void Plus::dump(std::ostream &out, const std::string &indent) {
   out << indent << "plus" << std::endl;
   m_x->dump(out, indent + "  ");
@@ -979,6 +1106,11 @@ void Negation::resolve(Context &ctx, int l, Imports *imports) {
   m_x->resolve(ctx, l, imports);
 }
 
+void Negation::compile(bytecode::Compiler &c) {
+  m_x->compile(c);
+  c.emit(bytecode::Op::NEG);
+}
+
 void Negation::dump(std::ostream &out, const std::string &indent) {
   out << indent << "negation" << std::endl;
   m_x->dump(out, indent + "  ");
@@ -1011,6 +1143,12 @@ void Addition::resolve(Context &ctx, int l, Imports *imports) {
   m_b->resolve(ctx, l, imports);
 }
 
+void Addition::compile(bytecode::Compiler &c) {
+  m_a->compile(c);
+  m_b->compile(c);
+  c.emit(bytecode::Op::ADD);
+}
+
 void Addition::dump(std::ostream &out, const std::string &indent) {
   out << indent << "addition" << std::endl;
   m_a->dump(out, indent + "  ");
@@ -1036,6 +1174,12 @@ void Subtraction::resolve(Context &ctx, int l, Imports *imports) {
   m_b->resolve(ctx, l, imports);
 }
 
+void Subtraction::compile(bytecode::Compiler &c) {
+  m_a->compile(c);
+  m_b->compile(c);
+  c.emit(bytecode::Op::SUB);
+}
+
 void Subtraction::dump(std::ostream &out, const std::string &indent) {
   out << indent << "subtraction" << std::endl;
   m_a->dump(out, indent + "  ");
@@ -1061,6 +1205,12 @@ void Multiplication::resolve(Context &ctx, int l, Imports *imports) {
   m_b->resolve(ctx, l, imports);
 }
 
+void Multiplication::compile(bytecode::Compiler &c) {
+  m_a->compile(c);
+  m_b->compile(c);
+  c.emit(bytecode::Op::MUL);
+}
+
 void Multiplication::dump(std::ostream &out, const std::string &indent) {
   out << indent << "multiplication" << std::endl;
   m_a->dump(out, indent + "  ");
@@ -1086,6 +1236,12 @@ void Division::resolve(Context &ctx, int l, Imports *imports) {
   m_b->resolve(ctx, l, imports);
 }
 
+void Division::compile(bytecode::Compiler &c) {
+  m_a->compile(c);
+  m_b->compile(c);
+  c.emit(bytecode::Op::DIV);
+}
+
 void Division::dump(std::ostream &out, const std::string &indent) {
   out << indent << "division" << std::endl;
   m_a->dump(out, indent + "  ");
@@ -1111,6 +1267,12 @@ void Remainder::resolve(Context &ctx, int l, Imports *imports) {
   m_b->resolve(ctx, l, imports);
 }
 
+void Remainder::compile(bytecode::Compiler &c) {
+  m_a->compile(c);
+  m_b->compile(c);
+  c.emit(bytecode::Op::REM);
+}
+
 void Remainder::dump(std::ostream &out, const std::string &indent) {
   out << indent << "remainder" << std::endl;
   m_a->dump(out, indent + "  ");
@@ -1136,6 +1298,12 @@ void Exponentiation::resolve(Context &ctx, int l, Imports *imports) {
   m_b->resolve(ctx, l, imports);
 }
 
+void Exponentiation::compile(bytecode::Compiler &c) {
+  m_a->compile(c);
+  m_b->compile(c);
+  c.emit(bytecode::Op::POW);
+}
+
 void Exponentiation::dump(std::ostream &out, const std::string &indent) {
   out << indent << "exponentiation" << std::endl;
   m_a->dump(out, indent + "  ");
@@ -1161,6 +1329,12 @@ void ShiftLeft::resolve(Context &ctx, int l, Imports *imports) {
   m_b->resolve(ctx, l, imports);
 }
 
+void ShiftLeft::compile(bytecode::Compiler &c) {
+  m_a->compile(c);
+  m_b->compile(c);
+  c.emit(bytecode::Op::SHL);
+}
+
 void ShiftLeft::dump(std::ostream &out, const std::string &indent) {
   out << indent << "shift left" << std::endl;
   m_a->dump(out, indent + "  ");
@@ -1186,6 +1360,12 @@ void ShiftRight::resolve(Context &ctx, int l, Imports *imports) {
   m_b->resolve(ctx, l, imports);
 }
 
+void ShiftRight::compile(bytecode::Compiler &c) {
+  m_a->compile(c);
+  m_b->compile(c);
+  c.emit(bytecode::Op::SHR);
+}
+
 void ShiftRight::dump(std::ostream &out, const std::string &indent) {
   out << indent << "shift right" << std::endl;
   m_a->dump(out, indent + "  ");
@@ -1211,6 +1391,12 @@ void UnsignedShiftRight::resolve(Context &ctx, int l, Imports *imports) {
   m_b->resolve(ctx, l, imports);
 }
 
+void UnsignedShiftRight::compile(bytecode::Compiler &c) {
+  m_a->compile(c);
+  m_b->compile(c);
+  c.emit(bytecode::Op::USR);
+}
+
 void UnsignedShiftRight::dump(std::ostream &out, const std::string &indent) {
   out << indent << "unsigned shift right" << std::endl;
   m_a->dump(out, indent + "  ");
@@ -1232,6 +1418,11 @@ void BitwiseNot::resolve(Context &ctx, int l, Imports *imports) {
   m_x->resolve(ctx, l, imports);
 }
 
+void BitwiseNot::compile(bytecode::Compiler &c) {
+  m_x->compile(c);
+  c.emit(bytecode::Op::BIT_NOT);
+}
+
 void BitwiseNot::dump(std::ostream &out, const std::string &indent) {
   out << indent << "bitwise not" << std::endl;
   m_x->dump(out, indent + "  ");
@@ -1256,6 +1447,12 @@ void BitwiseAnd::resolve(Context &ctx, int l, Imports *imports) {
   m_b->resolve(ctx, l, imports);
 }
 
+void BitwiseAnd::compile(bytecode::Compiler &c) {
+  m_a->compile(c);
+  m_b->compile(c);
+  c.emit(bytecode::Op::BIT_AND);
+}
+
 void BitwiseAnd::dump(std::ostream &out, const std::string &indent) {
   out << indent << "bitwise and" << std::endl;
   m_a->dump(out, indent + "  ");
@@ -1281,6 +1478,12 @@ void BitwiseOr::resolve(Context &ctx, int l, Imports *imports) {
   m_b->resolve(ctx, l, imports);
 }
 
+void BitwiseOr::compile(bytecode::Compiler &c) {
+  m_a->compile(c);
+  m_b->compile(c);
+  c.emit(bytecode::Op::BIT_OR);
+}
+
 void BitwiseOr::dump(std::ostream &out, const std::string &indent) {
   out << indent << "bitwise or" << std::endl;
   m_a->dump(out, indent + "  ");
@@ -1306,6 +1509,12 @@ void BitwiseXor::resolve(Context &ctx, int l, Imports *imports) {
   m_b->resolve(ctx, l, imports);
 }
 
+void BitwiseXor::compile(bytecode::Compiler &c) {
+  m_a->compile(c);
+  m_b->compile(c);
+  c.emit(bytecode::Op::BIT_XOR);
+}
+
 void BitwiseXor::dump(std::ostream &out, const std::string &indent) {
   out << indent << "bitwise xor" << std::endl;
   m_a->dump(out, indent + "  ");
@@ -1327,6 +1536,11 @@ void LogicalNot::resolve(Context &ctx, int l, Imports *imports) {
   m_x->resolve(ctx, l, imports);
 }
 
+void LogicalNot::compile(bytecode::Compiler &c) {
+  m_x->compile(c);
+  c.emit(bytecode::Op::NOT);
+}
+
 void LogicalNot::dump(std::ostream &out, const std::string &indent) {
   out << indent << "logical not" << std::endl;
   m_x->dump(out, indent + "  ");
@@ -1348,6 +1562,14 @@ void LogicalAnd::resolve(Context &ctx, int l, Imports *imports) {
   m_b->resolve(ctx, l, imports);
 }
 
+void LogicalAnd::compile(bytecode::Compiler &c) {
+  m_a->compile(c);
+  auto j = c.label();
+  c.emit(bytecode::Op::AND);
+  m_b->compile(c);
+  c.patch(j);
+}
+
 void LogicalAnd::dump(std::ostream &out, const std::string &indent) {
   out << indent << "logical and" << std::endl;
   m_a->dump(out, indent + "  ");
@@ -1370,6 +1592,14 @@ void LogicalOr::resolve(Context &ctx, int l, Imports *imports) {
   m_b->resolve(ctx, l, imports);
 }
 
+void LogicalOr::compile(bytecode::Compiler &c) {
+  m_a->compile(c);
+  auto j = c.label();
+  c.emit(bytecode::Op::OR);
+  m_b->compile(c);
+  c.patch(j);
+}
+
 void LogicalOr::dump(std::ostream &out, const std::string &indent) {
   out << indent << "logical or" << std::endl;
   m_a->dump(out, indent + "  ");
@@ -1392,6 +1622,14 @@ void NullishCoalescing::resolve(Context &ctx, int l, Imports *imports) {
   m_b->resolve(ctx, l, imports);
 }
 
+void NullishCoalescing::compile(bytecode::Compiler &c) {
+  m_a->compile(c);
+  auto j = c.label();
+  c.emit(bytecode::Op::NULL_OR);
+  m_b->compile(c);
+  c.patch(j);
+}
+
 void NullishCoalescing::dump(std::ostream &out, const std::string &indent) {
   out << indent << "nullish coalescing" << std::endl;
   m_a->dump(out, indent + "  ");
@@ -1415,6 +1653,12 @@ void Equality::resolve(Context &ctx, int l, Imports *imports) {
   m_b->resolve(ctx, l, imports);
 }
 
+void Equality::compile(bytecode::Compiler &c) {
+  m_a->compile(c);
+  m_b->compile(c);
+  c.emit(bytecode::Op::EQL);
+}
+
 void Equality::dump(std::ostream &out, const std::string &indent) {
   out << indent << "equality" << std::endl;
   m_a->dump(out, indent + "  ");
@@ -1438,6 +1682,12 @@ void Inequality::resolve(Context &ctx, int l, Imports *imports) {
   m_b->resolve(ctx, l, imports);
 }
 
+void Inequality::compile(bytecode::Compiler &c) {
+  m_a->compile(c);
+  m_b->compile(c);
+  c.emit(bytecode::Op::NEQ);
+}
+
 void Inequality::dump(std::ostream &out, const std::string &indent) {
   out << indent << "inequality" << std::endl;
   m_a->dump(out, indent + "  ");
@@ -1461,6 +1711,12 @@ void Identity::resolve(Context &ctx, int l, Imports *imports) {
   m_b->resolve(ctx, l, imports);
 }
 
+void Identity::compile(bytecode::Compiler &c) {
+  m_a->compile(c);
+  m_b->compile(c);
+  c.emit(bytecode::Op::SAME);
+}
+
 void Identity::dump(std::ostream &out, const std::string &indent) {
   out << indent << "identity" << std::endl;
   m_a->dump(out, indent + "  ");
@@ -1484,6 +1740,12 @@ void Nonidentity::resolve(Context &ctx, int l, Imports *imports) {
   m_b->resolve(ctx, l, imports);
 }
 
+void Nonidentity::compile(bytecode::Compiler &c) {
+  m_a->compile(c);
+  m_b->compile(c);
+  c.emit(bytecode::Op::DIFF);
+}
+
 void Nonidentity::dump(std::ostream &out, const std::string &indent) {
   out << indent << "nonidentity" << std::endl;
   m_a->dump(out, indent + "  ");
@@ -1515,6 +1777,12 @@ void GreaterThan::resolve(Context &ctx, int l, Imports *imports) {
   m_b->resolve(ctx, l, imports);
 }
 
+void GreaterThan::compile(bytecode::Compiler &c) {
+  m_a->compile(c);
+  m_b->compile(c);
+  c.emit(bytecode::Op::GT);
+}
+
 void GreaterThan::dump(std::ostream &out, const std::string &indent) {
   out << indent << "greater than" << std::endl;
   m_a->dump(out, indent + "  ");
@@ -1546,6 +1814,12 @@ void GreaterThanOrEqual::resolve(Context &ctx, int l, Imports *imports) {
   m_b->resolve(ctx, l, imports);
 }
 
+void GreaterThanOrEqual::compile(bytecode::Compiler &c) {
+  m_a->compile(c);
+  m_b->compile(c);
+  c.emit(bytecode::Op::GE);
+}
+
 void GreaterThanOrEqual::dump(std::ostream &out, const std::string &indent) {
   out << indent << "greater than or equal" << std::endl;
   m_a->dump(out, indent + "  ");
@@ -1577,6 +1851,12 @@ void LessThan::resolve(Context &ctx, int l, Imports *imports) {
   m_b->resolve(ctx, l, imports);
 }
 
+void LessThan::compile(bytecode::Compiler &c) {
+  m_a->compile(c);
+  m_b->compile(c);
+  c.emit(bytecode::Op::LT);
+}
+
 void LessThan::dump(std::ostream &out, const std::string &indent) {
   out << indent << "less than" << std::endl;
   m_a->dump(out, indent + "  ");
@@ -1608,6 +1888,12 @@ void LessThanOrEqual::resolve(Context &ctx, int l, Imports *imports) {
   m_b->resolve(ctx, l, imports);
 }
 
+void LessThanOrEqual::compile(bytecode::Compiler &c) {
+  m_a->compile(c);
+  m_b->compile(c);
+  c.emit(bytecode::Op::LE);
+}
+
 void LessThanOrEqual::dump(std::ostream &out, const std::string &indent) {
   out << indent << "less than or equal" << std::endl;
   m_a->dump(out, indent + "  ");
@@ -2229,6 +2515,19 @@ void Conditional::resolve(Context &ctx, int l, Imports *imports) {
   m_c->resolve(ctx, l, imports);
 }
 
+void Conditional::compile(bytecode::Compiler &c) {
+  m_a->compile(c);
+  auto j1 = c.label();
+  c.emit(bytecode::Op::JUMP_IF_NOT);
+  m_b->compile(c);
+  auto j2 = c.label();
+  c.emit(bytecode::Op::JUMP);
+  c.adjust(-1);
+  c.patch(j1);
+  m_c->compile(c);
+  c.patch(j2);
+}
+
 void Conditional::dump(std::ostream &out, const std::string &indent) {
   out << indent << "conditional" << std::endl;
   m_a->dump(out, indent + "  ");
@@ -2236,6 +2535,45 @@ void Conditional::dump(std::ostream &out, const std::string &indent) {
   m_c->dump(out, indent + "  ");
 }
 
+//
+// Compiled
+//
+
+auto Compiled::compile(Expr *expr) -> Expr* {
+  if (dynamic_cast<Compiled*>(expr)) return expr;
+  auto *compiled = new Compiled(expr);
+  if (compiled->m_trivial) {
+    compiled->m_expr.release();
+    delete compiled;
+    return expr;
+  }
+  compiled->locate(expr->source(), expr->line(), expr->column());
+  return compiled;
+}
+
+Compiled::Compiled(Expr *expr) : m_expr(expr) {
+  bytecode::Compiler c(m_program);
+  expr->compile(c);
+  m_trivial = c.is_trivial();
+}
+
+bool Compiled::eval(Context &ctx, Value &result) {
+  return m_program.run(ctx, result);
+}
+
+void Compiled::resolve(Context &ctx, int l, Imports *imports) {
+  m_expr->resolve(ctx, l, imports);
+}
+
+auto Compiled::reduce(Reducer &r) -> Reducer::Value* {
+  return m_expr->reduce(r);
+}
+
+void Compiled::dump(std::ostream &out, const std::string &indent) {
+  out << indent << "compiled" << std::endl;
+  m_program.dump(out, indent + "  ");
+}
+
 } // namespace expr
 
 } // namespace pjs
@@ -28,8 +28,10 @@
 
 #include "types.hpp"
 #include "builtin.hpp"
+#include "bytecode.hpp"
 
 #include <cmath>
+#include <functional>
 #include <string>
 #include <initializer_list>
 #include <iostream>
@@ -180,6 +182,7 @@ public:
   virtual void resolve(Context &ctx, int l = -1, Imports *imports = nullptr) {}
   virtual auto reduce(Reducer &r) -> Reducer::Value* { return r.undefined(); }
   virtual auto reduce_lval(Reducer &r, Reducer::Value *rval) -> Reducer::Value* { return r.undefined(); }
+  virtual void compile(bytecode::Compiler &c) { c.fallback(this); }
   virtual void dump(std::ostream &out, const std::string &indent = "") = 0;
 
   //
@@ -209,6 +212,32 @@ private:
   int m_column = 0;
 };
 
+//
+// CacheSite
+//
+
+class CacheSite {
+public:
+  CacheSite(Expr *expr, PropertyCache &cache);
+  ~CacheSite();
+
+  auto expr() const -> Expr* { return m_expr; }
+  auto cache() const -> const PropertyCache& { return m_cache; }
+
+  static void for_each(const std::function<void(CacheSite*)> &cb);
+  static auto removed() -> uint64_t { return s_removed; }
+
+private:
+  Expr* m_expr;
+  PropertyCache& m_cache;
+  CacheSite** m_list;
+  CacheSite* m_prev = nullptr;
+  CacheSite* m_next;
+
+  thread_local static CacheSite* s_all;
+  thread_local static uint64_t s_removed;
+};
+
 namespace expr {
 
 //
@@ -221,6 +250,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -262,6 +292,7 @@ public:
   virtual bool eval(Context &ctx, Value &result) override;
   virtual auto reduce(Reducer &r) -> Reducer::Value* override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -294,6 +325,7 @@ class Undefined : public Expr {
 public:
   virtual bool eval(Context &ctx, Value &result) override;
   virtual auto reduce(Reducer &r) -> Reducer::Value* override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 };
 
@@ -305,6 +337,7 @@ class Null : public Expr {
 public:
   virtual bool eval(Context &ctx, Value &result) override;
   virtual auto reduce(Reducer &r) -> Reducer::Value* override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 };
 
@@ -318,6 +351,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual auto reduce(Reducer &r) -> Reducer::Value* override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -334,6 +368,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual auto reduce(Reducer &r) -> Reducer::Value* override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -352,6 +387,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual auto reduce(Reducer &r) -> Reducer::Value* override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -470,6 +506,7 @@ public:
 private:
   Ref<Str> m_key;
   PropertyCache m_cache;
+  CacheSite m_site{this, m_cache};
 };
 
 //
@@ -491,6 +528,7 @@ private:
   int m_l = -1;
   Ref<Str> m_key;
   PropertyCache m_cache;
+  CacheSite m_site{this, m_cache};
 };
 
 //
@@ -505,6 +543,7 @@ public:
   virtual bool eval(Context &ctx, Value &result) override;
   virtual bool assign(Context &ctx, Value &value) override;
   virtual bool clear(Context &ctx, Value &result) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -534,6 +573,7 @@ public:
   virtual bool clear(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
   virtual auto reduce(Reducer &r) -> Reducer::Value* override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -564,12 +604,14 @@ public:
   virtual bool clear(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
   virtual auto reduce(Reducer &r) -> Reducer::Value* override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
   std::unique_ptr<Expr> m_obj;
   std::unique_ptr<Expr> m_key;
   PropertyCache m_cache;
+  CacheSite m_site{this, m_cache};
 };
 
 //
@@ -582,12 +624,14 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
   std::unique_ptr<Expr> m_obj;
   std::unique_ptr<Expr> m_key;
   PropertyCache m_cache;
+  CacheSite m_site{this, m_cache};
 };
 
 //
@@ -632,6 +676,7 @@ public:
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
   virtual auto reduce(Reducer &r) -> Reducer::Value* override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -655,6 +700,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -672,6 +718,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -688,6 +735,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -704,6 +752,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -721,6 +770,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -738,6 +788,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -755,6 +806,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -772,6 +824,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -789,6 +842,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -806,6 +860,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -823,6 +878,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -840,6 +896,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -857,6 +914,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -873,6 +931,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -890,6 +949,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -907,6 +967,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -924,6 +985,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -940,6 +1002,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -957,6 +1020,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -974,6 +1038,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -991,6 +1056,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -1008,6 +1074,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -1025,6 +1092,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -1042,6 +1110,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -1059,6 +1128,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -1076,6 +1146,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -1093,6 +1164,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -1110,6 +1182,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -1544,6 +1617,7 @@ public:
 
   virtual bool eval(Context &ctx, Value &result) override;
   virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual void compile(bytecode::Compiler &c) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
 private:
@@ -1552,6 +1626,27 @@ private:
   std::unique_ptr<Expr> m_c;
 };
 
+//
+// Compiled
+//
+
+class Compiled : public Expr {
+public:
+  static auto compile(Expr *expr) -> Expr*;
+
+  virtual bool eval(Context &ctx, Value &result) override;
+  virtual void resolve(Context &ctx, int l, Imports *imports) override;
+  virtual auto reduce(Reducer &r) -> Reducer::Value* override;
+  virtual void dump(std::ostream &out, const std::string &indent) override;
+
+private:
+  Compiled(Expr *expr);
+
+  std::unique_ptr<Expr> m_expr;
+  bytecode::Program m_program;
+  bool m_trivial;
+};
+
 } // namespace expr
 
 //
@@ -26,9 +26,11 @@
 #include "parser.hpp"
 #include "expr.hpp"
 
+#include <cstring>
 #include <map>
 #include <mutex>
 #include <stack>
+#include <vector>
 
 namespace pjs {
 
@@ -97,19 +99,44 @@ public:
     }
   }
 
+  struct TokenData {
+    double n;
+    std::string s;
+  };
+
   static void clear() {
     s_tokens.resize(1);
     s_number_map.clear();
     s_string_map.clear();
+    s_table = &s_tokens;
+  }
+
+  //
+  // Takes out all values collected so far
+  //
+
+  static auto take() -> std::vector<TokenData> {
+    std::vector<TokenData> values;
+    values.swap(s_tokens);
+    clear();
+    return values;
+  }
+
+  //
+  // Looks up values in a table collected earlier, maybe by another thread
+  //
+
+  static void use(const std::vector<TokenData> *table) {
+    s_table = table;
   }
 
   auto id() const -> int { return m_id; }
   bool is_eof() const { return !m_id; }
   bool is_operator() const { return m_id & OPERATOR_BIT; }
-  bool is_number() const { return !(m_id & OPERATOR_BIT) && std::isnan(s_tokens[m_id].n) == false; }
-  bool is_string() const { return !(m_id & OPERATOR_BIT) && std::isnan(s_tokens[m_id].n) == true; }
-  auto n() const -> double { return s_tokens[m_id].n; }
-  auto s() const -> const std::string& { return s_tokens[m_id].s; }
+  bool is_number() const { return !(m_id & OPERATOR_BIT) && std::isnan((*s_table)[m_id].n) == false; }
+  bool is_string() const { return !(m_id & OPERATOR_BIT) && std::isnan((*s_table)[m_id].n) == true; }
+  auto n() const -> double { return (*s_table)[m_id].n; }
+  auto s() const -> const std::string& { return (*s_table)[m_id].s; }
 
   bool operator==(const Token &r) const { return m_id == r.m_id; }
   bool operator!=(const Token &r) const { return m_id != r.m_id; }
@@ -127,21 +154,17 @@ public:
       s[3] = std::toupper((m_id >> 24) & 0x7f);
       return std::string(s);
     } else if (is_number()) {
-      return std::to_string(s_tokens[m_id].n);
+      return std::to_string((*s_table)[m_id].n);
     } else {
-      return s_tokens[m_id].s;
+      return (*s_table)[m_id].s;
     }
   }
 
 private:
   int m_id;
 
-  struct TokenData {
-    double n;
-    std::string s;
-  };
-
   thread_local static std::vector<TokenData> s_tokens;
+  thread_local static const std::vector<TokenData>* s_table;
   thread_local static std::map<double, int> s_number_map;
   thread_local static std::map<std::string, int> s_string_map;
 };
@@ -149,9 +172,25 @@ private:
 const Token Token::eof(0);
 const Token Token::err(-1);
 thread_local std::vector<Token::TokenData> Token::s_tokens(1);
+thread_local const std::vector<Token::TokenData>* Token::s_table(&Token::s_tokens);
 thread_local std::map<double, int> Token::s_number_map;
 thread_local std::map<std::string, int> Token::s_string_map;
 
+//
+// Parser::Tokens
+//
+
+class Parser::Tokens {
+public:
+  struct Entry {
+    int id;
+    Location location;
+  };
+
+  std::vector<Entry> entries;
+  std::vector<Token::TokenData> values;
+};
+
 //
 // Tokenizer
 //
@@ -162,9 +201,18 @@ public:
     init_operator_map();
   }
 
+  //
+  // Replays tokens lexed in advance instead of reading a script
+  //
+
+  Tokenizer(const Parser::Tokens *tokens) : m_tokens(tokens), m_token(0) {
+    init_operator_map();
+  }
+
   void set_template_mode(bool b) { m_is_template = b; }
 
   bool eof() const {
+    if (m_tokens) return m_ptr >= m_tokens->entries.size();
     return m_ptr >= m_script.length();
   }
 
@@ -184,6 +232,21 @@ public:
     return m_token;
   }
 
+  //
+  // Changes whenever operators or keywords are added, removed or
+  // renumbered, all of which change what a token id stands for
+  //
+
+  static auto signature() -> uint64_t {
+    init_operator_map();
+    uint64_t h = 14695981039346656037ull;
+    for (const auto &p : s_operator_map) {
+      for (auto c : p.first) h = (h ^ uint8_t(c)) * 1099511628211ull;
+      for (int i = 0; i < 32; i += 8) h = (h ^ uint8_t(p.second >> i)) * 1099511628211ull;
+    }
+    return h;
+  }
+
   static bool is_identifier_name(const Token &tok, std::string &str) {
     auto i = s_identifier_names.find(tok.id());
     if (i == s_identifier_names.end()) return false;
@@ -198,6 +261,7 @@ private:
   static void init_operator_map();
 
   std::string m_script;
+  const Parser::Tokens* m_tokens = nullptr;
   size_t m_ptr = 0;
   Location m_loc;
   Location m_token_loc;
@@ -301,6 +365,14 @@ void Tokenizer::init_operator_map() {
 
 auto Tokenizer::parse(Location &loc) -> Token {
 
+  // Replay tokens lexed in advance, repeating the last one at the end
+  if (m_tokens) {
+    auto &entries = m_tokens->entries;
+    auto &e = entries[m_ptr < entries.size() ? m_ptr++ : entries.size() - 1];
+    loc = e.location;
+    return Token(e.id);
+  }
+
   // Parse template strings
   if (m_is_template) {
     auto c = get();
@@ -698,6 +770,7 @@ private:
 class ExpressionParser {
 public:
   ExpressionParser(const Source *source);
+  ExpressionParser(const Source *source, const Parser::Tokens *tokens);
 
   auto parse(
     std::string &error,
@@ -852,6 +925,12 @@ ExpressionParser::ExpressionParser(const Source *source)
 {
 }
 
+ExpressionParser::ExpressionParser(const Source *source, const Parser::Tokens *tokens)
+  : m_source(source)
+  , m_tokenizer(tokens)
+{
+}
+
 auto ExpressionParser::parse(
   std::string &error,
   int &error_line,
@@ -1401,6 +1480,143 @@ Expr* ExpressionParser::operand() {
 //
 // Parser
 //
+// Lexing ahead has to switch in and out of template mode by itself,
+// the same way the parser would when it sees a template string.
+// Each open template string or template expression is on a stack,
+// where a template expression keeps count of its open braces so as
+// to know which closing brace goes back to the template string.
+//
+
+auto Parser::lex(const Source *source) -> std::shared_ptr<const Tokens> {
+  Token::clear();
+  Tokenizer tokenizer(source->content);
+  auto tokens = std::make_shared<Tokens>();
+  std::vector<int> stack;
+  stack.push_back(0);
+  for (;;) {
+    auto in_template = (stack.back() < 0);
+    tokenizer.set_template_mode(in_template);
+    Location loc;
+    auto t = tokenizer.read(loc);
+    tokens->entries.push_back({ t.id(), loc });
+    if (t == Token::eof || t == Token::err) break;
+    if (in_template) {
+      if (t.id() == Token::OPR("`")) {
+        stack.pop_back();
+      } else if (t.id() == Token::OPR("${")) {
+        stack.push_back(0);
+      }
+    } else {
+      switch (t.id()) {
+        case Token::OPR("`"): stack.push_back(-1); break;
+        case Token::OPR("{"): stack.back()++; break;
+        case Token::OPR("}"):
+          if (stack.back() > 0) {
+            stack.back()--;
+          } else if (stack.size() > 1) {
+            stack.pop_back();
+          }
+          break;
+      }
+    }
+  }
+  tokens->values = Token::take();
+  return tokens;
+}
+
+//
+// Encoded tokens are only meant to be read back by the same build on
+// the same kind of machine, so numbers are written as they are in memory,
+// after a header that has to match exactly. The header names the build
+// given by the caller and carries a signature of the operator and keyword
+// table, so tokens from another build are rejected even when the format
+// number hasn't been bumped. Anything that doesn't look right when
+// decoding makes the whole thing rejected, never half-read.
+//
+
+static const char s_tokens_magic[] = { 'P', 'J', 'S', 'T' };
+static const uint32_t s_tokens_format = 1;
+static const uint32_t s_tokens_byte_order = 0x01020304;
+
+template<class T>
+static void write(std::string &out, const T &v) {
+  out.append((const char *)&v, sizeof(v));
+}
+
+template<class T>
+static bool read(const std::string &in, size_t &ptr, T &v) {
+  if (ptr + sizeof(v) > in.size()) return false;
+  std::memcpy(&v, in.data() + ptr, sizeof(v));
+  ptr += sizeof(v);
+  return true;
+}
+
+void Parser::encode(const Tokens *tokens, const std::string &build, std::string &out) {
+  out.append(s_tokens_magic, sizeof(s_tokens_magic));
+  write(out, s_tokens_format);
+  write(out, s_tokens_byte_order);
+  write(out, Tokenizer::signature());
+  write(out, uint32_t(build.size()));
+  out.append(build);
+  write(out, uint32_t(tokens->entries.size()));
+  for (const auto &e : tokens->entries) {
+    write(out, int32_t(e.id));
+    write(out, int32_t(e.location.position));
+    write(out, int32_t(e.location.line));
+    write(out, int32_t(e.location.column));
+  }
+  write(out, uint32_t(tokens->values.size()));
+  for (const auto &v : tokens->values) {
+    write(out, v.n);
+    write(out, uint32_t(v.s.size()));
+    out.append(v.s);
+  }
+}
+
+auto Parser::decode(const std::string &in, const std::string &build) -> std::shared_ptr<const Tokens> {
+  size_t ptr = sizeof(s_tokens_magic);
+  uint32_t format, byte_order, build_size, n;
+  uint64_t signature;
+  if (in.compare(0, ptr, s_tokens_magic, ptr)) return nullptr;
+  if (!read(in, ptr, format) || format != s_tokens_format) return nullptr;
+  if (!read(in, ptr, byte_order) || byte_order != s_tokens_byte_order) return nullptr;
+  if (!read(in, ptr, signature) || signature != Tokenizer::signature()) return nullptr;
+  if (!read(in, ptr, build_size) || build_size != build.size()) return nullptr;
+  if (in.compare(ptr, build_size, build)) return nullptr;
+  ptr += build_size;
+  if (!read(in, ptr, n) || n == 0 || n > in.size()) return nullptr;
+
+  auto tokens = std::make_shared<Tokens>();
+  tokens->entries.resize(n);
+  for (auto &e : tokens->entries) {
+    int32_t id, position, line, column;
+    if (!read(in, ptr, id)) return nullptr;
+    if (!read(in, ptr, position)) return nullptr;
+    if (!read(in, ptr, line)) return nullptr;
+    if (!read(in, ptr, column)) return nullptr;
+    e.id = id;
+    e.location.position = position;
+    e.location.line = line;
+    e.location.column = column;
+  }
+
+  if (!read(in, ptr, n) || n == 0 || n > in.size()) return nullptr;
+  tokens->values.resize(n);
+  for (auto &v : tokens->values) {
+    uint32_t len;
+    if (!read(in, ptr, v.n)) return nullptr;
+    if (!read(in, ptr, len) || ptr + len > in.size()) return nullptr;
+    v.s.assign(in, ptr, len);
+    ptr += len;
+  }
+  if (ptr != in.size()) return nullptr;
+
+  for (const auto &e : tokens->entries) {
+    if (!Token(e.id).is_operator() && size_t(e.id) >= n) return nullptr;
+  }
+
+  return tokens;
+}
 
 auto Parser::parse(
   const Source *source,
@@ -1413,6 +1629,21 @@ auto Parser::parse(
   return parser.parse(error, error_line, error_column);
 }
 
+auto Parser::parse(
+  const Source *source,
+  const Tokens *tokens,
+  std::string &error,
+  int &error_line,
+  int &error_column) -> Expr*
+{
+  Token::clear();
+  Token::use(&tokens->values);
+  ExpressionParser parser(source, tokens);
+  auto expr = parser.parse(error, error_line, error_column);
+  Token::clear();
+  return expr;
+}
+
 auto Parser::tokenize(const std::string &script) -> std::list<std::string> {
   std::list<std::string> tokens;
   Token::clear();
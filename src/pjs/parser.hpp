@@ -28,6 +28,7 @@
 
 #include <initializer_list>
 #include <list>
+#include <memory>
 #include <set>
 #include <string>
 
@@ -38,8 +39,30 @@ class Source;
 
 class Parser {
 public:
+
+  //
+  // Parser::Tokens
+  //
+  // A script lexed in advance. It refers to nothing thread-local,
+  // so once made it can be parsed by any thread any number of times.
+  //
+
+  class Tokens;
+
+  static auto lex(const Source *source) -> std::shared_ptr<const Tokens>;
+  static void encode(const Tokens *tokens, const std::string &build, std::string &out);
+  static auto decode(const std::string &in, const std::string &build) -> std::shared_ptr<const Tokens>;
+
+  static auto parse(
+    const Source *source,
+    std::string &error,
+    int &error_line,
+    int &error_column
+  ) -> Expr*;
+
   static auto parse(
     const Source *source,
+    const Tokens *tokens,
     std::string &error,
     int &error_line,
     int &error_column
@@ -704,6 +704,12 @@ auto Object::values(Object *obj) -> Array* {
   return a;
 }
 
+//
+// PropertyCache
+//
+
+bool PropertyCache::s_stats_enabled = false;
+
 //
 // Boolean
 //
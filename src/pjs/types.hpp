@@ -848,6 +848,23 @@ class Class :
   public Pooled<Class> // TODO: crashes when reload on Ubuntu without being pooled, why?
 {
 public:
+
+  //
+  // Class::HashStorage
+  //
+  // Where objects of a class keep the properties not declared by the
+  // class, when not in the default ordered hash.
+  //
+
+  struct HashStorage {
+    size_t (*size)(const Object *obj);
+    bool (*has)(Object *obj, Str *key);
+    bool (*get)(Object *obj, Str *key, Value &val);
+    void (*set)(Object *obj, Str *key, const Value &val);
+    bool (*erase)(Object *obj, Str *key);
+    bool (*iterate)(Object *obj, const std::function<bool(Str*, Value&)> &callback);
+  };
+
   static auto make(const std::string &name, Class *super, const std::list<Field*> &fields) -> Class* {
     return new Class(name, super, fields);
   }
@@ -869,6 +886,8 @@ public:
   void set_ctor(const std::function<Object*(Context&)> &ctor) { m_ctor = ctor; }
   void set_geti(const std::function<void(Object*, int, Value&)> &geti) { m_geti = geti; }
   void set_seti(const std::function<void(Object*, int, const Value&)> &seti) { m_seti = seti; }
+  void set_hash_storage(const HashStorage *hs) { m_hash_storage = hs; }
+  auto hash_storage() const -> const HashStorage* { return m_hash_storage; }
   bool has_ctor() const { return (bool)m_ctor; }
   bool has_geti() const { return (bool)m_geti; }
   bool has_seti() const { return (bool)m_seti; }
@@ -924,6 +943,7 @@ private:
   std::function<Object*(Context&)> m_ctor;
   std::function<void(Object*, int, Value&)> m_geti;
   std::function<void(Object*, int, const Value&)> m_seti;
+  const HashStorage* m_hash_storage = nullptr;
   std::vector<Ref<Field>> m_fields;
   std::vector<int> m_field_index;
   std::unordered_map<Str*, int> m_field_map;
@@ -963,6 +983,7 @@ public:
         m_c->set_ctor(m_init_data->ctor);
         m_c->set_geti(m_init_data->geti);
         m_c->set_seti(m_init_data->seti);
+        m_c->set_hash_storage(m_init_data->hash_storage);
       }
       delete m_init_data;
       m_init_data = nullptr;
@@ -980,6 +1001,7 @@ private:
   static void ctor(std::function<Object*(Context&)> f = [](Context&) -> Object* { return T::make(); }) { m_init_data->ctor = f; };
   static void geti(std::function<void(Object*, int, Value&)> f) { m_init_data->geti = f; }
   static void seti(std::function<void(Object*, int, const Value&)> f) { m_init_data->seti = f; }
+  static void hash_storage(const Class::HashStorage *hs) { m_init_data->hash_storage = hs; }
 
   static void variable(const std::string &name);
   static void variable(const std::string &name, typename T::Field id, int options = Field::Enumerable | Field::Writable);
@@ -1006,6 +1028,7 @@ private:
     std::function<Object*(Context&)> ctor;
     std::function<void(Object*, int, Value&)> geti;
     std::function<void(Object*, int, const Value&)> seti;
+    const Class::HashStorage* hash_storage = nullptr;
   };
 
   thread_local static Class* m_c;
@@ -1429,8 +1452,9 @@ public:
   bool has(Str *key);
   bool get(Str *key, Value &val);
   void set(Str *key, const Value &val);
-  auto ht_size() const -> size_t { return m_hash ? m_hash->size() : 0; }
-  bool ht_has(Str *key) { return m_hash ? m_hash->has(key) : false; }
+
+  auto ht_size() const -> size_t;
+  bool ht_has(Str *key);
   bool ht_get(Str *key, Value &val);
   void ht_set(Str *key, const Value &val);
   bool ht_delete(Str *key);
@@ -1667,8 +1691,24 @@ inline void Object::set(Str *key, const Value &val) {
   else ht_set(key, val);
 }
 
+//
+// Properties not declared by the class live in an ordered hash, unless
+// the class keeps them in a HashStorage of its own.
+//
+
+inline auto Object::ht_size() const -> size_t {
+  if (auto hs = m_class->hash_storage()) return hs->size(this);
+  return m_hash ? m_hash->size() : 0;
+}
+
+inline bool Object::ht_has(Str *key) {
+  if (auto hs = m_class->hash_storage()) return hs->has(this, key);
+  return m_hash ? m_hash->has(key) : false;
+}
+
 inline bool Object::ht_get(Str *key, Value &val) {
   assert_same_thread(*this);
+  if (auto hs = m_class->hash_storage()) return hs->get(this, key, val);
   if (!m_hash || !m_hash->get(key, val)) {
     val = Value::undefined;
     return false;
@@ -1678,12 +1718,14 @@ inline bool Object::ht_get(Str *key, Value &val) {
 
 inline void Object::ht_set(Str *key, const Value &val) {
   assert_same_thread(*this);
+  if (auto hs = m_class->hash_storage()) return hs->set(this, key, val);
   if (!m_hash) m_hash = OrderedHash<Ref<Str>, Value>::make();
   m_hash->set(key, val);
 }
 
 inline bool Object::ht_delete(Str *key) {
   assert_same_thread(*this);
+  if (auto hs = m_class->hash_storage()) return hs->erase(this, key);
   if (!m_hash) return false;
   return m_hash->erase(key);
 }
@@ -1696,7 +1738,14 @@ inline void Object::iterate_all(const std::function<void(Str*, Value&)> &callbac
       callback(f->name(), m_data->at(i));
     }
   }
-  if (m_hash) {
+  if (auto hs = m_class->hash_storage()) {
+    hs->iterate(
+      this, [&](Str *k, Value &v) {
+        callback(k, v);
+        return true;
+      }
+    );
+  } else if (m_hash) {
     OrderedHash<Ref<Str>, Value>::Iterator iterator(m_hash);
     while (auto *ent = iterator.next()) {
       callback(ent->k, ent->v);
@@ -1719,6 +1768,7 @@ inline bool Object::iterate_while(const std::function<bool(Str*, Value&)> &callb
 
 inline bool Object::iterate_hash(const std::function<bool(Str*, Value&)> &callback) {
   assert_same_thread(*this);
+  if (auto hs = m_class->hash_storage()) return hs->iterate(this, callback);
   if (m_hash) {
     OrderedHash<Ref<Str>, Value>::Iterator iterator(m_hash);
     while (auto *ent = iterator.next()) {
@@ -2372,20 +2422,59 @@ public:
     obj->ht_set(key, val);
   }
 
+  //
+  // Inline cache statistics, only counted when enabled
+  //
+
+  static void set_stats_enabled(bool b) { s_stats_enabled = b; }
+  static bool stats_enabled() { return s_stats_enabled; }
+
+  auto hits() const -> uint64_t { return m_hits; }
+  auto misses() const -> uint64_t { return m_misses; }
+  auto evictions() const -> uint64_t { return m_evictions; }
+  auto shapes() const -> int { return m_size; }
+
 private:
+
+  //
+  // Up to MAX_SHAPES (class, key) pairs are remembered, most recently
+  // missed first, so that sites seeing a few different receiver classes
+  // still hit. Sites that keep evicting are megamorphic.
+  //
+
+  static const int MAX_SHAPES = 4;
+
+  struct Shape {
+    Ref<Class> type;
+    Ref<Str> key;
+    int index = -1;
+  };
+
   Ref<Str> m_const_key;
-  Ref<Str> m_key;
-  Ref<Class> m_class;
-  int m_index = -1;
+  Shape m_shapes[MAX_SHAPES];
+  int m_size = 0;
+  uint64_t m_hits = 0;
+  uint64_t m_misses = 0;
+  uint64_t m_evictions = 0;
+
+  static bool s_stats_enabled;
 
   int find(Class *type, Str *key) {
-    auto i = m_index;
-    if (type != m_class || key != m_key) {
-      m_class = type;
-      m_key = key;
-      m_index = (i = type->find_field(key));
+    for (int i = 0; i < m_size; i++) {
+      auto &s = m_shapes[i];
+      if (s.type.get() == type && s.key.get() == key) {
+        if (s_stats_enabled) m_hits++;
+        return s.index;
+      }
     }
-    return i;
+    if (s_stats_enabled) m_misses++;
+    if (m_size < MAX_SHAPES) m_size++; else if (s_stats_enabled) m_evictions++;
+    for (int i = m_size - 1; i > 0; i--) m_shapes[i] = std::move(m_shapes[i-1]);
+    auto &s = m_shapes[0];
+    s.type = type;
+    s.key = key;
+    s.index = type->find_field(key);
+    return s.index;
   }
 };
 
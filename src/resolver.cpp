@@ -0,0 +1,806 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "resolver.hpp"
+#include "timer.hpp"
+#include "api/dns.hpp"
+#include "api/stats.hpp"
+#include "utils.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <unordered_map>
+
+#include <ifaddrs.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+namespace pipy {
+
+using tcp = asio::ip::tcp;
+using udp = asio::ip::udp;
+
+thread_local static pjs::ConstStr STR_id("id");
+thread_local static pjs::ConstStr STR_rd("rd");
+thread_local static pjs::ConstStr STR_tc("tc");
+thread_local static pjs::ConstStr STR_rcode("rcode");
+thread_local static pjs::ConstStr STR_question("question");
+thread_local static pjs::ConstStr STR_answer("answer");
+thread_local static pjs::ConstStr STR_authority("authority");
+thread_local static pjs::ConstStr STR_name("name");
+thread_local static pjs::ConstStr STR_type("type");
+thread_local static pjs::ConstStr STR_ttl("ttl");
+thread_local static pjs::ConstStr STR_rdata("rdata");
+thread_local static pjs::ConstStr STR_minimum("minimum");
+thread_local static pjs::ConstStr STR_A("A");
+thread_local static pjs::ConstStr STR_AAAA("AAAA");
+thread_local static pjs::ConstStr STR_SOA("SOA");
+
+thread_local static Data::Producer s_dp("Resolver");
+
+thread_local static pjs::Ref<stats::Counter> s_metric_cache_hit;
+thread_local static pjs::Ref<stats::Counter> s_metric_cache_miss;
+thread_local static pjs::Ref<stats::Histogram> s_metric_resolve_time;
+
+static const int    RCODE_NOERROR = 0;
+static const int    RCODE_NXDOMAIN = 3;
+static const size_t MAX_RESPONSE_SIZE = 4096;
+static const size_t MAX_CACHE_SIZE = 10000;
+static const double RESOLUTION_DELAY = 0.05; // RFC 8305, section 3
+static const double SYSTEM_TTL = 5;
+static const double NEGATIVE_TTL = 5;
+static const double MAX_NEGATIVE_TTL = 300;
+static const double CONFIG_CHECK_INTERVAL = 5;
+
+static const char *RESOLV_CONF_PATH = "/etc/resolv.conf";
+static const char *HOSTS_PATH = "/etc/hosts";
+
+static std::vector<udp::endpoint> s_nameservers;
+
+//
+// Resolver configuration from /etc/resolv.conf and /etc/hosts
+//
+// Loaded again when either file has changed, checked at most once
+// every CONFIG_CHECK_INTERVAL seconds. A query keeps the configuration
+// it started with till it finishes.
+//
+
+struct ResolverConfig {
+  struct Stamp {
+    ino_t ino = 0;
+    off_t size = 0;
+    time_t mtime = 0;
+
+    Stamp() {}
+    Stamp(const char *path) {
+      struct stat st;
+      if (!stat(path, &st)) {
+        ino = st.st_ino;
+        size = st.st_size;
+        mtime = st.st_mtime;
+      }
+    }
+
+    bool operator==(const Stamp &r) const {
+      return ino == r.ino && size == r.size && mtime == r.mtime;
+    }
+  };
+
+  std::vector<udp::endpoint> nameservers;
+  std::unordered_map<std::string, Resolver::Addresses> hosts;
+  Stamp resolv_conf_stamp;
+  Stamp hosts_stamp;
+  bool has_search = false;
+  int ndots = 1;
+  int timeout = 5;
+  int attempts = 2;
+  bool query_a = true;
+  bool query_aaaa = false;
+
+  ResolverConfig()
+    : resolv_conf_stamp(RESOLV_CONF_PATH)
+    , hosts_stamp(HOSTS_PATH)
+  {
+    load_resolv_conf();
+    load_hosts();
+    check_interfaces();
+    if (!s_nameservers.empty()) nameservers = s_nameservers;
+  }
+
+  bool changed() const {
+    return !(Stamp(RESOLV_CONF_PATH) == resolv_conf_stamp && Stamp(HOSTS_PATH) == hosts_stamp);
+  }
+
+  void load_resolv_conf() {
+    std::ifstream fs(RESOLV_CONF_PATH);
+    std::string line;
+    while (std::getline(fs, line)) {
+      std::istringstream ss(line);
+      std::string key, value;
+      if (!(ss >> key) || key[0] == '#' || key[0] == ';') continue;
+      if (key == "nameserver") {
+        if (ss >> value) {
+          asio::error_code ec;
+          auto ip = asio::ip::make_address(value, ec);
+          if (!ec) nameservers.push_back(udp::endpoint(ip, 53));
+        }
+      } else if (key == "search" || key == "domain") {
+        has_search = bool(ss >> value);
+      } else if (key == "options") {
+        while (ss >> value) {
+          if (value.compare(0, 6, "ndots:") == 0) ndots = std::atoi(value.c_str() + 6);
+          else if (value.compare(0, 8, "timeout:") == 0) timeout = std::max(1, std::atoi(value.c_str() + 8));
+          else if (value.compare(0, 9, "attempts:") == 0) attempts = std::max(1, std::atoi(value.c_str() + 9));
+        }
+      }
+    }
+  }
+
+  void load_hosts() {
+    std::ifstream fs(HOSTS_PATH);
+    std::string line;
+    while (std::getline(fs, line)) {
+      auto p = line.find('#');
+      if (p != std::string::npos) line.resize(p);
+      std::istringstream ss(line);
+      std::string ip, name;
+      if (!(ss >> ip)) continue;
+      asio::error_code ec;
+      auto addr = asio::ip::make_address(ip, ec);
+      if (ec) continue;
+      while (ss >> name) {
+        auto &list = hosts[utils::lower(name)];
+        if (std::find(list.begin(), list.end(), addr) == list.end()) {
+          list.push_back(addr);
+        }
+      }
+    }
+  }
+
+  // Same as AI_ADDRCONFIG: only ask for the families
+  // with a non-loopback address configured on this host
+  void check_interfaces() {
+    struct ifaddrs *ifa = nullptr;
+    if (getifaddrs(&ifa)) return;
+    bool has_ipv4 = false, has_ipv6 = false;
+    for (auto *i = ifa; i; i = i->ifa_next) {
+      if (!i->ifa_addr) continue;
+      if (i->ifa_addr->sa_family == AF_INET) {
+        auto *sa = (const struct sockaddr_in *)i->ifa_addr;
+        if ((ntohl(sa->sin_addr.s_addr) >> 24) != 127) has_ipv4 = true;
+      } else if (i->ifa_addr->sa_family == AF_INET6) {
+        auto *sa = (const struct sockaddr_in6 *)i->ifa_addr;
+        if (!IN6_IS_ADDR_LOOPBACK(&sa->sin6_addr) && !IN6_IS_ADDR_LINKLOCAL(&sa->sin6_addr)) has_ipv6 = true;
+      }
+    }
+    freeifaddrs(ifa);
+    query_a = has_ipv4 || !has_ipv6;
+    query_aaaa = has_ipv6;
+  }
+
+  // Names subject to the search list are left to the system resolver
+  bool is_absolute(const std::string &name) const {
+    if (name.empty()) return false;
+    if (name.back() == '.') return true;
+    if (!has_search) return true;
+    return std::count(name.begin(), name.end(), '.') >= ndots;
+  }
+};
+
+static auto resolver_config(bool &reloaded) -> std::shared_ptr<const ResolverConfig> {
+  static std::mutex s_mutex;
+  static std::shared_ptr<const ResolverConfig> s_config;
+  static double s_check_time = 0;
+  std::lock_guard<std::mutex> lock(s_mutex);
+  auto now = utils::now();
+  reloaded = false;
+  if (now >= s_check_time) {
+    s_check_time = now + CONFIG_CHECK_INTERVAL * 1000;
+    if (!s_config) {
+      s_config = std::make_shared<ResolverConfig>();
+    } else if (s_config->changed()) {
+      s_config = std::make_shared<ResolverConfig>();
+      reloaded = true;
+    }
+  }
+  return s_config;
+}
+
+// RFC 8305, section 4: interleave address families, IPv6 first
+static void sort_addresses(Resolver::Addresses &addresses) {
+  Resolver::Addresses v4, v6;
+  for (const auto &a : addresses) {
+    if (std::find(v4.begin(), v4.end(), a) != v4.end()) continue;
+    if (std::find(v6.begin(), v6.end(), a) != v6.end()) continue;
+    (a.is_v6() ? v6 : v4).push_back(a);
+  }
+  addresses.clear();
+  for (size_t i = 0; i < v4.size() || i < v6.size(); i++) {
+    if (i < v6.size()) addresses.push_back(v6[i]);
+    if (i < v4.size()) addresses.push_back(v4[i]);
+  }
+}
+
+//
+// Resolver::Cache
+//
+
+class Resolver::Cache {
+public:
+  static bool find(const std::string &name, std::error_code &ec, Addresses &addresses);
+  static void store(const std::string &name, const std::error_code &ec, const Addresses &addresses, double ttl);
+  static void clear();
+
+private:
+  struct Entry {
+    std::error_code ec;
+    Addresses addresses;
+    double expiration;
+  };
+
+  static std::mutex s_mutex;
+  static std::unordered_map<std::string, Entry> s_entries;
+};
+
+std::mutex Resolver::Cache::s_mutex;
+std::unordered_map<std::string, Resolver::Cache::Entry> Resolver::Cache::s_entries;
+
+bool Resolver::Cache::find(const std::string &name, std::error_code &ec, Addresses &addresses) {
+  std::lock_guard<std::mutex> lock(s_mutex);
+  auto i = s_entries.find(name);
+  if (i == s_entries.end()) return false;
+  if (i->second.expiration <= utils::now()) {
+    s_entries.erase(i);
+    return false;
+  }
+  ec = i->second.ec;
+  addresses = i->second.addresses;
+  return true;
+}
+
+void Resolver::Cache::clear() {
+  std::lock_guard<std::mutex> lock(s_mutex);
+  s_entries.clear();
+}
+
+void Resolver::Cache::store(const std::string &name, const std::error_code &ec, const Addresses &addresses, double ttl) {
+  if (ttl <= 0) return;
+  auto now = utils::now();
+  std::lock_guard<std::mutex> lock(s_mutex);
+  if (s_entries.size() >= MAX_CACHE_SIZE) {
+    for (auto i = s_entries.begin(); i != s_entries.end(); ) {
+      if (i->second.expiration <= now) {
+        i = s_entries.erase(i);
+      } else {
+        i++;
+      }
+    }
+    if (s_entries.size() >= MAX_CACHE_SIZE) {
+      s_entries.clear();
+    }
+  }
+  auto &e = s_entries[name];
+  e.ec = ec;
+  e.addresses = addresses;
+  e.expiration = now + ttl * 1000;
+}
+
+//
+// Resolver::Query
+//
+
+class Resolver::Query : public pjs::RefCount<Query> {
+public:
+  static auto get(const std::string &name, const std::shared_ptr<const ResolverConfig> &config) -> Query*;
+
+  void add(Resolver *waiter) { m_waiters.push(waiter); }
+  void remove(Resolver *waiter) { m_waiters.remove(waiter); }
+
+private:
+  Query(const std::string &name, const std::shared_ptr<const ResolverConfig> &config);
+
+  enum { A, AAAA };
+
+  struct Question {
+    bool asked = false;
+    bool answered = false;
+    int id = 0;
+    int rcode = RCODE_NOERROR;
+    double ttl = 0;
+    Addresses addresses;
+  };
+
+  std::string m_name;
+  std::shared_ptr<const ResolverConfig> m_config;
+  List<Resolver> m_waiters;
+  Question m_questions[2];
+  udp::socket m_socket;
+  tcp::resolver m_system_resolver;
+  Timer m_retry_timer;
+  Timer m_delay_timer;
+  int m_server = 0;
+  int m_attempts = 0;
+  double m_start_time;
+  bool m_notified = false;
+  bool m_finished = false;
+  char m_buffer[MAX_RESPONSE_SIZE];
+
+  void start();
+  void send();
+  void receive();
+  void received(size_t size);
+  void answer(Question &q, pjs::Object *msg, int type);
+  void check();
+  void next_server();
+  void fallback();
+  void notify(const std::error_code &ec, const Addresses &addresses);
+  void finish(const std::error_code &ec, const Addresses &addresses, double ttl);
+
+  thread_local static std::unordered_map<std::string, Query*> s_queries;
+
+  friend class pjs::RefCount<Query>;
+};
+
+thread_local std::unordered_map<std::string, Resolver::Query*> Resolver::Query::s_queries;
+
+auto Resolver::Query::get(const std::string &name, const std::shared_ptr<const ResolverConfig> &config) -> Query* {
+  auto &q = s_queries[name];
+  if (!q) {
+    q = new Query(name, config);
+    q->retain();
+    q->start();
+  }
+  return q;
+}
+
+Resolver::Query::Query(const std::string &name, const std::shared_ptr<const ResolverConfig> &config)
+  : m_name(name)
+  , m_config(config)
+  , m_socket(Net::context())
+  , m_system_resolver(Net::context())
+  , m_start_time(utils::now())
+{
+  m_questions[A].asked = m_config->query_a;
+  m_questions[AAAA].asked = m_config->query_aaaa;
+}
+
+void Resolver::Query::start() {
+  const auto &conf = *m_config;
+  if (conf.nameservers.empty() || !conf.is_absolute(m_name)) {
+    fallback();
+  } else {
+    send();
+  }
+}
+
+void Resolver::Query::send() {
+  const auto &conf = *m_config;
+  const auto &server = conf.nameservers[m_server];
+
+  std::error_code ec;
+  m_socket.close(ec);
+  m_socket.open(server.protocol(), ec);
+  if (!ec) m_socket.connect(server, ec);
+  if (ec) {
+    next_server();
+    return;
+  }
+
+  thread_local static std::minstd_rand s_rand(std::random_device{}());
+
+  for (int i = 0; i < 2; i++) {
+    auto &q = m_questions[i];
+    if (!q.asked || q.answered) continue;
+    q.id = s_rand() & 0xffff;
+
+    pjs::Ref<pjs::Object> question(pjs::Object::make());
+    question->set(STR_name, pjs::Str::make(m_name));
+    question->set(STR_type, i == A ? STR_A.get() : STR_AAAA.get());
+    pjs::Ref<pjs::Array> questions(pjs::Array::make());
+    questions->push(question.get());
+    pjs::Ref<pjs::Object> msg(pjs::Object::make());
+    msg->set(STR_id, q.id);
+    msg->set(STR_rd, 1);
+    msg->set(STR_question, questions.get());
+
+    Data buf;
+    try {
+      Data::Builder db(buf, &s_dp);
+      DNS::encode(msg, db);
+      db.flush();
+    } catch (std::runtime_error &err) {
+      fallback();
+      return;
+    }
+
+    m_socket.send(DataChunks(buf.chunks()), 0, ec);
+    if (ec) {
+      next_server();
+      return;
+    }
+  }
+
+  receive();
+
+  pjs::Ref<Query> self(this);
+  m_retry_timer.schedule(
+    conf.timeout,
+    [=]() {
+      self->next_server();
+    }
+  );
+}
+
+void Resolver::Query::receive() {
+  pjs::Ref<Query> self(this);
+  m_socket.async_receive(
+    asio::buffer(m_buffer, sizeof(m_buffer)),
+    [=](const std::error_code &ec, size_t n) {
+      if (ec != asio::error::operation_aborted && !self->m_finished) {
+        if (ec) {
+          self->next_server();
+        } else {
+          self->received(n);
+        }
+      }
+    }
+  );
+}
+
+void Resolver::Query::received(size_t size) {
+  pjs::Ref<pjs::Object> msg;
+  try {
+    Data data(m_buffer, size, &s_dp);
+    msg = DNS::decode(data);
+  } catch (std::runtime_error &err) {
+    receive();
+    return;
+  }
+
+  pjs::Value id, tc, rcode;
+  msg->get(STR_id, id);
+  msg->get(STR_tc, tc);
+  msg->get(STR_rcode, rcode);
+
+  for (int i = 0; i < 2; i++) {
+    auto &q = m_questions[i];
+    if (!q.asked || q.answered || q.id != int(id.to_number())) continue;
+    if (tc.to_boolean()) {
+      fallback();
+      return;
+    }
+    auto code = rcode.is_undefined() ? RCODE_NOERROR : int(rcode.to_number());
+    if (code != RCODE_NOERROR && code != RCODE_NXDOMAIN) {
+      next_server();
+      return;
+    }
+    q.rcode = code;
+    answer(q, msg, i);
+    check();
+    if (m_finished) return;
+    break;
+  }
+
+  receive();
+}
+
+void Resolver::Query::answer(Question &q, pjs::Object *msg, int type) {
+  q.answered = true;
+
+  auto ttl = std::numeric_limits<double>::infinity();
+  pjs::Value answers;
+  msg->get(STR_answer, answers);
+  if (answers.is_array()) {
+    answers.as<pjs::Array>()->iterate_all(
+      [&](pjs::Value &v, int) {
+        if (!v.is_object() || !v.o()) return;
+        pjs::Value t, data, life;
+        v.o()->get(STR_type, t);
+        v.o()->get(STR_rdata, data);
+        v.o()->get(STR_ttl, life);
+        if (!t.is_string() || !data.is_string()) return;
+        if (type == A && t.s() == STR_A) {
+          asio::error_code ec;
+          auto ip = asio::ip::make_address_v4(data.s()->str(), ec);
+          if (!ec) q.addresses.push_back(ip);
+        } else if (type == AAAA && t.s() == STR_AAAA) {
+          Data hex(data.s()->str(), Data::Encoding::Hex, &s_dp);
+          if (hex.size() != 16) return;
+          asio::ip::address_v6::bytes_type bytes;
+          hex.to_bytes(bytes.data());
+          q.addresses.push_back(asio::ip::address_v6(bytes));
+        } else {
+          return;
+        }
+        ttl = std::min(ttl, life.to_number());
+      }
+    );
+  }
+
+  // RFC 2308: negative answers are cached for min(SOA TTL, SOA.minimum)
+  if (q.addresses.empty()) {
+    ttl = NEGATIVE_TTL;
+    pjs::Value authority;
+    msg->get(STR_authority, authority);
+    if (authority.is_array()) {
+      authority.as<pjs::Array>()->iterate_all(
+        [&](pjs::Value &v, int) {
+          if (!v.is_object() || !v.o()) return;
+          pjs::Value t, data, life, minimum;
+          v.o()->get(STR_type, t);
+          v.o()->get(STR_rdata, data);
+          v.o()->get(STR_ttl, life);
+          if (!t.is_string() || t.s() != STR_SOA || !data.is_object() || !data.o()) return;
+          data.o()->get(STR_minimum, minimum);
+          ttl = std::min(MAX_NEGATIVE_TTL, std::min(life.to_number(), minimum.to_number()));
+        }
+      );
+    }
+  }
+
+  q.ttl = ttl;
+}
+
+void Resolver::Query::check() {
+  auto &a = m_questions[A];
+  auto &aaaa = m_questions[AAAA];
+  bool done_a = !a.asked || a.answered;
+  bool done_aaaa = !aaaa.asked || aaaa.answered;
+
+  if (done_a && done_aaaa) {
+    Addresses addresses(a.addresses);
+    addresses.insert(addresses.end(), aaaa.addresses.begin(), aaaa.addresses.end());
+    auto ttl = std::numeric_limits<double>::infinity();
+    if (a.asked) ttl = std::min(ttl, a.ttl);
+    if (aaaa.asked) ttl = std::min(ttl, aaaa.ttl);
+    if (addresses.empty()) {
+      finish(asio::error::host_not_found, addresses, ttl);
+    } else {
+      sort_addresses(addresses);
+      finish(std::error_code(), addresses, ttl);
+    }
+
+  } else if (!m_notified) {
+    if (aaaa.answered && !aaaa.addresses.empty()) {
+      notify(std::error_code(), aaaa.addresses);
+    } else if (a.answered && !a.addresses.empty()) {
+      pjs::Ref<Query> self(this);
+      m_delay_timer.schedule(
+        RESOLUTION_DELAY,
+        [=]() {
+          if (!self->m_notified && !self->m_finished) {
+            self->notify(std::error_code(), self->m_questions[A].addresses);
+          }
+        }
+      );
+    }
+  }
+}
+
+void Resolver::Query::next_server() {
+  if (m_finished) return;
+  const auto &conf = *m_config;
+  int n = conf.nameservers.size();
+  if (++m_attempts >= n * conf.attempts) {
+    fallback();
+  } else {
+    m_server = (m_server + 1) % n;
+    send();
+  }
+}
+
+void Resolver::Query::fallback() {
+  std::error_code ec;
+  m_retry_timer.cancel();
+  m_socket.close(ec);
+
+  if (m_notified) {
+    Addresses addresses;
+    for (const auto &q : m_questions) {
+      addresses.insert(addresses.end(), q.addresses.begin(), q.addresses.end());
+    }
+    sort_addresses(addresses);
+    finish(std::error_code(), addresses, SYSTEM_TTL);
+    return;
+  }
+
+  pjs::Ref<Query> self(this);
+  m_system_resolver.async_resolve(
+    tcp::resolver::query(m_name, ""),
+    [=](const std::error_code &ec, tcp::resolver::results_type results) {
+      if (ec == asio::error::operation_aborted) return;
+      Addresses addresses;
+      for (const auto &r : results) {
+        addresses.push_back(r.endpoint().address());
+      }
+      sort_addresses(addresses);
+      if (ec == asio::error::host_not_found) {
+        self->finish(ec, addresses, NEGATIVE_TTL);
+      } else {
+        self->finish(ec, addresses, ec ? 0 : SYSTEM_TTL);
+      }
+    }
+  );
+}
+
+void Resolver::Query::notify(const std::error_code &ec, const Addresses &addresses) {
+  if (!m_notified) {
+    m_notified = true;
+    init_metrics();
+    s_metric_resolve_time->observe(utils::now() - m_start_time);
+  }
+
+  while (auto *waiter = m_waiters.head()) {
+    waiter->complete(ec, addresses);
+  }
+}
+
+void Resolver::Query::finish(const std::error_code &ec, const Addresses &addresses, double ttl) {
+  if (m_finished) return;
+  m_finished = true;
+
+  if (!ec || ec == asio::error::host_not_found) {
+    Cache::store(m_name, ec, addresses, ttl);
+  }
+
+  notify(ec, addresses);
+
+  std::error_code err;
+  m_retry_timer.cancel();
+  m_delay_timer.cancel();
+  m_socket.close(err);
+
+  s_queries.erase(m_name);
+  release();
+}
+
+//
+// Resolver
+//
+
+// Takes the place of the name servers in /etc/resolv.conf
+void Resolver::set_server(const std::string &address) {
+  std::string host;
+  int port = 53;
+  asio::error_code ec;
+  auto ip = asio::ip::make_address(address, ec);
+  if (ec && utils::get_host_port(address, host, port)) ip = asio::ip::make_address(host, ec);
+  if (ec) throw std::runtime_error("invalid DNS server address: " + address);
+  s_nameservers.clear();
+  s_nameservers.push_back(udp::endpoint(ip, port));
+}
+
+Resolver::~Resolver() {
+  if (m_query) {
+    m_query->remove(this);
+  }
+}
+
+void Resolver::resolve(const std::string &host, const Callback &callback) {
+  cancel();
+  init_metrics();
+
+  m_callback = callback;
+
+  if (host.empty()) {
+    complete(asio::error::host_not_found, Addresses());
+    return;
+  }
+
+  asio::error_code ec;
+  auto ip = asio::ip::make_address(host, ec);
+  if (!ec) {
+    complete(std::error_code(), Addresses(1, ip));
+    return;
+  }
+
+  auto name = utils::lower(host);
+  if (name == "localhost") {
+    complete(std::error_code(), Addresses(1, asio::ip::make_address_v4("127.0.0.1")));
+    return;
+  }
+
+  // Answers from the old name servers go away with their configuration
+  bool reloaded;
+  auto conf = resolver_config(reloaded);
+  if (reloaded) Cache::clear();
+
+  auto i = conf->hosts.find(name);
+  if (i != conf->hosts.end()) {
+    Addresses addresses(i->second);
+    sort_addresses(addresses);
+    complete(std::error_code(), addresses);
+    return;
+  }
+
+  Addresses addresses;
+  if (Cache::find(name, ec, addresses)) {
+    s_metric_cache_hit->increase();
+    complete(ec, addresses);
+    return;
+  }
+
+  s_metric_cache_miss->increase();
+  m_query = Query::get(name, conf);
+  m_query->add(this);
+}
+
+void Resolver::cancel() {
+  if (m_callback) {
+    complete(asio::error::operation_aborted, Addresses());
+  }
+}
+
+// Callbacks are always posted, never called from within resolve() or cancel()
+void Resolver::complete(const std::error_code &ec, const Addresses &addresses) {
+  if (m_query) {
+    m_query->remove(this);
+    m_query = nullptr;
+  }
+  if (auto cb = std::move(m_callback)) {
+    m_callback = nullptr;
+    Net::current().post(
+      [=]() {
+        cb(ec, addresses);
+      }
+    );
+  }
+}
+
+void Resolver::init_metrics() {
+  if (!s_metric_cache_hit) {
+    pjs::Ref<pjs::Array> label_names = pjs::Array::make();
+
+    s_metric_cache_hit = stats::Counter::make(
+      pjs::Str::make("pipy_dns_cache_hit_count"),
+      label_names
+    );
+
+    s_metric_cache_miss = stats::Counter::make(
+      pjs::Str::make("pipy_dns_cache_miss_count"),
+      label_names
+    );
+
+    pjs::Ref<pjs::Array> buckets = pjs::Array::make(21);
+    double limit = 1.5;
+    for (int i = 0; i < 20; i++) {
+      buckets->set(i, std::floor(limit));
+      limit *= 1.5;
+    }
+    buckets->set(20, std::numeric_limits<double>::infinity());
+
+    s_metric_resolve_time = stats::Histogram::make(
+      pjs::Str::make("pipy_dns_resolve_time"),
+      buckets, label_names
+    );
+  }
+}
+
+} // namespace pipy
@@ -0,0 +1,68 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef RESOLVER_HPP
+#define RESOLVER_HPP
+
+#include "net.hpp"
+#include "list.hpp"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace pipy {
+
+//
+// Resolver
+//
+
+class Resolver : public List<Resolver>::Item {
+public:
+  typedef std::vector<asio::ip::address> Addresses;
+  typedef std::function<void(const std::error_code &ec, const Addresses &addresses)> Callback;
+
+  static void set_server(const std::string &address);
+
+  ~Resolver();
+
+  void resolve(const std::string &host, const Callback &callback);
+  void cancel();
+
+private:
+  class Query;
+  class Cache;
+
+  Query* m_query = nullptr;
+  Callback m_callback;
+
+  void complete(const std::error_code &ec, const Addresses &addresses);
+
+  static void init_metrics();
+};
+
+} // namespace pipy
+
+#endif // RESOLVER_HPP
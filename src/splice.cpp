@@ -0,0 +1,199 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "splice.hpp"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+namespace pipy {
+
+static const size_t PIPE_SIZE = 64 * 1024;
+static const size_t MAX_TRANSFER_SIZE = 16 * PIPE_SIZE;
+
+//
+// splice(2) into a socket whose peer has gone raises SIGPIPE, as
+// there is no MSG_NOSIGNAL for it. Rather than ignoring SIGPIPE for
+// the whole process, which would take it away from scripts waiting
+// on it with task('SIGPIPE'), keep it blocked on this thread while
+// splicing and take back the one raised by the write, if any.
+//
+
+#ifdef __linux__
+
+class SigPipeGuard {
+public:
+  SigPipeGuard() {
+    sigset_t pending;
+    sigemptyset(&m_set);
+    sigaddset(&m_set, SIGPIPE);
+    sigpending(&pending);
+    m_was_pending = sigismember(&pending, SIGPIPE);
+    if (!m_was_pending) pthread_sigmask(SIG_BLOCK, &m_set, &m_old_set);
+  }
+
+  ~SigPipeGuard() {
+    if (m_was_pending) return;
+    if (m_raised) {
+      struct timespec ts = { 0, 0 };
+      sigtimedwait(&m_set, nullptr, &ts);
+    }
+    pthread_sigmask(SIG_SETMASK, &m_old_set, nullptr);
+  }
+
+  void raised() { m_raised = true; }
+
+private:
+  sigset_t m_set;
+  sigset_t m_old_set;
+  bool m_was_pending;
+  bool m_raised = false;
+};
+
+#endif // __linux__
+
+//
+// Splicer
+//
+
+bool Splicer::pair(Target *a, Target *b) {
+#ifdef __linux__
+  auto *sa = a->splicer();
+  auto *sb = b->splicer();
+  if (!sa->open()) return false;
+  if (!sb->open()) { sa->close(); return false; }
+  std::error_code ec;
+  a->splice_socket().non_blocking(true, ec);
+  b->splice_socket().non_blocking(true, ec);
+  sa->m_target = b;
+  sb->m_target = a;
+  return true;
+#else
+  return false;
+#endif // __linux__
+}
+
+void Splicer::unpair(Target *t) {
+  auto *s = t->splicer();
+  if (auto *peer = s->m_target) {
+    auto *p = peer->splicer();
+    p->m_target = nullptr;
+    p->m_pipe_size = 0;
+    p->close();
+  }
+  s->m_target = nullptr;
+  s->m_pipe_size = 0;
+  s->close();
+}
+
+Splicer::~Splicer() {
+  close();
+}
+
+//
+// Reads from fd into the pipe and writes out to the target until
+// fd has nothing more to read, the target cannot take any more,
+// or enough has been moved for one round. Bytes left in the pipe
+// are written later by flush() when the target gets writable again.
+// A failure writing to the target is not an error reading from fd,
+// so it is left to the target instead of being returned in ec.
+//
+
+auto Splicer::transfer(int fd, std::error_code &ec) -> size_t {
+  size_t total = 0;
+#ifdef __linux__
+  while (!m_pipe_size && total < MAX_TRANSFER_SIZE) {
+    auto n = splice(fd, nullptr, m_pipe[1], nullptr, PIPE_SIZE, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n == 0) {
+      ec = asio::error::eof;
+      break;
+    }
+    if (n < 0) {
+      if (errno != EAGAIN && errno != EINTR) {
+        ec = std::error_code(errno, std::system_category());
+      }
+      break;
+    }
+    m_pipe_size += n;
+    total += n;
+    flush();
+    if (!m_target) break;
+  }
+#endif // __linux__
+  return total;
+}
+
+void Splicer::flush() {
+#ifdef __linux__
+  if (!m_target || !m_pipe_size) return;
+  auto fd = m_target->splice_socket().native_handle();
+  std::error_code ec;
+  {
+    SigPipeGuard guard;
+    while (m_pipe_size > 0) {
+      auto n = splice(m_pipe[0], nullptr, fd, nullptr, m_pipe_size, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+      if (n < 0) {
+        if (errno == EPIPE) guard.raised();
+        if (errno != EAGAIN && errno != EINTR) {
+          ec = std::error_code(errno, std::system_category());
+        }
+        break;
+      }
+      m_pipe_size -= n;
+      m_target->splice_written(n);
+    }
+  }
+  if (ec) fail(ec);
+#endif // __linux__
+}
+
+void Splicer::fail(const std::error_code &ec) {
+  if (auto *target = m_target) {
+    target->splice_failed(ec);
+  }
+}
+
+bool Splicer::open() {
+#ifdef __linux__
+  if (m_pipe[0] >= 0) return true;
+  if (pipe2(m_pipe, O_NONBLOCK | O_CLOEXEC)) {
+    m_pipe[0] = m_pipe[1] = -1;
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif // __linux__
+}
+
+void Splicer::close() {
+  if (m_pipe[0] >= 0) ::close(m_pipe[0]);
+  if (m_pipe[1] >= 0) ::close(m_pipe[1]);
+  m_pipe[0] = m_pipe[1] = -1;
+}
+
+} // namespace pipy
@@ -0,0 +1,88 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SPLICE_HPP
+#define SPLICE_HPP
+
+#include "net.hpp"
+
+namespace pipy {
+
+//
+// Splicer
+//
+// Moves bytes read from one TCP socket to another through a pipe with
+// splice(2), so that they never get copied into user space. Each end
+// of a pass-through connection owns the Splicer for the bytes it reads
+// and points it at the other end as its target.
+//
+
+class Splicer {
+public:
+
+  //
+  // Splicer::Target
+  //
+
+  class Target {
+  public:
+    virtual auto splicer() -> Splicer* = 0;
+    virtual auto splice_socket() -> asio::ip::tcp::socket& = 0;
+    virtual bool splice_ready() const = 0;
+    virtual bool splice_pumping() const = 0;
+    virtual void splice_written(size_t size) = 0;
+    virtual void splice_failed(const std::error_code &ec) = 0;
+  };
+
+  static bool pair(Target *a, Target *b);
+  static void unpair(Target *t);
+
+  ~Splicer();
+
+  auto target() const -> Target* { return m_target; }
+
+  // Whether the target has to drain what is already queued for it,
+  // in the pipe or in its own buffer, before any more can be read
+  bool pending() const { return m_pipe_size > 0 || (m_target && m_target->splice_pumping()); }
+  bool ready() const { return m_target && !m_pipe_size && m_target->splice_ready(); }
+
+  // Errors reading from fd are returned in ec, while errors writing
+  // to the target go to the target itself with splice_failed()
+  auto transfer(int fd, std::error_code &ec) -> size_t;
+  void flush();
+  void fail(const std::error_code &ec);
+
+private:
+  Target* m_target = nullptr;
+  int m_pipe[2] = { -1, -1 };
+  size_t m_pipe_size = 0;
+
+  bool open();
+  void close();
+};
+
+} // namespace pipy
+
+#endif // SPLICE_HPP
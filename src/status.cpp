@@ -73,6 +73,11 @@ void Status::update_local() {
   inbounds.clear();
   outbounds.clear();
 
+  if (auto *worker = Worker::current()) {
+    parse_time = worker->parse_time();
+    instantiate_time = worker->instantiate_time();
+  }
+
   std::map<std::string, std::set<PipelineLayout*>> all_modules;
   PipelineLayout::for_each([&](PipelineLayout *p) {
     if (auto mod = dynamic_cast<JSModule*>(p->module())) {
@@ -195,7 +200,14 @@ inline static void merge_sets(std::set<T> &a, const std::set<T> &b) {
   }
 }
 
+//
+// Threads load the codebase in parallel, so the slowest one
+// is what the whole process has to wait for
+//
+
 void Status::merge(const Status &other) {
+  parse_time = std::max(parse_time, other.parse_time);
+  instantiate_time = std::max(instantiate_time, other.instantiate_time);
   merge_sets(modules, other.modules);
   merge_sets(pools, other.pools);
   merge_sets(objects, other.objects);
@@ -210,6 +222,8 @@ bool Status::from_json(const Data &data) {
   thread_local static pjs::Ref<pjs::Str> key_uuid(pjs::Str::make("uuid"));
   thread_local static pjs::Ref<pjs::Str> key_name(pjs::Str::make("name"));
   thread_local static pjs::Ref<pjs::Str> key_version(pjs::Str::make("version"));
+  thread_local static pjs::Ref<pjs::Str> key_parse_time(pjs::Str::make("parseTime"));
+  thread_local static pjs::Ref<pjs::Str> key_instantiate_time(pjs::Str::make("instantiateTime"));
   thread_local static pjs::Ref<pjs::Str> key_modules(pjs::Str::make("modules"));
   thread_local static pjs::Ref<pjs::Str> key_filename(pjs::Str::make("filename"));
   thread_local static pjs::Ref<pjs::Str> key_graph(pjs::Str::make("graph"));
@@ -220,6 +234,8 @@ bool Status::from_json(const Data &data) {
   pjs::Value val_uuid;
   pjs::Value val_name;
   pjs::Value val_version;
+  pjs::Value val_parse_time;
+  pjs::Value val_instantiate_time;
   pjs::Value val_modules;
   pjs::Value val_logs;
 
@@ -231,6 +247,8 @@ bool Status::from_json(const Data &data) {
   root->get(key_uuid, val_uuid);
   root->get(key_name, val_name);
   root->get(key_version, val_version);
+  root->get(key_parse_time, val_parse_time);
+  root->get(key_instantiate_time, val_instantiate_time);
   root->get(key_modules, val_modules);
   root->get(key_logs, val_logs);
 
@@ -245,6 +263,8 @@ bool Status::from_json(const Data &data) {
   uuid = val_uuid.s()->str();
   name = val_name.s()->str();
   version = val_version.s()->str();
+  parse_time = val_parse_time.is_number() ? val_parse_time.n() : 0;
+  instantiate_time = val_instantiate_time.is_number() ? val_instantiate_time.n() : 0;
 
   val_modules.o()->iterate_all(
     [this](pjs::Str *k, pjs::Value &v) {
@@ -277,6 +297,8 @@ void Status::to_json(std::ostream &out) const {
   out << ",\"uuid\":\"" << uuid << '"';
   out << ",\"name\":\"" << name << '"';
   out << ",\"version\":\"" << utils::escape(version) << '"';
+  out << ",\"parseTime\":" << parse_time;
+  out << ",\"instantiateTime\":" << instantiate_time;
   out << ",\"modules\":{";
   bool first = true;
   for (const auto &mod : modules) {
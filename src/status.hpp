@@ -178,6 +178,8 @@ public:
   std::string uuid;
   std::string name;
   std::string version;
+  double parse_time = 0;
+  double instantiate_time = 0;
   std::set<ModuleInfo> modules;
   std::set<PoolInfo> pools;
   std::set<ObjectInfo> objects;
@@ -25,14 +25,217 @@
 
 #include "timer.hpp"
 
+#include <chrono>
+#include <cmath>
+
 namespace pipy {
 
+//
+// WheelTimer::Wheel
+//
+// Ticks every 10ms. The first level has 256 slots, one per tick, and each
+// of the 4 levels above it has 64 slots, each covering a whole round of
+// the level below. Timers further out than the first level are cascaded
+// down a level each time the level below wraps around, the way the
+// classic Linux kernel timer wheel works. The wheel's single asio timer
+// only wakes up at ticks with something due or where a cascade happens.
+//
+
+class WheelTimer::Wheel {
+public:
+  static auto get() -> Wheel* {
+    if (!s_wheel) s_wheel = new Wheel;
+    return s_wheel;
+  }
+
+  static void cancel_all() {
+    if (s_wheel) s_wheel->clear();
+  }
+
+  void schedule(WheelTimer *timer, double timeout) {
+    auto now = tick_now();
+    if (!m_count) m_current = now;
+    auto ticks = uint64_t(std::ceil(timeout * 1000 / TICK_MS));
+    timer->m_expiration = now + (ticks > 0 ? ticks : 1);
+    add(timer);
+    m_count++;
+    wake(timer->m_expiration);
+  }
+
+  void cancel(WheelTimer *timer) {
+    timer->m_slot->remove(timer);
+    timer->m_slot = nullptr;
+    if (!--m_count) sleep();
+  }
+
+private:
+  static const int TICK_MS = 10;
+  static const int ROOT_BITS = 8;
+  static const int LEVEL_BITS = 6;
+  static const int ROOT_SIZE = 1 << ROOT_BITS;
+  static const int LEVEL_SIZE = 1 << LEVEL_BITS;
+  static const int LEVELS = 4;
+  static const uint64_t MAX_TICKS = (uint64_t(1) << (ROOT_BITS + LEVELS * LEVEL_BITS)) - 1;
+
+  Wheel() : m_timer(Net::context()), m_origin(std::chrono::steady_clock::now()) {}
+
+  List<WheelTimer> m_root[ROOT_SIZE];
+  List<WheelTimer> m_levels[LEVELS][LEVEL_SIZE];
+  asio::steady_timer m_timer;
+  std::chrono::steady_clock::time_point m_origin;
+  uint64_t m_current = 0;
+  uint64_t m_wakeup = 0;
+  size_t m_count = 0;
+  bool m_waiting = false;
+
+  thread_local static Wheel* s_wheel;
+
+  auto tick_now() const -> uint64_t {
+    auto t = std::chrono::steady_clock::now() - m_origin;
+    return std::chrono::duration_cast<std::chrono::milliseconds>(t).count() / TICK_MS;
+  }
+
+  void add(WheelTimer *timer) {
+    auto expiration = timer->m_expiration;
+    if (expiration <= m_current) expiration = m_current + 1;
+    if (expiration - m_current > MAX_TICKS) expiration = m_current + MAX_TICKS;
+    auto delta = expiration - m_current;
+    List<WheelTimer> *slot;
+    if (delta < ROOT_SIZE) {
+      slot = &m_root[expiration & (ROOT_SIZE - 1)];
+    } else {
+      int level = 0;
+      while (level < LEVELS - 1 && delta >= (uint64_t(1) << (ROOT_BITS + (level + 1) * LEVEL_BITS))) level++;
+      auto shift = ROOT_BITS + level * LEVEL_BITS;
+      slot = &m_levels[level][(expiration >> shift) & (LEVEL_SIZE - 1)];
+    }
+    slot->push(timer);
+    timer->m_slot = slot;
+  }
+
+  //
+  // Moves all timers in one slot of a level down to where they belong
+  // now, and returns the slot index so the caller knows whether this
+  // level has wrapped around, too.
+  //
+
+  auto cascade(int level) -> int {
+    auto shift = ROOT_BITS + level * LEVEL_BITS;
+    auto index = int((m_current >> shift) & (LEVEL_SIZE - 1));
+    auto &slot = m_levels[level][index];
+    while (auto *timer = slot.head()) {
+      slot.remove(timer);
+      add(timer);
+    }
+    return index;
+  }
+
+  void advance(uint64_t now) {
+    while (m_current < now && m_count > 0) {
+      m_current++;
+      auto index = int(m_current & (ROOT_SIZE - 1));
+      if (!index) {
+        for (int level = 0; level < LEVELS; level++) {
+          if (cascade(level)) break;
+        }
+      }
+      auto &slot = m_root[index];
+      while (auto *timer = slot.head()) {
+        slot.remove(timer);
+        timer->m_slot = nullptr;
+        m_count--;
+        auto handler = std::move(timer->m_handler);
+        timer->m_handler = nullptr;
+        handler();
+      }
+    }
+    if (!m_count) m_current = now;
+  }
+
+  //
+  // The next tick to wake up at is the first one with a due slot
+  // on the first level, or where the first level wraps around.
+  //
+
+  auto next_tick() const -> uint64_t {
+    auto t = m_current + 1;
+    for (;;) {
+      if (!m_root[t & (ROOT_SIZE - 1)].empty()) return t;
+      if (!(t & (ROOT_SIZE - 1))) return t;
+      t++;
+    }
+  }
+
+  void wake(uint64_t tick) {
+    if (m_waiting && m_wakeup <= tick) return;
+    m_wakeup = tick;
+    m_waiting = true;
+    m_timer.expires_at(m_origin + std::chrono::milliseconds(tick * TICK_MS));
+    m_timer.async_wait(
+      [this, tick](const std::error_code &ec) {
+        if (ec || tick != m_wakeup) return;
+        m_waiting = false;
+        advance(tick_now());
+        if (m_count > 0) wake(next_tick());
+      }
+    );
+  }
+
+  // Nothing is left to wait for, so do not hold the event loop
+  void sleep() {
+    if (m_waiting) {
+      m_waiting = false;
+      std::error_code ec;
+      m_timer.cancel(ec);
+    }
+  }
+
+  void clear() {
+    for (auto &slot : m_root) clear(slot);
+    for (auto &level : m_levels) for (auto &slot : level) clear(slot);
+    m_count = 0;
+    sleep();
+  }
+
+  void clear(List<WheelTimer> &slot) {
+    while (auto *timer = slot.head()) {
+      slot.remove(timer);
+      timer->m_slot = nullptr;
+      timer->m_handler = nullptr;
+    }
+  }
+};
+
+thread_local WheelTimer::Wheel* WheelTimer::Wheel::s_wheel = nullptr;
+
+//
+// WheelTimer
+//
+
+void WheelTimer::schedule(double timeout, const std::function<void()> &handler) {
+  cancel();
+  m_handler = handler;
+  Wheel::get()->schedule(this, timeout);
+}
+
+void WheelTimer::cancel() {
+  if (m_slot) {
+    Wheel::get()->cancel(this);
+    m_handler = nullptr;
+  }
+}
+
+//
+// Timer
+//
+
 thread_local List<Timer> Timer::s_all_timers;
 
 void Timer::cancel_all() {
   for (auto *timer = s_all_timers.head(); timer; timer = timer->next()) {
     timer->cancel();
   }
+  WheelTimer::Wheel::cancel_all();
 }
 
 void Timer::schedule(double timeout, const std::function<void()> &handler) {
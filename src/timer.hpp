@@ -29,6 +29,8 @@
 #include "net.hpp"
 #include "list.hpp"
 
+#include <functional>
+
 namespace pipy {
 
 //
@@ -74,6 +76,37 @@ private:
   thread_local static List<Timer> s_all_timers;
 };
 
+//
+// WheelTimer
+//
+// A timer of coarse resolution kept on a hierarchical timing wheel that
+// each thread has one of, for timeouts that get rescheduled on every bit
+// of I/O, like the ones on connections. Scheduling and cancelling are
+// O(1) and take no asio timer of their own.
+//
+
+class WheelTimer : public List<WheelTimer>::Item {
+public:
+  WheelTimer() {}
+  WheelTimer(const WheelTimer &) = delete;
+
+  ~WheelTimer() {
+    cancel();
+  }
+
+  void schedule(double timeout, const std::function<void()> &handler);
+  void cancel();
+
+private:
+  class Wheel;
+
+  List<WheelTimer>* m_slot = nullptr;
+  uint64_t m_expiration = 0;
+  std::function<void()> m_handler;
+
+  friend class Timer;
+};
+
 } // namespace pipy
 
 #endif // TIMER_HPP
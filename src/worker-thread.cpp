@@ -26,19 +26,33 @@
 #include "worker-thread.hpp"
 #include "worker.hpp"
 #include "codebase.hpp"
+#include "module.hpp"
 #include "timer.hpp"
 #include "net.hpp"
 #include "log.hpp"
 #include "api/logging.hpp"
+#include "pjs/expr.hpp"
 #include "utils.hpp"
 
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif // __linux__
+
 namespace pipy {
 
 thread_local WorkerThread* WorkerThread::s_current = nullptr;
 
-WorkerThread::WorkerThread(WorkerManager *manager, int index, bool is_graph_enabled)
+WorkerThread::WorkerThread(WorkerManager *manager, int index, int cpu, bool is_graph_enabled)
   : m_manager(manager)
   , m_index(index)
+  , m_cpu(cpu)
   , m_active_pipeline_count(0)
   , m_working(false)
   , m_recycling(false)
@@ -344,6 +358,54 @@ void WorkerThread::init_metrics() {
       gauge->set(total);
     }
   );
+
+  //
+  // Stats - property inline caches
+  //
+
+  if (!pjs::PropertyCache::stats_enabled()) return;
+
+  label_names->length(1);
+  label_names->set(0, "location");
+
+  auto inline_cache_gauge = [&](const char *name, uint64_t (pjs::PropertyCache::*count)() const) {
+    uint64_t removed = 0;
+    stats::Gauge::make(
+      pjs::Str::make(name),
+      label_names,
+      [=](stats::Gauge *gauge) mutable {
+
+        // Drop locations of the sites gone with an old codebase
+        if (removed != pjs::CacheSite::removed()) {
+          removed = pjs::CacheSite::removed();
+          gauge->clear();
+        }
+
+        double total = 0;
+        pjs::CacheSite::for_each(
+          [&](pjs::CacheSite *site) {
+            const auto &cache = site->cache();
+            if (!cache.hits() && !cache.misses()) return;
+            auto *expr = site->expr();
+            auto *source = expr->source();
+            auto n = (cache.*count)();
+            char loc[100];
+            std::snprintf(loc, sizeof(loc), ":%d:%d", expr->line(), expr->column());
+            pjs::Str *location = pjs::Str::make((source ? source->filename : std::string()) + loc)->retain();
+            auto metric = gauge->with_labels(&location, 1);
+            metric->set(n);
+            total += n;
+            location->release();
+          }
+        );
+        gauge->set(total);
+      }
+    );
+  };
+
+  inline_cache_gauge("pipy_pjs_inline_cache_hit_count", &pjs::PropertyCache::hits);
+  inline_cache_gauge("pipy_pjs_inline_cache_miss_count", &pjs::PropertyCache::misses);
+  inline_cache_gauge("pipy_pjs_inline_cache_eviction_count", &pjs::PropertyCache::evictions);
 }
 
 void WorkerThread::shutdown_all() {
@@ -352,9 +414,35 @@ void WorkerThread::shutdown_all() {
   Listener::for_each([&](Listener *l) { l->pipeline_layout(nullptr); });
 }
 
+//
+// Pinning a thread to its CPU also makes it allocate memory on the NUMA
+// node of that CPU from then on, which covers the pools of the thread
+// since it hasn't allocated anything from them yet.
+//
+
+void WorkerThread::pin() {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(m_cpu, &set);
+  if (auto err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) {
+    Log::error("[start] Thread %d cannot be pinned to CPU %d: %s", m_index, m_cpu, std::strerror(err));
+    return;
+  }
+  if (syscall(SYS_set_mempolicy, MPOL_LOCAL, nullptr, 0)) {
+    Log::warn("[start] Thread %d cannot use local NUMA memory: %s", m_index, std::strerror(errno));
+  }
+  unsigned int cpu = 0, node = 0;
+  syscall(SYS_getcpu, &cpu, &node, nullptr);
+  Log::info("[start] Thread %d pinned to CPU %d on NUMA node %u", m_index, m_cpu, node);
+#endif // __linux__
+}
+
 void WorkerThread::main() {
   Log::init();
 
+  if (m_cpu >= 0) pin();
+
   auto &entry = Codebase::current()->entry();
   auto worker = Worker::make(m_graph_enabled);
   auto mod = worker->load_js_module(entry);
@@ -377,6 +465,7 @@ void WorkerThread::main() {
     m_working = true;
     while (m_working) {
       Net::current().run();
+      Listener::stop_balancing();
       m_working = false;
       m_done = true;
       m_manager->on_thread_done(m_index);
@@ -424,8 +513,11 @@ auto WorkerManager::get() -> WorkerManager& {
 bool WorkerManager::start(int concurrency) {
   if (started()) return false;
 
+  m_concurrency = concurrency;
+
   for (int i = 0; i < concurrency; i++) {
-    auto wt = new WorkerThread(this, i, m_graph_enabled && (i == 0));
+    auto cpu = m_cpu_affinity.empty() ? -1 : m_cpu_affinity[i % m_cpu_affinity.size()];
+    auto wt = new WorkerThread(this, i, cpu, m_graph_enabled && (i == 0));
     if (!wt->start()) {
       delete wt;
       stop(true);
@@ -586,6 +678,8 @@ void WorkerManager::reload() {
     std::condition_variable cv;
     bool all_ok = true;
 
+    JSModule::begin_reload();
+
     for (auto *wt : m_worker_threads) {
       wt->reload(
         [&](bool ok) {
@@ -602,6 +696,8 @@ void WorkerManager::reload() {
     std::unique_lock<std::mutex> lock(m);
     cv.wait(lock, [&]{ return n == 0; });
 
+    JSModule::end_reload(all_ok);
+
     for (auto *wt : m_worker_threads) {
       wt->reload_done(all_ok);
     }
@@ -48,12 +48,13 @@ class WorkerManager;
 
 class WorkerThread {
 public:
-  WorkerThread(WorkerManager *manager, int index, bool is_graph_enabled);
+  WorkerThread(WorkerManager *manager, int index, int cpu, bool is_graph_enabled);
   ~WorkerThread();
 
   static auto current() -> WorkerThread* { return s_current; }
 
   auto index() const -> int { return m_index; }
+  auto cpu() const -> int { return m_cpu; }
   bool done() { return m_done; }
   auto active_pipeline_count() const -> size_t { return m_active_pipeline_count.load(std::memory_order_relaxed); }
 
@@ -70,6 +71,7 @@ public:
 private:
   WorkerManager* m_manager;
   int m_index;
+  int m_cpu;
   Net* m_net = nullptr;
   std::string m_version;
   std::string m_new_version;
@@ -92,6 +94,7 @@ private:
   static void init_metrics();
   static void shutdown_all();
 
+  void pin();
   void main();
 
   thread_local static WorkerThread* s_current;
@@ -106,6 +109,9 @@ public:
   static auto get() -> WorkerManager&;
 
   void enable_graph(bool b) { m_graph_enabled = b; }
+  void set_cpu_affinity(const std::vector<int> &cpus) { m_cpu_affinity = cpus; }
+  auto cpu_affinity() const -> const std::vector<int>& { return m_cpu_affinity; }
+  auto concurrency() const -> int { return m_concurrency; }
   void on_done(const std::function<void()> &cb) { m_on_done = cb; }
   bool started() const { return !m_worker_threads.empty(); }
   bool start(int concurrency = 1);
@@ -125,6 +131,8 @@ private:
   int m_status_counter = -1;
   stats::MetricDataSum m_metric_data_sum;
   int m_metric_data_sum_counter = -1;
+  std::vector<int> m_cpu_affinity;
+  int m_concurrency = 0;
   bool m_graph_enabled = false;
   std::function<void()> m_on_done;
 
@@ -57,6 +57,7 @@
 #include "log.hpp"
 
 #include <array>
+#include <chrono>
 #include <limits>
 #include <stdexcept>
 
@@ -206,9 +207,19 @@ auto Worker::load_js_module(const std::string &path) -> JSModule* {
   auto m = new JSModule(this, new_module_index());
   add_module(m);
   m_module_map[path] = m;
-  if (!m_root) m_root = m;
-  if (!m->load(path)) return nullptr;
-  return m;
+  if (m_root) return m->load(path) ? m : nullptr;
+
+  //
+  // Loading the root module loads all others it imports, so the time it
+  // takes minus the time spent lexing is all that goes into instantiating
+  //
+
+  m_root = m;
+  auto t = std::chrono::steady_clock::now();
+  auto ok = m->load(path);
+  auto d = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
+  m_instantiate_time = d - m_parse_time;
+  return ok ? m : nullptr;
 }
 
 auto Worker::load_native_module(const std::string &path) -> nmi::NativeModule* {
@@ -298,10 +309,13 @@ bool Worker::solve(pjs::Context &ctx, pjs::Str *filename, pjs::Value &result) {
   auto &f = m_solved_files[filename];
   f.source.filename = filename->str();
   f.source.content = data.to_string();
+  auto t = std::chrono::steady_clock::now();
+  auto tokens = JSModule::lex(f.source);
+  m_parse_time += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
   std::string error;
   char error_msg[1000];
   int error_line, error_column;
-  auto expr = pjs::Parser::parse(&f.source, error, error_line, error_column);
+  auto expr = pjs::Parser::parse(&f.source, tokens.get(), error, error_line, error_column);
   if (!expr) {
     std::snprintf(
       error_msg, sizeof(error_msg), "Syntax error: %s at line %d column %d in %s",
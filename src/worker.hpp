@@ -58,6 +58,8 @@ public:
   auto root() const -> Module* { return m_root; }
   auto thread() const -> Thread* { return m_thread; }
   auto global_object() const -> pjs::Object* { return m_global_object; }
+  auto parse_time() const -> double { return m_parse_time; }
+  auto instantiate_time() const -> double { return m_instantiate_time; }
   bool handling_signal(int sig);
   auto find_js_module(const std::string &path) -> JSModule*;
   auto load_js_module(const std::string &path) -> JSModule*;
@@ -107,6 +109,8 @@ private:
   std::map<pjs::Ref<pjs::Str>, Namespace> m_namespaces;
   std::map<pjs::Ref<pjs::Str>, SolvedFile> m_solved_files;
   bool m_graph_enabled = false;
+  double m_parse_time = 0;
+  double m_instantiate_time = 0;
 
   auto new_module_index() -> int;
   void add_module(Module *m);
@@ -0,0 +1,57 @@
+((
+  results = [],
+
+  reply = q => new Message(
+    DNS.encode({
+      id: q.id,
+      qr: 1,
+      rd: 1,
+      ra: 1,
+      question: q.question,
+      answer: q.question[0].type === 'A' ? [
+        { name: q.question[0].name, type: 'A', ttl: 60, rdata: '127.0.0.2' },
+        { name: q.question[0].name, type: 'A', ttl: 60, rdata: '127.0.0.1' },
+      ] : [],
+    })
+  ),
+
+  lookup = (tag, options) => $=>$
+    .connect('two.invalid:8055', options)
+    .handleData(d => results.push(`${tag}: ${d.toString()}`))
+    .handleStreamEnd(e => e.error && results.push(`${tag}: ${e.error}`)),
+
+) => pipy()
+
+//
+// Name server answering with an address nobody listens on first
+//
+
+.listen('127.0.0.1:5301', { protocol: 'udp' })
+.replaceMessage(msg => reply(DNS.decode(msg.body)))
+
+.listen('127.0.0.1:8055')
+.replaceData(() => [new Data(`from ${__inbound.remoteAddress}${__inbound.remotePort === 8056 ? ':8056' : ''}`), new StreamEnd])
+
+//
+// The second address is connected from the bound source address
+//
+
+.task()
+.onStart(() => new Data('x'))
+.fork().to(lookup('bound', { bind: '127.0.0.3' }))
+
+.task()
+.onStart(() => new Data('x'))
+.fork().to(lookup('bound to a port', { bind: '127.0.0.4:8056' }))
+
+.task()
+.onStart(() => new Message)
+.wait(() => false, { timeout: 1 })
+.replaceMessage(
+  () => [new Data(results.sort().join('\n') + '\n'), new StreamEnd]
+)
+.tee('-')
+.wait(() => false, { timeout: 0.1 })
+.handleStreamEnd(() => pipy.exit())
+
+)()
@@ -0,0 +1,48 @@
+((
+  targets = new Array(10).fill(0).map((_, i) => `t${i}`),
+  keys = new Array(20000).fill(0).map((_, i) => `key-${i}`),
+
+  lb = new algo.ConsistentHashingLoadBalancer(targets),
+  weighted = new algo.ConsistentHashingLoadBalancer(
+    targets.reduce((o, t) => (o[t] = (t === 't0' ? 3 : 1), o), {})
+  ),
+
+  select = lb => keys.map(k => lb.select(k)),
+
+  //
+  // Largest deviation of any target's share of keys from its weight's share
+  //
+
+  deviation = (selected, share) => (
+    (counts = selected.reduce((c, t) => (c[t] = (c[t] || 0) + 1, c), {})) => targets.reduce(
+      (max, t) => Math.max(max, Math.abs(counts[t] / (keys.length * share(t)) - 1)),
+      0
+    )
+  )(),
+
+  lines = [],
+
+) => pipy()
+
+.task()
+.onStart(
+  () => (
+    ((
+      before = select(lb),
+      after = (lb.set('t3', 0), select(lb)),
+      restored = (lb.set('t3', 1), select(lb)),
+      movedOthers = keys.filter((_, i) => before[i] !== 't3' && before[i] !== after[i]),
+    ) => (
+      lines.push(`even spread within 5%: ${deviation(before, () => 1/10) < 0.05}`),
+      lines.push(`weighted spread within 5%: ${deviation(select(weighted), t => (t === 't0' ? 3 : 1) / 12) < 0.05}`),
+      lines.push(`removed target gets no keys: ${after.every(t => t !== 't3')}`),
+      lines.push(`keys of other targets moved under 1%: ${movedOthers.length < keys.length / 100}`),
+      lines.push(`target added back gets its keys back: ${restored.every((t, i) => t === before[i])}`)
+    ))(),
+    [new Data(lines.join('\n') + '\n'), new StreamEnd]
+  )
+)
+.tee('-')
+.wait(() => false, { timeout: 0.1 })
+
+)()
@@ -0,0 +1,27 @@
+((
+  lb = new algo.EWMALoadBalancer(['a', 'b'], null, { name: 'test' }),
+  lines = [],
+
+) => pipy()
+
+.task()
+.onStart(
+  () => (
+    ((
+      sticky = [lb.select('k'), lb.select('k'), lb.select('k')],
+      busy = sticky[0],
+      others = [lb.select(), lb.select(), lb.select()],
+    ) => (
+      lines.push(`keyed selections stick: ${sticky.every(t => t === busy)}`),
+      lines.push(`unkeyed selections avoid the busy target: ${others.every(t => t !== busy)}`),
+      sticky.forEach(t => lb.deselect(t)),
+      others.forEach(t => lb.deselect(t)),
+      lines.push(`keyed selection after deselect: ${lb.select('k') === busy}`)
+    ))(),
+    [new Data(lines.join('\n') + '\n'), new StreamEnd]
+  )
+)
+.tee('-')
+.wait(() => false, { timeout: 0.1 })
+
+)()
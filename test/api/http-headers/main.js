@@ -0,0 +1,48 @@
+((
+  lines = [],
+  encoded = '',
+
+) => pipy()
+
+.task()
+.onStart(
+  () => [
+    new Data(
+      'POST /x HTTP/1.1\r\n' +
+      'Host: example.com\r\n' +
+      'X-Foo: foo\r\n' +
+      'Content-Type: text/plain\r\n' +
+      'X-Bar: bar\r\n' +
+      'Content-Length: 2\r\n' +
+      '\r\nhi'
+    ),
+    new StreamEnd
+  ]
+)
+.decodeHTTPRequest()
+.handleMessageStart(
+  msg => ((h = msg.head.headers) => (
+    lines.push(`keys: ${Object.keys(h).join(',')}`),
+    lines.push(`h.host: ${h.host}, h['Host']: ${h['Host']}, h['X-FOO']: ${h['X-FOO']}`),
+    lines.push(`'Content-Type' in h: ${'Content-Type' in h}, 'x-none' in h: ${'x-none' in h}`),
+    h['X-Foo'] = 'changed',
+    h['x-new'] = 'new',
+    delete h['X-BAR'],
+    delete h['x-none'],
+    lines.push(`after set/delete: ${JSON.stringify(h)}`),
+    lines.push(`entries: ${Object.entries(h).map(([k, v]) => k + '=' + v).join(' ')}`)
+  ))()
+)
+.encodeHTTPRequest()
+.replaceData(d => (encoded += d.toString(), new Data))
+.replaceStreamEnd(
+  () => (
+    lines.push('encoded:'),
+    encoded.split('\r\n').forEach(l => lines.push(l)),
+    [new Data(lines.join('\n') + '\n'), new StreamEnd]
+  )
+)
+.tee('-')
+.wait(() => false, { timeout: 0.1 })
+
+)()
@@ -0,0 +1,55 @@
+((
+  trie = new algo.IPTrie({ '10.0.0.0/8': 'a', '2001:db8::/32': 'v6' }),
+
+  lines = [],
+
+  check = (tag, ips) => lines.push(
+    `${tag}: ` + ips.map(ip => `${ip}=${trie.lookup(ip)}`).join(' ')
+  ),
+
+) => pipy()
+
+.task()
+.onStart(
+  () => (
+    check('initial', ['10.1.2.3', '11.0.0.1', '2001:db8::1']),
+
+    trie.add('10.1.2.128/25', 'd'),
+    check('add /25', ['10.1.2.3', '10.1.2.200']),
+
+    trie.add('10.1.0.0/16', 'b'),
+    check('add shorter /16', ['10.1.2.200', '10.1.9.9', '10.2.0.1']),
+
+    trie.add('10.1.2.0/24', 'c'),
+    check('add /24 in between', ['10.1.2.3', '10.1.2.200', '10.1.3.1']),
+
+    trie.add('0.0.0.0/0', 'default'),
+    check('add default', ['11.0.0.1', '10.1.2.200', '10.2.0.1']),
+
+    trie.add('10.1.0.0/16', 'b2'),
+    check('add duplicate', ['10.1.9.9', '10.1.2.3']),
+
+    trie.add('2001:db8:1::/48', 'v6b'),
+    trie.add('2001::/16', 'v6c'),
+    check('add IPv6', ['2001:db8:1::1', '2001:db8:2::1', '2001:1::1', '2002::1']),
+    check('IPv4-mapped', ['::ffff:10.1.2.3']),
+
+    lines.push(`size: ${trie.size}`),
+
+    trie.reload({ '192.168.0.0/16': 'r' }),
+    trie.add('192.168.1.0/24', 'r2'),
+    new Message
+  )
+)
+.wait(() => false, { timeout: 0.2 })
+.replaceMessage(
+  () => (
+    check('reloaded', ['192.168.1.1', '192.168.2.1', '10.1.2.3']),
+    lines.push(`size: ${trie.size}`),
+    [new Data(lines.join('\n') + '\n'), new StreamEnd]
+  )
+)
+.tee('-')
+.wait(() => false, { timeout: 0.1 })
+
+)()
@@ -0,0 +1,42 @@
+((
+  uniform = new stats.LogHistogram('test_log_histogram_uniform', { precision: 3 }),
+  skewed = new stats.LogHistogram('test_log_histogram_skewed', { precision: 2, highest: 1000 }),
+  labeled = new stats.LogHistogram('test_log_histogram_labeled', {}, ['path']),
+
+  lines = [],
+
+  show = (name, h) => lines.push(
+    `${name}: ` + [0, 0.5, 0.9, 0.99, 1].map(q => `q${q * 100}=${h.quantile(q)}`).join(' ')
+  ),
+
+) => pipy()
+
+.task()
+.onStart(
+  () => (
+    show('empty', uniform),
+
+    new Array(100).fill(0).forEach((_, i) => uniform.observe(i + 1)),
+    show('1..100', uniform),
+
+    new Array(90).fill(0).forEach(() => skewed.observe(40)),
+    new Array(9).fill(0).forEach(() => skewed.observe(300)),
+    skewed.observe(5000),
+    show('90x40 9x300 1x5000', skewed),
+
+    labeled.withLabels('/a').observe(10),
+    labeled.withLabels('/a').observe(20),
+    labeled.withLabels('/b').observe(1000),
+    show('label /a', labeled.withLabels('/a')),
+    show('label /b', labeled.withLabels('/b')),
+
+    uniform.zero(),
+    show('zeroed', uniform),
+
+    [new Data(lines.join('\n') + '\n'), new StreamEnd]
+  )
+)
+.tee('-')
+.wait(() => false, { timeout: 0.1 })
+
+)()
@@ -0,0 +1,51 @@
+((
+  COUNT = 20000,
+  PADDING = 'x'.repeat(200),
+
+  modes = ['block', 'drop', 'sample'],
+  filename = mode => `/tmp/pipy-test-logging-${mode}.log`,
+  loggers = modes.map(
+    mode => (
+      os.writeFile(filename(mode), ''),
+      new logging.TextLogger(`test-${mode}`, { overflow: mode, sampleRate: 0.5 }).toFile(filename(mode))
+    )
+  ),
+
+  check = mode => (
+    (
+      lines = os.readFile(filename(mode)).toString().split('\n').filter(l => l),
+      numbers = lines.map(l => l.split(' ')[0] * 1),
+    ) => ({
+      all: numbers.length === COUNT,
+      some: numbers.length > 0 && numbers.length <= COUNT,
+      ordered: numbers.every((n, i) => i === 0 || n > numbers[i - 1]),
+      intact: lines.every(l => l === `${l.split(' ')[0] * 1} ${PADDING}`),
+    })
+  )(),
+
+  lines = [],
+
+) => pipy()
+
+.task()
+.onStart(
+  () => (
+    new Array(COUNT).fill(0).forEach(
+      (_, i) => loggers.forEach(l => l.log(`${i} ${PADDING}`))
+    ),
+    new Message
+  )
+)
+.wait(() => false, { timeout: 1 })
+.replaceMessage(
+  () => (
+    ((r = check('block')) => lines.push(`block: all lines: ${r.all}, in order: ${r.ordered}, intact: ${r.intact}`))(),
+    ((r = check('drop')) => lines.push(`drop: some lines: ${r.some}, in order: ${r.ordered}, intact: ${r.intact}`))(),
+    ((r = check('sample')) => lines.push(`sample: some lines: ${r.some}, in order: ${r.ordered}, intact: ${r.intact}`))(),
+    [new Data(lines.join('\n') + '\n'), new StreamEnd]
+  )
+)
+.tee('-')
+.wait(() => false, { timeout: 0.1 })
+
+)()
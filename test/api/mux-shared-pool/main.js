@@ -0,0 +1,83 @@
+((
+  connections = 0,
+  results = [],
+
+  request = (tag, path) => () => new Message(
+    { method: 'GET', path, headers: { 'x-tag': tag } }
+  ),
+
+  report = tag => msg => results.push(
+    `${tag}: ${msg.head.status} connection=${msg.head.headers['X-Connection']} ${msg.body.toString()}`
+  ),
+
+  options = { sharedPool: 'upstream', maxConnections: 1 },
+
+  upstream = $=>$.connect('127.0.0.1:8081'),
+
+) => pipy()
+
+//
+// Upstream telling which connection each request came on
+//
+
+.listen('127.0.0.1:8081')
+.onStart(() => void connections++)
+.demuxHTTP().to($=>$
+  .replaceMessage(
+    req => new Message(
+      { status: 200, headers: { 'x-connection': connections } },
+      `${req.head.method} ${req.head.path} ${req.head.headers['X-Tag']}`
+    )
+  )
+)
+
+//
+// Two muxHTTP filters in the same pool share the only connection allowed,
+// the second one by handing its streams over to the session of the first
+//
+
+.task()
+.onStart(request('a', '/a'))
+.muxHTTP(() => 'up', options).to(upstream)
+.handleMessage(report('a'))
+
+.task()
+.onStart(request('b', '/b'))
+.muxHTTP(() => 'up', options).to(upstream)
+.handleMessage(report('b'))
+
+.task()
+.onStart(request('c', '/c'))
+.wait(() => false, { timeout: 0.2 })
+.muxHTTP(() => 'up', options).to(upstream)
+.handleMessage(report('c'))
+
+//
+// A muxQueue filter in the same pool with the same key does not speak the
+// same protocol, so it opens its own connection
+//
+
+.task()
+.onStart(request('d', '/d'))
+.wait(() => false, { timeout: 0.4 })
+.muxQueue(() => 'up', options).to($=>$
+  .encodeHTTPRequest()
+  .connect('127.0.0.1:8081')
+  .decodeHTTPResponse()
+)
+.handleMessage(report('d'))
+
+.task()
+.onStart(() => new Message)
+.wait(() => false, { timeout: 0.8 })
+.replaceMessage(
+  () => [
+    new Data(results.sort().concat(`connections: ${connections}`).join('\n') + '\n'),
+    new StreamEnd
+  ]
+)
+.tee('-')
+.wait(() => false, { timeout: 0.1 })
+.handleStreamEnd(() => pipy.exit())
+
+)()
@@ -0,0 +1,48 @@
+((
+  evaluated = [],
+  arg = name => (evaluated.push(name), name),
+  args = () => (evaluated.splice(0).join(',') || 'none'),
+
+  obj = {
+    f: (a, b) => `f(${a},${b})`,
+    g: null,
+    n: 42,
+    get: () => obj,
+  },
+
+  lines = [],
+
+) => pipy()
+
+.task()
+.onStart(
+  () => (
+    lines.push(`call: ${obj.f(arg('a'), arg('b'))}, evaluated ${args()}`),
+    lines.push(`chained: ${obj.get().get().f(arg('c'), 1)}, evaluated ${args()}`),
+    lines.push(`optional on function: ${obj.f?.(arg('d'), arg('e'))}, evaluated ${args()}`),
+    lines.push(`optional on null: ${obj.g?.(arg('f'))}, evaluated ${args()}`),
+    lines.push(`optional on undefined: ${obj.h?.(arg('g'))}, evaluated ${args()}`),
+    lines.push(`optional in expression: ${(obj.h?.(arg('h')) ?? 'default') + '!'}, evaluated ${args()}`),
+    new StreamEnd
+  )
+)
+
+.task()
+.onStart(
+  () => (
+    obj.n(arg('i')),
+    new StreamEnd
+  )
+)
+
+.task()
+.onStart(
+  () => (
+    lines.push(`not a function: evaluated ${args()}`),
+    [new Data(lines.join('\n') + '\n'), new StreamEnd]
+  )
+)
+.tee('-')
+.wait(() => false, { timeout: 0.1 })
+
+)()
@@ -0,0 +1,52 @@
+((
+  evaluated = [],
+  arg = (name, value) => (evaluated.push(name), value),
+  args = () => (evaluated.splice(0).join(',') || 'none'),
+
+  calc = (a, b) => [
+    a + b, a - b, a * b, a / b, a % b, a ** 2,
+    a << 2, a >> 1, -a >>> 28, a & b, a | b, a ^ b, ~a,
+    +'3' + a, -a, !a,
+  ].join(' '),
+
+  compare = (a, b) => [
+    a == b, a != b, a === b, a !== b, a > b, a >= b, a < b, a <= b,
+  ].map(x => x ? 1 : 0).join(''),
+
+  logic = (a, b) => [
+    arg('a1', a) && arg('b1', b),
+    arg('a2', a) || arg('b2', b),
+    arg('a3', a) ?? arg('b3', b),
+    arg('a4', a) ? arg('b4', 'yes') : arg('c4', 'no'),
+  ].map(x => `${x}`).join(' ') + ` (${args()})`,
+
+  props = (o) => [
+    o?.y, o?.['y'], o?.x?.z, o?.w?.z,
+  ].map(x => `${x}`).join(' '),
+
+  lines = [],
+
+) => pipy()
+
+.task()
+.onStart(
+  () => (
+    lines.push(`calc 7 3: ${calc(7, 3)}`),
+    lines.push(`calc 2.5 -4: ${calc(2.5, -4)}`),
+    lines.push(`concat: ${'a' + 1 + 2} ${1 + 2 + 'a'} ${'x' + null + undefined}`),
+    lines.push(`compare 1 '1': ${compare(1, '1')}`),
+    lines.push(`compare 'a' 'b': ${compare('a', 'b')}`),
+    lines.push(`compare undefined 0: ${compare(undefined, 0)}`),
+    lines.push(`compare null undefined: ${compare(null, undefined)}`),
+    lines.push(`logic 0 1: ${logic(0, 1)}`),
+    lines.push(`logic 'a' 'b': ${logic('a', 'b')}`),
+    lines.push(`logic null 2: ${logic(null, 2)}`),
+    lines.push(`props object: ${props({ x: { z: 1 }, y: 2 })}`),
+    lines.push(`props null: ${props(null)}`),
+    [new Data(lines.join('\n') + '\n'), new StreamEnd]
+  )
+)
+.tee('-')
+.wait(() => false, { timeout: 0.1 })
+
+)()
@@ -0,0 +1,97 @@
+((
+  queries = {},
+  results = [],
+
+  reply = (q, name) => new Message(
+    DNS.encode({
+      id: q.id,
+      qr: 1,
+      rd: 1,
+      ra: 1,
+      tc: name === 'tc.invalid' ? 1 : 0,
+      rcode: name === 'nx.invalid' ? 3 : 0,
+      question: q.question,
+      answer: name === 'a.invalid' && q.question[0].type === 'A' ? [
+        { name, type: 'A', ttl: 60, rdata: '127.0.0.1' }
+      ] : [],
+    })
+  ),
+
+  lookup = (name, tag) => $=>$
+    .connect(`${name}:8053`)
+    .handleData(d => results.push(`${tag} ${name}: ${d.toString()}`))
+    .handleStreamEnd(e => e.error && results.push(`${tag} ${name}: ${e.error}`)),
+
+  request = () => new Data('x'),
+
+) => pipy()
+
+//
+// Name server counting the A queries it receives
+//
+
+.listen('127.0.0.1:5300', { protocol: 'udp' })
+.replaceMessage(
+  msg => ((q = DNS.decode(msg.body), name = q.question[0].name) => (
+    q.question[0].type === 'A' && (queries[name] = (queries[name] || 0) + 1),
+    reply(q, name)
+  ))()
+)
+
+.listen('127.0.0.1:8053')
+.replaceData(() => [new Data('ok'), new StreamEnd])
+
+//
+// Two lookups at the same time share one query
+//
+
+.task()
+.onStart(request)
+.fork([0, 1]).to(lookup('a.invalid', '1 concurrent'))
+
+//
+// Later lookups are answered by the cache
+//
+
+.task()
+.onStart(request)
+.wait(() => false, { timeout: 0.3 })
+.fork().to(lookup('a.invalid', '2 cached'))
+
+.task()
+.onStart(request)
+.wait(() => false, { timeout: 0.3 })
+.fork().to(lookup('nx.invalid', '2 negative'))
+
+.task()
+.onStart(request)
+.wait(() => false, { timeout: 0.6 })
+.fork().to(lookup('nx.invalid', '3 negative cached'))
+
+//
+// Truncated answers fall back to the system resolver
+//
+
+.task()
+.onStart(request)
+.wait(() => false, { timeout: 0.6 })
+.fork().to(lookup('tc.invalid', '3 fallback'))
+
+.task()
+.onStart(() => new Message)
+.wait(() => false, { timeout: 1.5 })
+.replaceMessage(
+  () => [
+    new Data(
+      results.sort().concat(
+        Object.keys(queries).sort().map(k => `queries for ${k}: ${queries[k]}`)
+      ).join('\n') + '\n'
+    ),
+    new StreamEnd
+  ]
+)
+.tee('-')
+.wait(() => false, { timeout: 0.1 })
+.handleStreamEnd(() => pipy.exit())
+
+)()
@@ -0,0 +1,36 @@
+((
+  cache = new algo.SharedCache('shared-cache-test', { size: 4 }),
+  keys = new Array(10).fill(0).map((_, i) => 'k' + i),
+  list = () => keys.filter(k => cache.get(k) !== undefined).join(','),
+  lines = [],
+
+) => pipy()
+
+.task()
+.onStart(
+  () => (
+    keys.forEach(k => cache.set(k, k.toUpperCase())),
+    lines.push(`size 4: ${list()}`),
+    lines.push(`k9: ${cache.get('k9')}`),
+
+    cache.get('k6'),
+    cache.set('k0', 'K0'),
+    lines.push(`touched k6, set k0: ${list()}`),
+
+    new algo.SharedCache('shared-cache-test', { size: 2 }),
+    lines.push(`resized to 2: ${list()}`),
+
+    cache.remove('k9'),
+    cache.set('k0', { a: 1 }),
+    lines.push(`removed k9, set k0 again: ${list()} ${JSON.stringify(cache.get('k0'))}`),
+
+    cache.clear(),
+    lines.push(`cleared: ${list()}`),
+
+    [new Data(lines.join('\n') + '\n'), new StreamEnd]
+  )
+)
+.tee('-')
+.wait(() => false, { timeout: 0.1 })
+
+)()
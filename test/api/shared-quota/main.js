@@ -0,0 +1,113 @@
+((
+  //
+  // Runs in two worker threads. The one that takes the only token
+  // of this quota does the checks and prints, the other one only
+  // competes for a concurrency slot. Quotas used only by the leader are
+  // only constructed there, or the other worker would apply the options
+  // again whenever it gets to it.
+  //
+
+  leader = new algo.SharedQuota('sq-leader', 1).get('').consume(1) > 0,
+
+  keys = leader && new algo.SharedQuota('sq-keys', 3),
+  rate = leader && new algo.SharedQuota('sq-rate', 10, { per: 0.2, produce: 2 }),
+  reload = leader && new algo.SharedQuota('sq-reload', 5),
+  slots = new algo.SharedQuota('sq-slots', 1),
+  times = new algo.SharedCache('sq-times'),
+
+  results = {},
+
+) => pipy()
+
+//
+// Quotas of different keys are independent
+//
+
+.task()
+.onStart(
+  () => void (leader && (
+    results.keys = [
+      `a ${keys.get('a').consume(5)} of 5`,
+      `b ${keys.get('b').consume(1)} of 1`,
+      `a left ${keys.get('a').current}`,
+      `b left ${keys.get('b').current}`,
+    ].join(', ')
+  ))
+)
+
+//
+// A quota refills by 'produce' every 'per' up to the initial value
+//
+
+.task()
+.onStart(() => new Message)
+.handleMessageStart(() => leader && (results.rate = [rate.get('k').consume(10) - 10]))
+.wait(() => false, { timeout: 0.5 })
+.handleMessageStart(() => leader && results.rate.push(rate.get('k').current))
+.wait(() => false, { timeout: 1 })
+.handleMessageStart(() => leader && results.rate.push(rate.get('k').current))
+
+//
+// Options of a newly constructed instance of the same name
+// apply to the quotas already taken out, like after a reload
+//
+
+.task()
+.onStart(() => new Message)
+.handleMessageStart(
+  () => leader && (
+    reload.get('k').consume(5),
+    new algo.SharedQuota('sq-reload', 8, { per: 0.1 }),
+    results.reload = [reload.get('k').initial, reload.get('k').current]
+  )
+)
+.wait(() => false, { timeout: 0.5 })
+.handleMessageStart(() => leader && results.reload.push(reload.get('k').current))
+
+//
+// A concurrency slot taken on one worker is released when its stream
+// is done, waking up the stream waiting for it on the other worker
+//
+
+.task()
+.onStart(() => new Message)
+.wait(() => leader, { timeout: 0.3 })
+.demuxQueue().to($=>$
+  .throttleConcurrency(() => slots.get('k'))
+  .handleMessageStart(() => leader || times.set('passed', Date.now()))
+  .wait(() => !leader, { timeout: 1 })
+  .handleMessageEnd(() => leader && times.set('released', Date.now()))
+)
+
+.task()
+.onStart(() => new Message)
+.wait(() => false, { timeout: 2 })
+.replaceMessage(
+  () => leader ? (
+    (
+      passed = times.get('passed'),
+      released = times.get('released'),
+    ) => (
+      results.concurrency = (
+        passed === undefined ? 'waiter not woken' :
+        passed < released ? 'waiter not blocked' : 'waiter woken on release'
+      ),
+      [
+        new Data(
+          [
+            `keys: ${results.keys}`,
+            `rate: ${results.rate.join(' -> ')}`,
+            `reload: initial ${results.reload[0]}, ${results.reload[1]} -> ${results.reload[2]}`,
+            `concurrency: ${results.concurrency}`,
+          ].join('\n') + '\n'
+        ),
+        new StreamEnd
+      ]
+    )
+  )() : new Message
+)
+.tee('-')
+.wait(() => false, { timeout: 0.1 })
+.handleStreamEnd(() => pipy.exit())
+
+)()
@@ -0,0 +1,50 @@
+((
+  certificate = {
+    cert: new crypto.CertificateChain(pipy.load('server-cert.pem')),
+    key: new crypto.PrivateKey(pipy.load('server-key.pem')),
+  },
+
+  options = cache => ({ certificate, sessionCache: { name: cache } }),
+
+  //
+  // Each case makes a full handshake on port 8443 and then tries to
+  // resume the session on 8444, which shares the cache, and on 8445,
+  // which does not. OpenSSL's s_client tells whether a handshake was
+  // new or resumed.
+  //
+
+  script = `
+    connect() {
+      openssl s_client -connect 127.0.0.1:$1 -tls1_2 $2 < /dev/null 2> /dev/null |
+      grep -oE '^(New|Reused),' | tr -d ','
+    }
+    resume() {
+      f=$(mktemp)
+      a=$(connect 8443 "$1 -sess_out $f")
+      b=$(connect 8444 "$1 -sess_in $f")
+      c=$(connect 8445 "$1 -sess_in $f")
+      rm -f $f
+      echo $a $b $c
+    }
+    echo "session id: $(resume -no_ticket)"
+    echo "session ticket: $(resume)"
+  `,
+
+) => pipy()
+
+.listen('127.0.0.1:8443')
+.acceptTLS(options('a')).to($=>$.replaceStreamStart(new StreamEnd))
+
+.listen('127.0.0.1:8444')
+.acceptTLS(options('a')).to($=>$.replaceStreamStart(new StreamEnd))
+
+.listen('127.0.0.1:8445')
+.acceptTLS(options('b')).to($=>$.replaceStreamStart(new StreamEnd))
+
+.task()
+.onStart(() => new Data)
+.exec(['sh', '-c', script])
+.tee('-')
+.handleStreamEnd(() => pipy.exit())
+
+)()
@@ -0,0 +1,68 @@
+((
+  sizes = [1, 100, 1400, 1400, 1400, 1400, 3000, 8000, 8000, 16000, 1, 1, 500],
+
+  results = {},
+
+  batch = () => sizes.map(
+    (n, i) => new Message(new Data(new Array(n).fill(65 + i)))
+  ),
+
+  show = msg => (
+    (s = msg.body.toString(), c = s.substring(0, 1)) => `${s.length}${c}${s === c.repeat(s.length) ? '' : '!'}`
+  )(),
+
+  client = (tag, port, options) => $=>$
+    .connect(`127.0.0.1:${port}`, { protocol: 'udp', idleTimeout: 1, ...options })
+    .handleMessage(msg => (results[tag] ??= []).push(show(msg))),
+
+) => pipy()
+
+//
+// Echo servers with and without GSO/GRO
+//
+
+.listen('127.0.0.1:8070', { protocol: 'udp' })
+.replaceMessage(msg => msg)
+
+.listen('127.0.0.1:8071', { protocol: 'udp', gso: true, gro: true })
+.replaceMessage(msg => msg)
+
+//
+// Each client sends a batch of datagrams of different sizes at once,
+// with runs of the same size that GSO and GRO can coalesce
+//
+
+.task()
+.onStart(batch)
+.fork().to(client('plain to plain', 8070, {}))
+
+.task()
+.onStart(batch)
+.fork().to(client('gso to plain', 8070, { gso: true }))
+
+.task()
+.onStart(batch)
+.fork().to(client('plain to gro', 8071, {}))
+
+.task()
+.onStart(batch)
+.fork().to(client('gso to gro', 8071, { gso: true, gro: true }))
+
+.task()
+.onStart(() => new Message)
+.wait(() => false, { timeout: 0.5 })
+.replaceMessage(
+  () => [
+    new Data(
+      Object.keys(results).sort().map(
+        k => `${k}: ${results[k].join(' ')}`
+      ).join('\n') + '\n'
+    ),
+    new StreamEnd
+  ]
+)
+.tee('-')
+.wait(() => false, { timeout: 0.1 })
+.handleStreamEnd(() => pipy.exit())
+
+)()
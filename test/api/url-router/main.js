@@ -0,0 +1,62 @@
+((
+  router = new algo.URLRouter({
+    '/users/:id': 'user',
+    '/users/:userId/posts': 'posts',
+    '/users/:userId/posts/:postId': 'post',
+    '/files/*': 'files',
+    '/a/*/c': 'any segment',
+    '*.example.com/': 'subdomain',
+    'www.example.com/:page': 'www',
+  }),
+
+  show = path => (
+    (m => m ? `${path} -> ${m.value} ${JSON.stringify(m.params)}` : `${path} -> none`)(
+      router.match(path)
+    )
+  ),
+
+  paths = [
+    '/users/5',
+    '/users/5/posts',
+    '/users/5/posts/7',
+    '/users/5/comments',
+    '/files/a/b/c.txt',
+    '/a/b/c',
+    '/a/b/d',
+    'foo.example.com/',
+    'www.example.com/home',
+    'www.example.com:8080/home?x=1',
+  ],
+
+  lines = [],
+
+) => pipy()
+
+.task()
+.onStart(
+  () => (
+    paths.forEach(p => lines.push(show(p))),
+    router.add('/users/:name/likes', 'likes'),
+    lines.push(`added: ${show('/users/5/likes')}`),
+    router.reload({
+      '/items/:itemId': 'item',
+      '/users/:uid': 'user',
+    }),
+    router.add('/extra', 'added while reloading'),
+    new Message
+  )
+)
+.wait(() => false, { timeout: 0.2 })
+.replaceMessage(
+  () => (
+    lines.push(`reloaded: ${show('/items/9')}`),
+    lines.push(`reloaded: ${show('/users/5')}`),
+    lines.push(`reloaded: ${show('/users/5/posts')}`),
+    lines.push(`reloaded: ${show('/extra')}`),
+    [new Data(lines.join('\n') + '\n'), new StreamEnd]
+  )
+)
+.tee('-')
+.wait(() => false, { timeout: 0.1 })
+
+)()
@@ -0,0 +1,64 @@
+//
+// Compares HashingLoadBalancer and ConsistentHashingLoadBalancer on:
+//   - selection cost (ns per select)
+//   - fraction of keys that move to a different target on churn
+//
+// Usage: bin/pipy test/benchmarks/algo/consistent-hashing.js
+//
+
+((
+  N = 1000000,
+  K = 100000,
+
+  targets = new Array(10).fill(0).map((_, i) => `10.0.0.${i + 1}:8080`),
+  keys = new Array(K).fill(0).map((_, i) => `session-${i}`),
+
+  snapshot = lb => keys.map(k => lb.select(k)),
+
+  moved = (a, b) => a.filter((t, i) => t !== b[i]).length / K,
+
+  time = lb => (
+    ((t = Date.now()) => (
+      new Array(N).fill(0).forEach((_, i) => lb.select(keys[i % K])),
+      (Date.now() - t) * 1000000 / N
+    ))()
+  ),
+
+  report = (name, cost, churn) => console.log(
+    name.padEnd(32, ' '),
+    'select', cost.toFixed(0).padStart(5, ' '), 'ns',
+    '  moved:',
+    Object.entries(churn).map(([k, v]) => `${k} ${(v * 100).toFixed(1)}%`).join(', ')
+  ),
+
+) => (
+  ((
+    lb = new algo.HashingLoadBalancer(targets),
+    before = snapshot(lb),
+  ) => report(
+    'HashingLoadBalancer',
+    time(lb),
+    {
+      'remove 1/10': moved(before, snapshot(new algo.HashingLoadBalancer(targets.slice(1)))),
+      'add 1': moved(before, snapshot(new algo.HashingLoadBalancer([...targets, '10.0.0.11:8080']))),
+    }
+  ))(),
+
+  ((
+    lb = new algo.ConsistentHashingLoadBalancer(targets),
+    before = snapshot(lb),
+    churn = {},
+  ) => (
+    lb.set(targets[0], 0), churn['remove 1/10'] = moved(before, snapshot(lb)), lb.set(targets[0], 1),
+    lb.set('10.0.0.11:8080', 1), churn['add 1'] = moved(before, snapshot(lb)), lb.set('10.0.0.11:8080', 0),
+    lb.set(targets[0], 2), churn['reweight 1'] = moved(before, snapshot(lb)), lb.set(targets[0], 1),
+    churn['unhealthy 1'] = ((unhealthy = new algo.Cache) => (
+      unhealthy.set(targets[0], true),
+      moved(before, keys.map(k => lb.select(k, unhealthy)))
+    ))(),
+    report('ConsistentHashingLoadBalancer', time(lb), churn)
+  ))(),
+
+  pipy.exit(),
+  pipy()
+))()
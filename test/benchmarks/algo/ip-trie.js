@@ -0,0 +1,48 @@
+//
+// Lookup cost of algo.IPTrie with a 500k-prefix table (400k IPv4
+// prefixes of /8 to /32, mostly /24, and 100k IPv6 prefixes of /32
+// to /64), against a linear scan over 1k Netmask objects.
+//
+// Usage: bin/pipy test/benchmarks/algo/ip-trie.js
+//
+
+((
+  N = 1000000,
+
+  seed = 1,
+  rand = n => (seed = (seed * 48271) % 2147483647) % n,
+
+  v4 = () => `${rand(224)}.${rand(256)}.${rand(256)}.${rand(256)}`,
+  v6 = () => `2001:${rand(10000)}:${rand(10000)}:${rand(10000)}::${rand(10000)}`,
+  v4len = () => ((r = rand(100)) => r < 70 ? 24 : r < 85 ? 16 + rand(8) : r < 95 ? 25 + rand(8) : 8 + rand(8))(),
+
+  table = new Data(
+    new Array(400000).fill(0).map((_, i) => `${v4()}/${v4len()} v4-${i}`).join('\n') + '\n' +
+    new Array(100000).fill(0).map((_, i) => `${v6()}/${32 + rand(33)} v6-${i}`).join('\n')
+  ),
+
+  addresses = new Array(1000).fill(0).map((_, i) => i % 5 ? v4() : v6()),
+  raw = addresses.filter(a => !a.includes(':')).map(a => new Data(a.split('.').map(n => n * 1))),
+
+  trie = ((t = Date.now(), trie = new algo.IPTrie(table)) => (
+    trie.lookup('0.0.0.0'),
+    console.log('ip-trie', trie.size, 'prefixes built in', Date.now() - t, 'ms'),
+    trie
+  ))(),
+
+  masks = new Array(1000).fill(0).map(() => new Netmask(`${v4()}/${v4len()}`)),
+
+  measure = (name, n, f) => (
+    (found = 0, t = Date.now()) => (
+      new Array(n).fill(0).forEach((_, i) => f(i) !== undefined && found++),
+      console.log('ip-trie', name, n, 'lookups', ((Date.now() - t) * 1000000 / n).toFixed(0), 'ns/lookup', found, 'found')
+    )
+  )(),
+
+) => (
+  measure('string', N, i => trie.lookup(addresses[i % addresses.length])),
+  measure('raw', N, i => trie.lookup(raw[i % raw.length])),
+  measure('netmask-scan-1k', N / 100, i => masks.find(m => m.contains(addresses[i % addresses.length]))),
+  pipy.exit(),
+  pipy()
+))()
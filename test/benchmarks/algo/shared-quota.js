@@ -0,0 +1,53 @@
+//
+// Contention on algo.SharedQuota when every worker thread takes tokens
+// from the same few buckets at once. Each thread calls consume(1) CALLS
+// times, going round KEYS shared quotas of RATE tokens per second, then
+// does the same on a thread-local algo.Quota for comparison. Printed per
+// thread are the cost of each call and the tokens admitted. Summed over
+// all threads, the tokens admitted by the shared quotas should stay
+// within KEYS x RATE per second elapsed, however many threads there are.
+//
+// Usage: [KEYS=1] [RATE=100000] [CALLS=10000000] bin/pipy --threads=32 test/benchmarks/algo/shared-quota.js
+//
+
+((
+  KEYS = (os.env.KEYS || 1) * 1,
+  RATE = (os.env.RATE || 100000) * 1,
+  CALLS = (os.env.CALLS || 10000000) * 1,
+
+  shared = new algo.SharedQuota('benchmark', RATE, { per: 1 }),
+  local = new algo.Quota(RATE, { per: 1 }),
+
+  keys = new Array(KEYS).fill(0).map((_, i) => `tenant-${i}`),
+
+  batch = new Array(1000).fill(0),
+  seconds = 0,
+
+  measure = (name, f) => (
+    (admitted = 0, t = Date.now()) => (
+      new Array(CALLS / batch.length).fill(0).forEach(
+        () => batch.forEach((_, i) => admitted += f(keys[i % KEYS]))
+      ),
+      console.log(
+        'shared-quota', name,
+        ((Date.now() - t) * 1000000 / CALLS).toFixed(0), 'ns/call',
+        admitted, 'admitted in', Date.now() - t, 'ms',
+      )
+    )
+  )(),
+
+) => pipy()
+
+.task('1s')
+.onStart(
+  () => (
+    ++seconds === 2 && (
+      measure('shared', key => shared.get(key).consume(1)),
+      measure('local', () => local.consume(1)),
+      pipy.exit()
+    ),
+    new StreamEnd
+  )
+)
+
+)()
@@ -0,0 +1,60 @@
+//
+// Lookup cost of algo.URLRouter with a 20k-route table made of
+// host-specific, exact, parameterized and prefix (/*) routes.
+//
+// Usage: bin/pipy test/benchmarks/algo/url-router.js
+//
+
+((
+  N = 1000000,
+
+  services = new Array(500).fill(0).map((_, i) => `svc-${i}`),
+  resources = ['users', 'orders', 'items', 'carts', 'invoices', 'payments', 'reviews', 'sessions', 'shipments', 'tokens'],
+
+  routes = Object.fromEntries([
+    ...services.flatMap(
+      s => resources.flatMap(
+        r => [
+          [`/${s}/v1/${r}`, `${s}:${r}:list`],
+          [`/${s}/v1/${r}/:id`, `${s}:${r}:get`],
+          [`/${s}/v1/${r}/:id/history`, `${s}:${r}:history`],
+          [`/${s}/v2/${r}/*`, `${s}:${r}:v2`],
+        ]
+      )
+    ),
+    ...services.map(s => [`${s}.example.com/*`, `${s}:host`]),
+    ...services.map(s => [`/static/${s}/*`, `${s}:static`]),
+  ]),
+
+  urls = new Array(1000).fill(0).map(
+    (_, i) => ((
+      s = services[i * 7919 % services.length],
+      r = resources[i % resources.length],
+    ) => [
+      `/${s}/v1/${r}`,
+      `/${s}/v1/${r}/${i}`,
+      `/${s}/v1/${r}/${i}/history`,
+      `/${s}/v2/${r}/${i}/details`,
+      `${s}.example.com/index.html`,
+      `/static/${s}/js/app.${i}.js`,
+      `/unknown/${s}/${i}`,
+    ][i % 7])()
+  ),
+
+  router = ((t = Date.now(), r = new algo.URLRouter(routes)) => (
+    r.find('/'),
+    console.log('url-router', Object.keys(routes).length, 'routes built in', Date.now() - t, 'ms'),
+    r
+  ))(),
+
+  found = 0,
+  t = Date.now(),
+
+) => (
+  new Array(N).fill(0).forEach(
+    (_, i) => router.find(urls[i % urls.length]) !== undefined && found++
+  ),
+  console.log('url-router', N, 'lookups', ((Date.now() - t) * 1000000 / N).toFixed(0), 'ns/lookup', found, 'found'),
+  pipy.exit(),
+  pipy()
+))()
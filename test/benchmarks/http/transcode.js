@@ -0,0 +1,66 @@
+//
+// Throughput of decoding and re-encoding HTTP/1 requests with realistic heads
+// (10 to 40 headers, 1 to 4 KB each), fed as pipelined requests.
+//
+// Usage: bin/pipy test/benchmarks/http/transcode.js
+//
+
+((
+  ROUNDS = 200,
+
+  names = [
+    'user-agent', 'accept', 'accept-language', 'accept-encoding', 'cache-control',
+    'x-request-id', 'x-forwarded-for', 'x-forwarded-proto', 'x-b3-traceid', 'x-b3-spanid',
+    'authorization', 'cookie', 'referer', 'origin', 'sec-fetch-mode', 'sec-fetch-site',
+    'if-none-match', 'if-modified-since', 'x-client-version', 'x-tenant-id',
+  ],
+
+  request = i => (
+    (
+      n = 10 + i * 7 % 31,
+      pad = new Array(1 + i % 6).fill('abcdefghijklmnopqrstuvwxyz0123456789').join(''),
+    ) => [
+      `GET /api/v1/items/${i}?page=${i % 10}&sort=name HTTP/1.1`,
+      'Host: api.example.com',
+      ...new Array(n).fill(0).map(
+        (_, j) => `${j < names.length ? names[j] : 'x-custom-header-' + j}: ${pad}-${i}-${j}`
+      ),
+      '', '',
+    ].join('\r\n')
+  )(),
+
+  requests = new Array(100).fill(0).map((_, i) => request(i)),
+  batch = new Data(requests.join('')),
+
+  count = 0,
+  start = 0,
+
+) => pipy()
+
+.task()
+.onStart(
+  () => (
+    start = Date.now(),
+    [
+      ...new Array(ROUNDS).fill(0).map(() => new Data(batch)),
+      new StreamEnd,
+    ]
+  )
+)
+.decodeHTTPRequest()
+.handleMessageStart(() => count++)
+.encodeHTTPRequest()
+.handleStreamEnd(
+  () => (
+    ((ms = Date.now() - start) => console.log(
+      'http-transcode', count, 'requests',
+      (batch.size * ROUNDS / 1024 / 1024).toFixed(1), 'MB',
+      ms, 'ms',
+      Math.round(count / ms * 1000), 'req/s',
+    ))(),
+    pipy.exit()
+  )
+)
+.dummy()
+
+)()
@@ -0,0 +1,49 @@
+//
+// Cost on the worker thread of writing access-log style JSON messages
+// to a file, measured from a running event loop.
+//
+// Usage: bin/pipy test/benchmarks/logging/file.js
+//
+
+((
+  COUNT = 200000,
+
+  logger = new logging.JSONLogger('benchmark').toFile('/tmp/pipy-benchmark/access.log'),
+
+  entry = i => ({
+    time: 1700000000000 + i,
+    method: 'GET',
+    path: `/api/v1/items/${i}?page=${i % 10}`,
+    status: 200,
+    upstream: `10.0.${i % 4}.${i % 250}:8080`,
+    bytes: 1024 + i % 4096,
+    latency: i % 100,
+    userAgent: 'Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36',
+  }),
+
+  entries = new Array(1000).fill(0).map((_, i) => entry(i)),
+
+  done = false,
+
+) => pipy()
+
+.task('1s')
+.onStart(
+  () => (
+    done || (
+      done = true,
+      ((start = Date.now()) => (
+        new Array(COUNT).fill(0).forEach((_, i) => logger.log(entries[i % entries.length])),
+        ((ms = Date.now() - start) => console.log(
+          'logging-file', COUNT, 'messages',
+          ms, 'ms',
+          Math.round(COUNT / ms * 1000), 'msg/s',
+        ))()
+      ))(),
+      pipy.exit()
+    ),
+    new StreamEnd
+  )
+)
+
+)()
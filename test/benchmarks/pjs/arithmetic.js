@@ -0,0 +1,19 @@
+((
+  N = 1000000,
+
+  score = (x, y, w) => (
+    ((x * 31 + y) % 97) / (w + 1) +
+    (x << 3 ^ y >> 1) - (x > y ? x - y : y - x) * 0.5
+  ),
+
+  sum = 0,
+  t = Date.now(),
+
+) => (
+  new Array(N).fill(0).forEach(
+    (_, i) => sum += score(i, i & 255, i % 7)
+  ),
+  console.log('arithmetic', N, Date.now() - t, Math.floor(sum)),
+  pipy.exit(),
+  pipy()
+))()
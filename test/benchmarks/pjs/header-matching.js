@@ -0,0 +1,32 @@
+((
+  N = 1000000,
+
+  head = {
+    method: 'GET',
+    path: '/api/v1/users/123',
+    headers: {
+      'host': 'api.example.com',
+      'user-agent': 'curl/7.79.1',
+      'accept': '*/*',
+      'x-request-id': '0f8fad5b-d9cb-469f-a165-70867728950e',
+    },
+  },
+
+  match = head => (
+    head.headers['host'] === 'api.example.com' &&
+    head.method === 'GET' &&
+    head.path.startsWith('/api/') &&
+    (head.headers['x-canary'] ?? 'false') !== 'true'
+  ),
+
+  hits = 0,
+  t = Date.now(),
+
+) => (
+  new Array(N).fill(0).forEach(
+    () => match(head) && hits++
+  ),
+  console.log('header-matching', N, Date.now() - t, hits),
+  pipy.exit(),
+  pipy()
+))()
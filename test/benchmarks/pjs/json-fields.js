@@ -0,0 +1,27 @@
+((
+  N = 1000000,
+
+  body = JSON.parse(`{
+    "user": { "id": 123, "name": "alice", "roles": ["admin", "dev"] },
+    "token": { "iss": "pipy", "exp": 1700000000, "scope": "read write" },
+    "items": [{ "sku": "a-1", "qty": 2 }, { "sku": "b-2", "qty": 5 }]
+  }`),
+
+  extract = obj => (
+    obj.user.id + ':' +
+    obj.user.roles[0] + ':' +
+    obj.token.iss + ':' +
+    (obj.items[1]?.qty ?? 0)
+  ),
+
+  total = 0,
+  t = Date.now(),
+
+) => (
+  new Array(N).fill(0).forEach(
+    () => total += extract(body).length
+  ),
+  console.log('json-fields', N, Date.now() - t, total),
+  pipy.exit(),
+  pipy()
+))()
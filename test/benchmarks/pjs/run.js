@@ -0,0 +1,41 @@
+#!/usr/bin/env node
+
+//
+// Runs each benchmark script with both the bytecode engine and the
+// tree-walking interpreter (--no-bytecode) and compares the timings.
+//
+// Each script is expected to log a line of "<name> <iterations> <ms> <checksum>".
+//
+
+import { spawnSync } from 'child_process';
+import { join, dirname, basename } from 'path';
+import fs from 'fs';
+import chalk from 'chalk';
+
+const basePath = dirname(new URL(import.meta.url).pathname);
+const pipyBinPath = join(basePath, '../../../bin/pipy');
+
+function run(script, args) {
+  const proc = spawnSync(pipyBinPath, [...args, join(basePath, script)]);
+  const output = proc.stdout.toString() + proc.stderr.toString();
+  const prefix = basename(script, '.js') + ' ';
+  const line = output.split('\n').map(l => l.substring(l.indexOf('] ') + 2)).find(l => l.startsWith(prefix));
+  if (!line) throw new Error(`No result from ${script}: ${output}`);
+  const [name, n, ms, checksum] = line.trim().split(' ');
+  return { name, n: Number(n), ms: Number(ms), checksum };
+}
+
+const scripts = fs.readdirSync(basePath).filter(f => f.endsWith('.js') && f !== 'run.js').sort();
+
+for (const script of scripts) {
+  const tree = run(script, ['--no-bytecode']);
+  const bytecode = run(script, []);
+  const ok = tree.checksum === bytecode.checksum;
+  console.log(
+    chalk.cyan(tree.name.padEnd(20)),
+    'tree', chalk.yellow(`${Math.round(tree.n / tree.ms * 1000)} ops/s`.padEnd(16)),
+    'bytecode', chalk.yellow(`${Math.round(bytecode.n / bytecode.ms * 1000)} ops/s`.padEnd(16)),
+    'speedup', chalk.green(`${(tree.ms / bytecode.ms).toFixed(2)}x`.padEnd(8)),
+    ok ? chalk.green('OK') : chalk.red(`MISMATCH ${tree.checksum} != ${bytecode.checksum}`),
+  );
+}
@@ -0,0 +1,69 @@
+#!/usr/bin/env node
+
+//
+// Measures how long it takes to start up and exit with a large script,
+// without a script cache, with an empty one (--script-cache filled on the
+// way) and with a warm one. The script is generated with FUNCTIONS arrow
+// functions of a few dozen tokens each, and every case runs RUNS times.
+//
+// Usage: [FUNCTIONS=20000] [RUNS=5] [THREADS=1] node test/benchmarks/startup/run.js
+//
+
+import { spawnSync } from 'child_process';
+import { join, dirname } from 'path';
+import fs from 'fs';
+import os from 'os';
+
+const FUNCTIONS = Number(process.env.FUNCTIONS || 20000);
+const RUNS = Number(process.env.RUNS || 5);
+const THREADS = Number(process.env.THREADS || 1);
+
+const basePath = dirname(new URL(import.meta.url).pathname);
+const pipyBinPath = join(basePath, '../../../bin/pipy');
+
+const workPath = fs.mkdtempSync(join(os.tmpdir(), 'pipy-startup-'));
+const scriptPath = join(workPath, 'main.js');
+const cachePath = join(workPath, 'cache');
+
+fs.writeFileSync(scriptPath, [
+  '((',
+  ...new Array(FUNCTIONS).fill(0).map(
+    (_, i) => `  f${i} = (a, b) => a?.x > ${i} ? \`${i}:\${a.y || 'none'}\` : [b, ${i * 0.5}, { k: 'v${i}' }],`
+  ),
+  ') => pipy()',
+  '.task()',
+  '.onStart(() => (pipy.exit(), new StreamEnd))',
+  ')()',
+].join('\n'));
+
+function run(args) {
+  const t = process.hrtime.bigint();
+  const proc = spawnSync(pipyBinPath, ['--no-graph', `--threads=${THREADS}`, ...args, scriptPath]);
+  const ms = Number(process.hrtime.bigint() - t) / 1e6;
+  if (proc.status !== 0) throw new Error(`pipy exited with ${proc.status}: ${proc.stderr}`);
+  return ms;
+}
+
+function report(name, args, before) {
+  const times = new Array(RUNS).fill(0).map(() => (before && before(), run(args)));
+  const avg = times.reduce((a, b) => a + b) / times.length;
+  console.log(
+    name.padEnd(12),
+    `avg ${avg.toFixed(0)} ms`.padEnd(14),
+    `min ${Math.min(...times).toFixed(0)} ms`.padEnd(14),
+    `max ${Math.max(...times).toFixed(0)} ms`,
+  );
+  return avg;
+}
+
+const reset = () => fs.rmSync(cachePath, { recursive: true, force: true });
+
+console.log(`${(fs.statSync(scriptPath).size / 1024 / 1024).toFixed(1)} MB script, ${THREADS} thread(s)`);
+
+const none = report('no cache', []);
+const cold = report('cold cache', [`--script-cache=${cachePath}`], reset);
+const warm = report('warm cache', [`--script-cache=${cachePath}`]);
+
+console.log(`speedup with warm cache: ${(none / warm).toFixed(2)}x, cold cache overhead: ${(cold - none).toFixed(0)} ms`);
+
+fs.rmSync(workPath, { recursive: true, force: true });
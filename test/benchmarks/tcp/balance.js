@@ -0,0 +1,66 @@
+//
+// Spread of connections over worker threads with a mix of long-lived and
+// short connections. Every thread listens on port 8000 and, from the
+// second second on, opens LONG connections that stay open until the end
+// plus SHORT connections per second that send a byte and close. The long
+// ones are closed by an idle timeout before exiting. Printed each second
+// by every thread (tagged with a random name) are the connections it has
+// open and the ones it accepted in that second.
+// Run it with and without --balance-connections and compare how far the
+// busiest thread is from the idlest.
+//
+// Usage: [LONG=1000] [SHORT=200] [DURATION=10] bin/pipy --threads=8 --reuse-port [--balance-connections] test/benchmarks/tcp/balance.js
+//
+
+((
+  LONG = (os.env.LONG || 1000) * 1,
+  SHORT = (os.env.SHORT || 200) * 1,
+  DURATION = (os.env.DURATION || 10) * 1,
+
+  tag = Math.random().toString(36).substring(2, 6),
+  longs = new Array(LONG).fill(0),
+  shorts = new Array(SHORT).fill(0),
+
+  live = 0,
+  accepted = 0,
+  seconds = 0,
+
+) => pipy()
+
+.listen(8000)
+.onStart(() => void (live++, accepted++))
+.onEnd(() => void live--)
+.handleData(() => undefined)
+
+.task('1s')
+.onStart(
+  () => (
+    ++seconds > 2 && seconds <= DURATION + 2 && console.log(
+      'tcp-balance', tag, live, 'open', accepted, 'accepted/s',
+    ),
+    accepted = 0,
+    seconds > DURATION + 3 && pipy.exit(),
+    seconds > 2 && seconds <= DURATION + 2 ? [new Data('x'), new StreamEnd] : new StreamEnd
+  )
+)
+.branch(
+  () => seconds > 2 && seconds <= DURATION + 2, (
+    $=>$.fork(shorts).to($=>$.connect('127.0.0.1:8000'))
+  ),
+  (
+    $=>$
+  )
+)
+
+.task('1s')
+.onStart(() => seconds === 2 ? new Data('x') : new StreamEnd)
+.branch(
+  () => seconds === 2, (
+    $=>$.fork(longs).to($=>$.connect('127.0.0.1:8000', { idleTimeout: DURATION + 0.5 }))
+  ),
+  (
+    $=>$
+  )
+)
+
+)()
@@ -0,0 +1,89 @@
+//
+// Throughput and latency of a TCP proxy. Port 8000 forwards to an echo
+// server on port 8001, with a no-op filter in front of connect() so that
+// the bytes are read and written by pipy rather than spliced in the kernel.
+// CONNECTIONS clients send SIZE-byte messages through the proxy at a total
+// RATE, in bursts every 10ms, and time the echo of each message. Printed
+// each second are the messages sent and echoed, the bytes echoed and the
+// average and worst round-trip time in milliseconds (Date.now() resolution).
+// Run it on a build with -DPIPY_IO_URING=ON and on one without at the same
+// RATE, and raise RATE until the echoes fall behind to find the maximum.
+//
+// Usage: [RATE=100000] [CONNECTIONS=100] [SIZE=1024] bin/pipy test/benchmarks/tcp/proxy.js
+//
+
+((
+  RATE = (os.env.RATE || 100000) * 1,
+  CONNECTIONS = (os.env.CONNECTIONS || 100) * 1,
+  SIZE = (os.env.SIZE || 1024) * 1,
+  DURATION = 5,
+
+  burst = Math.max(1, RATE / CONNECTIONS / 100),
+  payload = new Data(new Array(SIZE).fill(120)),
+  messages = new Array(Math.ceil(RATE / CONNECTIONS * DURATION)).fill(0),
+  indices = new Array(CONNECTIONS).fill(0).map((_, i) => i),
+
+  sent = 0,
+  echoed = 0,
+  bytes = 0,
+  latencySum = 0,
+  latencyMax = 0,
+  seconds = 0,
+
+  record = t => (
+    echoed++,
+    latencySum += t,
+    latencyMax = Math.max(latencyMax, t)
+  ),
+
+) => pipy({
+  _times: null,
+  _pending: 0,
+})
+
+.listen(8000)
+.handleData(() => undefined)
+.connect('127.0.0.1:8001')
+
+.listen(8001)
+.handleData(() => undefined)
+
+.task()
+.onStart(() => messages.map(() => new Message(payload)))
+.fork(indices).to(
+  $=>$
+  .onStart(() => void (_times = []))
+  .throttleMessageRate(() => new algo.Quota(burst, { produce: burst, per: 0.01 }))
+  .handleMessageStart(() => void (sent++, _times.push(Date.now())))
+  .connect('127.0.0.1:8000')
+  .handleData(
+    data => (
+      (
+        now = Date.now(),
+        n = Math.floor((_pending + data.size) / SIZE),
+      ) => (
+        bytes += data.size,
+        _pending = (_pending + data.size) % SIZE,
+        _times.splice(0, n).forEach(t => record(now - t))
+      )
+    )()
+  )
+)
+
+.task('1s')
+.onStart(
+  () => (
+    seconds > 0 && console.log(
+      'tcp-proxy', sent, 'msg/s sent',
+      echoed, 'msg/s echoed',
+      (bytes / 1024 / 1024).toFixed(1), 'MB/s',
+      'rtt avg', echoed > 0 ? (latencySum / echoed).toFixed(2) : '-',
+      'max', latencyMax,
+    ),
+    sent = echoed = bytes = latencySum = latencyMax = 0,
+    ++seconds > DURATION + 1 && pipy.exit(),
+    new StreamEnd
+  )
+)
+
+)()
@@ -0,0 +1,22 @@
+//
+// Forwarding cost of an opaque TCP proxy. Port 8000 has connect() as its
+// only filter, so both directions get spliced in the kernel. Port 8001 adds
+// a no-op filter in front, which keeps the bytes going through user space.
+//
+// Usage: iperf3 -s
+//        bin/pipy test/benchmarks/tcp/splice.js
+//        iperf3 -c 127.0.0.1 -p 8000 -t 10 [--bidir]
+//        iperf3 -c 127.0.0.1 -p 8001 -t 10 [--bidir]
+//
+// Compare the throughputs and the CPU time taken by pipy in each run
+// (e.g. with pidstat -p $(pgrep pipy) 1).
+//
+
+pipy()
+
+.listen(8000)
+.connect('127.0.0.1:5201')
+
+.listen(8001)
+.handleData(() => undefined)
+.connect('127.0.0.1:5201')
@@ -0,0 +1,72 @@
+//
+// Cost of connection timeouts at a high connection count. The task opens
+// CONNECTIONS connections to the listener on port 8000, spread over
+// ADDRESSES loopback addresses so the ephemeral ports don't run out.
+// Both ends have idle, read and write timeouts, so every byte sent or
+// received reschedules a few timers. Each connection sends one byte per
+// INTERVAL seconds, throttled by a quota of its own, and the listener
+// echoes it back. Printed each second are the connections established
+// and the bytes echoed.
+//
+// Usage: ulimit -n 1100000
+//        [CONNECTIONS=500000] [ADDRESSES=20] [INTERVAL=5] bin/pipy test/benchmarks/tcp/timeouts.js
+//
+// Each connection takes two file descriptors in the same process, and on
+// most systems 'sysctl net.ipv4.ip_local_port_range' and 'fs.nr_open' need
+// raising as well. Compare the echo rate and the CPU time taken by pipy
+// across builds (e.g. with pidstat -p $(pgrep pipy) 1).
+//
+
+((
+  CONNECTIONS = (os.env.CONNECTIONS || 500000) * 1,
+  ADDRESSES = (os.env.ADDRESSES || 20) * 1,
+  INTERVAL = (os.env.INTERVAL || 5) * 1,
+  DURATION = 30,
+
+  timeouts = {
+    readTimeout: INTERVAL * 4,
+    writeTimeout: INTERVAL * 4,
+    idleTimeout: INTERVAL * 4,
+  },
+
+  payload = new Data(new Array(DURATION * 2 / INTERVAL + 1).fill(120)),
+  indices = new Array(CONNECTIONS).fill(0).map((_, i) => i),
+
+  connected = 0,
+  closed = 0,
+  echoed = 0,
+  seconds = 0,
+
+) => pipy({
+  _target: '',
+})
+
+.listen(8000, timeouts)
+.onStart(() => void connected++)
+.onEnd(() => void closed++)
+.handleData(() => undefined)
+
+.task()
+.onStart(() => payload)
+.fork(indices).to(
+  $=>$
+  .onStart(i => void (_target = `127.0.0.${i % ADDRESSES + 1}:8000`))
+  .throttleDataRate(() => new algo.Quota(1, { produce: 1, per: INTERVAL }))
+  .connect(() => _target, timeouts)
+  .handleData(data => void (echoed += data.size))
+)
+
+.task('1s')
+.onStart(
+  () => (
+    seconds > 0 && console.log(
+      'tcp-timeouts', connected - closed, 'connections',
+      echoed, 'bytes/s echoed',
+    ),
+    echoed = 0,
+    ++seconds > DURATION && pipy.exit(),
+    new StreamEnd
+  )
+)
+
+)()
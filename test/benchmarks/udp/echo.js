@@ -0,0 +1,51 @@
+//
+// Packets per second through a UDP listener that echoes 64-byte datagrams
+// back to a UDP connect() in the same worker. The client offers a fixed rate
+// in bursts every 10ms; the numbers printed each second are the datagrams
+// the listener received and the echoes the client got back.
+//
+// Usage: [RATE=<packets per second>] [OFFLOAD=gso,gro] bin/pipy test/benchmarks/udp/echo.js
+//
+
+((
+  RATE = (os.env.RATE || 200000) * 1,
+  DURATION = 5,
+
+  offload = {
+    gso: (os.env.OFFLOAD || '').includes('gso'),
+    gro: (os.env.OFFLOAD || '').includes('gro'),
+  },
+
+  payload = new Data(new Array(64).fill(120)),
+  burst = RATE / 100,
+
+  received = 0,
+  echoed = 0,
+  seconds = 0,
+
+) => pipy()
+
+.listen(8000, { protocol: 'udp', ...offload })
+.handleMessage(() => received++)
+
+.task()
+.onStart(() => new Array(RATE * DURATION).fill(0).map(() => new Message(payload)))
+.throttleMessageRate(new algo.Quota(burst, { produce: burst, per: 0.01 }))
+.connect('127.0.0.1:8000', { protocol: 'udp', ...offload })
+.handleMessage(() => echoed++)
+
+.task('1s')
+.onStart(
+  () => (
+    seconds > 0 && console.log(
+      'udp-echo', RATE, 'pps offered',
+      received, 'pps received',
+      echoed, 'pps echoed',
+    ),
+    received = echoed = 0,
+    ++seconds > DURATION + 1 && pipy.exit(),
+    new StreamEnd
+  )
+)
+
+)()
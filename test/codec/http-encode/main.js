@@ -0,0 +1,8 @@
+pipy()
+
+.task()
+.onStart(() => new Message)
+.read('input')
+.decodeHTTPRequest()
+.encodeHTTPRequest()
+.tee('-')
@@ -0,0 +1,13 @@
+pipy()
+
+.task()
+.onStart(() => new Message)
+.read('input')
+.decodeHTTPRequest()
+.replaceMessage(
+  msg => new Message(
+    JSON.stringify(msg.head) + '\n' +
+    msg.body.toString() + '\n'
+  )
+)
+.tee('-')
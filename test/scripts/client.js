@@ -5,6 +5,7 @@ import fs from 'fs';
 import http from 'http';
 import https from 'https';
 import http2 from 'http2';
+import net from 'net';
 import { join } from 'path';
 
 const log = console.log;
@@ -117,11 +118,54 @@ protocols.http2 = function(target) {
   return f;
 }
 
+//
+// Sends the body over a new connection and half-closes it, then reads
+// until the other side closes. With closeAfter, the connection is closed
+// once that many bytes have come back, which resets it since the rest
+// of the echo is still coming.
+//
+
+protocols.tcp = function(target) {
+  const i = target.lastIndexOf(':');
+  const host = target.substring(0, i);
+  const port = target.substring(i + 1)|0;
+
+  const f = ({ body, closeAfter }) => (
+    new Promise(
+      (resolve, reject) => {
+        const buffer = [];
+        let size = 0;
+        const done = () => resolve({
+          statusCode: 200,
+          rawBody: Buffer.concat(buffer),
+        });
+        const socket = net.connect({ host, port, allowHalfOpen: true });
+        socket.on('data', chunk => {
+          buffer.push(chunk);
+          size += chunk.length;
+          if (closeAfter && size >= closeAfter) {
+            socket.destroy();
+            done();
+          }
+        });
+        socket.on('end', () => { socket.destroy(); done(); });
+        socket.on('error', err => reject(err));
+        socket.end(body);
+      }
+    )
+  );
+
+  f.destroy = () => {};
+
+  return f;
+}
+
 export default async function(config, basePath) {
   const stats = {
     countRequests: 0,
     totalRequests: 0,
     totalTransfer: 0,
+    totalLatency: 0,
     totalStatusErrors: 0,
     totalVerifyErrors: 0,
   };
@@ -165,7 +209,9 @@ export default async function(config, basePath) {
           req = req.request();
         }
 
+        const start = performance.now();
         const res = await client(req);
+        stats.totalLatency += performance.now() - start;
         stats.countRequests += 1;
         stats.totalTransfer += res.rawBody.length;
         if (res.statusCode < 400) {
@@ -242,8 +288,10 @@ export default async function(config, basePath) {
         'Status Errors' , chalk.red(padding(stats.totalStatusErrors, 8)),
         'Verify Errors' , chalk.red(padding(stats.totalVerifyErrors, 8)),
         'Transfer'      , chalk.magenta(padding(prettyBytes(Math.floor(stats.totalTransfer/t)) + '/s', 8)),
+        'Latency'       , chalk.yellow(padding((stats.countRequests > 0 ? (stats.totalLatency / stats.countRequests).toFixed(2) : '-') + 'ms', 10)),
       );
       stats.totalTransfer = 0;
+      stats.totalLatency = 0;
       stats.countRequests = 0;
       time = now;
     },
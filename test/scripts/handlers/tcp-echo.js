@@ -0,0 +1,21 @@
+import crypto from 'crypto';
+
+export function request(options) {
+  const { size, closeAfter } = options;
+  const body = crypto.randomBytes(size|0);
+  return function() {
+    return { body, closeAfter };
+  }
+}
+
+export function verify() {
+  return function(req, res) {
+    const { body, closeAfter } = req;
+    const data = res.rawBody;
+    if (closeAfter) {
+      return data.length >= closeAfter && !Buffer.compare(data, body.subarray(0, data.length));
+    } else {
+      return !Buffer.compare(data, body);
+    }
+  }
+}
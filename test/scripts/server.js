@@ -1,5 +1,6 @@
 import express from 'express';
 import http2 from 'http2';
+import net from 'net';
 import fs from 'fs';
 import { join } from 'path';
 
@@ -70,7 +71,27 @@ function createHTTP2() {
   };
 }
 
+function startTCP(port) {
+  const server = net.createServer(
+    { allowHalfOpen: true },
+    socket => {
+      socket.on('error', () => socket.destroy());
+      socket.pipe(socket);
+    }
+  );
+
+  server.on('error', err => log(err));
+  server.listen(port);
+}
+
 export default async function(config, basePath) {
+  if (config.protocol === 'tcp') {
+    log('Starting TCP echo server...');
+    startTCP((config.listen|0) || 8080);
+    log('TCP echo server started');
+    return;
+  }
+
   const app = config.protocol === 'http2' ? createHTTP2() : express();
 
   log('Starting mock server...');
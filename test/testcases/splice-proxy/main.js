@@ -0,0 +1,8 @@
+//
+// connect() is the only filter, so both directions are spliced
+//
+
+pipy()
+
+.listen(8000)
+  .connect('localhost:8080')
@@ -0,0 +1,4 @@
+pipy()
+
+.listen(8000)
+  .connect('localhost:8080')